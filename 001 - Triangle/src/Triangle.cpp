@@ -24,6 +24,7 @@ Triangle::Triangle(int argc, const char* argv[])
 , m_bindir(argv[0])
 {
    m_bindir.remove_filename();
+   ParseCommandLine(argc, argv);
    Init();
 }
 
@@ -68,10 +69,10 @@ void Triangle::CreateVertexBuffer() {
 
    vk::DeviceSize size = vertices.size() * sizeof(Vertex);
 
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    stagingBuffer.CopyFromHost(0, size, vertices.data());
 
-   m_VertexBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_VertexBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
    CopyBuffer(stagingBuffer.m_Buffer, m_VertexBuffer->m_Buffer, 0, 0, size);
 }
 
@@ -87,10 +88,10 @@ void Triangle::CreateIndexBuffer() {
    uint32_t count = static_cast<uint32_t>(indices.size());
    vk::DeviceSize size = count * sizeof(uint32_t);
 
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    stagingBuffer.CopyFromHost(0, size, indices.data());
 
-   m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(m_Device, m_PhysicalDevice, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(*m_Allocator, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
    CopyBuffer(stagingBuffer.m_Buffer, m_IndexBuffer->m_Buffer, 0, 0, size);
 }
 
@@ -117,7 +118,7 @@ void Triangle::CreateUniformBuffers() {
    //                   Would it be better to have them as device-local  (and copy after each update)?
    m_UniformBuffers.reserve(m_CommandBuffers.size());
    for (const auto& commandBuffer : m_CommandBuffers) {
-      m_UniformBuffers.emplace_back(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+      m_UniformBuffers.emplace_back(*m_Allocator, size, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    }
 }
 
@@ -359,7 +360,10 @@ void Triangle::CreatePipeline() {
    pipelineCI.pStages = shaderStages.data();
 
    // .value works around bug in Vulkan.hpp (refer https://github.com/KhronosGroup/Vulkan-Hpp/issues/659)
-   m_Pipeline = m_Device.createGraphicsPipeline(m_PipelineCache, pipelineCI).value;
+   {
+      Vulkan::Profiler::CpuScope scope(m_Profiler.get(), "CreatePipeline");
+      m_Pipeline = m_Device.createGraphicsPipeline(m_PipelineCache, pipelineCI).value;
+   }
 
    // Shader modules are no longer needed once the graphics pipeline has been created
    DestroyShaderModule(shaderStages[0].module);
@@ -1,13 +1,12 @@
 #include "TexturedModel.h"
+#include "MeshCache.h"
+#include "TextureLoader.h"
 #include "Utility.h"
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
@@ -30,6 +29,7 @@ TexturedModel::TexturedModel(int argc, const char* argv[])
 , m_bindir(argv[0])
 {
    m_bindir.remove_filename();
+   ParseCommandLine(argc, argv);
    Init();
 }
 
@@ -64,10 +64,12 @@ void TexturedModel::Init() {
    m_Direction = glm::normalize(glm::vec3 {-2.0f, -2.0f, -4.0f});
    m_Up = glm::normalize(glm::vec3 {0.0f, 1.0f, 0.0f});
 
-   LoadModel();
+   // parse the model on a worker thread while the texture is loaded on this one
+   Vulkan::TaskHandle loadModel = m_JobSystem->Spawn([this] { LoadModel(); });
+   CreateTextureResources();
+   m_JobSystem->Wait(loadModel);
    CreateVertexBuffer();
    CreateIndexBuffer();
-   CreateTextureResources();
    CreateUniformBuffers();
    CreateDescriptorSetLayout();
    CreatePipelineLayout();
@@ -79,12 +81,19 @@ void TexturedModel::Init() {
 
 
 void TexturedModel::LoadModel() {
+   // layout name identifies Vertex and how it is filled in below.  Change it if either changes
+   constexpr std::string_view meshCacheLayout = "TexturedModel.Vertex";
+   const char* fileName = "Assets/Models/Cube.obj";
+   if (Vulkan::MeshCache::Load(fileName, meshCacheLayout, m_Vertices, m_Indices)) {
+      return;
+   }
+
    tinyobj::attrib_t attrib;
    std::vector<tinyobj::shape_t> shapes;
    std::vector<tinyobj::material_t> materials;
    std::string warn, err;
 
-   if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, "Assets/Models/Cube.obj")) {
+   if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, fileName)) {
       throw std::runtime_error(warn + err);
    }
 
@@ -117,6 +126,7 @@ void TexturedModel::LoadModel() {
          m_Indices.push_back(uniqueVertices[vertex]);
       }
    }
+   Vulkan::MeshCache::Save(fileName, meshCacheLayout, m_Vertices, m_Indices);
 }
 
 
@@ -127,10 +137,10 @@ void TexturedModel::CreateVertexBuffer() {
 
    vk::DeviceSize size = m_Vertices.size() * sizeof(Vertex);
 
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    stagingBuffer.CopyFromHost(0, size, m_Vertices.data());
 
-   m_VertexBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_VertexBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
    CopyBuffer(stagingBuffer.m_Buffer, m_VertexBuffer->m_Buffer, 0, 0, size);
 }
 
@@ -144,10 +154,10 @@ void TexturedModel::CreateIndexBuffer() {
    uint32_t count = static_cast<uint32_t>(m_Indices.size());
    vk::DeviceSize size = count * sizeof(uint32_t);
 
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    stagingBuffer.CopyFromHost(0, size, m_Indices.data());
 
-   m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(m_Device, m_PhysicalDevice, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(*m_Allocator, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
    CopyBuffer(stagingBuffer.m_Buffer, m_IndexBuffer->m_Buffer, 0, 0, size);
 }
 
@@ -158,29 +168,12 @@ void TexturedModel::DestroyIndexBuffer() {
 
 
 void TexturedModel::CreateTextureResources() {
-   int texWidth;
-   int texHeight;
-   int texChannels;
-
-   stbi_uc* pixels = stbi_load("Assets/Textures/Statue.jpg", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-   vk::DeviceSize size = static_cast<vk::DeviceSize>(texWidth)* static_cast<vk::DeviceSize>(texHeight) * 4;
-   uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+   Vulkan::TextureLoader loader(m_PhysicalDevice, *m_Allocator, *m_UploadManager, *m_JobSystem);
+   Vulkan::TextureLoader::Result result = loader.Load({"Assets/Textures/Statue.jpg"}, true);
+   m_UploadManager->Wait(result.Ticket);
 
-   if (!pixels) {
-      throw std::runtime_error("failed to load texture image!");
-   }
-
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-   stagingBuffer.CopyFromHost(0, size, pixels);
-
-   stbi_image_free(pixels);
-
-   m_Texture = std::make_unique<Vulkan::Image>(m_Device, m_PhysicalDevice, texWidth, texHeight, mipLevels, vk::SampleCountFlagBits::e1, vk::Format::eR8G8B8A8Unorm, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal);
-   TransitionImageLayout(m_Texture->m_Image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, mipLevels);
-   CopyBufferToImage(stagingBuffer.m_Buffer, m_Texture->m_Image, texWidth, texHeight);
-   GenerateMIPMaps(m_Texture->m_Image, vk::Format::eR8G8B8A8Unorm, texWidth, texHeight, mipLevels);
-
-   m_Texture->CreateImageView(vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor, mipLevels);
+   const uint32_t mipLevels = result.Textures.front().MipLevels;
+   m_Texture = std::move(result.Textures.front().Image);
 
    vk::SamplerCreateInfo ci = {
       {}                                  /*flags*/,
@@ -228,7 +221,7 @@ void TexturedModel::CreateUniformBuffers() {
    //                   Would it be better to have them as device-local  (and copy after each update)?
    m_UniformBuffers.reserve(m_CommandBuffers.size());
    for (const auto& commandBuffer : m_CommandBuffers) {
-      m_UniformBuffers.emplace_back(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+      m_UniformBuffers.emplace_back(*m_Allocator, size, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    }
 }
 
@@ -478,7 +471,10 @@ void TexturedModel::CreatePipeline() {
    pipelineCI.pStages = shaderStages.data();
 
    // .value works around bug in Vulkan.hpp (refer https://github.com/KhronosGroup/Vulkan-Hpp/issues/659)
-   m_Pipeline = m_Device.createGraphicsPipeline(m_PipelineCache, pipelineCI).value;
+   {
+      Vulkan::Profiler::CpuScope scope(m_Profiler.get(), "CreatePipeline");
+      m_Pipeline = m_Device.createGraphicsPipeline(m_PipelineCache, pipelineCI).value;
+   }
 
    // Shader modules are no longer needed once the graphics pipeline has been created
    DestroyShaderModule(shaderStages[0].module);
@@ -1,19 +1,22 @@
 #include "Instancing.h"
 
 #include "Instance.h"
+#include "Log.h"
+#include "MeshCache.h"
+#include "TextureLoader.h"
 #include "Utility.h"
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
+#include <algorithm>
+#include <chrono>
 #include <random>
+#include <thread>
 
 #define M_PI       3.14159265358979323846f
 
@@ -36,6 +39,7 @@ Instancing::Instancing(int argc, const char* argv[])
 , m_bindir(argv[0])
 {
    m_bindir.remove_filename();
+   ParseCommandLine(argc, argv);
    Init();
 }
 
@@ -64,6 +68,21 @@ vk::PhysicalDeviceFeatures Instancing::GetRequiredPhysicalDeviceFeatures(vk::Phy
 }
 
 
+bool Instancing::ParseArgument(std::string_view arg, std::string_view value) {
+   if (arg == "--draws") {
+      m_DrawCount = static_cast<uint32_t>(std::stoul(std::string(value)));
+      if (m_DrawCount > 0) {
+         m_InstanceCount = m_DrawCount;   // one sphere per draw
+      }
+      return true;
+   } else if (arg == "--record-benchmark") {
+      m_RecordBenchmarkDrawCount = 1000 * (value.empty() ? 100 : static_cast<uint32_t>(std::stoul(std::string(value))));
+      return true;
+   }
+   return false;
+}
+
+
 void Instancing::Init() {
    Vulkan::Application::Init();
    
@@ -71,11 +90,13 @@ void Instancing::Init() {
    m_Direction = glm::normalize(glm::vec3 {0.0f, 0.0f, -1.0f});
    m_Up = glm::normalize(glm::vec3 {0.0f, 1.0f, 0.0f});
 
-   LoadModel();
+   // parse the model on a worker thread while the texture is loaded on this one
+   Vulkan::TaskHandle loadModel = m_JobSystem->Spawn([this] { LoadModel(); });
+   CreateTextureResources();
+   m_JobSystem->Wait(loadModel);
    CreateVertexBuffer();
    CreateInstanceBuffer();
    CreateIndexBuffer();
-   CreateTextureResources();
    CreateUniformBuffers();
    CreateDescriptorSetLayout();
    CreatePipelineLayout();
@@ -83,16 +104,26 @@ void Instancing::Init() {
    CreateDescriptorPool();
    CreateDescriptorSets();
    RecordCommandBuffers();
+   if (m_RecordBenchmarkDrawCount > 0) {
+      BenchmarkRecording();
+   }
 }
 
 
 void Instancing::LoadModel() {
+   // layout name identifies Vertex and how it is filled in below.  Change it if either changes
+   constexpr std::string_view meshCacheLayout = "Instancing.Vertex";
+   const char* fileName = "Assets/Models/sphere.obj";
+   if (Vulkan::MeshCache::Load(fileName, meshCacheLayout, m_Vertices, m_Indices)) {
+      return;
+   }
+
    tinyobj::attrib_t attrib;
    std::vector<tinyobj::shape_t> shapes;
    std::vector<tinyobj::material_t> materials;
    std::string warn, err;
 
-   if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, "Assets/Models/sphere.obj")) {
+   if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, fileName)) {
       throw std::runtime_error(warn + err);
    }
 
@@ -130,6 +161,7 @@ void Instancing::LoadModel() {
          m_Indices.push_back(uniqueVertices[vertex]);
       }
    }
+   Vulkan::MeshCache::Save(fileName, meshCacheLayout, m_Vertices, m_Indices);
 }
 
 
@@ -140,10 +172,10 @@ void Instancing::CreateVertexBuffer() {
 
    vk::DeviceSize size = m_Vertices.size() * sizeof(Vertex);
 
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    stagingBuffer.CopyFromHost(0, size, m_Vertices.data());
 
-   m_VertexBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_VertexBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
    CopyBuffer(stagingBuffer.m_Buffer, m_VertexBuffer->m_Buffer, 0, 0, size);
 }
 
@@ -171,10 +203,10 @@ void Instancing::CreateInstanceBuffer() {
 
    }
    vk::DeviceSize size = instances.size() * sizeof(Instance);
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    stagingBuffer.CopyFromHost(0, size, instances.data());
 
-   m_InstanceBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_InstanceBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
    CopyBuffer(stagingBuffer.m_Buffer, m_InstanceBuffer->m_Buffer, 0, 0, size);
 }
 
@@ -188,10 +220,10 @@ void Instancing::CreateIndexBuffer() {
    uint32_t count = static_cast<uint32_t>(m_Indices.size());
    vk::DeviceSize size = count * sizeof(uint32_t);
 
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    stagingBuffer.CopyFromHost(0, size, m_Indices.data());
 
-   m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(m_Device, m_PhysicalDevice, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(*m_Allocator, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
    CopyBuffer(stagingBuffer.m_Buffer, m_IndexBuffer->m_Buffer, 0, 0, size);
 }
 
@@ -202,29 +234,12 @@ void Instancing::DestroyIndexBuffer() {
 
 
 void Instancing::CreateTextureResources() {
-   int texWidth;
-   int texHeight;
-   int texChannels;
-
-   stbi_uc* pixels = stbi_load("Assets/Textures/2k_mars.jpg", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-   vk::DeviceSize size = static_cast<vk::DeviceSize>(texWidth)* static_cast<vk::DeviceSize>(texHeight) * 4;
-   uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
-
-   if (!pixels) {
-      throw std::runtime_error("failed to load texture image!");
-   }
-
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-   stagingBuffer.CopyFromHost(0, size, pixels);
+   Vulkan::TextureLoader loader(m_PhysicalDevice, *m_Allocator, *m_UploadManager, *m_JobSystem);
+   Vulkan::TextureLoader::Result result = loader.Load({"Assets/Textures/2k_mars.jpg"}, true);
+   m_UploadManager->Wait(result.Ticket);
 
-   stbi_image_free(pixels);
-
-   m_Texture = std::make_unique<Vulkan::Image>(m_Device, m_PhysicalDevice, texWidth, texHeight, mipLevels, vk::SampleCountFlagBits::e1, vk::Format::eR8G8B8A8Unorm, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal);
-   TransitionImageLayout(m_Texture->m_Image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, mipLevels);
-   CopyBufferToImage(stagingBuffer.m_Buffer, m_Texture->m_Image, texWidth, texHeight);
-   GenerateMIPMaps(m_Texture->m_Image, vk::Format::eR8G8B8A8Unorm, texWidth, texHeight, mipLevels);
-
-   m_Texture->CreateImageView(vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor, mipLevels);
+   const uint32_t mipLevels = result.Textures.front().MipLevels;
+   m_Texture = std::move(result.Textures.front().Image);
 
    vk::SamplerCreateInfo ci = {
       {}                                  /*flags*/,
@@ -267,18 +282,18 @@ void Instancing::CreateUniformBuffers() {
    // If we had instead made sure that only one command buffer is ever rendering at once,
    // then we could get away with just one uniform buffer.
 
+   //
+   // The per command buffer uniform buffers are regions of one persistently mapped ring buffer,
+   // selected with a dynamic offset when the descriptor set is bound.
    //
    // TODO: experiment: We are creating the uniform buffers as hostVisible and hostCoherent
    //                   Would it be better to have them as device-local  (and copy after each update)?
-   m_UniformBuffers.reserve(m_CommandBuffers.size());
-   for (const auto& commandBuffer : m_CommandBuffers) {
-      m_UniformBuffers.emplace_back(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-   }
+   m_UniformBuffer = std::make_unique<Vulkan::RingBuffer>(*m_Allocator, size, static_cast<uint32_t>(m_CommandBuffers.size()), vk::BufferUsageFlagBits::eUniformBuffer, m_PhysicalDeviceProperties.limits.minUniformBufferOffsetAlignment);
 }
 
 
 void Instancing::DestroyUniformBuffers() {
-   m_UniformBuffers.clear();
+   m_UniformBuffer.reset(nullptr);
 }
 
 
@@ -288,11 +303,11 @@ void Instancing::CreateDescriptorSetLayout() {
    // So every shader binding should map to one descriptor set layout binding
 
    vk::DescriptorSetLayoutBinding uboLayoutBinding = {
-      0                                   /*binding*/,
-      vk::DescriptorType::eUniformBuffer  /*descriptorType*/,
-      1                                   /*descriptorCount*/,
-      {vk::ShaderStageFlagBits::eVertex}  /*stageFlags*/,
-      nullptr                             /*pImmutableSamplers*/
+      0                                          /*binding*/,
+      vk::DescriptorType::eUniformBufferDynamic  /*descriptorType*/,
+      1                                          /*descriptorCount*/,
+      {vk::ShaderStageFlagBits::eVertex}         /*stageFlags*/,
+      nullptr                                    /*pImmutableSamplers*/
    };
 
    vk::DescriptorSetLayoutBinding samplerLayoutBinding = {
@@ -536,7 +551,10 @@ void Instancing::CreatePipeline() {
    pipelineCI.pStages = shaderStages.data();
 
    // .value works around bug in Vulkan.hpp (refer https://github.com/KhronosGroup/Vulkan-Hpp/issues/659)
-   m_Pipeline = m_Device.createGraphicsPipeline(m_PipelineCache, pipelineCI).value;
+   {
+      Vulkan::Profiler::CpuScope scope(m_Profiler.get(), "CreatePipeline");
+      m_Pipeline = m_Device.createGraphicsPipeline(m_PipelineCache, pipelineCI).value;
+   }
 
    // Shader modules are no longer needed once the graphics pipeline has been created
    DestroyShaderModule(shaderStages[0].module);
@@ -554,7 +572,7 @@ void Instancing::DestroyPipeline() {
 void Instancing::CreateDescriptorPool() {
    std::array<vk::DescriptorPoolSize, 2> typeCounts = {
       vk::DescriptorPoolSize {
-         vk::DescriptorType::eUniformBuffer,
+         vk::DescriptorType::eUniformBufferDynamic,
          static_cast<uint32_t>(m_SwapChainFrameBuffers.size())
       },
       vk::DescriptorPoolSize {
@@ -600,17 +618,19 @@ void Instancing::CreateDescriptorSets() {
       vk::ImageLayout::eShaderReadOnlyOptimal   /*imageLayout*/
    };
 
+   vk::DescriptorBufferInfo uniformBufferInfo = m_UniformBuffer->GetDescriptor(sizeof(UniformBufferObject));
+
    for (uint32_t i = 0; i < m_SwapChainFrameBuffers.size(); ++i) {
       std::vector<vk::WriteDescriptorSet> writeDescriptorSets = {
          {
-            m_DescriptorSets[i]                /*dstSet*/,
-            0                                  /*dstBinding*/,
-            0                                  /*dstArrayElement*/,
-            1                                  /*descriptorCount*/,
-            vk::DescriptorType::eUniformBuffer /*descriptorType*/,
-            nullptr                            /*pImageInfo*/,
-            &m_UniformBuffers[i].m_Descriptor /*pBufferInfo*/,
-            nullptr                            /*pTexelBufferView*/
+            m_DescriptorSets[i]                       /*dstSet*/,
+            0                                         /*dstBinding*/,
+            0                                         /*dstArrayElement*/,
+            1                                         /*descriptorCount*/,
+            vk::DescriptorType::eUniformBufferDynamic /*descriptorType*/,
+            nullptr                                   /*pImageInfo*/,
+            &uniformBufferInfo                        /*pBufferInfo*/,
+            nullptr                                   /*pTexelBufferView*/
          },
          {
             m_DescriptorSets[i]                       /*dstSet*/,
@@ -690,7 +710,7 @@ void Instancing::RecordCommandBuffers() {
       };
       commandBuffer.setScissor(0, scissor);
 
-      commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout, 0, m_DescriptorSets[i], nullptr);  // (i)th command buffer is bound to the (i)th descriptor set
+      commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout, 0, m_DescriptorSets[i], m_UniformBuffer->GetFrameOffset(i));  // (i)th command buffer is bound to the (i)th descriptor set, and (i)th region of the uniform buffer
       commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_Pipeline);
       commandBuffer.bindVertexBuffers(0, m_VertexBuffer->m_Buffer, {0});
       commandBuffer.bindVertexBuffers(1, m_InstanceBuffer->m_Buffer, {0});
@@ -706,6 +726,123 @@ void Instancing::RecordCommandBuffers() {
 }
 
 
+void Instancing::RecordDraws(vk::CommandBuffer commandBuffer, const uint32_t imageIndex, const uint32_t firstDraw, const uint32_t drawCount) {
+   // Secondary command buffers do not inherit any state, so everything has to be set up again in each one
+   vk::Viewport viewport = {
+      0.0f, 0.0f,
+      static_cast<float>(m_Extent.width), static_cast<float>(m_Extent.height),
+      0.0f, 1.0f
+   };
+   commandBuffer.setViewport(0, viewport);
+
+   vk::Rect2D scissor = {
+      {0, 0},
+      m_Extent
+   };
+   commandBuffer.setScissor(0, scissor);
+
+   commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout, 0, m_DescriptorSets[imageIndex], m_UniformBuffer->GetFrameOffset(imageIndex));
+   commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_Pipeline);
+   commandBuffer.bindVertexBuffers(0, m_VertexBuffer->m_Buffer, {0});
+   commandBuffer.bindVertexBuffers(1, m_InstanceBuffer->m_Buffer, {0});
+   commandBuffer.bindIndexBuffer(m_IndexBuffer->m_Buffer, 0, vk::IndexType::eUint32);
+   for (uint32_t draw = firstDraw; draw < firstDraw + drawCount; ++draw) {
+      commandBuffer.drawIndexed(m_IndexBuffer->m_Count, 1, 0, 0, draw % m_InstanceCount);
+   }
+}
+
+
+void Instancing::RecordFrameCommandBuffer() {
+   std::array<vk::ClearValue, 2> clearValues = {
+      vk::ClearColorValue {std::array<float,4>{0.0f, 0.0f, 0.0f, 1.0f}},
+      vk::ClearDepthStencilValue {1.0f, 0}
+   };
+
+   vk::RenderPassBeginInfo renderPassBI = {
+      m_RenderPass                               /*renderPass*/,
+      m_SwapChainFrameBuffers[m_CurrentImage]    /*framebuffer*/,
+      { {0,0}, m_Extent }                        /*renderArea*/,
+      static_cast<uint32_t>(clearValues.size())  /*clearValueCount*/,
+      clearValues.data()                         /*pClearValues*/
+   };
+
+   vk::CommandBufferInheritanceInfo inheritanceInfo = {
+      m_RenderPass                               /*renderPass*/,
+      0                                          /*subpass*/,
+      m_SwapChainFrameBuffers[m_CurrentImage]    /*framebuffer*/
+   };
+
+   // A few tasks per thread, so that threads that finish early can pick up more work
+   const uint32_t taskCount = std::min(m_DrawCount, 4 * m_FrameCommandBuffers->GetThreadCount());
+   const uint32_t imageIndex = m_CurrentImage;
+
+   vk::CommandBuffer commandBuffer = BeginFrameCommandBuffer();
+   commandBuffer.beginRenderPass(renderPassBI, vk::SubpassContents::eSecondaryCommandBuffers);
+   std::vector<vk::CommandBuffer> secondaryCommandBuffers = m_FrameCommandBuffers->RecordSecondary(m_CurrentFrame, inheritanceInfo, taskCount, [this, imageIndex, taskCount] (vk::CommandBuffer cmd, const uint32_t task) {
+      const uint32_t firstDraw = static_cast<uint32_t>(uint64_t(m_DrawCount) * task / taskCount);
+      const uint32_t lastDraw = static_cast<uint32_t>(uint64_t(m_DrawCount) * (task + 1) / taskCount);
+      RecordDraws(cmd, imageIndex, firstDraw, lastDraw - firstDraw);
+   });
+   commandBuffer.executeCommands(secondaryCommandBuffers);
+   commandBuffer.endRenderPass();
+}
+
+
+void Instancing::BenchmarkRecording() {
+   // Records the same draws into secondary command buffers with one thread, and then with all cores.
+   // Nothing is submitted, so this measures only the CPU cost of recording.
+   constexpr uint32_t iterationCount = 20;
+   const uint32_t drawCount = m_RecordBenchmarkDrawCount;
+   const uint32_t hardwareThreadCount = std::max(1u, std::thread::hardware_concurrency());
+   const uint32_t taskCount = std::min(drawCount, 4 * hardwareThreadCount);   // same split for both runs, so only the thread count differs
+
+   vk::RenderPassBeginInfo renderPassBI = {
+      m_RenderPass                               /*renderPass*/,
+      m_SwapChainFrameBuffers[0]                 /*framebuffer*/,
+      { {0,0}, m_Extent }                        /*renderArea*/,
+      0                                          /*clearValueCount*/,
+      nullptr                                    /*pClearValues*/
+   };
+
+   vk::CommandBufferInheritanceInfo inheritanceInfo = {
+      m_RenderPass                               /*renderPass*/,
+      0                                          /*subpass*/,
+      m_SwapChainFrameBuffers[0]                 /*framebuffer*/
+   };
+
+   double singleThreadMilliseconds = 0.0;
+   for (const uint32_t threadCount : {1u, hardwareThreadCount}) {
+      Vulkan::JobSystem jobSystem(threadCount);
+      Vulkan::FrameCommandBuffers frameCommandBuffers(m_Device, m_QueueFamilyIndices.GraphicsFamily.value(), 1, jobSystem);
+      double totalMilliseconds = 0.0;
+
+      // iteration 0 is a warm up (it allocates the command buffers, and wakes the worker threads)
+      for (uint32_t iteration = 0; iteration <= iterationCount; ++iteration) {
+         const auto startTime = std::chrono::steady_clock::now();
+         vk::CommandBuffer commandBuffer = frameCommandBuffers.BeginFrame(0);
+         commandBuffer.beginRenderPass(renderPassBI, vk::SubpassContents::eSecondaryCommandBuffers);
+         std::vector<vk::CommandBuffer> secondaryCommandBuffers = frameCommandBuffers.RecordSecondary(0, inheritanceInfo, taskCount, [this, drawCount, taskCount] (vk::CommandBuffer cmd, const uint32_t task) {
+            const uint32_t firstDraw = static_cast<uint32_t>(uint64_t(drawCount) * task / taskCount);
+            const uint32_t lastDraw = static_cast<uint32_t>(uint64_t(drawCount) * (task + 1) / taskCount);
+            RecordDraws(cmd, 0, firstDraw, lastDraw - firstDraw);
+         });
+         commandBuffer.executeCommands(secondaryCommandBuffers);
+         commandBuffer.endRenderPass();
+         commandBuffer.end();
+         if (iteration > 0) {
+            totalMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+         }
+      }
+
+      const double milliseconds = totalMilliseconds / iterationCount;
+      if (threadCount == 1) {
+         singleThreadMilliseconds = milliseconds;
+      }
+      LOG_INFO("Recorded {0} draws in {1} secondary command buffers on {2} thread(s): {3:.3f}ms ({4:.1f} million draws/s, {5:.2f}x single threaded)", drawCount, taskCount, threadCount, milliseconds, drawCount / (milliseconds * 1000.0), singleThreadMilliseconds / milliseconds);
+   }
+}
+
+
 void Instancing::Update(double deltaTime) {
    __super::Update(deltaTime);
    m_UniformBufferObject.projection = glm::perspective(m_FoVRadians, static_cast<float>(m_Extent.width) / static_cast<float>(m_Extent.height), 0.01f, 100.0f);
@@ -725,7 +862,11 @@ void Instancing::Update(double deltaTime) {
 
 void Instancing::RenderFrame() {
    BeginFrame();
-   m_UniformBuffers[m_CurrentImage].CopyFromHost(0, sizeof(UniformBufferObject), &m_UniformBufferObject);
+   m_UniformBuffer->BeginFrame(m_CurrentImage);
+   m_UniformBuffer->Push(m_UniformBufferObject);
+   if (m_DrawCount > 0) {
+      RecordFrameCommandBuffer();
+   }
    EndFrame();
 }
 
@@ -2,10 +2,12 @@
 
 #include "Buffer.h"
 #include "Image.h"
+#include "RingBuffer.h"
 #include "Vertex.h"
 
 #include <filesystem>
 #include <memory>
+#include <string_view>
 
 class Instancing final : public Vulkan::Application {
 public:
@@ -22,6 +24,8 @@ public:
 
    vk::PhysicalDeviceFeatures GetRequiredPhysicalDeviceFeatures(vk::PhysicalDeviceFeatures);
 
+   virtual bool ParseArgument(std::string_view arg, std::string_view value) override;
+
    virtual void Init() override;
 
    void LoadModel();
@@ -58,6 +62,15 @@ public:
 
    void RecordCommandBuffers();
 
+   // Record draws [firstDraw, firstDraw + drawCount), one instance each, into a secondary command buffer
+   void RecordDraws(vk::CommandBuffer commandBuffer, const uint32_t imageIndex, const uint32_t firstDraw, const uint32_t drawCount);
+
+   // Record this frame's command buffer, with m_DrawCount draws spread across secondary command buffers
+   void RecordFrameCommandBuffer();
+
+   // Time recording m_RecordBenchmarkDrawCount draws on one thread versus all cores
+   void BenchmarkRecording();
+
    virtual void Update(double deltaTime) override;
 
    virtual void RenderFrame() override;
@@ -75,12 +88,14 @@ private:
    std::unique_ptr<Vulkan::Image> m_Texture;
    vk::Sampler m_TextureSampler;
    UniformBufferObject m_UniformBufferObject;
-   std::vector<Vulkan::Buffer> m_UniformBuffers;
+   std::unique_ptr<Vulkan::RingBuffer> m_UniformBuffer;
    vk::DescriptorSetLayout m_DescriptorSetLayout;
    vk::PipelineLayout m_PipelineLayout;
    vk::Pipeline m_Pipeline;
    vk::DescriptorPool m_DescriptorPool;
    std::vector<vk::DescriptorSet> m_DescriptorSets;
-   const uint32_t m_InstanceCount = 1000;
+   uint32_t m_InstanceCount = 1000;
+   uint32_t m_DrawCount = 0;                  // --draws=<n>: if non-zero, record n draws of one instance each every frame, instead of one pre-recorded instanced draw
+   uint32_t m_RecordBenchmarkDrawCount = 0;   // --record-benchmark=<thousands>: benchmark recording this many draws at startup
 
 };
@@ -1,15 +1,13 @@
 #include "RasterSpheres.h"
 
 #include "Instance.h"
+#include "MeshCache.h"
 #include "Utility.h"
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
@@ -36,6 +34,7 @@ RasterSpheres::RasterSpheres(int argc, const char* argv[])
 , m_bindir(argv[0])
 {
    m_bindir.remove_filename();
+   ParseCommandLine(argc, argv);
    Init();
 }
 
@@ -84,12 +83,19 @@ void RasterSpheres::Init() {
 
 
 void RasterSpheres::LoadModel() {
+   // layout name identifies Vertex and how it is filled in below.  Change it if either changes
+   constexpr std::string_view meshCacheLayout = "RasterSpheres.Vertex";
+   const char* fileName = "Assets/Models/sphere.obj";
+   if (Vulkan::MeshCache::Load(fileName, meshCacheLayout, m_Vertices, m_Indices)) {
+      return;
+   }
+
    tinyobj::attrib_t attrib;
    std::vector<tinyobj::shape_t> shapes;
    std::vector<tinyobj::material_t> materials;
    std::string warn, err;
 
-   if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, "Assets/Models/sphere.obj")) {
+   if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, fileName)) {
       throw std::runtime_error(warn + err);
    }
 
@@ -118,6 +124,7 @@ void RasterSpheres::LoadModel() {
          m_Indices.push_back(uniqueVertices[vertex]);
       }
    }
+   Vulkan::MeshCache::Save(fileName, meshCacheLayout, m_Vertices, m_Indices);
 }
 
 
@@ -128,10 +135,10 @@ void RasterSpheres::CreateVertexBuffer() {
 
    vk::DeviceSize size = m_Vertices.size() * sizeof(Vertex);
 
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    stagingBuffer.CopyFromHost(0, size, m_Vertices.data());
 
-   m_VertexBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_VertexBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
    CopyBuffer(stagingBuffer.m_Buffer, m_VertexBuffer->m_Buffer, 0, 0, size);
 }
 
@@ -168,10 +175,10 @@ void RasterSpheres::CreateInstanceBuffer() {
    m_InstanceCount = static_cast<uint32_t>(instances.size());
 
    vk::DeviceSize size = instances.size() * sizeof(Instance);
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    stagingBuffer.CopyFromHost(0, size, instances.data());
 
-   m_InstanceBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_InstanceBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
    CopyBuffer(stagingBuffer.m_Buffer, m_InstanceBuffer->m_Buffer, 0, 0, size);
 }
 
@@ -185,10 +192,10 @@ void RasterSpheres::CreateIndexBuffer() {
    uint32_t count = static_cast<uint32_t>(m_Indices.size());
    vk::DeviceSize size = count * sizeof(uint32_t);
 
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    stagingBuffer.CopyFromHost(0, size, m_Indices.data());
 
-   m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(m_Device, m_PhysicalDevice, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(*m_Allocator, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
    CopyBuffer(stagingBuffer.m_Buffer, m_IndexBuffer->m_Buffer, 0, 0, size);
 }
 
@@ -210,18 +217,18 @@ void RasterSpheres::CreateUniformBuffers() {
    // If we had instead made sure that only one command buffer is ever rendering at once,
    // then we could get away with just one uniform buffer.
 
+   //
+   // The per command buffer uniform buffers are regions of one persistently mapped ring buffer,
+   // selected with a dynamic offset when the descriptor set is bound.
    //
    // TODO: experiment: We are creating the uniform buffers as hostVisible and hostCoherent
    //                   Would it be better to have them as device-local  (and copy after each update)?
-   m_UniformBuffers.reserve(m_CommandBuffers.size());
-   for (const auto& commandBuffer : m_CommandBuffers) {
-      m_UniformBuffers.emplace_back(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-   }
+   m_UniformBuffer = std::make_unique<Vulkan::RingBuffer>(*m_Allocator, size, static_cast<uint32_t>(m_CommandBuffers.size()), vk::BufferUsageFlagBits::eUniformBuffer, m_PhysicalDeviceProperties.limits.minUniformBufferOffsetAlignment);
 }
 
 
 void RasterSpheres::DestroyUniformBuffers() {
-   m_UniformBuffers.clear();
+   m_UniformBuffer.reset(nullptr);
 }
 
 
@@ -231,11 +238,11 @@ void RasterSpheres::CreateDescriptorSetLayout() {
    // So every shader binding should map to one descriptor set layout binding
 
    vk::DescriptorSetLayoutBinding uboLayoutBinding = {
-      0                                   /*binding*/,
-      vk::DescriptorType::eUniformBuffer  /*descriptorType*/,
-      1                                   /*descriptorCount*/,
-      {vk::ShaderStageFlagBits::eVertex}  /*stageFlags*/,
-      nullptr                             /*pImmutableSamplers*/
+      0                                          /*binding*/,
+      vk::DescriptorType::eUniformBufferDynamic  /*descriptorType*/,
+      1                                          /*descriptorCount*/,
+      {vk::ShaderStageFlagBits::eVertex}         /*stageFlags*/,
+      nullptr                                    /*pImmutableSamplers*/
    };
 
    vk::DescriptorSetLayoutBinding samplerLayoutBinding = {
@@ -479,7 +486,10 @@ void RasterSpheres::CreatePipeline() {
    pipelineCI.pStages = shaderStages.data();
 
    // .value works around bug in Vulkan.hpp (refer https://github.com/KhronosGroup/Vulkan-Hpp/issues/659)
-   m_Pipeline = m_Device.createGraphicsPipeline(m_PipelineCache, pipelineCI).value;
+   {
+      Vulkan::Profiler::CpuScope scope(m_Profiler.get(), "CreatePipeline");
+      m_Pipeline = m_Device.createGraphicsPipeline(m_PipelineCache, pipelineCI).value;
+   }
 
    // Shader modules are no longer needed once the graphics pipeline has been created
    DestroyShaderModule(shaderStages[0].module);
@@ -497,7 +507,7 @@ void RasterSpheres::DestroyPipeline() {
 void RasterSpheres::CreateDescriptorPool() {
    std::array<vk::DescriptorPoolSize, 2> typeCounts = {
       vk::DescriptorPoolSize {
-         vk::DescriptorType::eUniformBuffer,
+         vk::DescriptorType::eUniformBufferDynamic,
          static_cast<uint32_t>(m_SwapChainFrameBuffers.size())
       },
       vk::DescriptorPoolSize {
@@ -537,17 +547,19 @@ void RasterSpheres::CreateDescriptorSets() {
    // For every binding point used in a shader there needs to be one
    // descriptor set matching that binding point
 
+   vk::DescriptorBufferInfo uniformBufferInfo = m_UniformBuffer->GetDescriptor(sizeof(UniformBufferObject));
+
    for (uint32_t i = 0; i < m_SwapChainFrameBuffers.size(); ++i) {
       std::vector<vk::WriteDescriptorSet> writeDescriptorSets = {
          {
-            m_DescriptorSets[i]                /*dstSet*/,
-            0                                  /*dstBinding*/,
-            0                                  /*dstArrayElement*/,
-            1                                  /*descriptorCount*/,
-            vk::DescriptorType::eUniformBuffer /*descriptorType*/,
-            nullptr                            /*pImageInfo*/,
-            &m_UniformBuffers[i].m_Descriptor /*pBufferInfo*/,
-            nullptr                            /*pTexelBufferView*/
+            m_DescriptorSets[i]                       /*dstSet*/,
+            0                                         /*dstBinding*/,
+            0                                         /*dstArrayElement*/,
+            1                                         /*descriptorCount*/,
+            vk::DescriptorType::eUniformBufferDynamic /*descriptorType*/,
+            nullptr                                   /*pImageInfo*/,
+            &uniformBufferInfo                        /*pBufferInfo*/,
+            nullptr                                   /*pTexelBufferView*/
          }
       };
       m_Device.updateDescriptorSets(writeDescriptorSets, nullptr);
@@ -597,6 +609,8 @@ void RasterSpheres::RecordCommandBuffers() {
       vk::CommandBuffer& commandBuffer = m_CommandBuffers[i];
 
       commandBuffer.begin(commandBufferBI);
+      m_Profiler->CmdReset(commandBuffer, i);
+      const uint32_t drawScope = m_Profiler->CmdBeginScope(commandBuffer, i, "DrawSpheres");
 
       // Start the first sub pass specified in the default render pass setup by the base application.
       // This will clear the color and depth attachment
@@ -617,7 +631,7 @@ void RasterSpheres::RecordCommandBuffers() {
       };
       commandBuffer.setScissor(0, scissor);
 
-      commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout, 0, m_DescriptorSets[i], nullptr);  // (i)th command buffer is bound to the (i)th descriptor set
+      commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout, 0, m_DescriptorSets[i], m_UniformBuffer->GetFrameOffset(i));  // (i)th command buffer is bound to the (i)th descriptor set, and (i)th region of the uniform buffer
       commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_Pipeline);
       commandBuffer.bindVertexBuffers(0, m_VertexBuffer->m_Buffer, {0});
       commandBuffer.bindVertexBuffers(1, m_InstanceBuffer->m_Buffer, {0});
@@ -628,6 +642,7 @@ void RasterSpheres::RecordCommandBuffers() {
       // Ending the render pass will add an implicit barrier transitioning the frame buffer color attachment to 
       // VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for presenting it to the windowing system
 
+      m_Profiler->CmdEndScope(commandBuffer, i, drawScope);
       commandBuffer.end();
    }
 }
@@ -643,7 +658,8 @@ void RasterSpheres::Update(double deltaTime) {
 
 void RasterSpheres::RenderFrame() {
    BeginFrame();
-   m_UniformBuffers[m_CurrentImage].CopyFromHost(0, sizeof(UniformBufferObject), &m_UniformBufferObject);
+   m_UniformBuffer->BeginFrame(m_CurrentImage);
+   m_UniformBuffer->Push(m_UniformBufferObject);
    EndFrame();
 }
 
@@ -2,6 +2,7 @@
 
 #include "Buffer.h"
 #include "Image.h"
+#include "RingBuffer.h"
 #include "Vertex.h"
 
 #include <filesystem>
@@ -68,7 +69,7 @@ private:
    std::unique_ptr<Vulkan::IndexBuffer> m_IndexBuffer;
    std::unique_ptr<Vulkan::Buffer> m_InstanceBuffer;
    UniformBufferObject m_UniformBufferObject;
-   std::vector<Vulkan::Buffer> m_UniformBuffers;
+   std::unique_ptr<Vulkan::RingBuffer> m_UniformBuffer;
    vk::DescriptorSetLayout m_DescriptorSetLayout;
    vk::PipelineLayout m_PipelineLayout;
    vk::Pipeline m_Pipeline;
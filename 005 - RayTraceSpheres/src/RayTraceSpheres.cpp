@@ -3,15 +3,13 @@
 #include "Bindings.h"
 #include "GeometryInstance.h"
 #include "Material.h"
+#include "MeshCache.h"
 #include "Utility.h"
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
@@ -60,6 +58,7 @@ RayTraceSpheres::RayTraceSpheres(int argc, const char* argv[])
 , m_UniformBufferObject { glm::identity<mat4>(), glm::identity<mat4>(), 0 }
 {
    m_bindir.remove_filename();
+   ParseCommandLine(argc, argv);
    Init();
 }
 
@@ -130,13 +129,15 @@ void RayTraceSpheres::CreateScene() {
    std::vector<uint32_t> indices;
 
    // Load models
-   {
+   // (mesh cache layout name identifies Vertex and how it is filled in below.  Change it if either changes)
+   const std::string modelFileName = (m_bindir / "Assets" / "Models" / "sphere.obj").string();
+   Vulkan::MeshCache::LoadOrImport(modelFileName, "RayTraceSpheres.Vertex", vertices, indices, [&modelFileName] (std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
       tinyobj::attrib_t attrib;
       std::vector<tinyobj::shape_t> shapes;
       std::vector<tinyobj::material_t> materials;
       std::string warn, err;
 
-      if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, (m_bindir / "Assets" / "Models" / "sphere.obj").string().c_str())) {
+      if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, modelFileName.c_str())) {
          throw std::runtime_error(warn + err);
       }
 
@@ -165,16 +166,16 @@ void RayTraceSpheres::CreateScene() {
             indices.push_back(uniqueVertices[vertex]);
          }
       }
-   }
+   });
 
    // Create Vertex buffer
    {
       vk::DeviceSize size = vertices.size() * sizeof(Vertex);
 
-      Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+      Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
       stagingBuffer.CopyFromHost(0, size, vertices.data());
 
-      m_VertexBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+      m_VertexBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
       CopyBuffer(stagingBuffer.m_Buffer, m_VertexBuffer->m_Buffer, 0, 0, size);
    }
 
@@ -184,15 +185,14 @@ void RayTraceSpheres::CreateScene() {
       vk::DeviceSize size = count * sizeof(uint32_t);
 
       Vulkan::Buffer stagingBuffer = {
-         m_Device,
-         m_PhysicalDevice,
+         *m_Allocator,
          size,
          vk::BufferUsageFlagBits::eTransferSrc,
          vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
       };
       stagingBuffer.CopyFromHost(0, size, indices.data());
 
-      m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(m_Device, m_PhysicalDevice, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+      m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(*m_Allocator, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
       CopyBuffer(stagingBuffer.m_Buffer, m_IndexBuffer->m_Buffer, 0, 0, size);
    }
 
@@ -208,10 +208,10 @@ void RayTraceSpheres::CreateScene() {
       // 
       //    vk::DeviceSize size = transforms.size() * sizeof(glm::mat3x4);
       // 
-      //    Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+      //    Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
       //    stagingBuffer.CopyFromHost(0, size, transforms.data());
       // 
-      //    m_TransformBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+      //    m_TransformBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
       //    CopyBuffer(stagingBuffer.m_Buffer, m_TransformBuffer->m_Buffer, 0, 0, size);
    }
 
@@ -249,6 +249,10 @@ void RayTraceSpheres::CreateScene() {
 
    CreateBottomLevelAccelerationStructures(geometryGroups);
 
+   // Built (and compacted) before the TLAS instances are created, as compaction replaces the BLAS and its handle
+   BuildBottomLevelAccelerationStructures();
+   const uint64_t sphereBlasHandle = m_BLAS.back().m_Handle;
+
    std::vector<Vulkan::GeometryInstance> geometryInstances;
    std::vector<Material> materials;
 
@@ -266,7 +270,7 @@ void RayTraceSpheres::CreateScene() {
       0xff                           /*visibility mask*/,
       0                              /*hit group index*/,
       static_cast<uint32_t>(vk::GeometryInstanceFlagBitsNV::eTriangleCullDisable),
-      m_BLAS.back().m_Handle
+      sphereBlasHandle
    );
    materials.emplace_back(Lambertian({0.5, 0.5, 0.5}));
 
@@ -285,7 +289,7 @@ void RayTraceSpheres::CreateScene() {
                0xff                           /*visibility mask*/,
                0                              /*hit group index*/,
                static_cast<uint32_t>(vk::GeometryInstanceFlagBitsNV::eTriangleCullDisable),
-               m_BLAS.back().m_Handle
+               sphereBlasHandle
             );
             if (choose_mat < 0.8) {
                // diffuse
@@ -317,7 +321,7 @@ void RayTraceSpheres::CreateScene() {
       0xff                           /*visibility mask*/,
       0                              /*hit group index*/,
       static_cast<uint32_t>(vk::GeometryInstanceFlagBitsNV::eTriangleCullDisable),
-      m_BLAS.back().m_Handle
+      sphereBlasHandle
    );
    materials.emplace_back(Dielectric(1.5f));
 
@@ -331,7 +335,7 @@ void RayTraceSpheres::CreateScene() {
       0xff                           /*visibility mask*/,
       0                              /*hit group index*/,
       static_cast<uint32_t>(vk::GeometryInstanceFlagBitsNV::eTriangleCullDisable),
-      m_BLAS.back().m_Handle
+      sphereBlasHandle
    );
    materials.emplace_back(Lambertian({0.4, 0.2, 0.1}));
 
@@ -345,7 +349,7 @@ void RayTraceSpheres::CreateScene() {
       0xff                           /*visibility mask*/,
       0                              /*hit group index*/,
       static_cast<uint32_t>(vk::GeometryInstanceFlagBitsNV::eTriangleCullDisable),
-      m_BLAS.back().m_Handle
+      sphereBlasHandle
    );
    materials.emplace_back(Metallic({0.7, 0.6, 0.5}, 0.0));
 
@@ -353,10 +357,10 @@ void RayTraceSpheres::CreateScene() {
    {
       vk::DeviceSize size = materials.size() * sizeof(Material);
 
-      Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+      Vulkan::Buffer stagingBuffer(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
       stagingBuffer.CopyFromHost(0, size, materials.data());
 
-      m_MaterialBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+      m_MaterialBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
       CopyBuffer(stagingBuffer.m_Buffer, m_MaterialBuffer->m_Buffer, 0, 0, size);
    }
 
@@ -365,7 +369,7 @@ void RayTraceSpheres::CreateScene() {
    // Apparently, a general rule is that the fewer BLASs the better. 
    CreateTopLevelAccelerationStructure(geometryInstances);
 
-   BuildAccelerationStructures(geometryInstances);
+   BuildTopLevelAccelerationStructure(geometryInstances);
 }
 
 
@@ -381,13 +385,14 @@ void RayTraceSpheres::DestroyScene() {
 
 
 void RayTraceSpheres::CreateStorageImages() {
-   m_OutputImage = std::make_unique<Vulkan::Image>(m_Device, m_PhysicalDevice, m_Extent.width, m_Extent.height, 1, vk::SampleCountFlagBits::e1, m_Format, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eStorage, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_OutputImage = std::make_unique<Vulkan::Image>(*m_Allocator, m_Extent.width, m_Extent.height, 1, vk::SampleCountFlagBits::e1, m_Format, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eStorage, vk::MemoryPropertyFlagBits::eDeviceLocal);
    m_OutputImage->CreateImageView(m_Format, vk::ImageAspectFlagBits::eColor, 1);
-   TransitionImageLayout(m_OutputImage->m_Image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1);
+   // no need to wait for the transitions: the command buffers that use these images are submitted after them anyway
+   TransitionImageLayout(m_OutputImage->m_Image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1, false);
 
-   m_AccumumlationImage = std::make_unique<Vulkan::Image>(m_Device, m_PhysicalDevice, m_Extent.width, m_Extent.height, 1, vk::SampleCountFlagBits::e1, vk::Format::eR32G32B32A32Sfloat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eStorage, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_AccumumlationImage = std::make_unique<Vulkan::Image>(*m_Allocator, m_Extent.width, m_Extent.height, 1, vk::SampleCountFlagBits::e1, vk::Format::eR32G32B32A32Sfloat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eStorage, vk::MemoryPropertyFlagBits::eDeviceLocal);
    m_AccumumlationImage->CreateImageView(vk::Format::eR32G32B32A32Sfloat, vk::ImageAspectFlagBits::eColor, 1);
-   TransitionImageLayout(m_AccumumlationImage->m_Image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1);
+   TransitionImageLayout(m_AccumumlationImage->m_Image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1, false);
 }
 
 
@@ -414,7 +419,7 @@ void RayTraceSpheres::CreateUniformBuffers() {
    //                   Would it be better to have them as device-local  (and copy after each update)?
    m_UniformBuffers.reserve(m_CommandBuffers.size());
    for (const auto& commandBuffer : m_CommandBuffers) {
-      m_UniformBuffers.emplace_back(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+      m_UniformBuffers.emplace_back(*m_Allocator, size, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
    }
 }
 
@@ -629,7 +634,10 @@ void RayTraceSpheres::CreatePipeline() {
    };
 
    // .value works around bug in Vulkan.hpp (refer https://github.com/KhronosGroup/Vulkan-Hpp/issues/659)
-   m_Pipeline = m_Device.createRayTracingPipelineNV(m_PipelineCache, pipelineCI).value;
+   {
+      Vulkan::Profiler::CpuScope scope(m_Profiler.get(), "CreatePipeline");
+      m_Pipeline = m_Device.createRayTracingPipelineNV(m_PipelineCache, pipelineCI).value;
+   }
 
    // Shader modules are no longer needed once the graphics pipeline has been createdvk
    for (auto& shaderStage : shaderStages) {
@@ -649,7 +657,7 @@ void RayTraceSpheres::CreateShaderBindingTable() {
    // Create buffer for the shader binding table
    const uint32_t sbtSize = m_RayTracingProperties.shaderGroupHandleSize * 3;
 
-   m_ShaderBindingTable = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, sbtSize, vk::BufferUsageFlagBits::eRayTracingNV, vk::MemoryPropertyFlagBits::eHostVisible);
+   m_ShaderBindingTable = std::make_unique<Vulkan::Buffer>(*m_Allocator, sbtSize, vk::BufferUsageFlagBits::eRayTracingNV, vk::MemoryPropertyFlagBits::eHostVisible);
 
    std::vector<uint8_t> shaderHandleStorage;
    shaderHandleStorage.resize(sbtSize);
@@ -664,28 +672,31 @@ void RayTraceSpheres::DestroyShaderBindingTable() {
 
 
 void RayTraceSpheres::CreateDescriptorPool() {
+   // Room for one descriptor set per frame buffer.  On resize, frames in flight may still be using the old sets, so a new
+   // pool is created for the new sets, and the old pool is retired whole (see OnWindowResized())
+   const uint32_t setCount = static_cast<uint32_t>(m_SwapChainFrameBuffers.size());
    std::array<vk::DescriptorPoolSize, 4> typeCounts = {
       vk::DescriptorPoolSize {
          vk::DescriptorType::eAccelerationStructureNV,
-         static_cast<uint32_t>(m_SwapChainFrameBuffers.size())
+         setCount
       },
       vk::DescriptorPoolSize {
          vk::DescriptorType::eStorageImage,
-         static_cast<uint32_t>(2 * m_SwapChainFrameBuffers.size())
+         2 * setCount
       },
       vk::DescriptorPoolSize {
          vk::DescriptorType::eUniformBuffer,
-         static_cast<uint32_t>(m_SwapChainFrameBuffers.size())
+         setCount
       },
       vk::DescriptorPoolSize {
          vk::DescriptorType::eStorageBuffer,
-         static_cast<uint32_t>(3 * m_SwapChainFrameBuffers.size())
+         3 * setCount
       }
    };
 
    vk::DescriptorPoolCreateInfo descriptorPoolCI = {
       vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet       /*flags*/,
-      static_cast<uint32_t>(3 * m_SwapChainFrameBuffers.size())  /*maxSets*/,
+      3 * setCount                                               /*maxSets*/,
       static_cast<uint32_t>(typeCounts.size())                   /*poolSizeCount*/,
       typeCounts.data()                                          /*pPoolSizes*/
    };
@@ -868,6 +879,7 @@ void RayTraceSpheres::RecordCommandBuffers() {
    for (uint32_t i = 0; i < m_CommandBuffers.size(); ++i) {
       vk::CommandBuffer& commandBuffer = m_CommandBuffers[i];
       commandBuffer.begin(commandBufferBI);
+      m_Profiler->CmdReset(commandBuffer, i);
       commandBuffer.pushConstants<Constants>(m_PipelineLayout, vk::ShaderStageFlagBits::eRaygenNV, 0, m_Constants);
       commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingNV, m_Pipeline);
       commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingNV, m_PipelineLayout, 0, m_DescriptorSets[i], nullptr);  // (i)th command buffer is bound to the (i)th descriptor set
@@ -877,6 +889,7 @@ void RayTraceSpheres::RecordCommandBuffers() {
       vk::DeviceSize bindingOffsetHitShader = m_RayTracingProperties.shaderGroupHandleSize * 2;
       vk::DeviceSize bindingStride = m_RayTracingProperties.shaderGroupHandleSize;
 
+      const uint32_t traceRaysScope = m_Profiler->CmdBeginScope(commandBuffer, i, "TraceRays");
       commandBuffer.traceRaysNV(
          m_ShaderBindingTable->m_Buffer, bindingOffsetRayGenShader,
          m_ShaderBindingTable->m_Buffer, bindingOffsetMissShader, bindingStride,
@@ -884,6 +897,9 @@ void RayTraceSpheres::RecordCommandBuffers() {
          nullptr, 0, 0,
          m_Extent.width, m_Extent.height, 1
       );
+      m_Profiler->CmdEndScope(commandBuffer, i, traceRaysScope);
+
+      const uint32_t copyScope = m_Profiler->CmdBeginScope(commandBuffer, i, "CopyOutputImage");
 
       vk::ImageMemoryBarrier barrier = {
          {}                                    /*srcAccessMask*/,
@@ -922,7 +938,7 @@ void RayTraceSpheres::RecordCommandBuffers() {
          vk::AccessFlagBits::eTransferWrite    /*srcAccessMask*/,
          {}                                    /*dstAccessMask*/,
          vk::ImageLayout::eTransferDstOptimal  /*oldLayout*/,
-         vk::ImageLayout::ePresentSrcKHR       /*newLayout*/,
+         m_PresentLayout                       /*newLayout*/,
          VK_QUEUE_FAMILY_IGNORED               /*srcQueueFamilyIndex*/,
          VK_QUEUE_FAMILY_IGNORED               /*dstQueueFamilyIndex*/,
          m_SwapChainImages[i].m_Image          /*image*/,
@@ -942,6 +958,8 @@ void RayTraceSpheres::RecordCommandBuffers() {
       };
       commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
 
+      m_Profiler->CmdEndScope(commandBuffer, i, copyScope);
+
       commandBuffer.end();
    }
 }
@@ -957,12 +975,12 @@ void RayTraceSpheres::Update(double deltaTime) {
    m_UniformBufferObject.viewInverse = glm::inverse(modelView);
 
    if (
-      (glfwGetKey(m_Window, GLFW_KEY_W) == GLFW_PRESS) ||
-      (glfwGetKey(m_Window, GLFW_KEY_A) == GLFW_PRESS) ||
-      (glfwGetKey(m_Window, GLFW_KEY_S) == GLFW_PRESS) ||
-      (glfwGetKey(m_Window, GLFW_KEY_D) == GLFW_PRESS) ||
-      (glfwGetKey(m_Window, GLFW_KEY_R) == GLFW_PRESS) ||
-      (glfwGetKey(m_Window, GLFW_KEY_F) == GLFW_PRESS) ||
+      IsKeyPressed(GLFW_KEY_W) ||
+      IsKeyPressed(GLFW_KEY_A) ||
+      IsKeyPressed(GLFW_KEY_S) ||
+      IsKeyPressed(GLFW_KEY_D) ||
+      IsKeyPressed(GLFW_KEY_R) ||
+      IsKeyPressed(GLFW_KEY_F) ||
       m_LeftMouseDown
    ) {
       m_UniformBufferObject.accumulatedFrameCount = 0;
@@ -980,8 +998,17 @@ void RayTraceSpheres::RenderFrame() {
 
 void RayTraceSpheres::OnWindowResized() {
    __super::OnWindowResized();
-   DestroyDescriptorSets();
+   // The old storage images and descriptor sets may still be in use by frames in flight.
+   // Destroying the pool frees its sets.  The window can be resized on consecutive frames, so any number of old pools may
+   // be waiting in the deletion queue at once.
+   m_DeletionQueue.Push(std::move(m_AccumumlationImage));
+   m_DeletionQueue.Push(std::move(m_OutputImage));
+   m_DeletionQueue.Push([device = m_Device, descriptorPool = m_DescriptorPool] {
+      device.destroy(descriptorPool);
+   });
+   m_DescriptorSets.clear();
    CreateStorageImages();
+   CreateDescriptorPool();
    CreateDescriptorSets();
    RecordCommandBuffers();
    m_UniformBufferObject.accumulatedFrameCount = 0;
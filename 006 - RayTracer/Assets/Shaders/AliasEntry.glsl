@@ -0,0 +1,12 @@
+//
+// Shared by C++ application code and glsl shader code.
+//
+
+// One entry of an alias table (Vose's alias method), which samples index i of a discrete distribution in constant time:
+// pick an entry uniformly, then keep it with probability "probability", or take its alias otherwise.
+// See EnvironmentMap.h for how the environment map's tables are laid out, and LightList.h for the light list's table.
+struct AliasEntry {
+   float probability;    // of keeping this entry, rather than taking alias
+   uint alias;
+   float pdf;            // probability of this entry being sampled (see EnvironmentMap.h for what it is relative to)
+};
@@ -9,5 +9,10 @@
 #define BINDING_OFFSETBUFFER      6
 #define BINDING_MATERIALBUFFER    7
 #define BINDING_TEXTURESAMPLERS   8
+#define BINDING_PRIMITIVEBUFFER   9
+#define BINDING_ENVIRONMENTMAP    10
+#define BINDING_ENVIRONMENTTABLE  11   // alias table for sampling the environment map
+#define BINDING_LIGHTBUFFER       12
+#define BINDING_LIGHTTREE         13   // tree for sampling the light list
 
-#define BINDING_NUMBINDINGS       9
+#define BINDING_NUMBINDINGS       14
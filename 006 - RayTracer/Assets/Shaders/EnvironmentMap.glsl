@@ -0,0 +1,77 @@
+// Environment map lighting: an equirectangular (latitude-longitude) HDR image around the scene, that rays which miss
+// everything pick up, and that Lambertian hits sample directly (next event estimation), via a 2D alias table.
+// The two ways of reaching the environment are combined by multiple importance sampling (the power heuristic).
+// See EnvironmentMap.h, which builds the alias table, and has a CPU version of all of this.
+//
+// Direction (x, y, z) is at u = 0.5 + atan(z, x) / 2pi, v = acos(y) / pi.  i.e. up is the top row of the image.
+// The radiance is constant over each pixel (no filtering), so that it matches the alias table's piecewise constant
+// distribution exactly.
+//
+// Random.glsl, Bindings.glsl, Specialization.glsl and AliasEntry.glsl must be included before this.
+
+layout(set = 0, binding = BINDING_ENVIRONMENTMAP) uniform sampler2D environmentMap;
+layout(set = 0, binding = BINDING_ENVIRONMENTTABLE) readonly buffer EnvironmentAliasTable { AliasEntry environmentAliasTable[]; };
+
+// false => rays that miss pick up UniformBufferObject's horizon to zenith gradient instead, and nothing samples the
+// environment.  (The environment map and alias table are then placeholders.)
+layout(constant_id = CONSTANT_ENVIRONMENTMAP) const bool hasEnvironmentMap = false;
+
+#define ENVIRONMENT_PI 3.1415926535897932384626433832795
+
+
+ivec2 EnvironmentPixel(const vec3 direction, const ivec2 size) {
+   const vec3 d = normalize(direction);
+   const vec2 uv = vec2(0.5 + atan(d.z, d.x) / (2.0 * ENVIRONMENT_PI), acos(clamp(d.y, -1.0, 1.0)) / ENVIRONMENT_PI);
+   return clamp(ivec2(uv * vec2(size)), ivec2(0), size - 1);
+}
+
+
+// Solid angle pdf of a direction whose sin(theta) is sinTheta, within a pixel that has probability pixelPdf
+float EnvironmentSolidAnglePdf(const float pixelPdf, const ivec2 size, const float sinTheta) {
+   return pixelPdf * float(size.x) * float(size.y) / (2.0 * ENVIRONMENT_PI * ENVIRONMENT_PI * max(sinTheta, 1e-6));
+}
+
+
+vec3 EnvironmentRadiance(const vec3 direction) {
+   return texelFetch(environmentMap, EnvironmentPixel(direction, textureSize(environmentMap, 0)), 0).rgb;
+}
+
+
+// Solid angle pdf of SampleEnvironment() returning direction
+float EnvironmentPdf(const vec3 direction) {
+   const ivec2 size = textureSize(environmentMap, 0);
+   const ivec2 pixel = EnvironmentPixel(direction, size);
+   const float y = normalize(direction).y;
+   return EnvironmentSolidAnglePdf(environmentAliasTable[size.y + pixel.y * size.x + pixel.x].pdf, size, sqrt(max(1.0 - y * y, 0.0)));
+}
+
+
+// Index in [0, count) from the alias table that starts at first
+uint SampleAliasTable(const uint first, const uint count, inout uint randomSeed) {
+   const uint i = min(uint(RandomFloat(randomSeed) * float(count)), count - 1);
+   const AliasEntry entry = environmentAliasTable[first + i];
+   return (RandomFloat(randomSeed) < entry.probability) ? i : entry.alias;
+}
+
+
+// Direction towards the environment, in proportion to its radiance (as per EnvironmentMap.h).  w is its solid angle pdf.
+vec4 SampleEnvironment(inout uint randomSeed) {
+   const ivec2 size = textureSize(environmentMap, 0);
+   const uint row = SampleAliasTable(0, uint(size.y), randomSeed);
+   const uint column = SampleAliasTable(uint(size.y) + row * uint(size.x), uint(size.x), randomSeed);
+
+   // uniformly within the pixel
+   const float u = (float(column) + RandomFloat(randomSeed)) / float(size.x);
+   const float v = (float(row) + RandomFloat(randomSeed)) / float(size.y);
+   const float phi = (u - 0.5) * 2.0 * ENVIRONMENT_PI;
+   const float theta = v * ENVIRONMENT_PI;
+   const float sinTheta = sin(theta);
+   const vec3 direction = vec3(sinTheta * cos(phi), cos(theta), sinTheta * sin(phi));
+   return vec4(direction, EnvironmentSolidAnglePdf(environmentAliasTable[uint(size.y) + row * uint(size.x) + column].pdf, size, sinTheta));
+}
+
+
+// Multiple importance sampling weight of a sample from the strategy with pdf, when the other strategy has otherPdf
+float PowerHeuristic(const float pdf, const float otherPdf) {
+   return (pdf * pdf) / (pdf * pdf + otherPdf * otherPdf);
+}
@@ -0,0 +1,21 @@
+//
+// Shared by C++ application code and glsl shader code.
+//
+
+#define LIGHTNODE_LEAF        0x80000000u   // flags childOrLight as a light index
+
+// One node of the light list's tree (see LightTree.h), a binary BVH over the lights with an orientation cone as well as
+// bounds.  The root is node 0, and siblings are adjacent, first children at odd indices.
+// Be careful with alignment: each vec3 is followed by a scalar, so that the C++ and std430 layouts match.
+struct LightNode {
+   vec3 boundsMin;
+   float power;          // of all of the lights below
+   vec3 boundsMax;
+   uint parent;          // LIGHT_NONE for the root
+   vec3 axis;            // the lights' normals are within acos(cosThetaO) of axis (or of -axis too, if twoSided)
+   float cosThetaO;
+   float cosThetaE;      // and they emit within acos(cosThetaE) of their normals
+   uint twoSided;
+   uint childOrLight;    // interior node: index of its first child (the second follows).  Leaf: LIGHTNODE_LEAF | light index
+   uint padding0;
+};
@@ -0,0 +1,165 @@
+// Light list sampling: the scene's emissive surfaces (see LightList.h, which builds the list), that Lambertian hits
+// sample directly (next event estimation) by choosing a light via the light tree (see LightTree.h), in proportion to an
+// estimate of how much it contributes to the hit point, and then a point on it.  Rays that scatter onto a light anyway
+// are weighted against that by multiple importance sampling (the power heuristic), with LightPdf().
+//
+// Triangles and parallelograms are sampled uniformly by area.  Spheres are sampled uniformly over the hemisphere that
+// faces the shading point (the other half is hidden from it), so a point on the far half of a sphere has pdf zero.
+//
+// The estimate is as per Conty Estevez and Kulla's "Importance Sampling of Many Lights", but without the hit's normal:
+// LightPdf() has to give the same probabilities when a scattered ray hits a light, and the payload does not carry it.
+//
+// Random.glsl, Bindings.glsl and Specialization.glsl must be included before this.
+
+#include "LightNode.glsl"
+#include "LightSource.glsl"
+
+layout(set = 0, binding = BINDING_LIGHTBUFFER) readonly buffer LightArray { LightSource lights[]; };
+layout(set = 0, binding = BINDING_LIGHTTREE) readonly buffer LightTree { LightNode lightTree[]; };
+
+// false => there are no lights to sample, and the light buffer and light tree are placeholders
+layout(constant_id = CONSTANT_LIGHTS) const bool hasLights = false;
+
+
+// cos(max(0, a - b)), from cos(a) and cos(b), for angles in [0, pi]
+float CosSubClamped(const float cosA, const float cosB) {
+   if (cosA >= cosB) {
+      return 1.0;
+   }
+   return cosA * cosB + sqrt(max(0.0, 1.0 - cosA * cosA)) * sqrt(max(0.0, 1.0 - cosB * cosB));
+}
+
+
+// Estimate of the light from node's lights reaching point: their power, over the squared distance to their bounds' centre
+// (but no less than the bounds' radius), times the cosine of the smallest angle that any of them can emit towards point
+// at.  Zero only if none of them can light point at all.
+float LightNodeImportance(const LightNode node, const vec3 point) {
+   const vec3 diagonal = node.boundsMax - node.boundsMin;
+   const vec3 toPoint = point - 0.5 * (node.boundsMin + node.boundsMax);
+   const float radiusSquared = 0.25 * dot(diagonal, diagonal);
+   const float distanceSquared = dot(toPoint, toPoint);
+   if (distanceSquared <= radiusSquared) {
+      return node.power / max(radiusSquared, 1e-12);
+   }
+
+   // the angle from the cone's axis to point, less the cone's spread, less the angle that the bounds subtend at point
+   float cosTheta = dot(node.axis, toPoint * inversesqrt(distanceSquared));
+   if (node.twoSided != 0u) {
+      cosTheta = abs(cosTheta);
+   }
+   const float cosThetaB = sqrt(1.0 - radiusSquared / distanceSquared);
+   const float cosThetaP = CosSubClamped(CosSubClamped(cosTheta, node.cosThetaO), cosThetaB);
+   if (cosThetaP <= node.cosThetaE) {
+      return 0.0;
+   }
+   return node.power * cosThetaP / distanceSquared;
+}
+
+
+// Probability of choosing child (rather than its sibling) on the way down the tree from point
+float LightChildProbability(const uint child, const vec3 point) {
+   const uint first = ((child & 1u) != 0u) ? child : child - 1u;
+   const float importance0 = LightNodeImportance(lightTree[first], point);
+   const float importance1 = LightNodeImportance(lightTree[first + 1u], point);
+   const float sum = importance0 + importance1;
+   if (!(sum > 0.0)) {
+      return 0.0;
+   }
+   const float p0 = importance0 / sum;
+   return (child == first) ? p0 : 1.0 - p0;
+}
+
+
+// Light index, chosen by descending the light tree from its root, taking each child in proportion to its importance
+// from point.  One random number does for the whole descent (it is rescaled at each level).  pdf is the probability of
+// choosing the light.  If no light can reach point, returns LIGHT_NONE, with a pdf of zero.
+uint SampleLightIndex(const vec3 point, inout uint randomSeed, out float pdf) {
+   float u = RandomFloat(randomSeed);
+   uint node = 0u;
+   pdf = 1.0;
+   while ((lightTree[node].childOrLight & LIGHTNODE_LEAF) == 0u) {
+      // as per LightChildProbability()
+      const uint child = lightTree[node].childOrLight;
+      const float importance0 = LightNodeImportance(lightTree[child], point);
+      const float importance1 = LightNodeImportance(lightTree[child + 1u], point);
+      const float sum = importance0 + importance1;
+      if (!(sum > 0.0)) {
+         pdf = 0.0;
+         return LIGHT_NONE;
+      }
+      const float p0 = importance0 / sum;
+      if (u < p0) {
+         node = child;
+         u = u / p0;
+         pdf *= p0;
+      } else {
+         node = child + 1u;
+         u = min((u - p0) / (1.0 - p0), 0.99999994);
+         pdf *= 1.0 - p0;
+      }
+   }
+   return lightTree[node].childOrLight & ~LIGHTNODE_LEAF;
+}
+
+
+// Probability of SampleLightIndex() choosing light lightIndex from point: the product of the choices on the way down to
+// its leaf
+float LightSelectionPdf(const uint lightIndex, const vec3 point) {
+   float pdf = 1.0;
+   for (uint node = lights[lightIndex].node; node != 0u; node = lightTree[node].parent) {
+      pdf *= LightChildProbability(node, point);
+   }
+   return pdf;
+}
+
+
+// Point on light, uniformly over the part of it that is sampled from origin (see LightSamplingArea())
+vec3 SampleLightPoint(const LightSource light, const vec3 origin, inout uint randomSeed) {
+   if (light.type == LIGHT_SPHERE) {
+      return light.position + light.edge1.x * RandomOnUnitHemisphere(normalize(origin - light.position), 0.0, randomSeed);
+   }
+   const float u = RandomFloat(randomSeed);
+   const float v = RandomFloat(randomSeed);
+   if (light.type == LIGHT_TRIANGLE) {
+      const float su = sqrt(u);
+      return light.position + su * (v * light.edge1 + (1.0 - v) * light.edge2);
+   }
+   return light.position + u * light.edge1 + v * light.edge2;
+}
+
+
+float LightSamplingArea(const LightSource light) {
+   return (light.type == LIGHT_SPHERE) ? 0.5 * light.area : light.area;
+}
+
+
+// Cosine between light's surface at point, and (unit) direction toViewer.  <= 0 => point does not emit towards the viewer
+float LightCosine(const LightSource light, const vec3 point, const vec3 toViewer) {
+   if (light.type == LIGHT_SPHERE) {
+      return dot(normalize(point - light.position), toViewer);
+   }
+   const float cosine = dot(normalize(cross(light.edge1, light.edge2)), toViewer);
+   return (light.type == LIGHT_TRIANGLE) ? abs(cosine) : cosine;
+}
+
+
+// As per Scatter()'s MATERIAL_LIGHT, for a light whose cosine (from LightCosine()) is > 0
+vec3 LightRadiance(const LightSource light, const float cosine) {
+   return (light.focus > 0.0) ? pow(cosine, light.focus) * light.radiance : light.radiance;
+}
+
+
+// Solid angle pdf of sampling point of light lightIndex from origin, i.e. of the light index, and then the point
+float LightPdf(const uint lightIndex, const vec3 origin, const vec3 point) {
+   const LightSource light = lights[lightIndex];
+   if ((light.type == LIGHT_SPHERE) && (dot(point - light.position, origin - light.position) <= 0.0)) {
+      return 0.0;
+   }
+   const vec3 toOrigin = origin - point;
+   const float distanceSquared = dot(toOrigin, toOrigin);
+   const float cosine = LightCosine(light, point, toOrigin * inversesqrt(distanceSquared));
+   if (cosine <= 0.0) {
+      return 0.0;
+   }
+   return LightSelectionPdf(lightIndex, origin) * distanceSquared / (cosine * LightSamplingArea(light));
+}
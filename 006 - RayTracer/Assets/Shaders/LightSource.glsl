@@ -0,0 +1,22 @@
+//
+// Shared by C++ application code and glsl shader code.
+//
+
+#define LIGHT_TRIANGLE        0   // position + b1 * edge1 + b2 * edge2, emitting from both sides
+#define LIGHT_PARALLELOGRAM   1   // position + u * edge1 + v * edge2 (u, v in [0, 1]), emitting from the side that edge1 x edge2 faces
+#define LIGHT_SPHERE          2   // centre position, radius edge1.x, emitting outwards
+
+#define LIGHT_NONE            0xffffffffu   // light index of surfaces that are not in the light list
+
+// One emitter of the scene's light list (see LightList.h), in world space.
+// Be careful with alignment: each vec3 is followed by a scalar, so that the C++ and std430 layouts match.
+struct LightSource {
+   vec3 position;
+   uint type;            // LIGHT_xxx
+   vec3 edge1;
+   float area;           // of the whole surface
+   vec3 edge2;
+   float focus;          // the light material's materialParameter1: > 0 => radiance falls off as pow(cosine, focus)
+   vec3 radiance;
+   uint node;            // its leaf of the light tree (see LightNode.glsl)
+};
@@ -9,6 +9,8 @@
 #define MATERIAL_LIGHT        4
 #define MATERIAL_SMOKE        5
 
+#define MATERIAL_NUMTYPES     6
+
 // Be careful with alignment...
 struct Material {
    uint type;
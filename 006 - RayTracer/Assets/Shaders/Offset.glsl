@@ -5,4 +5,6 @@
 struct Offset {
    uint vertexOffset;
    uint indexOffset;
+   uint materialIndex;   // index into the (deduplicated) material buffer
+   uint lightIndex;      // light list index of the instance's first triangle (the others follow it), or LIGHT_NONE
 };
\ No newline at end of file
@@ -0,0 +1,12 @@
+//
+// Shared by C++ application code and glsl shader code.
+//
+
+// One AABB of a procedural BLAS.  Procedural hit shaders look up their primitive at gl_InstanceCustomIndexNV + gl_PrimitiveID
+struct Primitive {
+   mat3x4 blasToObject;   // columns are the rows of the (affine) transform from BLAS space to the primitive's object space
+   uint materialIndex;
+   uint lightIndex;       // light list index of the instance (a box's six faces are lights lightIndex + gl_HitKindNV), or LIGHT_NONE
+   uint padding1;
+   uint padding2;
+};
\ No newline at end of file
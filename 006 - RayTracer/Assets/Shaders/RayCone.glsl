@@ -0,0 +1,38 @@
+// Texture level of detail by ray cones (as per Akenine-Moller et al, "Texture Level of Detail Strategies for Real-Time
+// Ray Tracing", Ray Tracing Gems).
+// Each ray carries a cone, vec2(width, spreadAngle), in its RayPayload.  Primary rays start with zero width and the
+// spread angle of one pixel.  The cone widens with distance travelled, and the footprint of the cone on the surface it
+// hits, relative to the area that the texture coordinates cover there, gives the LOD.
+// Surfaces are treated as flat (the spread angle does not change at a bounce), which underestimates the footprint after
+// bounces off curved surfaces, i.e. errs on the side of sharpness.
+
+
+// Spread angle of a primary ray's cone: one pixel (of a launch that is pixelCount pixels high), for a projection whose
+// tangent of half the vertical field of view is tanHalfFovY
+float PixelSpreadAngle(const float tanHalfFovY, const float pixelCount) {
+   return atan(2.0 * tanHalfFovY / pixelCount);
+}
+
+
+// rayCone after travelling distance t
+vec2 RayConeAt(const vec2 rayCone, const float t) {
+   return vec2(rayCone.x + rayCone.y * t, rayCone.y);
+}
+
+
+// LOD for a ray cone (at the hit point) hitting a surface with given normal, where texture coordinates cover
+// uvPerWorldArea of uv space per unit world space area.
+// The result is relative to a 1x1 texture: add 0.5 * log2(width * height) of the texture that is sampled.
+float RayConeLod(const vec2 rayCone, const vec3 normal, const vec3 direction, const float uvPerWorldArea) {
+   const float footprint = rayCone.x / max(abs(dot(normal, normalize(direction))), 1e-4);
+   return log2(max(footprint, 1e-10)) + 0.5 * log2(max(uvPerWorldArea, 1e-20));
+}
+
+
+// How many times larger world space is than a procedural primitive's object space, along one axis (assuming the
+// transforms scale uniformly).  objectToWorld is gl_ObjectToWorldNV (i.e. from BLAS space)
+float PrimitiveToWorldScale(const mat3x4 blasToObject, const mat4x3 objectToWorld) {
+   const float blasToObjectVolume = abs(determinant(mat3(blasToObject[0].xyz, blasToObject[1].xyz, blasToObject[2].xyz)));
+   const float blasToWorldVolume = abs(determinant(mat3(objectToWorld)));
+   return pow(blasToWorldVolume / max(blasToObjectVolume, 1e-20), 1.0 / 3.0);
+}
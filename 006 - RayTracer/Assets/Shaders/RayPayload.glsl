@@ -1,7 +1,8 @@
 struct RayPayload
 {
    vec4 attenuationAndDistance; // rgb,t
-   vec4 emission;               // rgb,notused
+   vec4 emission;               // rgb,scatterPdf.  scatterPdf is the pdf of scatterDirection if the hit also sampled the environment map or lights (for the MIS weight of whatever the scattered ray finds), otherwise 0
    vec4 scatterDirection;       // xyz,isScattered
    uint randomSeed;
+   vec2 rayCone;                // width,spreadAngle.  In: at the ray origin.  Out: at the hit point (i.e. for the scattered ray).  See RayCone.glsl
 };
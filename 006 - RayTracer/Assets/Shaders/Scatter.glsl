@@ -1,16 +1,30 @@
 #extension GL_EXT_nonuniform_qualifier : require
 
+#include "AliasEntry.glsl"
 #include "Material.glsl"
 #include "Random.glsl"
+#include "RayCone.glsl"
 #include "RayPayload.glsl"
 #include "SNoise.glsl"
+#include "Specialization.glsl"
 #include "Texture.glsl"
+#include "EnvironmentMap.glsl"   // these two after AliasEntry.glsl, Random.glsl and Specialization.glsl, which they use
+#include "LightSampling.glsl"
 
 layout(set = 0, binding = BINDING_TLAS) uniform accelerationStructureNV world;
 layout(set = 0, binding = BINDING_MATERIALBUFFER) readonly buffer MaterialArray { Material materials[]; };
 layout(set = 0, binding = BINDING_TEXTURESAMPLERS) uniform sampler2D[] samplers;
 
 layout(location = 1) rayPayloadNV RayPayload ray1;
+layout(location = 2) rayPayloadNV bool isShadowed;
+
+// The material and texture types that the scene uses.  Once specialized, the branches for the others are constant
+// false, and are compiled out.
+layout(constant_id = CONSTANT_MATERIALTYPES) const uint materialTypes = 0xffffffffu;
+layout(constant_id = CONSTANT_TEXTURETYPES) const uint textureTypes = 0xffffffffu;
+
+#define HAS_MATERIALTYPE(type) ((materialTypes & (1u << (type))) != 0u)
+#define HAS_TEXTURETYPE(type) ((textureTypes & TEXTURETYPE_BIT(type)) != 0u)
 
 float Schlick(float cosine, float refractiveIndex) {
     float r0 = (1 - refractiveIndex) / (1 + refractiveIndex);
@@ -34,166 +48,226 @@ float Turbulence(vec3 p, int depth) {
 }
 
 
-vec3 Color(const vec3 hitPoint, const vec3 normal, const vec2 texCoord, const int textureType, const vec4 textureParam1, const vec4 textureParam2) {
-   switch(textureType) {
-      case TEXTURE_FLATCOLOR: {
-         // flat color
-         return textureParam1.rgb;
+// lod is as per RayConeLod()
+vec3 Color(const vec3 hitPoint, const vec3 normal, const vec2 texCoord, const float lod, const int textureType, const vec4 textureParam1, const vec4 textureParam2) {
+   if (HAS_TEXTURETYPE(TEXTURE_FLATCOLOR) && (textureType == TEXTURE_FLATCOLOR)) {
+      // flat color
+      return textureParam1.rgb;
+   } else if (HAS_TEXTURETYPE(TEXTURE_CHECKERBOARD) && (textureType == TEXTURE_CHECKERBOARD)) {
+      // checkboard
+      // WARNING: This texture doesnt work too well if you have a large axis-aligned face at some value where sin(value) is exactly 0
+      //          (For example, a large cube where one of the faces is axis-aligned at z = 0)
+      //          You will end up with floating point precision issues with sin(hitPoint.z) sometimes being slightly less than 0 and sometimes
+      //          slightly > 0.
+      const vec3 oddColor = textureParam1.rgb;
+      const vec3 evenColor = textureParam2.rgb;
+      const float scale = textureParam1.w;
+      float sineProduct = (sin(hitPoint.x * scale) >= 0.0? 1.0 : -1.0) * (sin(hitPoint.y * scale) >= 0.0? 1.0 : -1.0) * (sin(hitPoint.z * scale) >= 0.0? 1.0 : -1.0);
+      if (sineProduct < 0) {
+         return oddColor;
+      } else {
+         return evenColor;
       }
+   } else if (HAS_TEXTURETYPE(TEXTURE_SIMPLEX3D) && (textureType == TEXTURE_SIMPLEX3D)) {
+      vec3 p = hitPoint;
+      p *= textureParam2.w; // scale
+      return mix(textureParam1.rgb, vec3(snoise(p)), textureParam1.w);
+   } else if (HAS_TEXTURETYPE(TEXTURE_TURBULENCE) && (textureType == TEXTURE_TURBULENCE)) {
+      vec3 p = hitPoint;
+      p *= textureParam2.w; // scale
+      return mix(textureParam1.rgb, vec3(Turbulence(p, int(textureParam2.z))), textureParam1.w);   
+   } else if (HAS_TEXTURETYPE(TEXTURE_MARBLE) && (textureType == TEXTURE_MARBLE)) {
+      vec3 p = hitPoint;
+      p *= textureParam2.w; // scale
+      return mix(textureParam1.rgb, vec3(sin(p.z + 10.0 * Turbulence(p, int(textureParam2.z)))), textureParam1.w);
+   } else if (HAS_TEXTURETYPE(TEXTURE_NORMALS) && (textureType == TEXTURE_NORMALS)) {
+      return (vec3(1.0) + normal) / 2.0;
+   } else if (HAS_TEXTURETYPE(TEXTURE_UV) && (textureType == TEXTURE_UV)) {
+      return vec3(texCoord, 0.0);
+   } else if (HAS_TEXTURETYPE(TEXTURE_RED) && (textureType == TEXTURE_RED)) {
+      return vec3(1.0, 0.0, 0.0);
+   } else if (HAS_TEXTURETYPE(0) && (textureType >= 0)) {
+      // sample from textures, indexed by textureType.  Explicit LOD, as there are no derivatives in ray tracing shaders
+      const vec2 size = vec2(textureSize(samplers[textureType], 0));
+      return textureLod(samplers[textureType], texCoord, lod + 0.5 * log2(size.x * size.y)).rgb;
+   }
+   return vec3(0.0);
+}
 
-      case TEXTURE_CHECKERBOARD: {
-         // checkboard
-         // WARNING: This texture doesnt work too well if you have a large axis-aligned face at some value where sin(value) is exactly 0
-         //          (For example, a large cube where one of the faces is axis-aligned at z = 0)
-         //          You will end up with floating point precision issues with sin(hitPoint.z) sometimes being slightly less than 0 and sometimes
-         //          slightly > 0.
-         const vec3 oddColor = textureParam1.rgb;
-         const vec3 evenColor = textureParam2.rgb;
-         const float scale = textureParam1.w;
-         float sineProduct = (sin(hitPoint.x * scale) >= 0.0? 1.0 : -1.0) * (sin(hitPoint.y * scale) >= 0.0? 1.0 : -1.0) * (sin(hitPoint.z * scale) >= 0.0? 1.0 : -1.0);
-         if (sineProduct < 0) {
-            return oddColor;
-         } else {
-            return evenColor;
-         }
-      }
 
-      case TEXTURE_SIMPLEX3D: {
-         vec3 p = hitPoint;
-         p *= textureParam2.w; // scale
-         return mix(textureParam1.rgb, vec3(snoise(p)), textureParam1.w);
-      }
+// Shadow ray: is there anything at all between origin and distance tMax along direction?
+bool IsShadowed(const vec3 origin, const vec3 direction, const float tMax) {
+   isShadowed = true;
+   traceNV(
+      world,
+      gl_RayFlagsTerminateOnFirstHitNV | gl_RayFlagsSkipClosestHitShaderNV | gl_RayFlagsOpaqueNV,
+      0xff,
+      0,                // sbt record offset
+      0,                // sbt record stride
+      1,                // miss index (Shadow.rmiss)
+      origin,
+      0.001,            // tmin
+      direction,
+      tMax,
+      2                 // payload (isShadowed)
+   );
+   return isShadowed;
+}
 
-      case TEXTURE_TURBULENCE: {
-         vec3 p = hitPoint;
-         p *= textureParam2.w; // scale
-         return mix(textureParam1.rgb, vec3(Turbulence(p, int(textureParam2.z))), textureParam1.w);   
-      }
 
-      case TEXTURE_MARBLE: {
-         vec3 p = hitPoint;
-         p *= textureParam2.w; // scale
-         return mix(textureParam1.rgb, vec3(sin(p.z + 10.0 * Turbulence(p, int(textureParam2.z)))), textureParam1.w);
-      }
+// Next event estimation: light from the environment map reaching a Lambertian surface of given color (albedo), via a
+// direction sampled from the environment map and a shadow ray.  Weighted against the scattered ray (which samples the
+// cosine lobe) reaching the environment by multiple importance sampling.
+vec3 SampleEnvironmentLight(const vec3 hitPoint, const vec3 normal, const vec3 color, inout uint randomSeed) {
+   const vec4 directionAndPdf = SampleEnvironment(randomSeed);
+   const vec3 direction = directionAndPdf.xyz;
+   const float cosine = dot(normal, direction);
+   const float lightPdf = directionAndPdf.w;
 
-      case TEXTURE_NORMALS: {
-         return (vec3(1.0) + normal) / 2.0;
-      }
+   // lightPdf is zero if the environment map is black all over
+   if ((cosine <= 0.0) || !(lightPdf > 0.0) || IsShadowed(hitPoint, direction, 10000.0)) {
+      return vec3(0.0);
+   }
 
-      case TEXTURE_UV: {
-         return vec3(texCoord, 0.0);
-      }
+   const float scatterPdf = cosine / ENVIRONMENT_PI;
+   return (color / ENVIRONMENT_PI) * cosine * EnvironmentRadiance(direction) * PowerHeuristic(lightPdf, scatterPdf) / lightPdf;
+}
 
-      case TEXTURE_RED: {
-         return vec3(1.0, 0.0, 0.0);
-      }
 
-      default: {
-         // sample from textures, indexed by textureType
-         return texture(samplers[textureType], texCoord).rgb;
-      }
+// Next event estimation: light from the light list reaching a Lambertian surface of given color, via a point sampled on
+// one of the lights and a shadow ray to it.  Weighted against the scattered ray hitting the light by multiple importance
+// sampling.
+vec3 SampleLight(const vec3 hitPoint, const vec3 normal, const vec3 color, inout uint randomSeed) {
+   float selectionPdf;
+   const uint lightIndex = SampleLightIndex(hitPoint, randomSeed, selectionPdf);
+   if (lightIndex == LIGHT_NONE) {
+      return vec3(0.0);
+   }
+   const LightSource light = lights[lightIndex];
+   const vec3 lightPoint = SampleLightPoint(light, hitPoint, randomSeed);
+   const vec3 toLight = lightPoint - hitPoint;
+   const float distanceSquared = dot(toLight, toLight);
+   const float distance = sqrt(distanceSquared);
+   const vec3 direction = toLight / distance;
+   const float cosine = dot(normal, direction);
+   const float lightCosine = LightCosine(light, lightPoint, -direction);
+   const float lightPdf = selectionPdf * distanceSquared / (lightCosine * LightSamplingArea(light));
+
+   // the shadow ray stops just short of the light, so as not to hit the light itself
+   if ((cosine <= 0.0) || (lightCosine <= 0.0) || !(lightPdf > 0.0) || IsShadowed(hitPoint, direction, 0.999 * distance)) {
+      return vec3(0.0);
    }
+
+   const float scatterPdf = cosine / ENVIRONMENT_PI;
+   return (color / ENVIRONMENT_PI) * cosine * LightRadiance(light, lightCosine) * PowerHeuristic(lightPdf, scatterPdf) / lightPdf;
 }
 
 
-RayPayload ScatterLambertian(const vec3 hitPoint, const vec3 normal, const vec3 color, inout uint randomSeed) {
+RayPayload ScatterLambertian(const vec3 hitPoint, const vec3 normal, const vec3 color, const vec2 rayCone, inout uint randomSeed) {
+   vec4 emission = vec4(0.0);
+   if (hasEnvironmentMap) {
+      emission.rgb = SampleEnvironmentLight(hitPoint, normal, color, randomSeed);
+   }
+   if (hasLights) {
+      emission.rgb += SampleLight(hitPoint, normal, color, randomSeed);
+   }
    const vec3 scatterDirection = RandomOnUnitHemisphere(normal, 1.0, randomSeed);
-   return RayPayload(vec4(color, gl_HitTNV), vec4(0.0), vec4(scatterDirection, 1.0), randomSeed);
+   if (hasEnvironmentMap || hasLights) {
+      emission.w = max(dot(normal, scatterDirection), 1e-6) / ENVIRONMENT_PI;   // cosine sampled
+   }
+   return RayPayload(vec4(color, gl_HitTNV), emission, vec4(scatterDirection, 1.0), randomSeed, rayCone);
 }
 
 
-RayPayload ScatterMetallic(const vec3 hitPoint, const vec3 normal, const vec3 color, const float roughness, inout uint randomSeed) {
+RayPayload ScatterMetallic(const vec3 hitPoint, const vec3 normal, const vec3 color, const float roughness, const vec2 rayCone, inout uint randomSeed) {
    const vec3 scatterDirection = normalize(reflect(gl_WorldRayDirectionNV, normal) + roughness * RandomInUnitSphere(randomSeed));
-   return RayPayload(vec4(color, gl_HitTNV), vec4(0.0), vec4(scatterDirection, 1.0), randomSeed);
+   return RayPayload(vec4(color, gl_HitTNV), vec4(0.0), vec4(scatterDirection, 1.0), randomSeed, rayCone);
 }
 
 
-RayPayload Scatter(const vec3 hitPoint, const vec3 normal, const vec2 texCoord, const uint materialIndex, inout uint randomSeed) {
+// rayCone is the ray's cone at hitPoint, and uvPerWorldArea is as per RayConeLod().  lightIndex is the surface's index
+// in the light list (LIGHT_NONE if it is not a light), and scatterPdf is the incoming payload's emission.w (the pdf of
+// the previous hit having scattered this ray, if it also sampled the lights, for the MIS weight of hitting a light)
+RayPayload Scatter(const vec3 hitPoint, const vec3 normal, const vec2 texCoord, const float uvPerWorldArea, const uint materialIndex, const uint lightIndex, const vec2 rayCone, const float scatterPdf, inout uint randomSeed) {
    Material material = materials[materialIndex];
-
-   switch(material.type) {
-
-      case MATERIAL_LAMBERTIAN: {
-         return ScatterLambertian(hitPoint, normal, Color(hitPoint, normal, texCoord, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2), randomSeed);
+   const float lod = RayConeLod(rayCone, normal, gl_WorldRayDirectionNV, uvPerWorldArea);
+
+   if (HAS_MATERIALTYPE(MATERIAL_LAMBERTIAN) && (material.type == MATERIAL_LAMBERTIAN)) {
+      return ScatterLambertian(hitPoint, normal, Color(hitPoint, normal, texCoord, lod, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2), rayCone, randomSeed);
+   } else if (HAS_MATERIALTYPE(MATERIAL_PHONG) && (material.type == MATERIAL_PHONG)) {
+      const vec3 specular = Color(hitPoint, normal, texCoord, lod, material.specularTextureType, material.specularTextureParam1, material.specularTextureParam2);
+      const vec3 diffuse = min(1.0 - specular, Color(hitPoint, normal, texCoord, lod, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2));
+
+      float specularChance = dot(specular, vec3(1.0 / 3.0));
+      float diffuseChance = dot(diffuse, vec3(1.0 / 3.0));
+      float sum = specularChance + diffuseChance;
+      if(sum > 0.00001) {
+         diffuseChance /= sum;
+         specularChance /= sum;
+      } else {
+         diffuseChance = 1.0f;
+         specularChance = 0.0f;
       }
 
-      case MATERIAL_PHONG: {
-         const vec3 specular = Color(hitPoint, normal, texCoord, material.specularTextureType, material.specularTextureParam1, material.specularTextureParam2);
-         const vec3 diffuse = min(1.0 - specular, Color(hitPoint, normal, texCoord, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2));
-
-         float specularChance = dot(specular, vec3(1.0 / 3.0));
-         float diffuseChance = dot(diffuse, vec3(1.0 / 3.0));
-         float sum = specularChance + diffuseChance;
-         if(sum > 0.00001) {
-            diffuseChance /= sum;
-            specularChance /= sum;
-         } else {
-            diffuseChance = 1.0f;
-            specularChance = 0.0f;
-         }
-
-         const float select = RandomFloat(randomSeed);
-         if (select < specularChance) {
-            const float alpha = pow(10000.0f, material.materialParameter1 * material.materialParameter1);
-            const vec3 scatterDirection = RandomOnUnitHemisphere(reflect(gl_WorldRayDirectionNV, normal), alpha, randomSeed);
-            const float f = (alpha + 2.0) / (alpha + 1.0);
-            // note: cannot get here if specularChance is zero, so there is no division by zero.
-            return RayPayload(vec4(specular / specularChance * clamp(dot(normal, scatterDirection), 0.0, 1.0) * f, gl_HitTNV), vec4(0.0), vec4(scatterDirection, 1.0), randomSeed);
-         } else {
-            // note: cannot get here if diffuseChance is zero, so there is no division by zero.
-            return ScatterLambertian(hitPoint, normal, diffuse / diffuseChance, randomSeed);
-         }
+      const float select = RandomFloat(randomSeed);
+      if (select < specularChance) {
+         const float alpha = pow(10000.0f, material.materialParameter1 * material.materialParameter1);
+         const vec3 scatterDirection = RandomOnUnitHemisphere(reflect(gl_WorldRayDirectionNV, normal), alpha, randomSeed);
+         const float f = (alpha + 2.0) / (alpha + 1.0);
+         // note: cannot get here if specularChance is zero, so there is no division by zero.
+         return RayPayload(vec4(specular / specularChance * clamp(dot(normal, scatterDirection), 0.0, 1.0) * f, gl_HitTNV), vec4(0.0), vec4(scatterDirection, 1.0), randomSeed, rayCone);
+      } else {
+         // note: cannot get here if diffuseChance is zero, so there is no division by zero.
+         return ScatterLambertian(hitPoint, normal, diffuse / diffuseChance, rayCone, randomSeed);
       }
-
-      case MATERIAL_METALLIC: {
-         return ScatterMetallic(hitPoint, normal, Color(hitPoint, normal, texCoord, material.specularTextureType, material.specularTextureParam1, material.specularTextureParam2), material.materialParameter1, randomSeed);
+   } else if (HAS_MATERIALTYPE(MATERIAL_METALLIC) && (material.type == MATERIAL_METALLIC)) {
+      return ScatterMetallic(hitPoint, normal, Color(hitPoint, normal, texCoord, lod, material.specularTextureType, material.specularTextureParam1, material.specularTextureParam2), material.materialParameter1, rayCone, randomSeed);
+   } else if (HAS_MATERIALTYPE(MATERIAL_DIELECTRIC) && (material.type == MATERIAL_DIELECTRIC)) {
+      vec3 outward_normal;
+      float ni_over_nt;
+      float reflectProbability;
+      float cosine;
+      if (dot(gl_WorldRayDirectionNV, normal) > 0.0) {
+         outward_normal = -normal;
+         ni_over_nt = material.materialParameter1;
+         cosine = ni_over_nt * dot(gl_WorldRayDirectionNV, normal);
+      } else {
+         outward_normal = normal;
+         ni_over_nt = 1.0 / material.materialParameter1;
+         cosine = -dot(gl_WorldRayDirectionNV, normal);
       }
+      const vec3 refracted = refract(gl_WorldRayDirectionNV.xyz, outward_normal, ni_over_nt);
 
-      case MATERIAL_DIELECTRIC: {
-         vec3 outward_normal;
-         float ni_over_nt;
-         float reflectProbability;
-         float cosine;
-         if (dot(gl_WorldRayDirectionNV, normal) > 0.0) {
-            outward_normal = -normal;
-            ni_over_nt = material.materialParameter1;
-            cosine = ni_over_nt * dot(gl_WorldRayDirectionNV, normal);
-         } else {
-            outward_normal = normal;
-            ni_over_nt = 1.0 / material.materialParameter1;
-            cosine = -dot(gl_WorldRayDirectionNV, normal);
-         }
-         const vec3 refracted = refract(gl_WorldRayDirectionNV.xyz, outward_normal, ni_over_nt);
-
-         // fake colored glass.. I dont think it really behaves like this (e.g. shouldn't attenuation be proportional to how much
-         // of the material the ray passes through)?
-         const vec4 attenuationAndDistance = vec4(Color(hitPoint, normal, texCoord, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2), gl_HitTNV);
-
-         if(dot(refracted, refracted) > 0.0) {
-            reflectProbability = Schlick(cosine, material.materialParameter1);
-         } else {
-            reflectProbability = 1.0;
-         }
-         if(RandomFloat(randomSeed) < reflectProbability) {
-            const vec3 reflected = reflect(gl_WorldRayDirectionNV, normal);
-            return RayPayload(attenuationAndDistance, vec4(0.0), vec4(reflected, 1), randomSeed);
-         }
-         return RayPayload(attenuationAndDistance, vec4(0.0), vec4(refracted, 1), randomSeed);
-      } 
-
-      case MATERIAL_LIGHT: {
-         float emit = 1.0;
-         if(material.materialParameter1 > 0.0) {
-            emit = pow(max(0.0, -dot(gl_WorldRayDirectionNV, normal)), material.materialParameter1);
-         }
-         const vec3 color = Color(hitPoint, normal, texCoord, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2);
-         return RayPayload(vec4(0.0, 0.0, 0.0, gl_HitTNV), emit * vec4(color, 0.0), vec4(0.0), randomSeed);
-      }
+      // fake colored glass.. I dont think it really behaves like this (e.g. shouldn't attenuation be proportional to how much
+      // of the material the ray passes through)?
+      const vec4 attenuationAndDistance = vec4(Color(hitPoint, normal, texCoord, lod, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2), gl_HitTNV);
 
-      case MATERIAL_SMOKE: {
-         const vec4 attenuationAndDistance = vec4(Color(hitPoint, normal, texCoord, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2), gl_HitTNV);
-         const vec3 scatterDirection = RandomUnitVector(randomSeed);
-         return RayPayload(attenuationAndDistance, vec4(0.0), vec4(scatterDirection, 1.0), randomSeed);
+      if(dot(refracted, refracted) > 0.0) {
+         reflectProbability = Schlick(cosine, material.materialParameter1);
+      } else {
+         reflectProbability = 1.0;
+      }
+      if(RandomFloat(randomSeed) < reflectProbability) {
+         const vec3 reflected = reflect(gl_WorldRayDirectionNV, normal);
+         return RayPayload(attenuationAndDistance, vec4(0.0), vec4(reflected, 1), randomSeed, rayCone);
       }
+      return RayPayload(attenuationAndDistance, vec4(0.0), vec4(refracted, 1), randomSeed, rayCone);
+   } else if (HAS_MATERIALTYPE(MATERIAL_LIGHT) && (material.type == MATERIAL_LIGHT)) {
+      float emit = 1.0;
+      if(material.materialParameter1 > 0.0) {
+         emit = pow(max(0.0, -dot(gl_WorldRayDirectionNV, normal)), material.materialParameter1);
+      }
+      if (hasLights && (scatterPdf > 0.0) && (lightIndex != LIGHT_NONE)) {
+         emit *= PowerHeuristic(scatterPdf, LightPdf(lightIndex, gl_WorldRayOriginNV, hitPoint));
+      }
+      const vec3 color = Color(hitPoint, normal, texCoord, lod, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2);
+      return RayPayload(vec4(0.0, 0.0, 0.0, gl_HitTNV), emit * vec4(color, 0.0), vec4(0.0), randomSeed, rayCone);
+   } else if (HAS_MATERIALTYPE(MATERIAL_SMOKE) && (material.type == MATERIAL_SMOKE)) {
+      const vec4 attenuationAndDistance = vec4(Color(hitPoint, normal, texCoord, lod, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2), gl_HitTNV);
+      const vec3 scatterDirection = RandomUnitVector(randomSeed);
+      return RayPayload(attenuationAndDistance, vec4(0.0), vec4(scatterDirection, 1.0), randomSeed, rayCone);
    }
+
+   // unknown (or not specialized for) material: absorb the ray
+   return RayPayload(vec4(0.0, 0.0, 0.0, gl_HitTNV), vec4(0.0), vec4(0.0), randomSeed, rayCone);
 }
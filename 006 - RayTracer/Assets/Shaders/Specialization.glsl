@@ -0,0 +1,12 @@
+// Shared by C++ application code and glsl shader code.
+// Specialization constant ids of the ray tracing shaders.  RayTracer specializes its pipeline on these (see
+// PipelineFeatures.h), so that the shaders only contain what the scene uses.
+#define CONSTANT_MINRAYBOUNCES   0
+#define CONSTANT_MAXRAYBOUNCES   1
+#define CONSTANT_MATERIALTYPES   2   // bit (1 << MATERIAL_xxx) is set for each material type that is used
+#define CONSTANT_TEXTURETYPES    3   // bit TEXTURETYPE_BIT(TEXTURE_xxx) is set for each texture type that is used
+#define CONSTANT_ENVIRONMENTMAP  4   // the scene has an environment map (see EnvironmentMap.glsl)
+#define CONSTANT_LIGHTS          5   // the scene's light list is not empty (see LightSampling.glsl)
+
+// The procedural texture types (which are negative) have a bit each, and all image textures (type >= 0) share one
+#define TEXTURETYPE_BIT(type) (((type) >= 0) ? (1u << 8) : ((type) >= -5) ? (1u << (-(type) - 1)) : (1u << (-(type) - 95)))
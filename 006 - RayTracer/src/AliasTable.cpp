@@ -0,0 +1,48 @@
+#include "AliasTable.h"
+
+
+void BuildAliasEntries(const float* weights, const uint32_t count, const float pdfScale, AliasEntry* entries, std::vector<uint32_t>& scratch) {
+   double total = 0.0;
+   for (uint32_t i = 0; i < count; ++i) {
+      total += weights[i];
+   }
+   if (total <= 0.0) {
+      for (uint32_t i = 0; i < count; ++i) {
+         entries[i] = {1.0f, i, 0.0f};
+      }
+      return;
+   }
+
+   // probabilities scaled so that the average is one.  Entries below that ("small") are topped up from those above it
+   // ("large").  The small list is at the front of scratch, and the large list at the back.
+   scratch.resize(count);
+   uint32_t smallCount = 0;
+   uint32_t largeBegin = count;
+   for (uint32_t i = 0; i < count; ++i) {
+      const double probability = weights[i] / total;
+      entries[i] = {static_cast<float>(probability * count), i, static_cast<float>(probability * pdfScale)};
+      if (entries[i].probability < 1.0f) {
+         scratch[smallCount++] = i;
+      } else {
+         scratch[--largeBegin] = i;
+      }
+   }
+   while ((smallCount > 0) && (largeBegin < count)) {
+      const uint32_t small = scratch[--smallCount];
+      const uint32_t large = scratch[largeBegin];
+      entries[small].alias = large;
+      entries[large].probability -= 1.0f - entries[small].probability;
+      if (entries[large].probability < 1.0f) {
+         ++largeBegin;
+         scratch[smallCount++] = large;
+      }
+   }
+
+   // whatever is left over is only not exactly one because of rounding
+   for (uint32_t i = 0; i < smallCount; ++i) {
+      entries[scratch[i]].probability = 1.0f;
+   }
+   for (uint32_t i = largeBegin; i < count; ++i) {
+      entries[scratch[i]].probability = 1.0f;
+   }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+using uint = uint32_t;
+#include "AliasEntry.glsl"
+
+// Vose's alias method, for the distribution in proportion to weights[0 .. count).  Each entry's pdf is its probability
+// times pdfScale.  scratch is for the work lists (so that building many tables does not allocate each time).
+// If the weights are all zero, the table is uniform, with pdfs of zero.
+void BuildAliasEntries(const float* weights, const uint32_t count, const float pdfScale, AliasEntry* entries, std::vector<uint32_t>& scratch);
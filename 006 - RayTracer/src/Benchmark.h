@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Utility.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Helpers shared by the benchmarks (the *Benchmark.cpp files)
+namespace Benchmark {
+
+using Clock = std::chrono::steady_clock;
+using Vulkan::MillisecondsSince;
+
+constexpr uint32_t RepeatCount = 3;                    // timings are best of this many
+constexpr uint32_t ReferenceFirstSample = 1'000'000;   // first sample of CpuPathTracer reference images, so that they do not share samples with the renders they are compared with
+
+
+// Best (i.e. least noisy) time of RepeatCount runs of fn
+template<typename Fn>
+double BestMilliseconds(Fn&& fn) {
+   double best = std::numeric_limits<double>::max();
+   for (uint32_t repeat = 0; repeat < RepeatCount; ++repeat) {
+      const Clock::time_point start = Clock::now();
+      fn();
+      best = std::min(best, MillisecondsSince(start));
+   }
+   return best;
+}
+
+
+// Root mean square error of image against reference, over all pixels and channels
+inline double Rmse(const std::vector<glm::vec3>& image, const std::vector<glm::vec3>& reference) {
+   double sum = 0.0;
+   for (size_t i = 0; i < image.size(); ++i) {
+      const glm::vec3 d = image[i] - reference[i];
+      sum += glm::dot(d, d) / 3.0;
+   }
+   return std::sqrt(sum / static_cast<double>(image.size()));
+}
+
+}
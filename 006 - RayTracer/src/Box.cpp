@@ -26,7 +26,7 @@ void Box::SetDefaultShaderHitGroupIndex(const uint32_t shaderHitGroupIndex) {
 }
 
 
-BoxInstance::BoxInstance(const glm::vec3& centre, const glm::vec3& size, const glm::vec3& rotateRadians, const Material& material)
+BoxInstance::BoxInstance(const glm::vec3& centre, const glm::vec3& size, const glm::vec3& rotateRadians, const uint32_t materialIndex)
 : Instance {
    sm_ModelIndex,
    glm::transpose(
@@ -47,7 +47,7 @@ BoxInstance::BoxInstance(const glm::vec3& centre, const glm::vec3& size, const g
          size
       )
    ),
-   material
+   materialIndex
 }
 {
    ASSERT(sm_ModelIndex != ~0, "ERROR: Box model index has not been set.  You must set the model index (via SetModelIndex()) before instantiating a Box.");
@@ -58,7 +58,7 @@ void BoxInstance::SetModelIndex(uint32_t modelIndex) {
    sm_ModelIndex = modelIndex;
 }
 
-ProceduralBoxInstance::ProceduralBoxInstance(const glm::vec3& centre, const glm::vec3& size, const glm::vec3& rotateRadians, const Material& material)
+ProceduralBoxInstance::ProceduralBoxInstance(const glm::vec3& centre, const glm::vec3& size, const glm::vec3& rotateRadians, const uint32_t materialIndex)
 : Instance {
    sm_ModelIndex,
    glm::transpose(
@@ -79,7 +79,7 @@ ProceduralBoxInstance::ProceduralBoxInstance(const glm::vec3& centre, const glm:
          size
       )
    ),
-   material
+   materialIndex
 } {
    ASSERT(sm_ModelIndex != ~0, "ERROR: ProceduralBox model index has not been set.  You must set the model index (via SetModelIndex()) before instantiating a ProceduralBox.");
 }
@@ -26,7 +26,7 @@ private:
 
 class BoxInstance : public Instance {
 public:
-   BoxInstance(const glm::vec3& centre, const glm::vec3& size, const glm::vec3& rotationRadians, const Material& material);
+   BoxInstance(const glm::vec3& centre, const glm::vec3& size, const glm::vec3& rotationRadians, const uint32_t materialIndex);
 
 public:
    static void SetModelIndex(uint32_t modelIndex);
@@ -38,7 +38,7 @@ private:
 
 class ProceduralBoxInstance : public Instance {
 public:
-   ProceduralBoxInstance(const glm::vec3& centre, const glm::vec3& size, const glm::vec3& rotationRadians, const Material& material);
+   ProceduralBoxInstance(const glm::vec3& centre, const glm::vec3& size, const glm::vec3& rotationRadians, const uint32_t materialIndex);
 
 public:
    static void SetModelIndex(uint32_t modelIndex);
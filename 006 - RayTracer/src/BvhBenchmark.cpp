@@ -0,0 +1,188 @@
+#include "BvhBenchmark.h"
+
+#include "Benchmark.h"
+#include "Log.h"
+#include "Model.h"
+#include "SceneBvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace {
+
+constexpr float Pi = 3.1415926535897932384626433832795f;
+constexpr float TMin = 0.0001f;
+constexpr uint32_t QueryRayCount = 1 << 20;
+constexpr uint64_t BruteForceTriangleTests = 200'000'000;   // (roughly) how much work to spend on the brute force comparison
+
+
+struct Mesh {
+   std::vector<Vertex> Vertices;
+   std::vector<uint32_t> Indices;
+};
+
+
+struct Ray {
+   glm::vec3 Origin;
+   glm::vec3 Direction;
+};
+
+
+// Bumpy sphere of (about) triangleCount triangles
+Mesh GenerateMesh(const uint32_t triangleCount) {
+   const uint32_t rows = static_cast<uint32_t>(std::sqrt(triangleCount / 4));
+   const uint32_t columns = 2 * rows;
+   Mesh mesh;
+   mesh.Vertices.reserve(static_cast<size_t>(rows + 1) * (columns + 1));
+   for (uint32_t row = 0; row <= rows; ++row) {
+      const float theta = Pi * row / rows;
+      for (uint32_t column = 0; column <= columns; ++column) {
+         const float phi = 2.0f * Pi * column / columns;
+         const float radius = 1.0f + 0.05f * std::sin(13.0f * theta) * std::sin(17.0f * phi);
+         Vertex vertex = {};
+         vertex.pos = radius * glm::vec3 {std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)};
+         mesh.Vertices.push_back(vertex);
+      }
+   }
+   mesh.Indices.reserve(6 * static_cast<size_t>(rows) * columns);
+   for (uint32_t row = 0; row < rows; ++row) {
+      for (uint32_t column = 0; column < columns; ++column) {
+         const uint32_t i0 = row * (columns + 1) + column;
+         const uint32_t i1 = i0 + 1;
+         const uint32_t i2 = i0 + columns + 1;
+         const uint32_t i3 = i2 + 1;
+         mesh.Indices.insert(mesh.Indices.end(), {i0, i2, i1, i1, i2, i3});
+      }
+   }
+   return mesh;
+}
+
+
+// Rays from random points around the mesh, towards random points within its bounds.  Roughly half of them hit.
+std::vector<Ray> GenerateRays(const Vulkan::Aabb& bounds, const uint32_t count) {
+   std::mt19937 generator;
+   std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+   const glm::vec3 centre = bounds.GetCenter();
+   const float radius = glm::length(bounds.Max - bounds.Min);
+   std::vector<Ray> rays(count);
+   for (auto& ray : rays) {
+      const float z = 2.0f * distribution(generator) - 1.0f;
+      const float phi = 2.0f * Pi * distribution(generator);
+      const float r = std::sqrt(1.0f - z * z);
+      ray.Origin = centre + radius * glm::vec3 {r * std::cos(phi), r * std::sin(phi), z};
+      const glm::vec3 target = glm::mix(bounds.Min, bounds.Max, glm::vec3 {distribution(generator), distribution(generator), distribution(generator)});
+      ray.Direction = glm::normalize(target - ray.Origin);
+   }
+   return rays;
+}
+
+
+float ClosestHitBruteForce(const Mesh& mesh, const Ray& ray) {
+   float tMax = std::numeric_limits<float>::max();
+   for (size_t i = 0; i + 2 < mesh.Indices.size(); i += 3) {
+      float t;
+      glm::vec2 barycentrics;
+      if (SceneBvh::IntersectTriangle(ray.Origin, ray.Direction, mesh.Vertices[mesh.Indices[i]].pos, mesh.Vertices[mesh.Indices[i + 1]].pos, mesh.Vertices[mesh.Indices[i + 2]].pos, t, barycentrics) && (TMin <= t) && (t < tMax)) {
+         tMax = t;
+      }
+   }
+   return tMax;
+}
+
+
+// Returns closest t, or max float if the ray misses
+float ClosestHit(const Mesh& mesh, const Vulkan::Bvh& bvh, const Ray& ray) {
+   float tMax = std::numeric_limits<float>::max();
+   bvh.ClosestHit(ray.Origin, ray.Direction, TMin, tMax, [&mesh, &ray] (const uint32_t primitive, float& tMax) {
+      float t;
+      glm::vec2 barycentrics;
+      if (SceneBvh::IntersectTriangle(ray.Origin, ray.Direction, mesh.Vertices[mesh.Indices[3 * primitive]].pos, mesh.Vertices[mesh.Indices[3 * primitive + 1]].pos, mesh.Vertices[mesh.Indices[3 * primitive + 2]].pos, t, barycentrics) && (TMin <= t) && (t < tMax)) {
+         tMax = t;
+         return true;
+      }
+      return false;
+   });
+   return tMax;
+}
+
+
+bool AnyHit(const Mesh& mesh, const Vulkan::Bvh& bvh, const Ray& ray) {
+   return bvh.AnyHit(ray.Origin, ray.Direction, TMin, std::numeric_limits<float>::max(), [&mesh, &ray] (const uint32_t primitive, const float tMax) {
+      float t;
+      glm::vec2 barycentrics;
+      return SceneBvh::IntersectTriangle(ray.Origin, ray.Direction, mesh.Vertices[mesh.Indices[3 * primitive]].pos, mesh.Vertices[mesh.Indices[3 * primitive + 1]].pos, mesh.Vertices[mesh.Indices[3 * primitive + 2]].pos, t, barycentrics) && (TMin <= t) && (t < tMax);
+   });
+}
+
+
+void BenchmarkMesh(const char* name, const Mesh& mesh, Vulkan::JobSystem& jobSystem) {
+   const std::vector<Vulkan::Aabb> triangleBounds = SceneBvh::GetTriangleBounds(mesh.Vertices, mesh.Indices);
+   const uint32_t triangleCount = static_cast<uint32_t>(triangleBounds.size());
+
+   // build: single threaded and then on all threads
+   Vulkan::Bvh bvh;
+   const double singleThreadMilliseconds = Benchmark::BestMilliseconds([&] { bvh = Vulkan::Bvh {triangleBounds, nullptr}; });
+   const double multiThreadMilliseconds = Benchmark::BestMilliseconds([&] { bvh = Vulkan::Bvh {triangleBounds, &jobSystem}; });
+   const Vulkan::BvhStats& stats = bvh.GetStats();
+   LOG_INFO("BVH {0} ({1} triangles): build {2:.2f}ms on 1 thread, {3:.2f}ms on {4} threads ({5:.2f}x).  {6} nodes ({7} leaves), max depth {8}, SAH cost {9:.2f}", name, triangleCount, singleThreadMilliseconds, multiThreadMilliseconds, jobSystem.GetThreadCount(), singleThreadMilliseconds / multiThreadMilliseconds, stats.NodeCount, stats.LeafCount, stats.MaxDepth, stats.SahCost);
+
+   // queries, spread across all threads
+   const std::vector<Ray> rays = GenerateRays(bvh.GetBounds(), QueryRayCount);
+   std::vector<float> closestT(rays.size());
+   Benchmark::Clock::time_point start = Benchmark::Clock::now();
+   jobSystem.ParallelFor(0, QueryRayCount, 1024, [&] (const uint32_t begin, const uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+         closestT[i] = ClosestHit(mesh, bvh, rays[i]);
+      }
+   });
+   const double closestHitSeconds = Benchmark::MillisecondsSince(start) / 1000.0;
+
+   std::atomic<uint32_t> anyHitCount {0};
+   start = Benchmark::Clock::now();
+   jobSystem.ParallelFor(0, QueryRayCount, 1024, [&] (const uint32_t begin, const uint32_t end) {
+      uint32_t count = 0;
+      for (uint32_t i = begin; i < end; ++i) {
+         count += AnyHit(mesh, bvh, rays[i]) ? 1 : 0;
+      }
+      anyHitCount += count;
+   });
+   const double anyHitSeconds = Benchmark::MillisecondsSince(start) / 1000.0;
+
+   // brute force, over however many rays it takes to do a decent amount of work, and check that the answers agree
+   const uint32_t bruteForceRayCount = static_cast<uint32_t>(std::clamp<uint64_t>(BruteForceTriangleTests / std::max(triangleCount, 1u), 16, QueryRayCount));
+   std::atomic<uint32_t> mismatchCount {0};
+   start = Benchmark::Clock::now();
+   jobSystem.ParallelFor(0, bruteForceRayCount, 1, [&] (const uint32_t begin, const uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+         if (ClosestHitBruteForce(mesh, rays[i]) != closestT[i]) {
+            ++mismatchCount;
+         }
+      }
+   });
+   const double bruteForceSeconds = Benchmark::MillisecondsSince(start) / 1000.0;
+
+   const uint32_t hitCount = static_cast<uint32_t>(std::count_if(closestT.begin(), closestT.end(), [] (const float t) { return t < std::numeric_limits<float>::max(); }));
+   const double closestHitRate = QueryRayCount / closestHitSeconds;
+   const double bruteForceRate = bruteForceRayCount / bruteForceSeconds;
+   LOG_INFO("BVH {0}: {1} rays ({2:.1f}% hit).  Closest hit {3:.2f} million rays/s, any hit {4:.2f} million rays/s, brute force {5:.4f} million rays/s ({6:.0f}x slower)", name, QueryRayCount, 100.0 * hitCount / QueryRayCount, closestHitRate / 1e6, QueryRayCount / (anyHitSeconds * 1e6), bruteForceRate / 1e6, closestHitRate / bruteForceRate);
+   if (mismatchCount > 0) {
+      LOG_ERROR("BVH {0}: closest hit disagrees with brute force for {1} of {2} rays", name, mismatchCount.load(), bruteForceRayCount);
+   }
+   if (anyHitCount != hitCount) {
+      LOG_ERROR("BVH {0}: any hit found {1} hits, but closest hit found {2}", name, anyHitCount.load(), hitCount);
+   }
+}
+
+}
+
+
+void RunBvhBenchmarks(Vulkan::JobSystem& jobSystem) {
+   {
+      const Model wineGlass("Assets/Models/WineGlass.obj");
+      BenchmarkMesh("WineGlass.obj", {wineGlass.GetVertices(), wineGlass.GetIndices()}, jobSystem);
+   }
+   BenchmarkMesh("generated mesh", GenerateMesh(1'000'000), jobSystem);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "JobSystem.h"
+
+// Benchmarks for Vulkan::Bvh over triangle meshes: WineGlass.obj, and a generated mesh of a million triangles.
+// For each mesh, reports the build time (on one thread, and on all of jobSystem's threads), node count and SAH cost,
+// and closest hit and any hit query rates compared with brute force.  Results are logged.
+void RunBvhBenchmarks(Vulkan::JobSystem& jobSystem);
@@ -0,0 +1,898 @@
+#include "CpuPathTracer.h"
+
+#include "Box.h"
+#include "Sphere.h"
+
+#include <glm/gtc/noise.hpp>
+
+#include <stb_image.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+constexpr float Pi = 3.1415926535897932384626433832795f;
+constexpr float TMin = 0.001f;        // as per RayTrace.rgen
+constexpr float TMax = 10000.0f;
+constexpr uint32_t TileSize = 16;
+
+
+// Random.glsl
+// Note that GLSL evaluates function arguments left to right, whereas C++ does not define the order.  So where the
+// shaders construct a vector from several random numbers, the numbers are generated into locals first.
+
+uint32_t InitRandomSeed(const uint32_t val0, const uint32_t val1) {
+   uint32_t v0 = val0;
+   uint32_t v1 = val1;
+   uint32_t s0 = 0;
+   for (uint32_t n = 0; n < 16; n++) {
+      s0 += 0x9e3779b9;
+      v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+      v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+   }
+   return v0;
+}
+
+
+uint32_t RandomInt(uint32_t& seed) {
+   return (seed = 1664525 * seed + 1013904223);
+}
+
+
+float RandomFloat(uint32_t& seed) {
+   const uint32_t one = 0x3f800000;
+   const uint32_t msk = 0x007fffff;
+   return glm::uintBitsToFloat(one | (msk & (RandomInt(seed) >> 9))) - 1.0f;
+}
+
+
+float RandomFloat(const float minValue, const float maxValue, uint32_t& seed) {
+   return minValue + (maxValue - minValue) * RandomFloat(seed);
+}
+
+
+glm::vec3 RandomInUnitSphere(uint32_t& seed) {
+   glm::vec3 p;
+   do {
+      const float x = RandomFloat(seed);
+      const float y = RandomFloat(seed);
+      const float z = RandomFloat(seed);
+      p = 2.0f * glm::vec3 {x, y, z} - 1.0f;
+   } while (glm::dot(p, p) > 1.0f);
+   return p;
+}
+
+
+glm::vec3 RandomUnitVector(uint32_t& seed) {
+   const float a = RandomFloat(0.0f, 2.0f * Pi, seed);
+   const float z = RandomFloat(-1.0f, 1.0f, seed);
+   const float r = std::sqrt(1.0f - z * z);
+   return {r * std::cos(a), r * std::sin(a), z};
+}
+
+
+glm::mat3 GetOrthoNormalBasis(const glm::vec3& normal) {
+   glm::vec3 helper = {1.0f, 0.0f, 0.0f};
+   if (std::abs(normal.x) > 0.99f) {
+      helper = {0.0f, 0.0f, 1.0f};
+   }
+   const glm::vec3 tangent = glm::normalize(glm::cross(normal, helper));
+   const glm::vec3 binormal = glm::normalize(glm::cross(normal, tangent));
+   return glm::mat3 {tangent, binormal, normal};
+}
+
+
+glm::vec3 RandomOnUnitHemisphere(const glm::vec3& normal, const float alpha, uint32_t& seed) {
+   const float cosTheta = std::pow(RandomFloat(0.0f, 1.0f, seed), 1.0f / (alpha + 1.0f));
+   const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+   const float phi = RandomFloat(0.0f, 2.0f * Pi, seed);
+   return GetOrthoNormalBasis(normal) * glm::vec3 {std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta};
+}
+
+
+// Scatter.glsl
+
+float Schlick(const float cosine, const float refractiveIndex) {
+   float r0 = (1.0f - refractiveIndex) / (1.0f + refractiveIndex);
+   r0 = r0 * r0;
+   return r0 + (1.0f - r0) * std::pow((1.0f - cosine), 5.0f);
+}
+
+
+float Turbulence(const glm::vec3& p, const int depth) {
+   float accum = 0.0f;
+   glm::vec3 temp_p = p;
+   float weight = 1.0f;
+   for (int i = 0; i < depth; ++i) {
+      accum += weight * glm::simplex(temp_p);   // glm's simplex noise is the same (Ashima Arts) algorithm as SNoise.glsl
+      weight *= 0.5f;
+      temp_p *= 2.0f;
+   }
+   return std::abs(accum);
+}
+
+
+// EnvironmentMap.glsl
+float PowerHeuristic(const float pdf, const float otherPdf) {
+   return (pdf * pdf) / (pdf * pdf + otherPdf * otherPdf);
+}
+
+
+// LightSampling.glsl
+
+float CosSubClamped(const float cosA, const float cosB) {
+   if (cosA >= cosB) {
+      return 1.0f;
+   }
+   return cosA * cosB + std::sqrt(std::max(0.0f, 1.0f - cosA * cosA)) * std::sqrt(std::max(0.0f, 1.0f - cosB * cosB));
+}
+
+
+float LightNodeImportance(const LightNode& node, const glm::vec3& point) {
+   const glm::vec3 diagonal = node.boundsMax - node.boundsMin;
+   const glm::vec3 toPoint = point - 0.5f * (node.boundsMin + node.boundsMax);
+   const float radiusSquared = 0.25f * glm::dot(diagonal, diagonal);
+   const float distanceSquared = glm::dot(toPoint, toPoint);
+   if (distanceSquared <= radiusSquared) {
+      return node.power / std::max(radiusSquared, 1e-12f);
+   }
+
+   float cosTheta = glm::dot(node.axis, toPoint / std::sqrt(distanceSquared));
+   if (node.twoSided != 0) {
+      cosTheta = std::abs(cosTheta);
+   }
+   const float cosThetaB = std::sqrt(1.0f - radiusSquared / distanceSquared);
+   const float cosThetaP = CosSubClamped(CosSubClamped(cosTheta, node.cosThetaO), cosThetaB);
+   if (cosThetaP <= node.cosThetaE) {
+      return 0.0f;
+   }
+   return node.power * cosThetaP / distanceSquared;
+}
+
+
+float LightChildProbability(const std::vector<LightNode>& tree, const uint32_t child, const glm::vec3& point) {
+   const uint32_t first = ((child & 1) != 0) ? child : child - 1;
+   const float importance0 = LightNodeImportance(tree[first], point);
+   const float importance1 = LightNodeImportance(tree[first + 1], point);
+   const float sum = importance0 + importance1;
+   if (!(sum > 0.0f)) {
+      return 0.0f;
+   }
+   const float p0 = importance0 / sum;
+   return (child == first) ? p0 : 1.0f - p0;
+}
+
+
+uint32_t SampleLightIndex(const std::vector<LightNode>& tree, const glm::vec3& point, uint32_t& randomSeed, float& pdf) {
+   float u = RandomFloat(randomSeed);
+   uint32_t node = 0;
+   pdf = 1.0f;
+   while ((tree[node].childOrLight & LIGHTNODE_LEAF) == 0) {
+      const uint32_t child = tree[node].childOrLight;
+      const float importance0 = LightNodeImportance(tree[child], point);
+      const float importance1 = LightNodeImportance(tree[child + 1], point);
+      const float sum = importance0 + importance1;
+      if (!(sum > 0.0f)) {
+         pdf = 0.0f;
+         return LIGHT_NONE;
+      }
+      const float p0 = importance0 / sum;
+      if (u < p0) {
+         node = child;
+         u = u / p0;
+         pdf *= p0;
+      } else {
+         node = child + 1;
+         u = std::min((u - p0) / (1.0f - p0), 0.99999994f);
+         pdf *= 1.0f - p0;
+      }
+   }
+   return tree[node].childOrLight & ~LIGHTNODE_LEAF;
+}
+
+
+float LightSelectionPdf(const std::vector<LightSource>& lights, const std::vector<LightNode>& tree, const uint32_t lightIndex, const glm::vec3& point) {
+   float pdf = 1.0f;
+   for (uint32_t node = lights[lightIndex].node; node != 0; node = tree[node].parent) {
+      pdf *= LightChildProbability(tree, node, point);
+   }
+   return pdf;
+}
+
+
+// Not in the shaders: for comparison (see CpuPathTracer::LightSampling::Power)
+uint32_t SampleLightIndex(const std::vector<AliasEntry>& table, uint32_t& randomSeed) {
+   const uint32_t count = static_cast<uint32_t>(table.size());
+   const uint32_t i = std::min(static_cast<uint32_t>(RandomFloat(randomSeed) * static_cast<float>(count)), count - 1);
+   const AliasEntry& entry = table[i];
+   return (RandomFloat(randomSeed) < entry.probability) ? i : entry.alias;
+}
+
+
+glm::vec3 SampleLightPoint(const LightSource& light, const glm::vec3& origin, uint32_t& randomSeed) {
+   if (light.type == LIGHT_SPHERE) {
+      return light.position + light.edge1.x * RandomOnUnitHemisphere(glm::normalize(origin - light.position), 0.0f, randomSeed);
+   }
+   const float u = RandomFloat(randomSeed);
+   const float v = RandomFloat(randomSeed);
+   if (light.type == LIGHT_TRIANGLE) {
+      const float su = std::sqrt(u);
+      return light.position + su * (v * light.edge1 + (1.0f - v) * light.edge2);
+   }
+   return light.position + u * light.edge1 + v * light.edge2;
+}
+
+
+float LightSamplingArea(const LightSource& light) {
+   return (light.type == LIGHT_SPHERE) ? 0.5f * light.area : light.area;
+}
+
+
+float LightCosine(const LightSource& light, const glm::vec3& point, const glm::vec3& toViewer) {
+   if (light.type == LIGHT_SPHERE) {
+      return glm::dot(glm::normalize(point - light.position), toViewer);
+   }
+   const float cosine = glm::dot(glm::normalize(glm::cross(light.edge1, light.edge2)), toViewer);
+   return (light.type == LIGHT_TRIANGLE) ? std::abs(cosine) : cosine;
+}
+
+
+glm::vec3 LightRadiance(const LightSource& light, const float cosine) {
+   return (light.focus > 0.0f) ? std::pow(cosine, light.focus) * light.radiance : light.radiance;
+}
+
+
+RayPayload ScatterMetallic(const glm::vec3& normal, const glm::vec3& color, const float roughness, const glm::vec3& direction, const float hitT, uint32_t& randomSeed) {
+   const glm::vec3 scatterDirection = glm::normalize(glm::reflect(direction, normal) + roughness * RandomInUnitSphere(randomSeed));
+   return {glm::vec4 {color, hitT}, glm::vec4 {0.0f}, glm::vec4 {scatterDirection, 1.0f}, randomSeed};
+}
+
+
+// Sphere.rint and Box.rint.  tMax is the closest hit so far (gl_RayTmaxNV)
+
+uint32_t SmokeRandomSeed(const glm::vec3& worldOrigin, const uint32_t x, const uint32_t y, const uint32_t frame) {
+   // uint(float) of a negative value is undefined in GLSL.  Go via int, which is what GPUs generally do.
+   auto toUint = [] (const float f) { return static_cast<uint32_t>(static_cast<int32_t>(f)); };
+   return InitRandomSeed(InitRandomSeed(InitRandomSeed(InitRandomSeed(InitRandomSeed(x, y), toUint(worldOrigin.x)), toUint(worldOrigin.y)), toUint(worldOrigin.z)), frame);
+}
+
+
+bool IntersectProcedural(const Material& material, const float t1, const float t2, const float tMax, const glm::vec3& worldOrigin, const uint32_t x, const uint32_t y, const uint32_t frame, float& t) {
+   if (material.type == MATERIAL_SMOKE) {
+      uint32_t seed = SmokeRandomSeed(worldOrigin, x, y, frame);
+      const float hitDistance = std::max(t1, TMin) + material.materialParameter1 * std::log(RandomFloat(seed));
+      if ((hitDistance <= t2) && (t2 < tMax)) {
+         t = hitDistance;
+         return true;
+      }
+   } else if ((TMin <= t1 && t1 < tMax) || (TMin <= t2 && t2 < tMax)) {
+      t = (TMin <= t1 && t1 < tMax) ? t1 : t2;
+      return true;
+   }
+   return false;
+}
+
+
+bool IntersectSphere(const Material& material, const glm::vec3& origin, const glm::vec3& direction, const float tMax, const glm::vec3& worldOrigin, const uint32_t x, const uint32_t y, const uint32_t frame, float& t) {
+   const glm::vec3 oc = origin;
+   const float a = glm::dot(direction, direction);
+   const float b = glm::dot(oc, direction);
+   const float c = glm::dot(oc, oc) - 1.0f;
+   const float discriminant = b * b - a * c;
+   if (discriminant < 0.0f) {
+      return false;
+   }
+   const float t1 = (-b - std::sqrt(discriminant)) / a;
+   const float t2 = (-b + std::sqrt(discriminant)) / a;
+   return IntersectProcedural(material, t1, t2, tMax, worldOrigin, x, y, frame, t);
+}
+
+
+void ReportBoxHit(const float t, float& t1, float& t2, uint32_t& hitSide, const uint32_t side) {
+   if (t < t1) {
+      if (t1 < t2) {
+         t2 = t1;
+      }
+      t1 = t;
+      hitSide = side;
+   }
+   if ((t < t2) && (t > t1)) {
+      t2 = t;
+   }
+}
+
+
+void IntersectBoxSide(const glm::vec3& origin, const glm::vec3& direction, const int axis, const float k, const float tMax, float& t1, float& t2, uint32_t& hitSide, const uint32_t side) {
+   const float t = (k - origin[axis]) / direction[axis];
+   if (t < tMax) {
+      const glm::vec3 p = origin + t * direction;
+      const int u = (axis == 0) ? 1 : 0;
+      const int v = (axis == 2) ? 1 : 2;
+      if ((p[u] >= -0.5f) && (p[u] < 0.5f) && (p[v] >= -0.5f) && (p[v] < 0.5f)) {
+         ReportBoxHit(t, t1, t2, hitSide, side);
+      }
+   }
+}
+
+
+bool IntersectBox(const Material& material, const glm::vec3& origin, const glm::vec3& direction, const float tMax, const glm::vec3& worldOrigin, const uint32_t x, const uint32_t y, const uint32_t frame, float& t, uint32_t& hitSide) {
+   const float k = 0.5f;
+   float t1 = tMax;
+   float t2 = tMax;
+   hitSide = 0;
+   IntersectBoxSide(origin, direction, 2, -k, tMax, t1, t2, hitSide, 0);
+   IntersectBoxSide(origin, direction, 2, k, tMax, t1, t2, hitSide, 1);
+   IntersectBoxSide(origin, direction, 1, -k, tMax, t1, t2, hitSide, 2);
+   IntersectBoxSide(origin, direction, 1, k, tMax, t1, t2, hitSide, 3);
+   IntersectBoxSide(origin, direction, 0, -k, tMax, t1, t2, hitSide, 4);
+   IntersectBoxSide(origin, direction, 0, k, tMax, t1, t2, hitSide, 5);
+   return IntersectProcedural(material, t1, t2, tMax, worldOrigin, x, y, frame, t);
+}
+
+}
+
+
+CpuPathTracer::CpuPathTracer(const Scene& scene, Vulkan::JobSystem& jobSystem)
+: m_Scene(scene)
+, m_JobSystem(jobSystem)
+, m_Bvh(scene, &jobSystem)
+, m_Lights(ExtractLights(scene))
+{
+   const auto& models = m_Scene.GetModels();
+   m_Instances.reserve(m_Scene.GetInstances().size());
+   for (const auto& instance : m_Scene.GetInstances()) {
+      InstanceData& data = m_Instances.emplace_back();
+      data.InstanceModel = models.at(instance.GetModelIndex()).get();
+      data.ModelIndex = instance.GetModelIndex();
+      if (data.InstanceModel->IsProcedural()) {
+         data.Type = dynamic_cast<const Sphere*>(data.InstanceModel) ? GeometryType::Sphere : GeometryType::Box;
+      }
+
+      // instance transforms are the first three rows of the object to world matrix
+      data.ObjectToWorld = glm::transpose(glm::mat4 {instance.GetTransform()});
+      data.WorldToObject = glm::inverse(data.ObjectToWorld);
+      data.InstanceMaterial = m_Scene.GetMaterials()[instance.GetMaterialIndex()];
+   }
+
+   // as per RayTracer::CreateTextureResources(): RGBA, decoded in parallel
+   const auto& textureFileNames = m_Scene.GetTextureFileNames();
+   m_Textures.resize(textureFileNames.size());
+   m_JobSystem.ParallelFor(0, static_cast<uint32_t>(textureFileNames.size()), 1, [this, &textureFileNames] (const uint32_t begin, const uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+         TextureData& texture = m_Textures[i];
+         int texChannels;
+         stbi_uc* pixels = stbi_load(textureFileNames[i].c_str(), &texture.Width, &texture.Height, &texChannels, STBI_rgb_alpha);
+         if (!pixels) {
+            throw std::runtime_error("failed to load texture '" + textureFileNames[i] + "'");
+         }
+         texture.Pixels.assign(pixels, pixels + static_cast<size_t>(texture.Width) * texture.Height * 4);
+         stbi_image_free(pixels);
+      }
+   });
+
+   if (!m_Scene.GetEnvironmentMapFileName().empty()) {
+      m_EnvironmentMap = std::make_unique<EnvironmentMap>(m_Scene.GetEnvironmentMapFileName(), &m_JobSystem);
+   }
+}
+
+
+std::vector<glm::vec3> CpuPathTracer::Render(const Settings& settings) {
+   std::vector<glm::vec3> pixels(static_cast<size_t>(settings.Width) * settings.Height);
+   const uint32_t tileCountX = (settings.Width + TileSize - 1) / TileSize;
+   const uint32_t tileCountY = (settings.Height + TileSize - 1) / TileSize;
+   std::atomic<uint64_t> rayCount {0};
+
+   const auto startTime = std::chrono::steady_clock::now();
+   m_JobSystem.ParallelFor(0, tileCountX * tileCountY, 1, [this, &settings, &pixels, &rayCount, tileCountX] (const uint32_t begin, const uint32_t end) {
+      uint64_t tileRayCount = 0;
+      for (uint32_t tile = begin; tile < end; ++tile) {
+         const uint32_t x0 = (tile % tileCountX) * TileSize;
+         const uint32_t y0 = (tile / tileCountX) * TileSize;
+         const uint32_t x1 = std::min(x0 + TileSize, settings.Width);
+         const uint32_t y1 = std::min(y0 + TileSize, settings.Height);
+         for (uint32_t y = y0; y < y1; ++y) {
+            for (uint32_t x = x0; x < x1; ++x) {
+               // GPU accumulated frame count starts at 1
+               glm::vec3 color = {};
+               for (uint32_t frame = settings.FirstSample + 1; frame <= settings.FirstSample + settings.SampleCount; ++frame) {
+                  color += RayGen(x, y, frame, settings, tileRayCount);
+               }
+               pixels[static_cast<size_t>(y) * settings.Width + x] = color / static_cast<float>(settings.SampleCount);
+            }
+         }
+      }
+      rayCount += tileRayCount;
+   });
+
+   m_Stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+   m_Stats.RayCount = rayCount;
+   return pixels;
+}
+
+
+void CpuPathTracer::WriteImage(const std::filesystem::path& fileName, const uint32_t width, const uint32_t height, const std::vector<glm::vec3>& pixels) {
+   int result = 0;
+   if (fileName.extension() == ".hdr") {
+      result = stbi_write_hdr(fileName.string().c_str(), width, height, 3, &pixels.front().x);
+   } else {
+      const float gamma = 1.0f / 2.2f;
+      std::vector<uint8_t> bytes;
+      bytes.reserve(pixels.size() * 3);
+      for (const auto& pixel : pixels) {
+         for (int i = 0; i < 3; ++i) {
+            bytes.push_back(static_cast<uint8_t>(std::clamp(std::pow(pixel[i], gamma), 0.0f, 1.0f) * 255.0f + 0.5f));
+         }
+      }
+      result = stbi_write_png(fileName.string().c_str(), width, height, 3, bytes.data(), width * 3);
+   }
+   if (!result) {
+      throw std::runtime_error("failed to write image '" + fileName.string() + "'");
+   }
+}
+
+
+// RayTrace.rgen, for one pixel and frame.  Returns the frame's color for the pixel.
+glm::vec3 CpuPathTracer::RayGen(const uint32_t x, const uint32_t y, const uint32_t frame, const Settings& settings, uint64_t& rayCount) const {
+   const PixelSample sample = {x, y, frame, settings.Sampling, settings.Lights};
+   uint32_t randomSeed = InitRandomSeed(InitRandomSeed(x, y), frame);
+
+   const float jitterX = RandomFloat(randomSeed);
+   const float jitterY = RandomFloat(randomSeed);
+   const glm::vec2 uv = (glm::vec2 {x, y} + glm::vec2 {jitterX, jitterY}) / glm::vec2 {settings.Width, settings.Height} * 2.0f - 1.0f;
+
+   glm::vec3 origin = settings.ViewInverse * glm::vec4 {0.0f, 0.0f, 0.0f, 1.0f};
+   const glm::vec4 target = settings.ProjectionInverse * glm::vec4 {uv, 1.0f, 1.0f};
+   glm::vec3 direction = glm::normalize(settings.ViewInverse * glm::vec4 {glm::vec3 {target}, 0.0f});
+
+   glm::vec3 rayColor = {};
+   glm::vec3 attenuation = glm::vec3 {1.0f};
+   float scatterPdf = 0.0f;   // the payload's emission.w, as left by the previous hit
+
+   for (uint32_t b = 0; b <= settings.MaxRayBounces; ++b) {
+      const RayPayload ray = Trace(origin, direction, sample, randomSeed, scatterPdf);
+      randomSeed = ray.randomSeed;
+      scatterPdf = ray.emission.w;
+      ++rayCount;
+
+      const float t = ray.attenuationAndDistance.w;
+
+      rayColor += attenuation * glm::vec3 {ray.emission};
+
+      if (t < 0.0f) {
+         break;
+      }
+
+      const bool isScattered = ray.scatterDirection.w > 0.0f;
+      if (!isScattered) {
+         break;
+      }
+
+      attenuation *= glm::vec3 {ray.attenuationAndDistance};
+
+      // Russian roulette ray termination
+      if (b > settings.MinRayBounces) {
+         const float p = std::max({attenuation.r, attenuation.g, attenuation.b});
+         if (RandomFloat(randomSeed) > p) {
+            break;
+         }
+         attenuation *= 1.0f / p;
+      }
+
+      origin = origin + t * direction;
+      direction = ray.scatterDirection;
+   }
+   return rayColor;
+}
+
+
+// traceNV(): closest hit or miss
+RayPayload CpuPathTracer::Trace(const glm::vec3& origin, const glm::vec3& direction, const PixelSample& sample, const uint32_t randomSeed, const float scatterPdf) const {
+   const Hit hit = Intersect(origin, direction, TMax, sample);
+   if (hit.T < 0.0f) {
+      return Miss(direction, sample, randomSeed, scatterPdf);
+   }
+   return ClosestHit(hit, origin, direction, sample, randomSeed, scatterPdf);
+}
+
+
+CpuPathTracer::Hit CpuPathTracer::Intersect(const glm::vec3& origin, const glm::vec3& direction, const float rayTMax, const PixelSample& sample) const {
+   Hit closestHit;
+   float tMax = rayTMax;
+   m_Bvh.GetInstanceBvh().ClosestHit(origin, direction, TMin, tMax, [&] (const uint32_t instanceIndex, float& tMax) {
+      const InstanceData& instance = m_Instances[instanceIndex];
+
+      // gl_ObjectRayOriginNV, gl_ObjectRayDirectionNV.  Direction is not normalized, so t is the same in object and world space
+      const glm::vec3 objectOrigin = instance.WorldToObject * glm::vec4 {origin, 1.0f};
+      const glm::vec3 objectDirection = instance.WorldToObject * glm::vec4 {direction, 0.0f};
+
+      float t;
+      switch (instance.Type) {
+         case GeometryType::Triangles: {
+            const auto& vertices = instance.InstanceModel->GetVertices();
+            const auto& indices = instance.InstanceModel->GetIndices();
+            return m_Bvh.GetModelBvh(instance.ModelIndex).ClosestHit(objectOrigin, objectDirection, TMin, tMax, [&] (const uint32_t primitive, float& tMax) {
+               glm::vec2 barycentrics;
+               if (
+                  SceneBvh::IntersectTriangle(objectOrigin, objectDirection, vertices[indices[3 * primitive + 0]].pos, vertices[indices[3 * primitive + 1]].pos, vertices[indices[3 * primitive + 2]].pos, t, barycentrics) &&
+                  (TMin <= t) && (t < tMax)
+               ) {
+                  tMax = t;
+                  closestHit = {t, instanceIndex, primitive, 0, barycentrics};
+                  return true;
+               }
+               return false;
+            });
+         }
+         case GeometryType::Sphere: {
+            if (IntersectSphere(instance.InstanceMaterial, objectOrigin, objectDirection, tMax, origin, sample.X, sample.Y, sample.Frame, t)) {
+               tMax = t;
+               closestHit = {t, instanceIndex, 0, 0};
+               return true;
+            }
+            return false;
+         }
+         case GeometryType::Box: {
+            uint32_t hitSide;
+            if (IntersectBox(instance.InstanceMaterial, objectOrigin, objectDirection, tMax, origin, sample.X, sample.Y, sample.Frame, t, hitSide)) {
+               tMax = t;
+               closestHit = {t, instanceIndex, 0, hitSide};
+               return true;
+            }
+            return false;
+         }
+      }
+      return false;
+   });
+   return closestHit;
+}
+
+
+// RayTrace.rmiss
+RayPayload CpuPathTracer::Miss(const glm::vec3& direction, const PixelSample& sample, const uint32_t randomSeed, const float scatterPdf) const {
+   if (m_EnvironmentMap) {
+      const float weight = ((scatterPdf > 0.0f) && (sample.Sampling != EnvironmentSampling::None)) ? PowerHeuristic(scatterPdf, EnvironmentLightPdf(direction, sample.Sampling)) : 1.0f;
+      return {glm::vec4 {glm::vec3 {1.0f}, -1.0f}, glm::vec4 {weight * m_EnvironmentMap->Radiance(direction), 0.0f}, glm::vec4 {0.0f}, randomSeed};
+   }
+   const float t = std::clamp(glm::normalize(direction).y, 0.0f, 1.0f);
+   return {
+      glm::vec4 {glm::vec3 {1.0f}, -1.0f},
+      glm::vec4 {glm::mix(m_Scene.GetHorizonColor(), m_Scene.GetZenithColor(), t), 0.0f},
+      glm::vec4 {0.0f},
+      randomSeed
+   };
+}
+
+
+// Triangles.rchit, Sphere.rchit, box.rchit
+RayPayload CpuPathTracer::ClosestHit(const Hit& hit, const glm::vec3& origin, const glm::vec3& direction, const PixelSample& sample, const uint32_t randomSeed, const float scatterPdf) const {
+   const InstanceData& instance = m_Instances[hit.InstanceIndex];
+   const glm::vec3 objectOrigin = instance.WorldToObject * glm::vec4 {origin, 1.0f};
+   const glm::vec3 objectDirection = instance.WorldToObject * glm::vec4 {direction, 0.0f};
+
+   glm::vec3 hitPoint;
+   glm::vec3 normal;
+   glm::vec2 texCoord = {};
+   float normalSign = 1.0f;
+   switch (instance.Type) {
+      case GeometryType::Triangles: {
+         const auto& vertices = instance.InstanceModel->GetVertices();
+         const auto& indices = instance.InstanceModel->GetIndices();
+         const Vertex& v0 = vertices[indices[3 * hit.PrimitiveIndex + 0]];
+         const Vertex& v1 = vertices[indices[3 * hit.PrimitiveIndex + 1]];
+         const Vertex& v2 = vertices[indices[3 * hit.PrimitiveIndex + 2]];
+         const glm::vec3 barycentric = {1.0f - hit.Barycentrics.x - hit.Barycentrics.y, hit.Barycentrics.x, hit.Barycentrics.y};
+         hitPoint = v0.pos * barycentric.x + v1.pos * barycentric.y + v2.pos * barycentric.z;
+         normal = glm::normalize(v0.normal * barycentric.x + v1.normal * barycentric.y + v2.normal * barycentric.z);
+         texCoord = v0.uv * barycentric.x + v1.uv * barycentric.y + v2.uv * barycentric.z;
+         normalSign = glm::sign(glm::dot(normal, -objectDirection));
+         break;
+      }
+      case GeometryType::Sphere: {
+         hitPoint = objectOrigin + hit.T * objectDirection;
+         normal = glm::normalize(hitPoint);
+         const float phi = std::atan2(hitPoint.x, hitPoint.z);
+         const float theta = std::asin(hitPoint.y);
+         texCoord = {(phi + Pi) / (2.0f * Pi), 1.0f - (theta + Pi / 2.0f) / Pi};
+         break;
+      }
+      case GeometryType::Box: {
+         static const glm::vec3 normals[6] = {{0.0f, 0.0f, -1.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}};
+         hitPoint = objectOrigin + hit.T * objectDirection;
+         normal = normals[hit.HitKind];
+         switch (hit.HitKind) {
+            case 0:
+            case 1:
+               texCoord = {hitPoint.x, hitPoint.y};
+               break;
+            case 2:
+            case 3:
+               texCoord = {hitPoint.x, hitPoint.z};
+               break;
+            default:
+               texCoord = {hitPoint.y, hitPoint.z};
+               break;
+         }
+         break;
+      }
+   }
+
+   const glm::vec3 hitPointW = instance.ObjectToWorld * glm::vec4 {hitPoint, 1.0f};
+   const glm::vec3 normalW = glm::normalize(glm::vec3 {instance.ObjectToWorld * glm::vec4 {normal, 0.0f}}) * normalSign;
+
+   // a triangle's light is its instance's first plus gl_PrimitiveID, a box face's plus gl_HitKindNV (the other is 0)
+   const uint32_t firstLight = m_Lights.InstanceFirstLights[hit.InstanceIndex];
+   const uint32_t lightIndex = (firstLight == LIGHT_NONE) ? LIGHT_NONE : firstLight + hit.PrimitiveIndex + hit.HitKind;
+   return Scatter(hitPointW, normalW, texCoord, instance.InstanceMaterial, lightIndex, origin, direction, hit.T, sample, randomSeed, scatterPdf);
+}
+
+
+// Scatter.glsl
+// origin is the ray's (gl_WorldRayOriginNV), and lightIndex and scatterPdf are as per Scatter.glsl's Scatter()
+RayPayload CpuPathTracer::Scatter(const glm::vec3& hitPoint, const glm::vec3& normal, const glm::vec2& texCoord, const Material& material, const uint32_t lightIndex, const glm::vec3& origin, const glm::vec3& direction, const float hitT, const PixelSample& sample, uint32_t randomSeed, const float scatterPdf) const {
+   switch (material.type) {
+      case MATERIAL_LAMBERTIAN: {
+         return ScatterLambertian(hitPoint, normal, Color(hitPoint, normal, texCoord, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2), hitT, sample, randomSeed);
+      }
+
+      case MATERIAL_PHONG: {
+         const glm::vec3 specular = Color(hitPoint, normal, texCoord, material.specularTextureType, material.specularTextureParam1, material.specularTextureParam2);
+         const glm::vec3 diffuse = glm::min(1.0f - specular, Color(hitPoint, normal, texCoord, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2));
+
+         float specularChance = glm::dot(specular, glm::vec3 {1.0f / 3.0f});
+         float diffuseChance = glm::dot(diffuse, glm::vec3 {1.0f / 3.0f});
+         const float sum = specularChance + diffuseChance;
+         if (sum > 0.00001f) {
+            diffuseChance /= sum;
+            specularChance /= sum;
+         } else {
+            diffuseChance = 1.0f;
+            specularChance = 0.0f;
+         }
+
+         const float select = RandomFloat(randomSeed);
+         if (select < specularChance) {
+            const float alpha = std::pow(10000.0f, material.materialParameter1 * material.materialParameter1);
+            const glm::vec3 scatterDirection = RandomOnUnitHemisphere(glm::reflect(direction, normal), alpha, randomSeed);
+            const float f = (alpha + 2.0f) / (alpha + 1.0f);
+            return {glm::vec4 {specular / specularChance * std::clamp(glm::dot(normal, scatterDirection), 0.0f, 1.0f) * f, hitT}, glm::vec4 {0.0f}, glm::vec4 {scatterDirection, 1.0f}, randomSeed};
+         }
+         return ScatterLambertian(hitPoint, normal, diffuse / diffuseChance, hitT, sample, randomSeed);
+      }
+
+      case MATERIAL_METALLIC: {
+         return ScatterMetallic(normal, Color(hitPoint, normal, texCoord, material.specularTextureType, material.specularTextureParam1, material.specularTextureParam2), material.materialParameter1, direction, hitT, randomSeed);
+      }
+
+      case MATERIAL_DIELECTRIC: {
+         glm::vec3 outwardNormal;
+         float niOverNt;
+         float cosine;
+         if (glm::dot(direction, normal) > 0.0f) {
+            outwardNormal = -normal;
+            niOverNt = material.materialParameter1;
+            cosine = niOverNt * glm::dot(direction, normal);
+         } else {
+            outwardNormal = normal;
+            niOverNt = 1.0f / material.materialParameter1;
+            cosine = -glm::dot(direction, normal);
+         }
+         const glm::vec3 refracted = glm::refract(direction, outwardNormal, niOverNt);
+         const glm::vec4 attenuationAndDistance = {Color(hitPoint, normal, texCoord, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2), hitT};
+
+         const float reflectProbability = (glm::dot(refracted, refracted) > 0.0f) ? Schlick(cosine, material.materialParameter1) : 1.0f;
+         if (RandomFloat(randomSeed) < reflectProbability) {
+            return {attenuationAndDistance, glm::vec4 {0.0f}, glm::vec4 {glm::reflect(direction, normal), 1.0f}, randomSeed};
+         }
+         return {attenuationAndDistance, glm::vec4 {0.0f}, glm::vec4 {refracted, 1.0f}, randomSeed};
+      }
+
+      case MATERIAL_LIGHT: {
+         float emit = 1.0f;
+         if (material.materialParameter1 > 0.0f) {
+            emit = std::pow(std::max(0.0f, -glm::dot(direction, normal)), material.materialParameter1);
+         }
+         if ((sample.Lights != LightSampling::None) && (scatterPdf > 0.0f) && (lightIndex != LIGHT_NONE)) {
+            emit *= PowerHeuristic(scatterPdf, LightPdf(lightIndex, origin, hitPoint, sample.Lights));
+         }
+         const glm::vec3 color = Color(hitPoint, normal, texCoord, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2);
+         return {glm::vec4 {0.0f, 0.0f, 0.0f, hitT}, emit * glm::vec4 {color, 0.0f}, glm::vec4 {0.0f}, randomSeed};
+      }
+
+      case MATERIAL_SMOKE: {
+         const glm::vec4 attenuationAndDistance = {Color(hitPoint, normal, texCoord, material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2), hitT};
+         const glm::vec3 scatterDirection = RandomUnitVector(randomSeed);
+         return {attenuationAndDistance, glm::vec4 {0.0f}, glm::vec4 {scatterDirection, 1.0f}, randomSeed};
+      }
+   }
+
+   // unknown material: absorb
+   return {glm::vec4 {0.0f, 0.0f, 0.0f, hitT}, glm::vec4 {0.0f}, glm::vec4 {0.0f}, randomSeed};
+}
+
+
+RayPayload CpuPathTracer::ScatterLambertian(const glm::vec3& hitPoint, const glm::vec3& normal, const glm::vec3& color, const float hitT, const PixelSample& sample, uint32_t& randomSeed) const {
+   const bool samplesEnvironment = m_EnvironmentMap && (sample.Sampling != EnvironmentSampling::None);
+   const bool samplesLights = (sample.Lights != LightSampling::None) && !m_Lights.Lights.empty();
+   glm::vec4 emission = {};
+   if (samplesEnvironment) {
+      emission = glm::vec4 {SampleEnvironmentLight(hitPoint, normal, color, sample, randomSeed), 0.0f};
+   }
+   if (samplesLights) {
+      emission += glm::vec4 {SampleLight(hitPoint, normal, color, sample, randomSeed), 0.0f};
+   }
+   const glm::vec3 scatterDirection = RandomOnUnitHemisphere(normal, 1.0f, randomSeed);
+   if (samplesEnvironment || samplesLights) {
+      emission.w = std::max(glm::dot(normal, scatterDirection), 1e-6f) / Pi;   // cosine sampled
+   }
+   return {glm::vec4 {color, hitT}, emission, glm::vec4 {scatterDirection, 1.0f}, randomSeed};
+}
+
+
+// Scatter.glsl's SampleEnvironmentLight(), and Shadow.rmiss
+glm::vec3 CpuPathTracer::SampleEnvironmentLight(const glm::vec3& hitPoint, const glm::vec3& normal, const glm::vec3& color, const PixelSample& sample, uint32_t& randomSeed) const {
+   glm::vec4 directionAndPdf;
+   if (sample.Sampling == EnvironmentSampling::Uniform) {
+      directionAndPdf = {RandomUnitVector(randomSeed), 1.0f / (4.0f * Pi)};
+   } else {
+      directionAndPdf = m_EnvironmentMap->Sample([&randomSeed] { return RandomFloat(randomSeed); });
+   }
+   const glm::vec3 direction = directionAndPdf;
+   const float cosine = glm::dot(normal, direction);
+   const float lightPdf = directionAndPdf.w;
+
+   // lightPdf is zero if the environment map is black all over
+   if ((cosine <= 0.0f) || !(lightPdf > 0.0f)) {
+      return {};
+   }
+
+   // terminate on first hit: any hit at all (including smoke's) blocks the light
+   if (Intersect(hitPoint, direction, TMax, sample).T >= 0.0f) {
+      return {};
+   }
+
+   const float scatterPdf = cosine / Pi;
+   return (color / Pi) * cosine * m_EnvironmentMap->Radiance(direction) * PowerHeuristic(lightPdf, scatterPdf) / lightPdf;
+}
+
+
+// Solid angle pdf of SampleEnvironmentLight() choosing direction
+float CpuPathTracer::EnvironmentLightPdf(const glm::vec3& direction, const EnvironmentSampling sampling) const {
+   return (sampling == EnvironmentSampling::Uniform) ? 1.0f / (4.0f * Pi) : m_EnvironmentMap->Pdf(direction);
+}
+
+
+// Scatter.glsl's SampleLight(), and Shadow.rmiss
+glm::vec3 CpuPathTracer::SampleLight(const glm::vec3& hitPoint, const glm::vec3& normal, const glm::vec3& color, const PixelSample& sample, uint32_t& randomSeed) const {
+   uint32_t lightIndex;
+   float selectionPdf;
+   if (sample.Lights == LightSampling::Power) {
+      lightIndex = SampleLightIndex(m_Lights.Table, randomSeed);
+      selectionPdf = m_Lights.Table[lightIndex].pdf;
+   } else {
+      lightIndex = SampleLightIndex(m_Lights.Tree, hitPoint, randomSeed, selectionPdf);
+      if (lightIndex == LIGHT_NONE) {
+         return {};
+      }
+   }
+   const LightSource& light = m_Lights.Lights[lightIndex];
+   const glm::vec3 lightPoint = SampleLightPoint(light, hitPoint, randomSeed);
+   const glm::vec3 toLight = lightPoint - hitPoint;
+   const float distanceSquared = glm::dot(toLight, toLight);
+   const float distance = std::sqrt(distanceSquared);
+   const glm::vec3 direction = toLight / distance;
+   const float cosine = glm::dot(normal, direction);
+   const float lightCosine = LightCosine(light, lightPoint, -direction);
+   const float lightPdf = selectionPdf * distanceSquared / (lightCosine * LightSamplingArea(light));
+   if ((cosine <= 0.0f) || (lightCosine <= 0.0f) || !(lightPdf > 0.0f) || (Intersect(hitPoint, direction, 0.999f * distance, sample).T >= 0.0f)) {
+      return {};
+   }
+
+   const float scatterPdf = cosine / Pi;
+   return (color / Pi) * cosine * LightRadiance(light, lightCosine) * PowerHeuristic(lightPdf, scatterPdf) / lightPdf;
+}
+
+
+// Solid angle pdf of SampleLight() choosing point on light lightIndex from origin
+float CpuPathTracer::LightPdf(const uint32_t lightIndex, const glm::vec3& origin, const glm::vec3& point, const LightSampling sampling) const {
+   const LightSource& light = m_Lights.Lights[lightIndex];
+   if ((light.type == LIGHT_SPHERE) && (glm::dot(point - light.position, origin - light.position) <= 0.0f)) {
+      return 0.0f;
+   }
+   const glm::vec3 toOrigin = origin - point;
+   const float distanceSquared = glm::dot(toOrigin, toOrigin);
+   const float cosine = LightCosine(light, point, toOrigin / std::sqrt(distanceSquared));
+   if (cosine <= 0.0f) {
+      return 0.0f;
+   }
+   const float selectionPdf = (sampling == LightSampling::Power) ? m_Lights.Table[lightIndex].pdf : LightSelectionPdf(m_Lights.Lights, m_Lights.Tree, lightIndex, origin);
+   return selectionPdf * distanceSquared / (cosine * LightSamplingArea(light));
+}
+
+
+glm::vec3 CpuPathTracer::Color(const glm::vec3& hitPoint, const glm::vec3& normal, const glm::vec2& texCoord, const int textureType, const glm::vec4& textureParam1, const glm::vec4& textureParam2) const {
+   switch (textureType) {
+      case TEXTURE_FLATCOLOR: {
+         return textureParam1;
+      }
+
+      case TEXTURE_CHECKERBOARD: {
+         const glm::vec3 oddColor = textureParam1;
+         const glm::vec3 evenColor = textureParam2;
+         const float scale = textureParam1.w;
+         const float sineProduct = (std::sin(hitPoint.x * scale) >= 0.0f ? 1.0f : -1.0f) * (std::sin(hitPoint.y * scale) >= 0.0f ? 1.0f : -1.0f) * (std::sin(hitPoint.z * scale) >= 0.0f ? 1.0f : -1.0f);
+         return (sineProduct < 0.0f) ? oddColor : evenColor;
+      }
+
+      case TEXTURE_SIMPLEX3D: {
+         const glm::vec3 p = hitPoint * textureParam2.w;
+         return glm::mix(glm::vec3 {textureParam1}, glm::vec3 {glm::simplex(p)}, textureParam1.w);
+      }
+
+      case TEXTURE_TURBULENCE: {
+         const glm::vec3 p = hitPoint * textureParam2.w;
+         return glm::mix(glm::vec3 {textureParam1}, glm::vec3 {Turbulence(p, static_cast<int>(textureParam2.z))}, textureParam1.w);
+      }
+
+      case TEXTURE_MARBLE: {
+         const glm::vec3 p = hitPoint * textureParam2.w;
+         return glm::mix(glm::vec3 {textureParam1}, glm::vec3 {std::sin(p.z + 10.0f * Turbulence(p, static_cast<int>(textureParam2.z)))}, textureParam1.w);
+      }
+
+      case TEXTURE_NORMALS: {
+         return (glm::vec3 {1.0f} + normal) / 2.0f;
+      }
+
+      case TEXTURE_UV: {
+         return {texCoord, 0.0f};
+      }
+
+      case TEXTURE_RED: {
+         return {1.0f, 0.0f, 0.0f};
+      }
+
+      default: {
+         // image texture, indexed by textureType
+         if ((textureType >= 0) && (static_cast<size_t>(textureType) < m_Textures.size())) {
+            return SampleTexture(m_Textures[textureType], texCoord);
+         }
+         return {};
+      }
+   }
+}
+
+
+// As per RayTracer's texture sampler at LOD 0: bilinear filter, repeat address mode.  UNORM format, so no sRGB decode.
+// (the CPU reference does no texture LOD, and always decodes the source image, even if RayTracer uses a .ktx2 of it)
+glm::vec3 CpuPathTracer::SampleTexture(const TextureData& texture, const glm::vec2& texCoord) const {
+   if (texture.Pixels.empty() || !std::isfinite(texCoord.x) || !std::isfinite(texCoord.y)) {
+      return {};
+   }
+   const float x = (texCoord.x - std::floor(texCoord.x)) * texture.Width - 0.5f;
+   const float y = (texCoord.y - std::floor(texCoord.y)) * texture.Height - 0.5f;
+   const float x0 = std::floor(x);
+   const float y0 = std::floor(y);
+   const float fx = x - x0;
+   const float fy = y - y0;
+
+   auto texel = [&texture] (const int i, const int j) {
+      const int wrappedI = (i + texture.Width) % texture.Width;
+      const int wrappedJ = (j + texture.Height) % texture.Height;
+      const uint8_t* p = &texture.Pixels[(static_cast<size_t>(wrappedJ) * texture.Width + wrappedI) * 4];
+      return glm::vec3 {p[0], p[1], p[2]} / 255.0f;
+   };
+   const int i = static_cast<int>(x0);
+   const int j = static_cast<int>(y0);
+   return glm::mix(
+      glm::mix(texel(i, j), texel(i + 1, j), fx),
+      glm::mix(texel(i, j + 1), texel(i + 1, j + 1), fx),
+      fy
+   );
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "EnvironmentMap.h"
+#include "JobSystem.h"
+#include "LightList.h"
+#include "Scene.h"
+#include "SceneBvh.h"
+
+// vec4 and uint are declared by Material.h.  (The CPU reference does no texture LOD, so ignores RayPayload::rayCone)
+using vec2 = glm::vec2;
+#include "RayPayload.glsl"
+
+#include <glm/glm.hpp>
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+// Multithreaded CPU reference implementation of the ray tracing shaders.
+// Renders a Scene with the same semantics as RayTrace.rgen, RayTrace.rmiss, Shadow.rmiss, Scatter.glsl,
+// EnvironmentMap.glsl, LightSampling.glsl and the intersection and closest hit shaders (Triangles.rchit, Sphere.rint, Sphere.rchit, Box.rint,
+// box.rchit), using the same random number sequences.  This means a scene can be rendered (e.g. for reference images,
+// or regression checks) on a machine that has no ray tracing hardware.
+//
+// Each sample of a pixel corresponds to one accumulated frame of the GPU ray tracer.
+// Rays are intersected via a SceneBvh: a BVH over the instances, and then over the triangles of each instance's model.
+class CpuPathTracer {
+public:
+   // How Lambertian hits sample the scene's environment map (if it has one).  The shaders do Importance.  The others are
+   // for comparison.
+   enum class EnvironmentSampling {
+      None,          // not at all: only rays that scatter into the environment find it
+      Uniform,       // directions uniformly over the sphere, combined with the scattered rays by MIS
+      Importance     // directions from the environment map's alias table, combined with the scattered rays by MIS
+   };
+
+   // How Lambertian hits choose which of the scene's lights (see LightList.h) to sample.  The shaders do Tree.  The
+   // others are for comparison.
+   enum class LightSampling {
+      None,          // they do not sample lights at all: only rays that scatter onto a light find it
+      Power,         // in proportion to the lights' power, via the light list's alias table
+      Tree           // in proportion to the lights' estimated contribution to the hit, via the light tree (see LightTree.h)
+   };
+
+   struct Settings {
+      uint32_t Width = 800;
+      uint32_t Height = 600;
+      uint32_t SampleCount = 16;     // samples per pixel
+      uint32_t FirstSample = 0;      // samples are those of accumulated frames FirstSample + 1 to FirstSample + SampleCount
+      uint32_t MinRayBounces = 3;    // as per Scene (RayTracer passes the scene's)
+      uint32_t MaxRayBounces = 64;
+      glm::mat4 ViewInverse = glm::mat4 {1.0f};
+      glm::mat4 ProjectionInverse = glm::mat4 {1.0f};
+      EnvironmentSampling Sampling = EnvironmentSampling::Importance;
+      LightSampling Lights = LightSampling::Tree;
+   };
+
+   struct Stats {
+      double Seconds = 0.0;
+      uint64_t RayCount = 0;
+   };
+
+   // Builds the scene's BVHs and light list, and loads its textures and environment map.  scene and jobSystem must outlive this object
+   CpuPathTracer(const Scene& scene, Vulkan::JobSystem& jobSystem);
+   CpuPathTracer(const CpuPathTracer&) = delete;
+   CpuPathTracer(CpuPathTracer&&) = delete;
+
+   CpuPathTracer& operator=(const CpuPathTracer&) = delete;
+   CpuPathTracer& operator=(CpuPathTracer&&) = delete;
+
+   // Render the scene in tiles, spread across the job system's threads.
+   // Returns linear (i.e. not gamma corrected) RGB, Width x Height, top row first.
+   std::vector<glm::vec3> Render(const Settings& settings);
+
+   // Timing and ray count of the most recent Render()
+   const Stats& GetStats() const { return m_Stats; }
+
+   // Writes Radiance HDR (linear) if fileName has extension .hdr, otherwise PNG (gamma corrected, as per RayTrace.rgen)
+   static void WriteImage(const std::filesystem::path& fileName, const uint32_t width, const uint32_t height, const std::vector<glm::vec3>& pixels);
+
+private:
+   enum class GeometryType {
+      Triangles,
+      Sphere,
+      Box
+   };
+
+   struct InstanceData {
+      const Model* InstanceModel = nullptr;
+      uint32_t ModelIndex = 0;
+      GeometryType Type = GeometryType::Triangles;
+      glm::mat4 ObjectToWorld;
+      glm::mat4 WorldToObject;
+      Material InstanceMaterial;
+   };
+
+   struct TextureData {
+      int Width = 0;
+      int Height = 0;
+      std::vector<uint8_t> Pixels;    // RGBA
+   };
+
+   struct Hit {
+      float T = -1.0f;                // < 0 => miss
+      uint32_t InstanceIndex = 0;
+      uint32_t PrimitiveIndex = 0;
+      uint32_t HitKind = 0;
+      glm::vec2 Barycentrics = {};
+   };
+
+   // A sample of pixel (x, y) in accumulated frame "frame" (which is what the smoke's random numbers depend on)
+   struct PixelSample {
+      uint32_t X;
+      uint32_t Y;
+      uint32_t Frame;
+      EnvironmentSampling Sampling;
+      LightSampling Lights;
+   };
+
+   glm::vec3 RayGen(const uint32_t x, const uint32_t y, const uint32_t frame, const Settings& settings, uint64_t& rayCount) const;
+   RayPayload Trace(const glm::vec3& origin, const glm::vec3& direction, const PixelSample& sample, const uint32_t randomSeed, const float scatterPdf) const;
+   Hit Intersect(const glm::vec3& origin, const glm::vec3& direction, const float tMax, const PixelSample& sample) const;
+   RayPayload Miss(const glm::vec3& direction, const PixelSample& sample, const uint32_t randomSeed, const float scatterPdf) const;
+   RayPayload ClosestHit(const Hit& hit, const glm::vec3& origin, const glm::vec3& direction, const PixelSample& sample, const uint32_t randomSeed, const float scatterPdf) const;
+   RayPayload Scatter(const glm::vec3& hitPoint, const glm::vec3& normal, const glm::vec2& texCoord, const Material& material, const uint32_t lightIndex, const glm::vec3& origin, const glm::vec3& direction, const float hitT, const PixelSample& sample, uint32_t randomSeed, const float scatterPdf) const;
+   RayPayload ScatterLambertian(const glm::vec3& hitPoint, const glm::vec3& normal, const glm::vec3& color, const float hitT, const PixelSample& sample, uint32_t& randomSeed) const;
+   glm::vec3 SampleEnvironmentLight(const glm::vec3& hitPoint, const glm::vec3& normal, const glm::vec3& color, const PixelSample& sample, uint32_t& randomSeed) const;
+   float EnvironmentLightPdf(const glm::vec3& direction, const EnvironmentSampling sampling) const;
+   glm::vec3 SampleLight(const glm::vec3& hitPoint, const glm::vec3& normal, const glm::vec3& color, const PixelSample& sample, uint32_t& randomSeed) const;
+   float LightPdf(const uint32_t lightIndex, const glm::vec3& origin, const glm::vec3& point, const LightSampling sampling) const;
+   glm::vec3 Color(const glm::vec3& hitPoint, const glm::vec3& normal, const glm::vec2& texCoord, const int textureType, const glm::vec4& textureParam1, const glm::vec4& textureParam2) const;
+   glm::vec3 SampleTexture(const TextureData& texture, const glm::vec2& texCoord) const;
+
+private:
+   const Scene& m_Scene;
+   Vulkan::JobSystem& m_JobSystem;
+   SceneBvh m_Bvh;
+   std::vector<InstanceData> m_Instances;
+   std::vector<TextureData> m_Textures;
+   std::unique_ptr<EnvironmentMap> m_EnvironmentMap;   // nullptr => the scene has none
+   LightList m_Lights;
+   Stats m_Stats;
+};
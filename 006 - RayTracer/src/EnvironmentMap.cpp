@@ -0,0 +1,110 @@
+#include "EnvironmentMap.h"
+
+#include <stb_image.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr float Pi = 3.1415926535897932384626433832795f;
+
+
+// fn(begin, end) over rows [0, count), on the job system's threads if there is one
+template<typename Fn>
+void ForRows(Vulkan::JobSystem* pJobSystem, const uint32_t count, const Fn& fn) {
+   if (pJobSystem) {
+      pJobSystem->ParallelFor(0, count, 0, fn);
+   } else {
+      fn(0, count);
+   }
+}
+
+}
+
+
+EnvironmentMap::EnvironmentMap(const std::string& fileName, Vulkan::JobSystem* pJobSystem) {
+   int width;
+   int height;
+   int channels;
+   float* pixels = stbi_loadf(fileName.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+   if (!pixels) {
+      throw std::runtime_error("failed to load environment map '" + fileName + "': " + stbi_failure_reason());
+   }
+   m_Width = static_cast<uint32_t>(width);
+   m_Height = static_cast<uint32_t>(height);
+   m_Pixels.resize(static_cast<size_t>(m_Width) * m_Height);
+   std::memcpy(m_Pixels.data(), pixels, m_Pixels.size() * sizeof(glm::vec4));
+   stbi_image_free(pixels);
+   m_AliasTable = BuildAliasTable(m_Width, m_Height, m_Pixels, pJobSystem);
+}
+
+
+EnvironmentMap::EnvironmentMap(const uint32_t width, const uint32_t height, std::vector<glm::vec4> pixels, Vulkan::JobSystem* pJobSystem)
+: m_Width(width)
+, m_Height(height)
+, m_Pixels(std::move(pixels))
+{
+   if ((m_Width == 0) || (m_Height == 0) || (m_Pixels.size() != static_cast<size_t>(m_Width) * m_Height)) {
+      throw std::runtime_error("environment map pixels do not match its size");
+   }
+   m_AliasTable = BuildAliasTable(m_Width, m_Height, m_Pixels, pJobSystem);
+}
+
+
+std::vector<AliasEntry> EnvironmentMap::BuildAliasTable(const uint32_t width, const uint32_t height, const std::vector<glm::vec4>& pixels, Vulkan::JobSystem* pJobSystem) {
+   std::vector<float> weights(pixels.size());
+   std::vector<float> rowWeights(height);
+   ForRows(pJobSystem, height, [width, height, &pixels, &weights, &rowWeights] (const uint32_t begin, const uint32_t end) {
+      for (uint32_t y = begin; y < end; ++y) {
+         const float sinTheta = std::sin((static_cast<float>(y) + 0.5f) / static_cast<float>(height) * Pi);
+         double rowWeight = 0.0;
+         for (uint32_t x = 0; x < width; ++x) {
+            const glm::vec4& pixel = pixels[static_cast<size_t>(y) * width + x];
+            const float luminance = 0.2126f * pixel.r + 0.7152f * pixel.g + 0.0722f * pixel.b;
+            const float weight = std::isfinite(luminance) ? std::max(luminance, 0.0f) * sinTheta : 0.0f;
+            weights[static_cast<size_t>(y) * width + x] = weight;
+            rowWeight += weight;
+         }
+         rowWeights[y] = static_cast<float>(rowWeight);
+      }
+   });
+
+   std::vector<AliasEntry> table(height + static_cast<size_t>(width) * height);
+   std::vector<uint32_t> scratch;
+   BuildAliasEntries(rowWeights.data(), height, 1.0f, table.data(), scratch);
+
+   ForRows(pJobSystem, height, [width, height, &weights, &table] (const uint32_t begin, const uint32_t end) {
+      std::vector<uint32_t> scratch;
+      for (uint32_t y = begin; y < end; ++y) {
+         // the pixels' pdfs are relative to the whole image: the probability of the row, times that of the pixel in it
+         BuildAliasEntries(&weights[static_cast<size_t>(y) * width], width, table[y].pdf, &table[height + static_cast<size_t>(y) * width], scratch);
+      }
+   });
+   return table;
+}
+
+
+glm::ivec2 EnvironmentMap::Pixel(const glm::vec3& direction) const {
+   const glm::vec3 d = glm::normalize(direction);
+   const glm::vec2 uv = {0.5f + std::atan2(d.z, d.x) / (2.0f * Pi), std::acos(std::clamp(d.y, -1.0f, 1.0f)) / Pi};
+   return glm::clamp(glm::ivec2 {uv * glm::vec2 {m_Width, m_Height}}, glm::ivec2 {0}, glm::ivec2 {m_Width - 1, m_Height - 1});
+}
+
+
+float EnvironmentMap::SolidAnglePdf(const float pixelPdf, const float sinTheta) const {
+   return pixelPdf * static_cast<float>(m_Width) * static_cast<float>(m_Height) / (2.0f * Pi * Pi * std::max(sinTheta, 1e-6f));
+}
+
+
+glm::vec3 EnvironmentMap::Radiance(const glm::vec3& direction) const {
+   const glm::ivec2 pixel = Pixel(direction);
+   return m_Pixels[static_cast<size_t>(pixel.y) * m_Width + pixel.x];
+}
+
+
+float EnvironmentMap::Pdf(const glm::vec3& direction) const {
+   const glm::ivec2 pixel = Pixel(direction);
+   const float y = glm::normalize(direction).y;
+   return SolidAnglePdf(m_AliasTable[m_Height + static_cast<size_t>(pixel.y) * m_Width + pixel.x].pdf, std::sqrt(std::max(1.0f - y * y, 0.0f)));
+}
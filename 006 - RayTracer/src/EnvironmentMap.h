@@ -0,0 +1,90 @@
+#pragma once
+
+#include "AliasTable.h"
+#include "JobSystem.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// An equirectangular (latitude-longitude) HDR image that lights a scene from all around, together with a 2D alias
+// table for importance sampling it (i.e. choosing directions in proportion to how much light comes from them).
+//
+// Each pixel's weight is its luminance times sin(theta) of its centre (the solid angle that the pixel covers shrinks
+// towards the poles).  The alias table is a "marginal" table over the rows, by each row's total weight, followed by a
+// "conditional" table for each row, over the pixels of that row.  So a pixel is sampled by choosing a row and then a
+// pixel within it, two constant time lookups.  That is, the table is Height entries, then Height x Width entries (top
+// row first).  The marginal entries' pdfs are the probabilities of their rows, and the conditional entries' pdfs are
+// the probabilities of their pixels (not relative to their row).
+//
+// The rows are independent of each other, so are built in parallel.
+//
+// Radiance(), Pdf() and Sample() are the CPU versions of EnvironmentMap.glsl.
+class EnvironmentMap {
+public:
+   // Throws if the file cannot be decoded.  Radiance HDR (.hdr) files are linear.  Other formats that stb_image can
+   // decode are taken to be gamma 2.2 (and are not really high dynamic range).
+   // pJobSystem == nullptr => build the alias table on this thread only
+   EnvironmentMap(const std::string& fileName, Vulkan::JobSystem* pJobSystem);
+
+   // pixels are linear RGBA (alpha unused), width x height, top row first
+   EnvironmentMap(const uint32_t width, const uint32_t height, std::vector<glm::vec4> pixels, Vulkan::JobSystem* pJobSystem);
+
+   uint32_t GetWidth() const { return m_Width; }
+   uint32_t GetHeight() const { return m_Height; }
+   const std::vector<glm::vec4>& GetPixels() const { return m_Pixels; }
+   const std::vector<AliasEntry>& GetAliasTable() const { return m_AliasTable; }
+
+   static std::vector<AliasEntry> BuildAliasTable(const uint32_t width, const uint32_t height, const std::vector<glm::vec4>& pixels, Vulkan::JobSystem* pJobSystem);
+
+   glm::vec3 Radiance(const glm::vec3& direction) const;
+
+   // Solid angle pdf of Sample() returning direction
+   float Pdf(const glm::vec3& direction) const;
+
+   // Direction in proportion to radiance, with its solid angle pdf in w.
+   // randomFloat() returns uniform random numbers in [0, 1), and is called in the same order as the shader's RandomFloat()
+   template<typename RandomFloat>
+   glm::vec4 Sample(RandomFloat&& randomFloat) const;
+
+private:
+   glm::ivec2 Pixel(const glm::vec3& direction) const;
+   float SolidAnglePdf(const float pixelPdf, const float sinTheta) const;
+
+   template<typename RandomFloat>
+   uint32_t SampleAliasTable(const uint32_t first, const uint32_t count, RandomFloat& randomFloat) const;
+
+private:
+   uint32_t m_Width = 0;
+   uint32_t m_Height = 0;
+   std::vector<glm::vec4> m_Pixels;
+   std::vector<AliasEntry> m_AliasTable;
+};
+
+
+template<typename RandomFloat>
+uint32_t EnvironmentMap::SampleAliasTable(const uint32_t first, const uint32_t count, RandomFloat& randomFloat) const {
+   const uint32_t i = std::min(static_cast<uint32_t>(randomFloat() * static_cast<float>(count)), count - 1);
+   const AliasEntry& entry = m_AliasTable[first + i];
+   return (randomFloat() < entry.probability) ? i : entry.alias;
+}
+
+
+template<typename RandomFloat>
+glm::vec4 EnvironmentMap::Sample(RandomFloat&& randomFloat) const {
+   constexpr float pi = 3.1415926535897932384626433832795f;
+   const uint32_t row = SampleAliasTable(0, m_Height, randomFloat);
+   const uint32_t column = SampleAliasTable(m_Height + row * m_Width, m_Width, randomFloat);
+
+   const float u = (static_cast<float>(column) + randomFloat()) / static_cast<float>(m_Width);
+   const float v = (static_cast<float>(row) + randomFloat()) / static_cast<float>(m_Height);
+   const float phi = (u - 0.5f) * 2.0f * pi;
+   const float theta = v * pi;
+   const float sinTheta = std::sin(theta);
+   const glm::vec3 direction = {sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi)};
+   return {direction, SolidAnglePdf(m_AliasTable[m_Height + row * m_Width + column].pdf, sinTheta)};
+}
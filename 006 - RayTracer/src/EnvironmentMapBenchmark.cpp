@@ -0,0 +1,151 @@
+#include "EnvironmentMapBenchmark.h"
+
+#include "Benchmark.h"
+#include "CpuPathTracer.h"
+#include "EnvironmentMap.h"
+#include "Log.h"
+#include "Scene.h"
+#include "Sphere.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr float Pi = 3.1415926535897932384626433832795f;
+constexpr uint32_t ImageWidth = 160;                   // of the convergence renders
+constexpr uint32_t ImageHeight = 90;
+constexpr uint32_t ReferenceSampleCount = 4096;
+
+
+// Blue sky to a brighter horizon, dark grey ground, and a sun that is tiny (about 0.003% of the sphere) but gives most of
+// the light.  That is, the sort of environment that sampling only the BSDF converges slowly on.
+std::vector<glm::vec4> GenerateSky(Vulkan::JobSystem& jobSystem, const uint32_t width, const uint32_t height) {
+   const glm::vec3 sunDirection = glm::normalize(glm::vec3 {0.4f, 0.6f, -0.7f});
+   const float sunCosine = std::cos(0.6f * Pi / 180.0f);
+   std::vector<glm::vec4> pixels(static_cast<size_t>(width) * height);
+   jobSystem.ParallelFor(0, height, 0, [&] (const uint32_t begin, const uint32_t end) {
+      for (uint32_t y = begin; y < end; ++y) {
+         const float theta = (static_cast<float>(y) + 0.5f) / static_cast<float>(height) * Pi;
+         for (uint32_t x = 0; x < width; ++x) {
+            const float phi = ((static_cast<float>(x) + 0.5f) / static_cast<float>(width) - 0.5f) * 2.0f * Pi;
+            const glm::vec3 direction = {std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)};
+            glm::vec3 radiance = (direction.y > 0.0f) ? glm::mix(glm::vec3 {0.9f, 0.9f, 1.0f}, glm::vec3 {0.2f, 0.4f, 0.9f}, std::sqrt(direction.y)) : glm::vec3 {0.1f};
+            if (glm::dot(direction, sunDirection) > sunCosine) {
+               radiance = glm::vec3 {20000.0f, 18000.0f, 15000.0f};
+            }
+            pixels[static_cast<size_t>(y) * width + x] = glm::vec4 {radiance, 1.0f};
+         }
+      }
+   });
+   return pixels;
+}
+
+
+void BenchmarkAliasTableBuild(Vulkan::JobSystem& jobSystem, const uint32_t width, const uint32_t height, const std::vector<glm::vec4>& pixels) {
+   std::vector<AliasEntry> serial;
+   std::vector<AliasEntry> parallel;
+   const double serialMilliseconds = Benchmark::BestMilliseconds([&] { serial = EnvironmentMap::BuildAliasTable(width, height, pixels, nullptr); });
+   const double parallelMilliseconds = Benchmark::BestMilliseconds([&] { parallel = EnvironmentMap::BuildAliasTable(width, height, pixels, &jobSystem); });
+
+   LOG_INFO("Environment map alias table {0}x{1} ({2:.1f} MiB): 1 thread {3:.2f}ms, {4} threads {5:.2f}ms ({6:.1f}x)", width, height, serial.size() * sizeof(AliasEntry) / (1024.0 * 1024.0), serialMilliseconds, jobSystem.GetThreadCount(), parallelMilliseconds, serialMilliseconds / parallelMilliseconds);
+   if ((serial.size() != parallel.size()) || (std::memcmp(serial.data(), parallel.data(), serial.size() * sizeof(AliasEntry)) != 0)) {
+      LOG_ERROR("Environment map alias table {0}x{1}: parallel build differs from serial", width, height);
+   }
+}
+
+
+// A ground plane (a very large sphere) with a few spheres of Lambertian, Phong and metallic materials on it
+void CreateScene(Scene& scene, const std::filesystem::path& environmentMapFileName) {
+   SphereInstance::SetModelIndex(scene.AddModel(std::make_unique<Sphere>()));
+   scene.SetEnvironmentMapFileName(environmentMapFileName.string());
+   scene.AddInstance(SphereInstance({0.0f, -1000.0f, 0.0f}, 1000.0f, scene.AddMaterial(Lambertian(FlatColor({0.5f, 0.5f, 0.5f})))));
+   scene.AddInstance(SphereInstance({-2.2f, 1.0f, 0.0f}, 1.0f, scene.AddMaterial(Lambertian(FlatColor({0.8f, 0.3f, 0.2f})))));
+   scene.AddInstance(SphereInstance({0.0f, 1.0f, 0.0f}, 1.0f, scene.AddMaterial(Phong(FlatColor({0.2f, 0.6f, 0.3f}), 0.1f, 0.4f))));
+   scene.AddInstance(SphereInstance({2.2f, 1.0f, 0.0f}, 1.0f, scene.AddMaterial(Metallic(FlatColor({0.9f, 0.9f, 0.9f}), 0.2f))));
+}
+
+
+void BenchmarkConvergence(Vulkan::JobSystem& jobSystem, const std::filesystem::path& environmentMapFileName) {
+   Scene scene;
+   CreateScene(scene, environmentMapFileName);
+   CpuPathTracer pathTracer(scene, jobSystem);
+
+   CpuPathTracer::Settings settings;
+   settings.Width = ImageWidth;
+   settings.Height = ImageHeight;
+   settings.MinRayBounces = 3;
+   settings.MaxRayBounces = 16;
+   glm::mat4 projection = glm::perspective(glm::radians(40.0f), static_cast<float>(ImageWidth) / static_cast<float>(ImageHeight), 0.01f, 100.0f);
+   projection[1][1] *= -1;
+   settings.ViewInverse = glm::inverse(glm::lookAt(glm::vec3 {0.0f, 2.0f, 9.0f}, glm::vec3 {0.0f, 0.8f, 0.0f}, glm::vec3 {0.0f, 1.0f, 0.0f}));
+   settings.ProjectionInverse = glm::inverse(projection);
+
+   // all of the strategies converge to the same image, so the reference uses the best of them
+   settings.SampleCount = ReferenceSampleCount;
+   settings.FirstSample = Benchmark::ReferenceFirstSample;
+   settings.Sampling = CpuPathTracer::EnvironmentSampling::Importance;
+   const std::vector<glm::vec3> reference = pathTracer.Render(settings);
+   LOG_INFO("Environment map convergence: {0}x{1} reference image, {2} samples per pixel in {3:.1f}s", ImageWidth, ImageHeight, ReferenceSampleCount, pathTracer.GetStats().Seconds);
+
+   const struct {
+      CpuPathTracer::EnvironmentSampling Sampling;
+      const char* Name;
+   } strategies[] = {
+      {CpuPathTracer::EnvironmentSampling::None,       "BSDF only"},
+      {CpuPathTracer::EnvironmentSampling::Uniform,    "uniform + MIS"},
+      {CpuPathTracer::EnvironmentSampling::Importance, "alias table + MIS"}
+   };
+   for (const auto& strategy : strategies) {
+      settings.Sampling = strategy.Sampling;
+      settings.FirstSample = 0;
+      std::string results;
+      double seconds = 0.0;
+      for (const uint32_t sampleCount : {1u, 4u, 16u, 64u, 256u}) {
+         settings.SampleCount = sampleCount;
+         const std::vector<glm::vec3> image = pathTracer.Render(settings);
+         seconds = pathTracer.GetStats().Seconds;
+         char text[64];
+         std::snprintf(text, sizeof(text), "%s%u spp %.4f", results.empty() ? "" : ", ", sampleCount, Benchmark::Rmse(image, reference));
+         results += text;
+      }
+      LOG_INFO("Environment map convergence, {0}: RMSE {1}  (256 spp in {2:.2f}s)", strategy.Name, results, seconds);
+   }
+}
+
+}
+
+
+void RunEnvironmentMapBenchmarks(Vulkan::JobSystem& jobSystem, const std::filesystem::path& fileName) {
+   if (!fileName.empty()) {
+      const EnvironmentMap environmentMap(fileName.string(), nullptr);
+      BenchmarkAliasTableBuild(jobSystem, environmentMap.GetWidth(), environmentMap.GetHeight(), environmentMap.GetPixels());
+      BenchmarkConvergence(jobSystem, fileName);
+      return;
+   }
+
+   for (const uint32_t width : {1024u, 2048u, 4096u}) {
+      BenchmarkAliasTableBuild(jobSystem, width, width / 2, GenerateSky(jobSystem, width, width / 2));
+   }
+
+   // the convergence benchmark goes via a file, as scenes refer to their environment maps by file name
+   const std::filesystem::path directory = std::filesystem::temp_directory_path() / "EnvironmentMapBenchmark";
+   std::filesystem::create_directories(directory);
+   try {
+      constexpr uint32_t width = 1024;
+      constexpr uint32_t height = width / 2;
+      const std::vector<glm::vec4> sky = GenerateSky(jobSystem, width, height);
+      std::vector<glm::vec3> pixels(sky.begin(), sky.end());
+      const std::filesystem::path generatedFileName = directory / "Sky.hdr";
+      CpuPathTracer::WriteImage(generatedFileName, width, height, pixels);
+      BenchmarkConvergence(jobSystem, generatedFileName);
+   } catch (...) {
+      std::filesystem::remove_all(directory);
+      throw;
+   }
+   std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "JobSystem.h"
+
+#include <filesystem>
+
+// Benchmarks of environment map lighting (see EnvironmentMap.h):
+// - Building the alias table at several image sizes, on one thread and on all of jobSystem's threads.  The tables are
+//   checked to be identical.
+// - Convergence of the CPU reference (CpuPathTracer) on a small outdoor scene lit by the environment map: RMSE against a
+//   high sample count reference image, by samples per pixel, for each CpuPathTracer::EnvironmentSampling strategy.
+// fileName is the environment map (e.g. a .hdr).  If it is empty, then a generated sky (with a small, bright sun) is used,
+// which is deleted afterwards.  Results are logged.
+void RunEnvironmentMapBenchmarks(Vulkan::JobSystem& jobSystem, const std::filesystem::path& fileName);
@@ -1,9 +1,9 @@
 #include "Instance.h"
 
-Instance::Instance(const uint32_t modelIndex, const glm::mat3x4& transform, const Material& material)
+Instance::Instance(const uint32_t modelIndex, const glm::mat3x4& transform, const uint32_t materialIndex)
 : m_ModelIndex(modelIndex)
 , m_Transform(transform)
-, m_Material(material)
+, m_MaterialIndex(materialIndex)
 {}
 
 
@@ -17,6 +17,11 @@ const glm::mat3x4& Instance::GetTransform() const {
 }
 
 
-const Material& Instance::GetMaterial() const {
-   return m_Material;
+void Instance::SetTransform(const glm::mat3x4& transform) {
+   m_Transform = transform;
+}
+
+
+uint32_t Instance::GetMaterialIndex() const {
+   return m_MaterialIndex;
 }
@@ -1,19 +1,22 @@
 #pragma once
 
-#include "Material.h"
+#include <glm/glm.hpp>
+
+#include <cstdint>
 
 class Instance {
 public:
-   Instance(const uint32_t modelIndex, const glm::mat3x4& transform, const Material& material);
+   Instance(const uint32_t modelIndex, const glm::mat3x4& transform, const uint32_t materialIndex);
 
    uint32_t GetModelIndex() const;
 
    const glm::mat3x4& GetTransform() const;
+   void SetTransform(const glm::mat3x4& transform);
 
-   const Material& GetMaterial() const;
+   uint32_t GetMaterialIndex() const;   // index into the scene's materials (see Scene::AddMaterial())
 
 private:
    uint32_t m_ModelIndex;
    glm::mat3x4 m_Transform;
-   Material m_Material;
+   uint32_t m_MaterialIndex;
 };
@@ -0,0 +1,150 @@
+#include "Ktx2File.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+const uint8_t Ktx2Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// as per the KTX2 specification, in file order
+struct Ktx2Header {
+   uint8_t Identifier[12];
+   uint32_t VkFormat;
+   uint32_t TypeSize;
+   uint32_t PixelWidth;
+   uint32_t PixelHeight;
+   uint32_t PixelDepth;
+   uint32_t LayerCount;
+   uint32_t FaceCount;
+   uint32_t LevelCount;
+   uint32_t SupercompressionScheme;
+   uint32_t DfdByteOffset;
+   uint32_t DfdByteLength;
+   uint32_t KvdByteOffset;
+   uint32_t KvdByteLength;
+   uint64_t SgdByteOffset;
+   uint64_t SgdByteLength;
+};
+static_assert(sizeof(Ktx2Header) == 80, "Ktx2Header must match the KTX2 file layout");
+
+struct Ktx2Level {
+   uint64_t ByteOffset;
+   uint64_t ByteLength;
+   uint64_t UncompressedByteLength;
+};
+static_assert(sizeof(Ktx2Level) == 24, "Ktx2Level must match the KTX2 file layout");
+
+
+vk::Format UnormFormat(const vk::Format format) {
+   switch (format) {
+      case vk::Format::eBc7SrgbBlock:      return vk::Format::eBc7UnormBlock;
+      case vk::Format::eBc1RgbSrgbBlock:   return vk::Format::eBc1RgbUnormBlock;
+      case vk::Format::eBc1RgbaSrgbBlock:  return vk::Format::eBc1RgbaUnormBlock;
+      case vk::Format::eR8G8B8A8Srgb:      return vk::Format::eR8G8B8A8Unorm;
+      default:                             return format;
+   }
+}
+
+
+// size in bytes of a mip level of given dimensions
+uint64_t LevelSize(const vk::Format format, const uint32_t width, const uint32_t height) {
+   if (format == vk::Format::eR8G8B8A8Unorm) {
+      return static_cast<uint64_t>(width) * height * 4;
+   }
+   const uint64_t blockSize = (format == vk::Format::eBc7UnormBlock) ? 16 : 8;
+   return static_cast<uint64_t>((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+}
+
+
+Ktx2File::Ktx2File(const std::filesystem::path& fileName)
+: m_File(fileName)
+{
+   const auto error = [&fileName] (const std::string& message) {
+      return std::runtime_error("'" + fileName.string() + "' " + message);
+   };
+
+   const uint8_t* data = static_cast<const uint8_t*>(m_File.GetData());
+   const uint64_t fileSize = m_File.GetSize();
+
+   Ktx2Header header;
+   if (fileSize < sizeof(header)) {
+      throw error("is not a KTX2 file");
+   }
+   std::memcpy(&header, data, sizeof(header));
+   if (std::memcmp(header.Identifier, Ktx2Identifier, sizeof(Ktx2Identifier)) != 0) {
+      throw error("is not a KTX2 file");
+   }
+
+   const vk::Format format = static_cast<vk::Format>(header.VkFormat);
+   if (!IsSupportedFormat(format)) {
+      throw error("has unsupported format " + vk::to_string(format));
+   }
+   if ((header.PixelWidth == 0) || (header.PixelHeight == 0) || (header.PixelDepth > 1) || (header.LayerCount > 1) || (header.FaceCount != 1)) {
+      throw error("is not a single 2D image");
+   }
+   if (header.SupercompressionScheme != 0) {
+      throw error("is supercompressed");
+   }
+
+   m_Format = UnormFormat(format);
+   m_Width = header.PixelWidth;
+   m_Height = header.PixelHeight;
+
+   // levelCount 0 means "generate the mip levels at load time", which we do not do.
+   // There cannot be more levels than in a full mip chain (down to 1x1).
+   const uint32_t levelCount = std::max(header.LevelCount, 1u);
+   const uint32_t maxLevelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(m_Width, m_Height)))) + 1;
+   if (levelCount > maxLevelCount) {
+      throw error("has more mip levels than its size allows");
+   }
+   if (fileSize < sizeof(header) + levelCount * sizeof(Ktx2Level)) {
+      throw error("is truncated or corrupt");
+   }
+   std::vector<Ktx2Level> levels(levelCount);
+   std::memcpy(levels.data(), data + sizeof(header), levelCount * sizeof(Ktx2Level));
+
+   // levels are stored smallest first, each aligned for its format, so the data starts at the last level
+   uint64_t dataBegin = fileSize;
+   uint64_t dataEnd = 0;
+   for (uint32_t i = 0; i < levelCount; ++i) {
+      const Ktx2Level& level = levels[i];
+      const uint32_t width = std::max(m_Width >> i, 1u);
+      const uint32_t height = std::max(m_Height >> i, 1u);
+      if ((level.ByteLength != LevelSize(m_Format, width, height)) || (level.ByteOffset > fileSize) || (level.ByteLength > fileSize - level.ByteOffset)) {
+         throw error("is truncated or corrupt");
+      }
+      dataBegin = std::min(dataBegin, level.ByteOffset);
+      dataEnd = std::max(dataEnd, level.ByteOffset + level.ByteLength);
+   }
+
+   m_DataOffset = dataBegin;
+   m_DataSize = dataEnd - dataBegin;
+   m_LevelOffsets.reserve(levelCount);
+   for (const auto& level : levels) {
+      m_LevelOffsets.emplace_back(level.ByteOffset - dataBegin);
+   }
+}
+
+
+bool Ktx2File::IsSupportedFormat(const vk::Format format) {
+   switch (UnormFormat(format)) {
+      case vk::Format::eBc7UnormBlock:
+      case vk::Format::eBc1RgbUnormBlock:
+      case vk::Format::eBc1RgbaUnormBlock:
+      case vk::Format::eR8G8B8A8Unorm:
+         return true;
+      default:
+         return false;
+   }
+}
+
+
+const void* Ktx2File::GetData() const {
+   return static_cast<const uint8_t*>(m_File.GetData()) + m_DataOffset;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Read only view of a KTX2 texture container (see the Khronos KTX 2.0 specification).
+// Only what RayTracer needs is supported: a single 2D image (no array layers, cube faces or depth), with all of its mip
+// levels, in one of the formats IsSupportedFormat() accepts, and not supercompressed.
+// The level data is read in place from a memory mapping of the file.
+class Ktx2File {
+public:
+   // Throws if the file cannot be read, or is not a KTX2 file that we support
+   Ktx2File(const std::filesystem::path& fileName);
+
+   // BC7, BC1 and RGBA8.
+   // The sRGB variants are accepted but GetFormat() returns the UNORM equivalent, because the image textures loaded
+   // via stb are not sRGB decoded either.
+   static bool IsSupportedFormat(const vk::Format format);
+
+   vk::Format GetFormat() const { return m_Format; }
+   uint32_t GetWidth() const { return m_Width; }
+   uint32_t GetHeight() const { return m_Height; }
+   uint32_t GetMipLevels() const { return static_cast<uint32_t>(m_LevelOffsets.size()); }
+
+   // Offset of each mip level (0 is largest) from GetData()
+   const std::vector<vk::DeviceSize>& GetLevelOffsets() const { return m_LevelOffsets; }
+
+   // The level data: from the first level in the file, up to the end of the last
+   const void* GetData() const;
+   vk::DeviceSize GetDataSize() const { return m_DataSize; }
+
+private:
+   Vulkan::MappedFile m_File;
+   vk::Format m_Format = vk::Format::eUndefined;
+   uint32_t m_Width = 0;
+   uint32_t m_Height = 0;
+   std::vector<vk::DeviceSize> m_LevelOffsets;
+   vk::DeviceSize m_DataOffset = 0;   // of the level data within the file
+   vk::DeviceSize m_DataSize = 0;
+};
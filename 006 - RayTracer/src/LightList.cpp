@@ -0,0 +1,112 @@
+#include "LightList.h"
+
+#include "Sphere.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr float Pi = 3.1415926535897932384626433832795f;
+
+
+// Instance transforms are the top three rows of an affine transform
+glm::mat4 ToMat4(const glm::mat3x4& transform) {
+   return glm::transpose(glm::mat4(transform));
+}
+
+
+float Luminance(const glm::vec3& color) {
+   return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+}
+
+
+// Integral over the hemisphere of pow(cosine, focus) x cosine.  (focus 0 => constant radiance, so pi)
+float CosineFalloffIntegral(const float focus) {
+   return 2.0f * Pi / (std::max(focus, 0.0f) + 2.0f);
+}
+
+
+LightSource MakeLight(const uint32_t type, const glm::vec3& position, const glm::vec3& edge1, const glm::vec3& edge2, const float area, const Material& material) {
+   return {position, type, edge1, area, edge2, material.materialParameter1, glm::vec3 {material.diffuseTextureParam1}, 0};
+}
+
+
+// Faces of the unit box [-0.5, 0.5]^3 in box.rchit's order (-z, +z, -y, +y, -x, +x), transformed by objectToWorld.
+// Edges are ordered so that edge1 x edge2 faces outwards.
+void AddBoxFaces(const glm::mat4& objectToWorld, const Material& material, std::vector<LightSource>& lights) {
+   const bool isMirrored = glm::determinant(glm::mat3(objectToWorld)) < 0.0f;
+   for (uint32_t face = 0; face < 6; ++face) {
+      const int axis = 2 - static_cast<int>(face / 2);
+      const float side = (face & 1) ? 1.0f : -1.0f;
+      glm::vec3 edge1 = {};
+      glm::vec3 edge2 = {};
+      edge1[(axis + 1) % 3] = 1.0f;
+      edge2[(axis + 2) % 3] = 1.0f;
+      if (side < 0.0f) {
+         std::swap(edge1, edge2);
+      }
+      glm::vec3 corner = -0.5f * (edge1 + edge2);
+      corner[axis] = 0.5f * side;
+
+      glm::vec3 edge1W = objectToWorld * glm::vec4 {edge1, 0.0f};
+      glm::vec3 edge2W = objectToWorld * glm::vec4 {edge2, 0.0f};
+      if (isMirrored) {
+         std::swap(edge1W, edge2W);
+      }
+      lights.push_back(MakeLight(LIGHT_PARALLELOGRAM, objectToWorld * glm::vec4 {corner, 1.0f}, edge1W, edge2W, glm::length(glm::cross(edge1W, edge2W)), material));
+   }
+}
+
+}
+
+
+bool IsListedLight(const Material& material) {
+   const glm::vec3 radiance = material.diffuseTextureParam1;
+   return (material.type == MATERIAL_LIGHT) && (material.diffuseTextureType == TEXTURE_FLATCOLOR) && (std::max({radiance.r, radiance.g, radiance.b}) > 0.0f);
+}
+
+
+LightList ExtractLights(const Scene& scene) {
+   const auto& instances = scene.GetInstances();
+   LightList list;
+   list.InstanceFirstLights.assign(instances.size(), LIGHT_NONE);
+   for (uint32_t i = 0; i < instances.size(); ++i) {
+      const Instance& instance = instances[i];
+      const Material& material = scene.GetMaterials()[instance.GetMaterialIndex()];
+      if (!IsListedLight(material)) {
+         continue;
+      }
+      list.InstanceFirstLights[i] = static_cast<uint32_t>(list.Lights.size());
+
+      const Model& model = *scene.GetModels().at(instance.GetModelIndex());
+      const glm::mat4 objectToWorld = ToMat4(instance.GetTransform());
+      if (dynamic_cast<const Sphere*>(&model)) {
+         const float radius = glm::length(glm::vec3 {objectToWorld[0]});
+         list.Lights.push_back(MakeLight(LIGHT_SPHERE, objectToWorld[3], {radius, 0.0f, 0.0f}, {}, 4.0f * Pi * radius * radius, material));
+      } else if (model.IsProcedural()) {
+         AddBoxFaces(objectToWorld, material, list.Lights);
+      } else {
+         const auto& vertices = model.GetVertices();
+         const auto& indices = model.GetIndices();
+         for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            const glm::vec3 p0 = objectToWorld * glm::vec4 {vertices[indices[t + 0]].pos, 1.0f};
+            const glm::vec3 p1 = objectToWorld * glm::vec4 {vertices[indices[t + 1]].pos, 1.0f};
+            const glm::vec3 p2 = objectToWorld * glm::vec4 {vertices[indices[t + 2]].pos, 1.0f};
+            list.Lights.push_back(MakeLight(LIGHT_TRIANGLE, p0, p1 - p0, p2 - p0, 0.5f * glm::length(glm::cross(p1 - p0, p2 - p0)), material));
+         }
+      }
+   }
+
+   list.Powers.reserve(list.Lights.size());
+   for (const LightSource& light : list.Lights) {
+      const float sides = (light.type == LIGHT_TRIANGLE) ? 2.0f : 1.0f;
+      list.Powers.push_back(sides * Luminance(light.radiance) * light.area * CosineFalloffIntegral(light.focus));
+      list.TotalPower += list.Powers.back();
+   }
+   list.Table.resize(list.Lights.size());
+   std::vector<uint32_t> scratch;
+   BuildAliasEntries(list.Powers.data(), static_cast<uint32_t>(list.Powers.size()), 1.0f, list.Table.data(), scratch);
+   list.Tree = BuildLightTree(list.Lights, list.Powers);
+   return list;
+}
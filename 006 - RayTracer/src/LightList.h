@@ -0,0 +1,39 @@
+#pragma once
+
+#include "AliasTable.h"
+#include "LightTree.h"
+#include "Scene.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// The scene's light list: its emissive surfaces, in world space, for next event estimation (see LightSampling.glsl),
+// together with a light tree (see LightTree.h) for choosing one in proportion to its estimated contribution to a point,
+// which is what the shaders do, and an alias table for choosing one in proportion to its power.
+//
+// The instances that are lights are those whose material is a MATERIAL_LIGHT of flat color (with a textured light,
+// the radiance varies over the surface, which the list has no way of telling.  Those are still found by rays that
+// scatter onto them, as everything was before there was a list).  Their geometry becomes:
+// - a sphere: one LIGHT_SPHERE (spheres are assumed to be uniformly scaled, as SphereInstance makes them)
+// - a procedural box: six LIGHT_PARALLELOGRAMs, one per face, in box.rchit's gl_HitKindNV order
+// - a triangle mesh: one LIGHT_TRIANGLE per triangle, in index buffer order (so gl_PrimitiveID order)
+//
+// A light's power is its luminance, times its area, times the integral of its radiance's falloff (see Light()'s
+// focus) times cosine over the hemisphere.  Triangles are lit from both sides (Triangles.rchit flips their normals
+// to face the ray), so count double.  The alias table's pdfs are the lights' probabilities.
+struct LightList {
+   std::vector<LightSource> Lights;
+   std::vector<float> Powers;                   // one per light
+   std::vector<LightNode> Tree;
+   std::vector<AliasEntry> Table;               // one entry per light
+   std::vector<uint32_t> InstanceFirstLights;   // per scene instance: index of its first light, or LIGHT_NONE
+   double TotalPower = 0.0;
+};
+
+
+// Whether instances of material go in the light list
+bool IsListedLight(const Material& material);
+
+LightList ExtractLights(const Scene& scene);
@@ -0,0 +1,68 @@
+#include "LightSamplingBenchmark.h"
+
+#include "Benchmark.h"
+#include "Log.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t ReferenceSampleCount = 4096;
+constexpr double TargetNoise = 0.05;   // target RMSE, as a fraction of the reference's mean
+
+
+double Mean(const std::vector<glm::vec3>& image) {
+   double sum = 0.0;
+   for (const glm::vec3& pixel : image) {
+      sum += (pixel.r + pixel.g + pixel.b) / 3.0;
+   }
+   return sum / static_cast<double>(image.size());
+}
+
+}
+
+
+void RunLightSamplingBenchmark(const std::string& name, const Scene& scene, const CpuPathTracer::Settings& settings, Vulkan::JobSystem& jobSystem) {
+   CpuPathTracer pathTracer(scene, jobSystem);
+   CpuPathTracer::Settings renderSettings = settings;
+
+   // all of the strategies converge to the same image, so the reference uses the best of them
+   renderSettings.SampleCount = ReferenceSampleCount;
+   renderSettings.FirstSample = Benchmark::ReferenceFirstSample;
+   renderSettings.Lights = CpuPathTracer::LightSampling::Tree;
+   const std::vector<glm::vec3> reference = pathTracer.Render(renderSettings);
+   const double target = TargetNoise * Mean(reference);
+   LOG_INFO("Light sampling {0}: {1}x{2} reference image, {3} samples per pixel in {4:.1f}s.  Target RMSE {5:.4f}", name, settings.Width, settings.Height, ReferenceSampleCount, pathTracer.GetStats().Seconds, target);
+
+   const struct {
+      CpuPathTracer::LightSampling Sampling;
+      const char* Name;
+   } strategies[] = {
+      {CpuPathTracer::LightSampling::None,  "BSDF only"},
+      {CpuPathTracer::LightSampling::Power, "power + MIS"},
+      {CpuPathTracer::LightSampling::Tree,  "light tree + MIS"}
+   };
+   for (const auto& strategy : strategies) {
+      renderSettings.Lights = strategy.Sampling;
+      renderSettings.FirstSample = 0;
+      std::string results;
+      double rmse = 0.0;
+      double seconds = 0.0;
+      uint32_t sampleCount = 0;
+      for (const uint32_t count : {1u, 4u, 16u, 64u, 256u}) {
+         sampleCount = count;
+         renderSettings.SampleCount = sampleCount;
+         const std::vector<glm::vec3> image = pathTracer.Render(renderSettings);
+         seconds = pathTracer.GetStats().Seconds;
+         rmse = Benchmark::Rmse(image, reference);
+         char text[64];
+         std::snprintf(text, sizeof(text), "%s%u spp %.4f", results.empty() ? "" : ", ", sampleCount, rmse);
+         results += text;
+      }
+
+      // RMSE falls as 1 / sqrt(samples), so extrapolate from the most samples (which are least affected by the reference's own noise)
+      const double samplesToTarget = sampleCount * (rmse / target) * (rmse / target);
+      LOG_INFO("Light sampling {0}, {1}: RMSE {2}.  {3:.0f} spp to target ({4:.1f}s)", name, strategy.Name, results, samplesToTarget, seconds / sampleCount * samplesToTarget);
+   }
+}
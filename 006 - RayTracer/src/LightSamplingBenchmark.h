@@ -0,0 +1,12 @@
+#pragma once
+
+#include "CpuPathTracer.h"
+
+#include <string>
+
+// Benchmark of next event estimation of the light list (see LightList.h), on the CPU reference (CpuPathTracer), which
+// renders the same way as the shaders do.  Renders scene with settings (of which the size, camera and ray bounces are
+// used), with each CpuPathTracer::LightSampling strategy, and compares each against a high sample count reference image.
+// Reports RMSE by samples per pixel, and the samples per pixel (and time) that each needs to get down to a target noise
+// level: an RMSE of 5% of the reference's mean.  Results are logged.
+void RunLightSamplingBenchmark(const std::string& name, const Scene& scene, const CpuPathTracer::Settings& settings, Vulkan::JobSystem& jobSystem);
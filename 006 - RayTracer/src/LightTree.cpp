@@ -0,0 +1,264 @@
+#include "LightTree.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+constexpr float Pi = 3.1415926535897932384626433832795f;
+constexpr uint32_t BinCount = 12;
+
+
+// As per LightNode, for a set of lights (empty if it has none)
+struct LightBounds {
+   glm::vec3 Min = glm::vec3 {std::numeric_limits<float>::max()};
+   glm::vec3 Max = glm::vec3 {-std::numeric_limits<float>::max()};
+   glm::vec3 Axis = {0.0f, 0.0f, 1.0f};
+   float CosThetaO = 1.0f;
+   float CosThetaE = 1.0f;
+   bool TwoSided = false;
+   float Power = 0.0f;
+   bool IsEmpty = true;
+};
+
+
+float Angle(const float cosine) {
+   return std::acos(std::clamp(cosine, -1.0f, 1.0f));
+}
+
+
+LightBounds GetLightBounds(const LightSource& light, const float power) {
+   LightBounds bounds;
+   bounds.IsEmpty = false;
+   bounds.Power = power;
+   bounds.CosThetaE = 0.0f;   // Lambertian emitters (a focused light emits within a narrower cone, so this is conservative)
+   if (light.type == LIGHT_SPHERE) {
+      bounds.Min = light.position - glm::vec3 {light.edge1.x};
+      bounds.Max = light.position + glm::vec3 {light.edge1.x};
+      bounds.CosThetaO = -1.0f;   // normals in every direction
+      return bounds;
+   }
+
+   const glm::vec3 corners[] = {
+      light.position,
+      light.position + light.edge1,
+      light.position + light.edge2,
+      (light.type == LIGHT_PARALLELOGRAM) ? light.position + light.edge1 + light.edge2 : light.position
+   };
+   for (const glm::vec3& corner : corners) {
+      bounds.Min = glm::min(bounds.Min, corner);
+      bounds.Max = glm::max(bounds.Max, corner);
+   }
+   const glm::vec3 normal = glm::cross(light.edge1, light.edge2);
+   if (glm::dot(normal, normal) > 0.0f) {
+      bounds.Axis = glm::normalize(normal);
+   } else {
+      bounds.CosThetaO = -1.0f;   // degenerate: no area, so no power, but do not make up a normal
+   }
+   bounds.TwoSided = (light.type == LIGHT_TRIANGLE);
+   return bounds;
+}
+
+
+// Smallest cone (roughly) that contains the cones about axisA and axisB
+void UnionCones(const glm::vec3& axisA, const float cosThetaA, const glm::vec3& axisB, const float cosThetaB, glm::vec3& axis, float& cosTheta) {
+   const float thetaA = Angle(cosThetaA);
+   const float thetaB = Angle(cosThetaB);
+   const float thetaD = Angle(glm::dot(axisA, axisB));
+   if (std::min(thetaD + thetaB, Pi) <= thetaA) {
+      axis = axisA;
+      cosTheta = cosThetaA;
+      return;
+   }
+   if (std::min(thetaD + thetaA, Pi) <= thetaB) {
+      axis = axisB;
+      cosTheta = cosThetaB;
+      return;
+   }
+
+   const float thetaO = 0.5f * (thetaA + thetaD + thetaB);
+   const glm::vec3 rotationAxis = glm::cross(axisA, axisB);
+   if ((thetaO >= Pi) || !(glm::dot(rotationAxis, rotationAxis) > 0.0f)) {
+      axis = axisA;
+      cosTheta = -1.0f;
+      return;
+   }
+
+   // rotate axisA towards axisB (about their cross product, which is perpendicular to axisA) until the cone takes in both
+   const float thetaR = thetaO - thetaA;
+   axis = glm::normalize(axisA * std::cos(thetaR) + glm::cross(glm::normalize(rotationAxis), axisA) * std::sin(thetaR));
+   cosTheta = std::cos(thetaO);
+}
+
+
+LightBounds Union(const LightBounds& a, const LightBounds& b) {
+   if (a.IsEmpty) {
+      return b;
+   }
+   if (b.IsEmpty) {
+      return a;
+   }
+   LightBounds bounds;
+   bounds.IsEmpty = false;
+   bounds.Min = glm::min(a.Min, b.Min);
+   bounds.Max = glm::max(a.Max, b.Max);
+   UnionCones(a.Axis, a.CosThetaO, b.Axis, b.CosThetaO, bounds.Axis, bounds.CosThetaO);
+   bounds.CosThetaE = std::min(a.CosThetaE, b.CosThetaE);
+   bounds.TwoSided = a.TwoSided || b.TwoSided;
+   bounds.Power = a.Power + b.Power;
+   return bounds;
+}
+
+
+// Surface area orientation heuristic cost of a node with bounds: its power, times its bounds' surface area, times the
+// solid angle measure of its orientation cone
+float Cost(const LightBounds& bounds) {
+   if (bounds.IsEmpty) {
+      return 0.0f;
+   }
+   const glm::vec3 extent = bounds.Max - bounds.Min;
+   const float area = 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+
+   const float thetaO = Angle(bounds.CosThetaO);
+   const float thetaE = Angle(bounds.CosThetaE);
+   const float thetaW = std::min(thetaO + thetaE, Pi);
+   const float sinThetaO = std::sin(thetaO);
+   const float orientation = 2.0f * Pi * (1.0f - bounds.CosThetaO) + 0.5f * Pi * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinThetaO + bounds.CosThetaO);
+   return bounds.Power * area * orientation;
+}
+
+
+// Partition order[begin, end) into the two children's lights.  Returns where the second child's begin
+uint32_t Split(const std::vector<LightBounds>& lightBounds, const std::vector<glm::vec3>& centroids, std::vector<uint32_t>& order, const uint32_t begin, const uint32_t end) {
+   LightBounds bounds;
+   glm::vec3 centroidMin = glm::vec3 {std::numeric_limits<float>::max()};
+   glm::vec3 centroidMax = glm::vec3 {-std::numeric_limits<float>::max()};
+   for (uint32_t i = begin; i < end; ++i) {
+      bounds = Union(bounds, lightBounds[order[i]]);
+      centroidMin = glm::min(centroidMin, centroids[order[i]]);
+      centroidMax = glm::max(centroidMax, centroids[order[i]]);
+   }
+   const glm::vec3 extent = bounds.Max - bounds.Min;
+   const float maxExtent = std::max({extent.x, extent.y, extent.z});
+
+   float bestCost = std::numeric_limits<float>::max();
+   int bestAxis = -1;
+   uint32_t bestBin = 0;
+   for (int axis = 0; axis < 3; ++axis) {
+      const float centroidExtent = centroidMax[axis] - centroidMin[axis];
+      if (!(centroidExtent > 0.0f)) {
+         continue;
+      }
+      std::array<LightBounds, BinCount> bins;
+      for (uint32_t i = begin; i < end; ++i) {
+         const uint32_t bin = std::min(BinCount - 1, static_cast<uint32_t>((centroids[order[i]][axis] - centroidMin[axis]) / centroidExtent * BinCount));
+         bins[bin] = Union(bins[bin], lightBounds[order[i]]);
+      }
+
+      // cost of splitting after each bin.  (The first and last bins are never empty, so neither side of a split is)
+      std::array<float, BinCount - 1> costs;
+      LightBounds below;
+      for (uint32_t bin = 0; bin < BinCount - 1; ++bin) {
+         below = Union(below, bins[bin]);
+         costs[bin] = Cost(below);
+      }
+      LightBounds above;
+      for (uint32_t bin = BinCount - 1; bin > 0; --bin) {
+         above = Union(above, bins[bin]);
+         costs[bin - 1] += Cost(above);
+      }
+
+      // favour splitting across the node's longest extent, so that nodes do not get too thin
+      const float regularization = maxExtent / extent[axis];
+      for (uint32_t bin = 0; bin < BinCount - 1; ++bin) {
+         if (costs[bin] * regularization < bestCost) {
+            bestCost = costs[bin] * regularization;
+            bestAxis = axis;
+            bestBin = bin;
+         }
+      }
+   }
+
+   if (bestAxis < 0) {
+      // the lights' centroids are all in the same place, so it does not matter how they are split
+      return begin + (end - begin) / 2;
+   }
+   const float centroidExtent = centroidMax[bestAxis] - centroidMin[bestAxis];
+   const auto middle = std::partition(order.begin() + begin, order.begin() + end, [&] (const uint32_t light) {
+      return std::min(BinCount - 1, static_cast<uint32_t>((centroids[light][bestAxis] - centroidMin[bestAxis]) / centroidExtent * BinCount)) <= bestBin;
+   });
+   return static_cast<uint32_t>(middle - order.begin());
+}
+
+}
+
+
+std::vector<LightNode> BuildLightTree(std::vector<LightSource>& lights, const std::vector<float>& powers) {
+   const uint32_t lightCount = static_cast<uint32_t>(lights.size());
+   if (lightCount == 0) {
+      return {};
+   }
+
+   std::vector<LightBounds> lightBounds(lightCount);
+   std::vector<glm::vec3> centroids(lightCount);
+   for (uint32_t i = 0; i < lightCount; ++i) {
+      lightBounds[i] = GetLightBounds(lights[i], powers[i]);
+      centroids[i] = 0.5f * (lightBounds[i].Min + lightBounds[i].Max);
+   }
+   std::vector<uint32_t> order(lightCount);
+   std::iota(order.begin(), order.end(), 0);
+
+   // Top down, with an explicit stack (the tree can be deep, as the splits need not be balanced).  Children are always
+   // after their parents, so then the nodes' bounds can be filled in bottom up in one pass.
+   std::vector<LightNode> nodes(1);
+   std::vector<LightBounds> nodeBounds(1);
+   nodes.reserve(2 * static_cast<size_t>(lightCount) - 1);
+   nodeBounds.reserve(nodes.capacity());
+   nodes[0].parent = LIGHT_NONE;
+   struct Range {
+      uint32_t Node;
+      uint32_t Begin;
+      uint32_t End;
+   };
+   std::vector<Range> stack = {{0, 0, lightCount}};
+   while (!stack.empty()) {
+      const Range range = stack.back();
+      stack.pop_back();
+      if (range.End - range.Begin == 1) {
+         const uint32_t light = order[range.Begin];
+         nodes[range.Node].childOrLight = LIGHTNODE_LEAF | light;
+         nodeBounds[range.Node] = lightBounds[light];
+         lights[light].node = range.Node;
+         continue;
+      }
+      const uint32_t middle = Split(lightBounds, centroids, order, range.Begin, range.End);
+      const uint32_t child = static_cast<uint32_t>(nodes.size());
+      nodes[range.Node].childOrLight = child;
+      nodes.resize(child + 2);
+      nodeBounds.resize(child + 2);
+      nodes[child].parent = range.Node;
+      nodes[child + 1].parent = range.Node;
+      stack.push_back({child + 1, middle, range.End});
+      stack.push_back({child, range.Begin, middle});
+   }
+
+   for (size_t i = nodes.size(); i-- > 0;) {
+      LightNode& node = nodes[i];
+      if ((node.childOrLight & LIGHTNODE_LEAF) == 0) {
+         nodeBounds[i] = Union(nodeBounds[node.childOrLight], nodeBounds[node.childOrLight + 1]);
+      }
+      const LightBounds& bounds = nodeBounds[i];
+      node.boundsMin = bounds.Min;
+      node.power = bounds.Power;
+      node.boundsMax = bounds.Max;
+      node.axis = bounds.Axis;
+      node.cosThetaO = bounds.CosThetaO;
+      node.cosThetaE = bounds.CosThetaE;
+      node.twoSided = bounds.TwoSided ? 1 : 0;
+      node.padding0 = 0;
+   }
+   return nodes;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+using uint = uint32_t;
+using vec3 = glm::vec3;
+#include "LightNode.glsl"
+#include "LightSource.glsl"
+
+// Light tree: a binary BVH over a light list, whose nodes have an orientation cone (bounding the lights' normals, and the
+// directions that they emit in) as well as bounds, and the total power of the lights below them.  A light is chosen for a
+// point by descending from the root, taking each child in proportion to an estimate of how much its lights contribute to
+// the point (see LightSampling.glsl), as per Conty Estevez and Kulla's "Importance Sampling of Many Lights".  So lights
+// that are far away, facing away or dim are rarely chosen, however many there are.
+//
+// Each leaf is one light, so there are 2n - 1 nodes for n lights (none, for none).  Splits are chosen by the surface area
+// orientation heuristic, over a few bins of the lights' centroids on each axis.  Sets each light's node (its leaf).
+// powers are the lights' powers, as per LightList.h.
+std::vector<LightNode> BuildLightTree(std::vector<LightSource>& lights, const std::vector<float>& powers);
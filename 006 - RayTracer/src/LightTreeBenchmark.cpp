@@ -0,0 +1,135 @@
+#include "LightTreeBenchmark.h"
+
+#include "Benchmark.h"
+#include "CpuPathTracer.h"
+#include "LightList.h"
+#include "Log.h"
+#include "Rectangle2D.h"
+#include "Scene.h"
+#include "Sphere.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t ImageWidth = 128;                   // of the convergence renders
+constexpr uint32_t ImageHeight = 72;
+constexpr uint32_t ReferenceSampleCount = 1024;
+
+
+// A dark sky, a grey floor with a few Lambertian spheres on it near the camera, and lightCount small emissive spheres of
+// random colors and brightnesses scattered over the floor, two units apart on average
+void CreateScene(Scene& scene, const uint32_t lightCount) {
+   SphereInstance::SetModelIndex(scene.AddModel(std::make_unique<Sphere>()));
+   Rectangle2DInstance::SetModelIndex(scene.AddModel(std::make_unique<Rectangle2D>()));
+   scene.SetHorizonColor({0.0f, 0.0f, 0.0f});
+   scene.SetZenithColor({0.0f, 0.0f, 0.0f});
+
+   const float size = 2.0f * std::sqrt(static_cast<float>(lightCount)) + 4.0f;
+   scene.AddInstance(Rectangle2DInstance({0.0f, 0.0f, 0.0f}, {size, size}, {glm::radians(-90.0f), 0.0f, 0.0f}, scene.AddMaterial(Lambertian(FlatColor({0.5f, 0.5f, 0.5f})))));
+   scene.AddInstance(SphereInstance({-1.5f, 0.5f, 0.0f}, 0.5f, scene.AddMaterial(Lambertian(FlatColor({0.8f, 0.3f, 0.2f})))));
+   scene.AddInstance(SphereInstance({0.0f, 0.5f, 0.0f}, 0.5f, scene.AddMaterial(Lambertian(FlatColor({0.2f, 0.6f, 0.3f})))));
+   scene.AddInstance(SphereInstance({1.5f, 0.5f, 0.0f}, 0.5f, scene.AddMaterial(Lambertian(FlatColor({0.3f, 0.4f, 0.8f})))));
+
+   std::mt19937 generator;
+   std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+   for (uint32_t i = 0; i < lightCount; ++i) {
+      const float x = (distribution(generator) - 0.5f) * size;
+      const float z = (distribution(generator) - 0.5f) * size;
+      const float y = 0.1f + 2.0f * distribution(generator);
+      const glm::vec3 color = glm::vec3 {distribution(generator), distribution(generator), distribution(generator)} * (5.0f + 45.0f * distribution(generator));
+      scene.AddInstance(SphereInstance({x, y, z}, 0.1f, scene.AddMaterial(Light(FlatColor(color), 0.0f))));
+   }
+}
+
+
+uint32_t GetDepth(const std::vector<LightNode>& tree) {
+   std::vector<uint32_t> depths(tree.size(), 0);
+   uint32_t maxDepth = 0;
+   for (size_t i = 1; i < tree.size(); ++i) {
+      depths[i] = depths[tree[i].parent] + 1;
+      maxDepth = std::max(maxDepth, depths[i]);
+   }
+   return maxDepth;
+}
+
+
+void BenchmarkBuild(const Scene& scene, const uint32_t lightCount) {
+   const LightList lights = ExtractLights(scene);
+
+   // the build only sets each light's node, so one copy of the lights does for every run
+   std::vector<LightSource> lightSources = lights.Lights;
+   std::vector<LightNode> tree;
+   const double milliseconds = Benchmark::BestMilliseconds([&] {
+      tree = BuildLightTree(lightSources, lights.Powers);
+   });
+   LOG_INFO("Light tree of {0} lights: build {1:.2f}ms, {2} nodes, max depth {3}", lightCount, milliseconds, tree.size(), GetDepth(tree));
+}
+
+
+void BenchmarkConvergence(Vulkan::JobSystem& jobSystem, const Scene& scene, const uint32_t lightCount) {
+   CpuPathTracer pathTracer(scene, jobSystem);
+
+   CpuPathTracer::Settings settings;
+   settings.Width = ImageWidth;
+   settings.Height = ImageHeight;
+   settings.MinRayBounces = 3;
+   settings.MaxRayBounces = 8;
+   glm::mat4 projection = glm::perspective(glm::radians(50.0f), static_cast<float>(ImageWidth) / static_cast<float>(ImageHeight), 0.01f, 100.0f);
+   projection[1][1] *= -1;
+   settings.ViewInverse = glm::inverse(glm::lookAt(glm::vec3 {0.0f, 2.5f, 6.0f}, glm::vec3 {0.0f, 0.5f, 0.0f}, glm::vec3 {0.0f, 1.0f, 0.0f}));
+   settings.ProjectionInverse = glm::inverse(projection);
+
+   // both converge to the same image, so the reference uses the better of them
+   settings.SampleCount = ReferenceSampleCount;
+   settings.FirstSample = Benchmark::ReferenceFirstSample;
+   settings.Lights = CpuPathTracer::LightSampling::Tree;
+   const std::vector<glm::vec3> reference = pathTracer.Render(settings);
+   LOG_INFO("Light tree convergence, {0} lights: {1}x{2} reference image, {3} samples per pixel in {4:.1f}s", lightCount, ImageWidth, ImageHeight, ReferenceSampleCount, pathTracer.GetStats().Seconds);
+
+   const struct {
+      CpuPathTracer::LightSampling Sampling;
+      const char* Name;
+   } strategies[] = {
+      {CpuPathTracer::LightSampling::Power, "power"},
+      {CpuPathTracer::LightSampling::Tree,  "light tree"}
+   };
+   double rmses[2] = {};
+   for (uint32_t i = 0; i < 2; ++i) {
+      settings.Lights = strategies[i].Sampling;
+      settings.FirstSample = 0;
+      std::string results;
+      double seconds = 0.0;
+      for (const uint32_t sampleCount : {1u, 4u, 16u, 64u}) {
+         settings.SampleCount = sampleCount;
+         const std::vector<glm::vec3> image = pathTracer.Render(settings);
+         seconds = pathTracer.GetStats().Seconds;
+         rmses[i] = Benchmark::Rmse(image, reference);
+         char text[64];
+         std::snprintf(text, sizeof(text), "%s%u spp %.4f", results.empty() ? "" : ", ", sampleCount, rmses[i]);
+         results += text;
+      }
+      LOG_INFO("Light tree convergence, {0} lights, {1}: RMSE {2}  (64 spp in {3:.2f}s)", lightCount, strategies[i].Name, results, seconds);
+   }
+   LOG_INFO("Light tree convergence, {0} lights: variance at 64 spp is {1:.1f}x lower with the light tree", lightCount, (rmses[0] * rmses[0]) / (rmses[1] * rmses[1]));
+}
+
+}
+
+
+void RunLightTreeBenchmarks(Vulkan::JobSystem& jobSystem) {
+   for (const uint32_t lightCount : {10u, 1'000u, 100'000u}) {
+      Scene scene;
+      CreateScene(scene, lightCount);
+      BenchmarkBuild(scene, lightCount);
+      BenchmarkConvergence(jobSystem, scene, lightCount);
+   }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "JobSystem.h"
+
+// Benchmarks of the light tree (see LightTree.h), on generated scenes of 10, 1,000 and 100,000 small emissive spheres
+// scattered over a floor (at the same density, so the more there are, the more of them are far away):
+// - Building the tree over the scene's light list.
+// - Convergence of the CPU reference (CpuPathTracer), choosing lights in proportion to power versus via the tree: RMSE
+//   against a high sample count reference image, by samples per pixel, and the ratio of their variances.
+// Results are logged.
+void RunLightTreeBenchmarks(Vulkan::JobSystem& jobSystem);
@@ -0,0 +1,127 @@
+#include "MergedInstances.h"
+
+#include "Core.h"
+#include "TlasInstances.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <limits>
+
+namespace {
+
+// Instance transforms are the top three rows of an affine transform (the layout that the TLAS wants)
+glm::mat4 ToMat4(const glm::mat3x4& transform) {
+   return glm::transpose(glm::mat4(transform));
+}
+
+}
+
+
+MergedInstances MergeProceduralInstances(const Scene& scene, const uint32_t minGroupSize) {
+   const auto& models = scene.GetModels();
+   const auto& instances = scene.GetInstances();
+
+   // a group is one TLAS instance, so has one hit group: instances are grouped by model and material type
+   std::vector<std::vector<uint32_t>> instancesOfModel(models.size() * MATERIAL_NUMTYPES);
+   for (uint32_t i = 0; i < instances.size(); ++i) {
+      instancesOfModel[(instances[i].GetModelIndex() * MATERIAL_NUMTYPES) + scene.GetMaterials()[instances[i].GetMaterialIndex()].type].push_back(i);
+   }
+
+   MergedInstances merged;
+   std::vector<bool> isMerged(instances.size(), false);
+   uint32_t primitiveCount = static_cast<uint32_t>(instances.size());
+   for (uint32_t key = 0; key < instancesOfModel.size(); ++key) {
+      const uint32_t modelIndex = key / MATERIAL_NUMTYPES;
+      auto& instanceIndices = instancesOfModel[key];
+      if (models[modelIndex]->IsProcedural() && !instanceIndices.empty() && (instanceIndices.size() >= minGroupSize)) {
+         for (const uint32_t i : instanceIndices) {
+            isMerged[i] = true;
+         }
+         const uint32_t count = static_cast<uint32_t>(instanceIndices.size());
+         merged.Groups.push_back({modelIndex, primitiveCount, std::move(instanceIndices)});
+         primitiveCount += count;
+      }
+   }
+
+   for (uint32_t i = 0; i < instances.size(); ++i) {
+      if (!isMerged[i]) {
+         merged.UnmergedInstances.push_back(i);
+      }
+   }
+   return merged;
+}
+
+
+std::vector<Primitive> PackPrimitives(const Scene& scene, const MergedInstances& merged, const LightList& lights) {
+   const auto& instances = scene.GetInstances();
+   size_t primitiveCount = instances.size();
+   for (const auto& group : merged.Groups) {
+      primitiveCount += group.InstanceIndices.size();
+   }
+   ASSERT(primitiveCount <= (1u << 24), "ERROR: Too many primitives ({0}) for a 24 bit instance custom index", primitiveCount);
+
+   std::vector<Primitive> primitives;
+   primitives.reserve(primitiveCount);
+   const glm::mat3x4 identity(1.0f);
+   for (uint32_t i = 0; i < instances.size(); ++i) {
+      primitives.push_back({identity, instances[i].GetMaterialIndex(), lights.InstanceFirstLights[i], 0, 0});
+   }
+   for (const auto& group : merged.Groups) {
+      for (const uint32_t i : group.InstanceIndices) {
+         primitives.push_back({glm::mat3x4(glm::transpose(glm::inverse(ToMat4(instances[i].GetTransform())))), instances[i].GetMaterialIndex(), lights.InstanceFirstLights[i], 0, 0});
+      }
+   }
+   return primitives;
+}
+
+
+std::vector<std::array<glm::vec3, 2>> GetGroupAabbs(const Scene& scene, const MergedInstances::Group& group) {
+   const auto [min, max] = scene.GetModels().at(group.ModelIndex)->GetBoundingBox();
+   std::vector<std::array<glm::vec3, 2>> aabbs;
+   aabbs.reserve(group.InstanceIndices.size());
+   for (const uint32_t i : group.InstanceIndices) {
+      const glm::mat4 transform = ToMat4(scene.GetInstances()[i].GetTransform());
+      std::array<glm::vec3, 2> aabb = {glm::vec3 {std::numeric_limits<float>::max()}, glm::vec3 {std::numeric_limits<float>::lowest()}};
+      for (uint32_t corner = 0; corner < 8; ++corner) {
+         const glm::vec3 p = glm::vec3(transform * glm::vec4 {(corner & 1) ? max.x : min.x, (corner & 2) ? max.y : min.y, (corner & 4) ? max.z : min.z, 1.0f});
+         aabb[0] = glm::min(aabb[0], p);
+         aabb[1] = glm::max(aabb[1], p);
+      }
+      aabbs.emplace_back(aabb);
+   }
+   return aabbs;
+}
+
+
+std::vector<Vulkan::GeometryInstance> PackMergedTlasInstances(const Scene& scene, const MergedInstances& merged, const std::vector<uint64_t>& blasHandles) {
+   const auto& models = scene.GetModels();
+   std::vector<Vulkan::GeometryInstance> tlasInstances;
+
+   tlasInstances.reserve(merged.UnmergedInstances.size() + merged.Groups.size());
+   for (const uint32_t i : merged.UnmergedInstances) {
+      const Instance& instance = scene.GetInstances()[i];
+      ASSERT(blasHandles.at(instance.GetModelIndex()), "ERROR: BLAS handle is null.  Have you forgotten to allocate and bind memory?");
+      tlasInstances.emplace_back(
+         instance.GetTransform(),
+         i                                                                             /*instance index*/,
+         0xff                                                                          /*visibility mask*/,
+         GetInstanceHitGroupIndex(scene, instance)                                     /*hit group index*/,
+         static_cast<uint32_t>(vk::GeometryInstanceFlagBitsNV::eTriangleCullDisable)   /*instance flags*/,
+         blasHandles.at(instance.GetModelIndex())                                     /*acceleration structure handle*/
+      );
+   }
+
+   for (size_t g = 0; g < merged.Groups.size(); ++g) {
+      const auto& group = merged.Groups[g];
+      ASSERT(blasHandles.at(models.size() + g), "ERROR: BLAS handle is null.  Have you forgotten to allocate and bind memory?");
+      tlasInstances.emplace_back(
+         glm::mat3x4(1.0f)                                                             /*transform (the group's AABBs are already in world space)*/,
+         group.FirstPrimitive                                                          /*first primitive index*/,
+         0xff                                                                          /*visibility mask*/,
+         GetInstanceHitGroupIndex(scene, scene.GetInstances()[group.InstanceIndices[0]]) /*hit group index (the same for every instance of the group)*/,
+         static_cast<uint32_t>(vk::GeometryInstanceFlagBitsNV::eTriangleCullDisable)   /*instance flags*/,
+         blasHandles.at(models.size() + g)                                             /*acceleration structure handle*/
+      );
+   }
+   return tlasInstances;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "LightList.h"
+#include "Primitive.h"
+#include "Scene.h"
+
+#include "GeometryInstance.h"
+
+#include <array>
+#include <vector>
+
+// Scene optimization: procedural instances that share a model and material type (and so a shader hit group) are merged into a single BLAS
+// of many AABBs, one per instance, which is then just one TLAS instance.  Otherwise each procedural instance is its own
+// TLAS instance of its model's one-AABB BLAS, and for scenes of many small spheres, traversal degenerates into a flat
+// TLAS of tiny leaves.
+// Merged instances are static: their transforms are baked into the BLAS.
+struct MergedInstances {
+   struct Group {
+      uint32_t ModelIndex;
+      uint32_t FirstPrimitive;                  // index (in PackPrimitives()) of the primitive of InstanceIndices[0]
+      std::vector<uint32_t> InstanceIndices;    // the scene instances merged into this group, one AABB each
+   };
+   std::vector<Group> Groups;                   // one BLAS (and one TLAS instance) each
+   std::vector<uint32_t> UnmergedInstances;     // scene instances that are still TLAS instances of their model's BLAS
+};
+
+
+// Merge scene's procedural instances by model and material type.  Groups of fewer than minGroupSize instances are not
+// merged.
+MergedInstances MergeProceduralInstances(const Scene& scene, const uint32_t minGroupSize);
+
+// The primitive table that procedural hit shaders look up.
+// Entry i is scene instance i itself (with an identity transform), so that an unmerged instance's custom index is still
+// its instance index.  These are followed by the primitives of each group in turn.  Each primitive has its instance's
+// first light from lights (see LightList.h).
+std::vector<Primitive> PackPrimitives(const Scene& scene, const MergedInstances& merged, const LightList& lights);
+
+// AABB of each instance of group, in BLAS (i.e. world) space
+std::vector<std::array<glm::vec3, 2>> GetGroupAabbs(const Scene& scene, const MergedInstances::Group& group);
+
+// Pack the unmerged instances (as PackTlasInstances() does), followed by one instance per group.
+// blasHandles are the acceleration structure handles of the scene's models, followed by those of the groups.
+std::vector<Vulkan::GeometryInstance> PackMergedTlasInstances(const Scene& scene, const MergedInstances& merged, const std::vector<uint64_t>& blasHandles);
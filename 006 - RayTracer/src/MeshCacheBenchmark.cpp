@@ -0,0 +1,69 @@
+#include "MeshCacheBenchmark.h"
+
+#include "Benchmark.h"
+#include "Log.h"
+#include "MeshCache.h"
+#include "Model.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+bool IsSameMesh(const Model& a, const Model& b) {
+   return
+      (a.GetVertices().size() == b.GetVertices().size()) &&
+      (a.GetIndices() == b.GetIndices()) &&
+      (a.GetVertices().empty() || (std::memcmp(a.GetVertices().data(), b.GetVertices().data(), a.GetVertices().size() * sizeof(Vertex)) == 0))
+   ;
+}
+
+}
+
+
+void RunMeshCacheBenchmarks(const std::filesystem::path& modelsDirectory) {
+   std::vector<std::filesystem::path> fileNames;
+   for (const auto& entry : std::filesystem::recursive_directory_iterator(modelsDirectory)) {
+      if (entry.is_regular_file() && (entry.path().extension() == ".obj")) {
+         fileNames.emplace_back(entry.path());
+      }
+   }
+   std::sort(fileNames.begin(), fileNames.end());
+   if (fileNames.empty()) {
+      LOG_WARN("Mesh cache benchmark: no .obj files found in {0}", modelsDirectory.string());
+      return;
+   }
+
+   const std::filesystem::path savedDirectory = Vulkan::MeshCache::GetDirectory();
+   const std::filesystem::path cacheDirectory = std::filesystem::temp_directory_path() / "MeshCacheBenchmark";
+   std::filesystem::remove_all(cacheDirectory);
+
+   double totalParseMilliseconds = 0.0;
+   double totalCacheMilliseconds = 0.0;
+   for (const auto& fileName : fileNames) {
+      // parse, with the cache disabled
+      Vulkan::MeshCache::SetDirectory({});
+      const Model parsed(fileName.string().c_str());
+      const double parseMilliseconds = Benchmark::BestMilliseconds([&fileName] { Model model(fileName.string().c_str()); });
+
+      // cold: parse and write the cache entry.  Then warm: cache hits
+      Vulkan::MeshCache::SetDirectory(cacheDirectory);
+      const Benchmark::Clock::time_point start = Benchmark::Clock::now();
+      { Model model(fileName.string().c_str()); }
+      const double missMilliseconds = Benchmark::MillisecondsSince(start);
+      const double cacheMilliseconds = Benchmark::BestMilliseconds([&fileName] { Model model(fileName.string().c_str()); });
+      const Model cached(fileName.string().c_str());
+
+      totalParseMilliseconds += parseMilliseconds;
+      totalCacheMilliseconds += cacheMilliseconds;
+      LOG_INFO("Mesh cache {0} ({1} KB, {2} vertices, {3} triangles): parse {4:.3f}ms, miss (parse and write) {5:.3f}ms, hit {6:.3f}ms ({7:.1f}x faster than parse)", fileName.string(), std::filesystem::file_size(fileName) / 1024, parsed.GetVertices().size(), parsed.GetIndices().size() / 3, parseMilliseconds, missMilliseconds, cacheMilliseconds, parseMilliseconds / cacheMilliseconds);
+      if (!IsSameMesh(parsed, cached)) {
+         LOG_ERROR("Mesh cache {0}: cached mesh differs from parsed mesh", fileName.string());
+      }
+   }
+   LOG_INFO("Mesh cache: {0} files, parse {1:.3f}ms, hit {2:.3f}ms ({3:.1f}x faster)", fileNames.size(), totalParseMilliseconds, totalCacheMilliseconds, totalParseMilliseconds / totalCacheMilliseconds);
+
+   std::filesystem::remove_all(cacheDirectory);
+   Vulkan::MeshCache::SetDirectory(savedDirectory);
+}
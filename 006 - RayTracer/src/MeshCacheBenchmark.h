@@ -0,0 +1,9 @@
+#pragma once
+
+#include <filesystem>
+
+// Benchmark of importing .obj files (tinyobjloader parse + vertex deduplication, as done by Model) versus loading
+// them from the MeshCache.
+// Every .obj file under modelsDirectory (recursively) is loaded both ways, using a temporary cache directory, and the
+// results are checked to be identical.  Timings are logged.
+void RunMeshCacheBenchmarks(const std::filesystem::path& modelsDirectory);
@@ -1,17 +1,114 @@
 #include "Model.h"
 
 #include "Core.h"
+#include "MeshCache.h"
+#include "ObjImporter.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
 
 uint32_t Model::sm_ShaderHitGroupIndex = ~0;
+Vulkan::JobSystem* Model::sm_JobSystem = nullptr;
 
 
 Model::Model(const char* filename, const uint32_t shaderHitGroupIndex)
-: m_ShaderHitGroupIndex(shaderHitGroupIndex)
+: m_FileName(filename)
+, m_ShaderHitGroupIndex(shaderHitGroupIndex)
 {
+   // layout name identifies Vertex and how it is filled in below.  Change it if either changes
+   constexpr std::string_view meshCacheLayout = "RayTracer.Vertex";
+   if (Vulkan::MeshCache::Load(filename, meshCacheLayout, m_Vertices, m_Indices)) {
+      return;
+   }
+
+   ImportObj(filename, sm_JobSystem, m_Vertices, m_Indices);
+   Vulkan::MeshCache::Save(filename, meshCacheLayout, m_Vertices, m_Indices);
+}
+
+
+const std::vector<Vertex>& Model::GetVertices() const {
+   return m_Vertices;
+}
+
+
+const std::vector<uint32_t>& Model::GetIndices() const {
+   return m_Indices;
+}
+
+
+const std::string& Model::GetFileName() const {
+   return m_FileName;
+}
+
+
+bool Model::IsProcedural() const {
+   return false;
+}
+
+
+uint32_t Model::GetShaderHitGroupIndex() const {
+   ASSERT(m_ShaderHitGroupIndex != ~0, "ERROR: shader hit group index not set.  You must set the shader hit group index (via SetShaderHitGroupIndex()).");
+   return m_ShaderHitGroupIndex;
+}
+
+
+std::array<glm::vec3, 2> Model::GetBoundingBox() const {
+   ASSERT(false, "ERROR: GetBoundingBox() called for non-procedural model");
+   return {};
+};
+
+
+void Model::SetDefaultShaderHitGroupIndex(const uint32_t shaderHitGroupIndex) {
+   sm_ShaderHitGroupIndex = shaderHitGroupIndex;
+}
+
+uint32_t Model::GetDefaultShaderHitGroupIndex() {
+   return sm_ShaderHitGroupIndex;
+}
+
+
+void Model::SetJobSystem(Vulkan::JobSystem* jobSystem) {
+   sm_JobSystem = jobSystem;
+}
+
+
+void Model::ImportObj(const char* filename, Vulkan::JobSystem* jobSystem, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+   const Vulkan::ObjData obj = Vulkan::ImportObj(filename, jobSystem);
+   if (obj.HasPolygons) {
+      ImportObjTinyObjLoader(filename, vertices, indices);
+      return;
+   }
+   Vulkan::BuildIndexedMesh(obj, [] (const Vulkan::ObjData& obj, const Vulkan::ObjIndex& index) {
+      Vertex vertex = {
+         {
+            obj.Positions[3 * index.Position + 0],
+            obj.Positions[3 * index.Position + 1],
+            obj.Positions[3 * index.Position + 2],
+         } /*Pos*/
+      };
+      if (index.Normal >= 0) {
+         vertex.normal = {
+            obj.Normals[3 * index.Normal + 0],
+            obj.Normals[3 * index.Normal + 1],
+            obj.Normals[3 * index.Normal + 2],
+         };
+      }
+      if (index.TexCoord >= 0) {
+         vertex.uv = {
+            obj.TexCoords[2 * index.TexCoord + 0],
+            obj.TexCoords[2 * index.TexCoord + 1],
+         };
+      }
+      return vertex;
+   }, vertices, indices);
+}
+
+
+void Model::ImportObjTinyObjLoader(const char* filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+   vertices.clear();
+   indices.clear();
+
    tinyobj::attrib_t attrib;
    std::vector<tinyobj::shape_t> shapes;
    std::vector<tinyobj::material_t> materials;
@@ -48,46 +145,10 @@ Model::Model(const char* filename, const uint32_t shaderHitGroupIndex)
          }
 
          if (uniqueVertices.count(vertex) == 0) {
-            uniqueVertices[vertex] = static_cast<uint32_t>(m_Vertices.size());
-            m_Vertices.push_back(vertex);
+            uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(vertex);
          }
-         m_Indices.push_back(uniqueVertices[vertex]);
+         indices.push_back(uniqueVertices[vertex]);
       }
    }
 }
-
-
-const std::vector<Vertex>& Model::GetVertices() const {
-   return m_Vertices;
-}
-
-
-const std::vector<uint32_t>& Model::GetIndices() const {
-   return m_Indices;
-}
-
-
-bool Model::IsProcedural() const {
-   return false;
-}
-
-
-uint32_t Model::GetShaderHitGroupIndex() const {
-   ASSERT(m_ShaderHitGroupIndex != ~0, "ERROR: shader hit group index not set.  You must set the shader hit group index (via SetShaderHitGroupIndex()).");
-   return m_ShaderHitGroupIndex;
-}
-
-
-std::array<glm::vec3, 2> Model::GetBoundingBox() const {
-   ASSERT(false, "ERROR: GetBoundingBox() called for non-procedural model");
-   return {};
-};
-
-
-void Model::SetDefaultShaderHitGroupIndex(const uint32_t shaderHitGroupIndex) {
-   sm_ShaderHitGroupIndex = shaderHitGroupIndex;
-}
-
-uint32_t Model::GetDefaultShaderHitGroupIndex() {
-   return sm_ShaderHitGroupIndex;
-}
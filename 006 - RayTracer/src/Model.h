@@ -2,7 +2,10 @@
 
 #include "Vertex.h"
 
+#include "JobSystem.h"
+
 #include <array>
+#include <string>
 
 class Model {
 public:
@@ -19,10 +22,14 @@ public:
 
    const std::vector<uint32_t>& GetIndices() const;
 
+   // File the model was loaded from
+   const std::string& GetFileName() const;
+
    // If true, then model intersections will be determined via AABBs + procedural shader
    virtual bool IsProcedural() const;
 
-   // Shader hit group to use for model intersections.
+   // Geometry type of the model (i.e. which closest hit, and intersection, shaders its hits use).  Each geometry type
+   // has a shader hit group per material type (see GetInstanceHitGroupIndex()).
    uint32_t GetShaderHitGroupIndex() const;
 
    // only returns sensible result if IsProcedural() = true
@@ -32,10 +39,21 @@ public:
    static void SetDefaultShaderHitGroupIndex(const uint32_t shaderHitGroupIndex);
    static uint32_t GetDefaultShaderHitGroupIndex();
 
+   // Job system used to parse .obj files in parallel (may be null, in which case they are parsed serially)
+   static void SetJobSystem(Vulkan::JobSystem* jobSystem);
+
+   // Import an .obj file into deduplicated vertices and indices, as the Model constructor does on a mesh cache miss.
+   // ImportObj() uses the chunked parallel parser (Vulkan::ImportObj()); ImportObjTinyObjLoader() is the reference
+   // implementation that it must give identical results to.
+   static void ImportObj(const char* filename, Vulkan::JobSystem* jobSystem, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+   static void ImportObjTinyObjLoader(const char* filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
 private:
+   std::string m_FileName;
    std::vector<Vertex> m_Vertices;
    std::vector<uint32_t> m_Indices;
    uint32_t m_ShaderHitGroupIndex;
 
    static uint32_t sm_ShaderHitGroupIndex;
+   static Vulkan::JobSystem* sm_JobSystem;
 };
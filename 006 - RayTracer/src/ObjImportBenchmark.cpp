@@ -0,0 +1,141 @@
+#include "ObjImportBenchmark.h"
+
+#include "Benchmark.h"
+#include "Log.h"
+#include "Model.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t GridSize = 1024;   // generated files are a GridSize x GridSize grid of quads (two million triangles)
+
+
+struct Mesh {
+   std::vector<Vertex> Vertices;
+   std::vector<uint32_t> Indices;
+};
+
+
+bool IsSameMesh(const Mesh& a, const Mesh& b) {
+   return
+      (a.Vertices.size() == b.Vertices.size()) &&
+      (a.Indices == b.Indices) &&
+      (a.Vertices.empty() || (std::memcmp(a.Vertices.data(), b.Vertices.data(), a.Vertices.size() * sizeof(Vertex)) == 0))
+   ;
+}
+
+
+// A bumpy (GridSize + 1) x (GridSize + 1) vertex grid.
+// isQuads => positions and normals only, quad faces, relative (negative) indices
+// otherwise => positions, normals and texture coordinates, triangle faces, absolute indices
+void WriteGrid(const std::filesystem::path& fileName, const bool isQuads) {
+   std::ofstream file(fileName, std::ios::binary);
+   if (!file) {
+      throw std::runtime_error("Could not create '" + fileName.string() + "'");
+   }
+   constexpr uint32_t n = GridSize + 1;
+   char line[128];
+   std::string text;
+   text.reserve(1 << 20);
+   const auto flush = [&file, &text] (const bool isFinal) {
+      if (isFinal || (text.size() > (1 << 20) - sizeof(line))) {
+         file.write(text.data(), text.size());
+         text.clear();
+      }
+   };
+   const auto append = [&text, &line, &flush] (const int length) {
+      text.append(line, length);
+      flush(false);
+   };
+
+   text += "# generated by ObjImportBenchmark\no Grid\n";
+   for (uint32_t y = 0; y < n; ++y) {
+      for (uint32_t x = 0; x < n; ++x) {
+         const float u = static_cast<float>(x) / GridSize;
+         const float v = static_cast<float>(y) / GridSize;
+         const float h = 0.05f * std::sin(40.0f * u) * std::cos(40.0f * v);
+         append(std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", u - 0.5f, h, v - 0.5f));
+         append(std::snprintf(line, sizeof(line), "vn %.4f %.4f %.4f\n", -2.0f * std::cos(40.0f * u) * std::cos(40.0f * v), 1.0f, 2.0f * std::sin(40.0f * u) * std::sin(40.0f * v)));
+         if (!isQuads) {
+            append(std::snprintf(line, sizeof(line), "vt %.6f %.6f\n", u, v));
+         }
+      }
+      if (isQuads && (y > 0)) {
+         // faces of the row just finished, relative to the end of it
+         for (uint32_t x = 0; x < GridSize; ++x) {
+            const int i00 = static_cast<int>(x) - static_cast<int>(2 * n);
+            const int i10 = i00 + 1;
+            const int i01 = i00 + static_cast<int>(n);
+            const int i11 = i01 + 1;
+            append(std::snprintf(line, sizeof(line), "f %d//%d %d//%d %d//%d %d//%d\n", i00, i00, i01, i01, i11, i11, i10, i10));
+         }
+      }
+   }
+   if (!isQuads) {
+      for (uint32_t y = 0; y < GridSize; ++y) {
+         for (uint32_t x = 0; x < GridSize; ++x) {
+            const uint32_t i00 = y * n + x + 1;
+            const uint32_t i10 = i00 + 1;
+            const uint32_t i01 = i00 + n;
+            const uint32_t i11 = i01 + 1;
+            append(std::snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\n", i00, i00, i00, i01, i01, i01, i11, i11, i11));
+            append(std::snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\n", i00, i00, i00, i11, i11, i11, i10, i10, i10));
+         }
+      }
+   }
+   flush(true);
+   if (!file) {
+      throw std::runtime_error("Failed writing '" + fileName.string() + "'");
+   }
+}
+
+
+void BenchmarkFile(Vulkan::JobSystem& jobSystem, const std::filesystem::path& fileName) {
+   const std::string name = fileName.string();
+
+   Mesh reference;
+   Model::ImportObjTinyObjLoader(name.c_str(), reference.Vertices, reference.Indices);
+   const double tinyObjMilliseconds = Benchmark::BestMilliseconds([&name] { Mesh mesh; Model::ImportObjTinyObjLoader(name.c_str(), mesh.Vertices, mesh.Indices); });
+
+   Mesh serial;
+   Model::ImportObj(name.c_str(), nullptr, serial.Vertices, serial.Indices);
+   const double serialMilliseconds = Benchmark::BestMilliseconds([&name] { Mesh mesh; Model::ImportObj(name.c_str(), nullptr, mesh.Vertices, mesh.Indices); });
+
+   Mesh parallel;
+   Model::ImportObj(name.c_str(), &jobSystem, parallel.Vertices, parallel.Indices);
+   const double parallelMilliseconds = Benchmark::BestMilliseconds([&name, &jobSystem] { Mesh mesh; Model::ImportObj(name.c_str(), &jobSystem, mesh.Vertices, mesh.Indices); });
+
+   LOG_INFO("OBJ import {0} ({1} MB, {2} vertices, {3} triangles): tinyobjloader {4:.1f}ms, 1 thread {5:.1f}ms ({6:.1f}x), {7} threads {8:.1f}ms ({9:.1f}x)", name, std::filesystem::file_size(fileName) / (1024 * 1024), reference.Vertices.size(), reference.Indices.size() / 3, tinyObjMilliseconds, serialMilliseconds, tinyObjMilliseconds / serialMilliseconds, jobSystem.GetThreadCount(), parallelMilliseconds, tinyObjMilliseconds / parallelMilliseconds);
+   if (!IsSameMesh(reference, serial) || !IsSameMesh(reference, parallel)) {
+      LOG_ERROR("OBJ import {0}: result differs from tinyobjloader's", name);
+   }
+}
+
+}
+
+
+void RunObjImportBenchmarks(Vulkan::JobSystem& jobSystem, const std::filesystem::path& fileName) {
+   if (!fileName.empty()) {
+      BenchmarkFile(jobSystem, fileName);
+      return;
+   }
+
+   const std::filesystem::path directory = std::filesystem::temp_directory_path() / "ObjImportBenchmark";
+   std::filesystem::create_directories(directory);
+   try {
+      for (const bool isQuads : {false, true}) {
+         const std::filesystem::path generatedFileName = directory / (isQuads ? "GridQuads.obj" : "GridTriangles.obj");
+         WriteGrid(generatedFileName, isQuads);
+         BenchmarkFile(jobSystem, generatedFileName);
+      }
+   } catch (...) {
+      std::filesystem::remove_all(directory);
+      throw;
+   }
+   std::filesystem::remove_all(directory);
+}
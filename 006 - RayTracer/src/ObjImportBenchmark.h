@@ -0,0 +1,13 @@
+#pragma once
+
+#include "JobSystem.h"
+
+#include <filesystem>
+
+// Benchmark of the chunked parallel .obj importer (Model::ImportObj()) versus tinyobjloader
+// (Model::ImportObjTinyObjLoader()).
+// If fileName is empty, then the benchmark is run on generated multi-million triangle files (one of triangles with
+// positions, normals and texture coordinates, and one of quads using relative indices), which are deleted afterwards.
+// Each file is imported with tinyobjloader, with the new importer on one thread, and with the new importer on all of
+// jobSystem's threads.  The results are checked to be identical, and timings are logged.
+void RunObjImportBenchmarks(Vulkan::JobSystem& jobSystem, const std::filesystem::path& fileName);
@@ -0,0 +1,85 @@
+#include "PipelineFeatures.h"
+
+#include "Core.h"
+#include "LightList.h"
+#include "Specialization.glsl"
+#include "TlasInstances.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+static_assert(offsetof(PipelineFeatures, MinRayBounces) == CONSTANT_MINRAYBOUNCES * sizeof(uint32_t), "PipelineFeatures must be in specialization constant id order");
+static_assert(offsetof(PipelineFeatures, MaxRayBounces) == CONSTANT_MAXRAYBOUNCES * sizeof(uint32_t), "PipelineFeatures must be in specialization constant id order");
+static_assert(offsetof(PipelineFeatures, MaterialTypes) == CONSTANT_MATERIALTYPES * sizeof(uint32_t), "PipelineFeatures must be in specialization constant id order");
+static_assert(offsetof(PipelineFeatures, TextureTypes) == CONSTANT_TEXTURETYPES * sizeof(uint32_t), "PipelineFeatures must be in specialization constant id order");
+static_assert(offsetof(PipelineFeatures, EnvironmentMap) == CONSTANT_ENVIRONMENTMAP * sizeof(uint32_t), "PipelineFeatures must be in specialization constant id order");
+static_assert(offsetof(PipelineFeatures, Lights) == CONSTANT_LIGHTS * sizeof(uint32_t), "PipelineFeatures must be in specialization constant id order");
+
+
+bool PipelineFeatures::operator==(const PipelineFeatures& other) const {
+   return
+      (MinRayBounces == other.MinRayBounces) &&
+      (MaxRayBounces == other.MaxRayBounces) &&
+      (MaterialTypes == other.MaterialTypes) &&
+      (TextureTypes == other.TextureTypes) &&
+      (EnvironmentMap == other.EnvironmentMap) &&
+      (Lights == other.Lights) &&
+      (HitGroups == other.HitGroups)
+   ;
+}
+
+
+bool PipelineFeatures::Covers(const PipelineFeatures& other) const {
+   return
+      (MinRayBounces == other.MinRayBounces) &&
+      (MaxRayBounces == other.MaxRayBounces) &&
+      ((MaterialTypes & other.MaterialTypes) == other.MaterialTypes) &&
+      ((TextureTypes & other.TextureTypes) == other.TextureTypes) &&
+      (EnvironmentMap == other.EnvironmentMap) &&
+      (Lights == other.Lights) &&
+      ((HitGroups & other.HitGroups) == other.HitGroups)
+   ;
+}
+
+
+std::string PipelineFeatures::ToString() const {
+   char text[192];
+   std::snprintf(text, sizeof(text), "bounces %u to %u, material types 0x%02x, texture types 0x%03x, %s, %s, hit groups 0x%05x", MinRayBounces, MaxRayBounces, MaterialTypes, TextureTypes, EnvironmentMap ? "environment map" : "sky gradient", Lights ? "light list" : "no light list", HitGroups);
+   return text;
+}
+
+
+PipelineFeatures GetPipelineFeatures(const Scene& scene) {
+   PipelineFeatures features;
+   std::vector<bool> isUsed(scene.GetMaterials().size(), false);
+   for (const auto& instance : scene.GetInstances()) {
+      isUsed[instance.GetMaterialIndex()] = true;
+      const uint32_t hitGroupIndex = GetInstanceHitGroupIndex(scene, instance);
+      ASSERT(hitGroupIndex < 32, "ERROR: Hit group index {0} does not fit in PipelineFeatures::HitGroups", hitGroupIndex);
+      features.HitGroups |= 1u << hitGroupIndex;
+   }
+   for (size_t i = 0; i < isUsed.size(); ++i) {
+      if (!isUsed[i]) {
+         continue;
+      }
+      // only the textures that Scatter.glsl looks at for each type of material
+      const Material& material = scene.GetMaterials()[i];
+      features.MaterialTypes |= 1u << material.type;
+      if (IsListedLight(material)) {
+         features.Lights = 1;
+      }
+      if (material.type != MATERIAL_METALLIC) {
+         features.TextureTypes |= TEXTURETYPE_BIT(material.diffuseTextureType);
+      }
+      if ((material.type == MATERIAL_PHONG) || (material.type == MATERIAL_METALLIC)) {
+         features.TextureTypes |= TEXTURETYPE_BIT(material.specularTextureType);
+      }
+   }
+
+   features.MaxRayBounces = ((features.MaterialTypes & ~(1u << MATERIAL_LIGHT)) == 0) ? 0 : scene.GetMaxRayBounces();
+   features.MinRayBounces = std::min(scene.GetMinRayBounces(), features.MaxRayBounces);
+   features.EnvironmentMap = scene.GetEnvironmentMapFileName().empty() ? 0 : 1;
+   return features;
+}
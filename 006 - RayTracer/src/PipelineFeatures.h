@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Scene.h"
+
+#include <cstdint>
+#include <string>
+
+// What the ray tracing shaders are specialized on (see Specialization.glsl).
+// Members are in specialization constant id order, so that this can be the specialization data as is.
+struct PipelineFeatures {
+   uint32_t MinRayBounces = 0;
+   uint32_t MaxRayBounces = 0;
+   uint32_t MaterialTypes = 0;   // bit (1 << MATERIAL_xxx) for each material type
+   uint32_t TextureTypes = 0;    // bit TEXTURETYPE_BIT(TEXTURE_xxx) for each texture type
+   uint32_t EnvironmentMap = 0;  // (a VkBool32) the scene has an environment map
+   uint32_t Lights = 0;          // (a VkBool32) the scene's light list (see LightList.h) is not empty
+
+   // Not a specialization constant: bit (1 << GetInstanceHitGroupIndex()) for each hit group that instances use.  The
+   // pipeline only has these hit groups.
+   uint32_t HitGroups = 0;
+
+   bool operator==(const PipelineFeatures& other) const;
+   bool operator!=(const PipelineFeatures& other) const { return !(*this == other); }
+
+   // True if a pipeline specialized on these features renders a scene that needs only other's exactly as a pipeline
+   // specialized on other would.  That is: bounce limits, environment map and lights are equal, and material types,
+   // texture types and hit groups are supersets of other's.
+   bool Covers(const PipelineFeatures& other) const;
+
+   std::string ToString() const;
+};
+
+
+// The features that scene needs: its bounce limits, whether it has an environment map and lights to sample, and the
+// material types, texture types and hit groups that its instances use.
+// If nothing in the scene scatters rays (e.g. all lights), then there is no need to bounce at all.
+PipelineFeatures GetPipelineFeatures(const Scene& scene);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+using mat3x4 = glm::mat3x4;
+using uint = uint32_t;
+#include "Primitive.glsl"
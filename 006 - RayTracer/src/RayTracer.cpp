@@ -6,10 +6,23 @@
 using uint = uint32_t;
 #include "Constants.glsl"
 #include "Box.h"
+#include "BvhBenchmark.h"
+#include "EnvironmentMap.h"
+#include "EnvironmentMapBenchmark.h"
 #include "GeometryInstance.h"
+#include "Ktx2File.h"
+#include "LightSamplingBenchmark.h"
+#include "LightTreeBenchmark.h"
+#include "MeshCacheBenchmark.h"
+#include "ObjImportBenchmark.h"
 #include "Offset.h"
+#include "Primitive.h"
 #include "Rectangle2D.h"
+#include "Specialization.glsl"
 #include "Sphere.h"
+#include "TextureLoader.h"
+#include "TlasInstances.h"
+#include "TlasUpdateBenchmark.h"
 
 using mat4 = glm::mat4;
 using uint = uint32_t;
@@ -22,10 +35,14 @@ using vec3 = glm::vec3;
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <random>
+#include <unordered_map>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
 
 #define M_PI 3.14159265358979323846f
 
@@ -47,6 +64,71 @@ inline float RandomFloat(float min, float max) {
 }
 
 
+// Compares everything that a scene file saves
+bool IsSameScene(const Scene& a, const Scene& b) {
+   if (
+      (a.GetHorizonColor() != b.GetHorizonColor()) ||
+      (a.GetZenithColor() != b.GetZenithColor()) ||
+      (a.GetEnvironmentMapFileName() != b.GetEnvironmentMapFileName()) ||
+      (a.GetAccumulateFrames() != b.GetAccumulateFrames()) ||
+      (a.GetMinRayBounces() != b.GetMinRayBounces()) ||
+      (a.GetMaxRayBounces() != b.GetMaxRayBounces()) ||
+      (a.GetTextureNames() != b.GetTextureNames()) ||
+      (a.GetTextureFileNames() != b.GetTextureFileNames()) ||
+      (a.GetModels().size() != b.GetModels().size()) ||
+      (a.GetInstances().size() != b.GetInstances().size())
+   ) {
+      return false;
+   }
+   for (size_t i = 0; i < a.GetModels().size(); ++i) {
+      if ((a.GetModels()[i]->IsProcedural() != b.GetModels()[i]->IsProcedural()) || (a.GetModels()[i]->GetFileName() != b.GetModels()[i]->GetFileName())) {
+         return false;
+      }
+   }
+   for (size_t i = 0; i < a.GetInstances().size(); ++i) {
+      const Instance& instanceA = a.GetInstances()[i];
+      const Instance& instanceB = b.GetInstances()[i];
+      if (
+         (instanceA.GetModelIndex() != instanceB.GetModelIndex()) ||
+         (std::memcmp(&instanceA.GetTransform(), &instanceB.GetTransform(), sizeof(glm::mat3x4)) != 0) ||
+         (std::memcmp(&a.GetMaterials()[instanceA.GetMaterialIndex()], &b.GetMaterials()[instanceB.GetMaterialIndex()], sizeof(Material)) != 0)
+      ) {
+         return false;
+      }
+   }
+   return true;
+}
+
+
+// Log how much sharing materials between instances saves, compared with one material per instance
+void LogMaterialDeduplication(const std::string& sceneName, const Scene& scene) {
+   const size_t instanceCount = scene.GetInstances().size();
+   const size_t materialCount = scene.GetMaterials().size();
+   LOG_INFO("Scene {0}: {1} instances share {2} unique materials ({3:.1f}:1).  Material buffer {4} bytes, instead of {5} bytes", sceneName, instanceCount, materialCount, static_cast<double>(instanceCount) / std::max<size_t>(materialCount, 1), materialCount * sizeof(Material), instanceCount * sizeof(Material));
+}
+
+
+const RayTracer::GeometryShaders RayTracer::sm_GeometryShaders[eNumGeometryTypes] = {
+   {"Assets/Shaders/Triangles.rchit.spv", nullptr},                          // eTrianglesGeometry
+   {"Assets/Shaders/Sphere.rchit.spv",    "Assets/Shaders/Sphere.rint.spv"}, // eSphereGeometry
+   {"Assets/Shaders/Box.rchit.spv",       "Assets/Shaders/Box.rint.spv"}     // eBoxGeometry
+};
+
+
+const RayTracer::BuiltinScene RayTracer::sm_BuiltinScenes[] = {
+   {"FurnaceTest",                          &RayTracer::CreateSceneFurnaceTest},
+   {"NormalsTest",                          &RayTracer::CreateSceneNormalsTest},
+   {"Simple",                               &RayTracer::CreateSceneSimple},
+   {"RayTracingInOneWeekend",               &RayTracer::CreateSceneRayTracingInOneWeekend},
+   {"RayTracingTheNextWeekTexturesAndLight", &RayTracer::CreateSceneRayTracingTheNextWeekTexturesAndLight},
+   {"CornellBoxWithBoxes",                  &RayTracer::CreateSceneCornellBoxWithBoxes},
+   {"CornellBoxWithSmokeBoxes",             &RayTracer::CreateSceneCornellBoxWithSmokeBoxes},
+   {"CornellBoxWithEarth",                  &RayTracer::CreateSceneCornellBoxWithEarth},
+   {"RayTracingTheNextWeekFinal",           &RayTracer::CreateSceneRayTracingTheNextWeekFinal},
+   {"WineGlass",                            &RayTracer::CreateSceneWineGlass}
+};
+
+
 RayTracer::RayTracer(int argc, const char* argv[])
 : Vulkan::Application {
    { "Ray Tracer", VK_MAKE_VERSION(1,0,0) },
@@ -57,11 +139,24 @@ RayTracer::RayTracer(int argc, const char* argv[])
 #endif
 }
 {
-   Init();
+   ParseCommandLine(argc, argv);
+   if (m_IsBvhBenchmark || !m_MeshCacheBenchmarkDirectory.empty() || m_IsObjImportBenchmark || m_IsTlasUpdateBenchmark || m_IsEnvironmentMapBenchmark || m_IsLightSamplingBenchmark || m_IsLightTreeBenchmark || !m_ExportScenesDirectory.empty()) {
+      CreateJobSystem();
+   } else if (!m_CpuReferenceFile.empty()) {
+      // rendering on the CPU only needs the scene, not a Vulkan device (or window)
+      CreateJobSystem();
+      CreateScene();
+      if (!m_EnvironmentMapFileName.empty()) {
+         m_Scene.SetEnvironmentMapFileName(m_EnvironmentMapFileName);
+      }
+   } else {
+      Init();
+   }
 }
 
 
 RayTracer::~RayTracer() {
+   Model::SetJobSystem(nullptr);
    DestroyDescriptorSets();
    DestroyDescriptorPool();
    DestroyPipeline();
@@ -70,7 +165,10 @@ RayTracer::~RayTracer() {
    DestroyUniformBuffers();
    DestroyStorageImages();
    DestroyAccelerationStructures();
+   DestroyLightResources();
+   DestroyEnvironmentMapResources();
    DestroyTextureResources();
+   DestroyPrimitiveBuffer();
    DestroyMaterialBuffer();
    DestroyAABBBuffer();
    DestroyOffsetBuffer();
@@ -96,6 +194,8 @@ vk::PhysicalDeviceFeatures RayTracer::GetRequiredPhysicalDeviceFeatures(vk::Phys
    } else {
       ASSERT(false, "Device does not support sampler anisotrophy")
    }
+   // optional: textures are only loaded block compressed if this is available
+   features.setTextureCompressionBC(availableFeatures.textureCompressionBC);
    return features;
 }
 
@@ -107,6 +207,56 @@ void* RayTracer::GetRequiredPhysicalDeviceFeaturesEXT() {
 }
 
 
+bool RayTracer::ParseArgument(std::string_view arg, std::string_view value) {
+   if (arg == "--cpu-reference") {
+      m_CpuReferenceFile = value;
+      return true;
+   } else if (arg == "--samples") {
+      m_CpuReferenceSampleCount = std::max(1u, static_cast<uint32_t>(std::stoul(std::string(value))));
+      return true;
+   } else if (arg == "--benchmark-bvh") {
+      m_IsBvhBenchmark = true;
+      return true;
+   } else if (arg == "--benchmark-mesh-cache") {
+      m_MeshCacheBenchmarkDirectory = value.empty() ? "Assets/Models" : value;
+      return true;
+   } else if (arg == "--benchmark-obj-import") {
+      m_IsObjImportBenchmark = true;
+      m_ObjImportBenchmarkFile = value;
+      return true;
+   } else if (arg == "--benchmark-tlas-update") {
+      m_IsTlasUpdateBenchmark = true;
+      return true;
+   } else if (arg == "--benchmark-environment-map") {
+      m_IsEnvironmentMapBenchmark = true;
+      m_EnvironmentMapBenchmarkFile = value;
+      return true;
+   } else if (arg == "--benchmark-light-sampling") {
+      m_IsLightSamplingBenchmark = true;
+      return true;
+   } else if (arg == "--benchmark-light-tree") {
+      m_IsLightTreeBenchmark = true;
+      return true;
+   } else if (arg == "--environment") {
+      m_EnvironmentMapFileName = value;
+      return true;
+   } else if (arg == "--animate") {
+      m_IsAnimating = true;
+      return true;
+   } else if (arg == "--merge-instances") {
+      m_IsMergingInstances = true;
+      return true;
+   } else if (arg == "--scene") {
+      m_SceneName = value;
+      return true;
+   } else if (arg == "--export-scenes") {
+      m_ExportScenesDirectory = value;
+      return true;
+   }
+   return false;
+}
+
+
 void RayTracer::Init() {
    Vulkan::Application::Init();
 
@@ -120,12 +270,29 @@ void RayTracer::Init() {
    }
 
    CreateScene();
+   if (!m_EnvironmentMapFileName.empty()) {
+      m_Scene.SetEnvironmentMapFileName(m_EnvironmentMapFileName);
+   }
+   if (m_IsMergingInstances) {
+      if (m_IsAnimating) {
+         LOG_WARN("Ignoring --merge-instances: merged instances are static, but --animate moves them");
+      } else {
+         m_MergedInstances = MergeProceduralInstances(m_Scene, 2);
+      }
+   }
    CreateVertexBuffer();
    CreateIndexBuffer();
+   CreateLightResources();
    CreateOffsetBuffer();
    CreateAABBBuffer();
    CreateMaterialBuffer();
+   CreatePrimitiveBuffer();
    CreateTextureResources();
+   CreateEnvironmentMapResources();
+
+   // all of the above uploads go in one batch.  Acceleration structure build reads the vertex, index and AABB buffers
+   m_UploadManager->Wait(m_UploadManager->Submit());
+
    CreateAccelerationStructures();
    CreateStorageImages();
    CreateUniformBuffers();
@@ -134,15 +301,142 @@ void RayTracer::Init() {
    CreatePipeline();
    CreateDescriptorPool();
    CreateDescriptorSets();
-   RecordCommandBuffers();
+}
+
+
+void RayTracer::Run() {
+   if (m_IsBvhBenchmark) {
+      RunBvhBenchmarks(*m_JobSystem);
+   } else if (!m_MeshCacheBenchmarkDirectory.empty()) {
+      RunMeshCacheBenchmarks(m_MeshCacheBenchmarkDirectory);
+   } else if (m_IsObjImportBenchmark) {
+      RunObjImportBenchmarks(*m_JobSystem, m_ObjImportBenchmarkFile);
+   } else if (m_IsTlasUpdateBenchmark) {
+      RunTlasUpdateBenchmarks();
+   } else if (m_IsEnvironmentMapBenchmark) {
+      RunEnvironmentMapBenchmarks(*m_JobSystem, m_EnvironmentMapBenchmarkFile);
+   } else if (m_IsLightSamplingBenchmark) {
+      RunLightSamplingBenchmarks();
+   } else if (m_IsLightTreeBenchmark) {
+      RunLightTreeBenchmarks(*m_JobSystem);
+   } else if (!m_ExportScenesDirectory.empty()) {
+      ExportScenes();
+   } else if (!m_CpuReferenceFile.empty()) {
+      RenderCpuReference();
+   } else {
+      Vulkan::Application::Run();
+   }
+}
+
+
+CpuPathTracer::Settings RayTracer::GetCpuReferenceSettings(const uint32_t width, const uint32_t height) const {
+   CpuPathTracer::Settings settings;
+   settings.Width = width;
+   settings.Height = height;
+   settings.MinRayBounces = m_Scene.GetMinRayBounces();
+   settings.MaxRayBounces = m_Scene.GetMaxRayBounces();
+
+   // same camera as RenderFrame()
+   glm::mat4 projection = glm::perspective(m_FoVRadians, static_cast<float>(settings.Width) / static_cast<float>(settings.Height), 0.01f, 100.0f);
+   projection[1][1] *= -1;
+   glm::mat4 modelView = glm::lookAt(m_Eye, m_Eye + glm::normalize(m_Direction), m_Up);
+   settings.ViewInverse = glm::inverse(modelView);
+   settings.ProjectionInverse = glm::inverse(projection);
+   return settings;
+}
+
+
+void RayTracer::RenderCpuReference() {
+   CpuPathTracer::Settings settings = GetCpuReferenceSettings(m_Settings.WindowWidth, m_Settings.WindowHeight);
+   settings.SampleCount = m_CpuReferenceSampleCount;
+
+   CpuPathTracer pathTracer(m_Scene, *m_JobSystem);
+   std::vector<glm::vec3> pixels = pathTracer.Render(settings);
+   CpuPathTracer::WriteImage(m_CpuReferenceFile, settings.Width, settings.Height, pixels);
+
+   const CpuPathTracer::Stats& stats = pathTracer.GetStats();
+   LOG_INFO("CPU reference: {0}x{1}, {2} samples per pixel, on {3} threads: {4:.3f}s, {5} rays ({6:.2f} million rays/s).  Written to {7}", settings.Width, settings.Height, settings.SampleCount, m_JobSystem->GetThreadCount(), stats.Seconds, stats.RayCount, stats.RayCount / (stats.Seconds * 1e6), m_CpuReferenceFile);
+}
+
+
+void RayTracer::ExportScenes() {
+   std::filesystem::create_directories(m_ExportScenesDirectory);
+   for (const auto& builtinScene : sm_BuiltinScenes) {
+      m_Scene = {};
+      SetCamera({});
+      m_SceneName = builtinScene.Name;
+      CreateScene();
+      const SceneCamera camera = GetCamera();
+
+      for (const char* extension : {".scene", ".scenebin"}) {
+         const std::filesystem::path fileName = std::filesystem::path(m_ExportScenesDirectory) / (m_SceneName + extension);
+         SceneFile::Save(fileName, m_Scene, camera);
+
+         // check the round trip.  (field of view is saved in degrees, so might be out by a rounding error)
+         Scene scene;
+         const SceneCamera loadedCamera = SceneFile::Load(fileName, scene, *m_JobSystem);
+         if (
+            !IsSameScene(m_Scene, scene) ||
+            (loadedCamera.Eye != camera.Eye) ||
+            (loadedCamera.Direction != camera.Direction) ||
+            (loadedCamera.Up != camera.Up) ||
+            (std::abs(loadedCamera.FoVRadians - camera.FoVRadians) > 1e-6f)
+         ) {
+            LOG_ERROR("Exported scene {0} does not load back the same", fileName.string());
+         } else {
+            LOG_INFO("Exported scene {0}: {1} models, {2} instances", fileName.string(), scene.GetModels().size(), scene.GetInstances().size());
+         }
+      }
+      LogMaterialDeduplication(m_SceneName, m_Scene);
+   }
+}
+
+
+void RayTracer::RunLightSamplingBenchmarks() {
+   // small square images, as the Cornell boxes are square
+   constexpr uint32_t ImageSize = 128;
+   for (const char* sceneName : {"CornellBoxWithBoxes", "CornellBoxWithSmokeBoxes", "CornellBoxWithEarth"}) {
+      m_Scene = {};
+      SetCamera({});
+      m_SceneName = sceneName;
+      CreateScene();
+      RunLightSamplingBenchmark(m_SceneName, m_Scene, GetCpuReferenceSettings(ImageSize, ImageSize), *m_JobSystem);
+   }
+}
+
+
+SceneCamera RayTracer::GetCamera() const {
+   return {m_Eye, m_Direction, m_Up, m_FoVRadians};
+}
+
+
+void RayTracer::SetCamera(const SceneCamera& camera) {
+   m_Eye = camera.Eye;
+   m_Direction = camera.Direction;
+   m_Up = camera.Up;
+   m_FoVRadians = camera.FoVRadians;
 }
 
 
 void RayTracer::CreateScene() {
 
-   Model::SetDefaultShaderHitGroupIndex(eTrianglesHitGroup - eFirstHitGroup);
-   Sphere::SetDefaultShaderHitGroupIndex(eSphereHitGroup - eFirstHitGroup);
-   Box::SetDefaultShaderHitGroupIndex(eBoxHitGroup - eFirstHitGroup);
+   Model::SetDefaultShaderHitGroupIndex(eTrianglesGeometry);
+   Sphere::SetDefaultShaderHitGroupIndex(eSphereGeometry);
+   Box::SetDefaultShaderHitGroupIndex(eBoxGeometry);
+   Model::SetJobSystem(m_JobSystem.get());
+
+   const std::filesystem::path sceneFile = m_SceneName;
+   if ((sceneFile.extension() == ".scene") || (sceneFile.extension() == ".scenebin")) {
+      const auto start = std::chrono::steady_clock::now();
+      SetCamera(SceneFile::Load(sceneFile, m_Scene, *m_JobSystem));
+      LOG_INFO("Loaded scene {0} ({1} models, {2} instances) in {3:.2f}ms", m_SceneName, m_Scene.GetModels().size(), m_Scene.GetInstances().size(), std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+      return;
+   }
+
+   const auto builtinScene = std::find_if(std::begin(sm_BuiltinScenes), std::end(sm_BuiltinScenes), [this] (const BuiltinScene& scene) { return m_SceneName == scene.Name; });
+   if (builtinScene == std::end(sm_BuiltinScenes)) {
+      throw std::runtime_error("Unknown scene '" + m_SceneName + "'.  Expected the name of a built in scene, or a .scene or .scenebin file");
+   }
 
    m_Scene.AddTextureResource("Earth", "Assets/Textures/earthmap.jpg");
 
@@ -151,17 +445,7 @@ void RayTracer::CreateScene() {
    ProceduralBoxInstance::SetModelIndex(m_Scene.AddModel(std::make_unique<Box>(true)));
    Rectangle2DInstance::SetModelIndex(m_Scene.AddModel(std::make_unique<Rectangle2D>()));
 
-   //CreateSceneFurnaceTest();
-   //CreateSceneNormalsTest();
-   //CreateSceneSimple();
-   //CreateSceneRayTracingInOneWeekend();
-   //CreateSceneRayTracingTheNextWeekTexturesAndLight();
-   //CreateSceneCornellBoxWithBoxes();
-   //CreateSceneCornellBoxWithSmokeBoxes();
-   //CreateSceneCornellBoxWithEarth();
-   //CreateSceneRayTracingTheNextWeekFinal();
-   CreateSceneWineGlass();
-
+   (this->*builtinScene->Create)();
 }
 
 
@@ -192,7 +476,7 @@ void RayTracer::CreateSceneFurnaceTest() {
          // If lambertian material is working properly, then the rendered result
          // should be a uniform grey filled circle.
          // The color of the circle should be RGB(180,180,180)   (=sqrt(0.5) from gamma correction, times 255 for conversion to RGB)
-         m_Scene.AddInstance(std::make_unique<SphereInstance>(glm::vec3 {0.0f, 1.0f, 2.0f}, 1.0f, grey));
+         m_Scene.AddInstance(SphereInstance(glm::vec3 {0.0f, 1.0f, 2.0f}, 1.0f, m_Scene.AddMaterial(grey)));
          break;
 
       case Test::metal:
@@ -200,7 +484,7 @@ void RayTracer::CreateSceneFurnaceTest() {
          // should be a uniform grey filled circle.
          // Because:  metal material is a perfect reflector (real metals aren't),
          // and metal tints reflected light with its color (not so "glossy" non-metals)
-         m_Scene.AddInstance(std::make_unique<SphereInstance>(glm::vec3 {0.0f, 1.0f, -2.0f}, 1.0f, metal));
+         m_Scene.AddInstance(SphereInstance(glm::vec3 {0.0f, 1.0f, -2.0f}, 1.0f, m_Scene.AddMaterial(metal)));
          break;
    }
 
@@ -220,25 +504,25 @@ void RayTracer::CreateSceneNormalsTest() {
    // Faces should be coloured consistently with the sphere.
    // (i.e. a face should be coloured the same as the point on the sphere that faces in same direction)
 
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(
+   m_Scene.AddInstance(SphereInstance(
       glm::vec3 {0.0f, 0.0f, 0.0f},
       1.0f,
-      normals
+      m_Scene.AddMaterial(normals)
    ));
 
 
-   m_Scene.AddInstance(std::make_unique<BoxInstance>(
+   m_Scene.AddInstance(BoxInstance(
       glm::vec3 {2.0f, 0.0f, 0.0f},
       glm::vec3 {1.0f},
       glm::vec3 {glm::radians(20.0f), glm::radians(45.0f), glm::radians(0.0f)},
-      normals
+      m_Scene.AddMaterial(normals)
    ));
  
 
    glm::vec3 glassCentre = {-2.0f, 0.0f, 0.0f};
    glm::vec3 glassSize = {1.0f, 1.0f, 1.0f};
    glm::mat3x4 transform = glm::transpose(glm::scale(glm::translate(glm::identity<glm::mat4x4>(), glassCentre), glassSize));
-   m_Scene.AddInstance(std::make_unique<Instance>(wineGlass, transform, normals));
+   m_Scene.AddInstance(Instance(wineGlass, transform, m_Scene.AddMaterial(normals)));
 }
 
 
@@ -256,23 +540,23 @@ void RayTracer::CreateSceneSimple() {
    Material chromium = Metallic(FlatColor({0.549f, 0.556f, 0.554f}), 0.0);
    Material light = Light(FlatColor({170.0f, 170.0f, 170.0f}), 0.0);
 
-   m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(
+   m_Scene.AddInstance(Rectangle2DInstance(
       glm::vec3 {0.0f, 0.0f, 0.0f},
       glm::vec2 {1000.0f, 1000.0f},
       glm::vec3 {glm::radians(-90.0f), glm::radians(0.0f), glm::radians(0.0f)},
-      blue
+      m_Scene.AddMaterial(blue)
    ));
 
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(
+   m_Scene.AddInstance(SphereInstance(
       glm::vec3 {0.0f, 1.0f, 0.0f}   /*centre*/,
       1.0f                            /*radius*/,
-      hardPlastic
+      m_Scene.AddMaterial(hardPlastic)
    ));
 
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(
+   m_Scene.AddInstance(SphereInstance(
       glm::vec3(0.0f, 20.0f, 20.0f),
       1.0f,
-      light
+      m_Scene.AddMaterial(light)
    ));
 }
 
@@ -284,13 +568,13 @@ void RayTracer::CreateSceneRayTracingInOneWeekend() {
    m_Scene.SetHorizonColor({0.75f, 0.85f, 1.0f});
    m_Scene.SetZenithColor({0.5f, 0.7f, 1.0f});
 
-   m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(
+   m_Scene.AddInstance(Rectangle2DInstance(
       glm::vec3 {0.0f, 0.0f, 0.0f}                                         /*origin*/,
       glm::vec2 {1000.0f, 1000.0f}                                              /*size*/,
       glm::vec3 {glm::radians(-90.0f), glm::radians(0.0f), glm::radians(0.0f)}  /*rotation*/,
-      Lambertian(                                                               /*material*/
+      m_Scene.AddMaterial(Lambertian(                                                               /*material*/
          FlatColor({0.5f, 0.5f, 0.5f})                                             /*texture*/
-      )
+      ))
    ));
 
    // small random spheres
@@ -318,38 +602,38 @@ void RayTracer::CreateSceneRayTracingInOneWeekend() {
             } else {
                material = Dielectric(FlatColor({1.0f, 1.0f, 1.0f}), 1.5f);
             }
-            m_Scene.AddInstance(std::make_unique<SphereInstance>(centre, 0.2f, material));
+            m_Scene.AddInstance(SphereInstance(centre, 0.2f, m_Scene.AddMaterial(material)));
          }
       }
    }
 
    // the three main spheres...
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(
+   m_Scene.AddInstance(SphereInstance(
       glm::vec3 {0.0f, 1.0f, 0.0f}    /*centre*/,
       1.0f                            /*radius*/,
-      Dielectric(                     /*material*/
+      m_Scene.AddMaterial(Dielectric(                     /*material*/
          FlatColor(                      /*transmittance*/
             {1.0f, 1.0f, 1.0f}
          ),
          1.5f                         /*refractive index*/
-      )
+      ))
    ));
 
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(
+   m_Scene.AddInstance(SphereInstance(
       glm::vec3 {-4.0f, 1.00f, 0.0f}     /*centre*/,
       1.0f                              /*radius*/,
-      Lambertian(                       /*material*/
+      m_Scene.AddMaterial(Lambertian(                       /*material*/
          FlatColor({0.4f, 0.2f, 0.1f})     /*diffuse*/
-      )
+      ))
    ));
 
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(
+   m_Scene.AddInstance(SphereInstance(
       glm::vec3 {4.0f, 1.0f, 0.0f}       /*centre*/,
       1.0f                               /*radius*/,
-      Metallic(                          /*material*/
+      m_Scene.AddMaterial(Metallic(                          /*material*/
          FlatColor({0.7f, 0.6f, 0.5f})      /*specular*/,
          0.01f                              /*roughness*/
-      )
+      ))
    ));
 }
 
@@ -367,13 +651,13 @@ void RayTracer::CreateSceneRayTracingTheNextWeekTexturesAndLight() {
 
    // note: Shifted everything up by 1 unit in the y direction, so that the background plane is not at y=0
    //       (checkerboard texture does not work well across large axis-aligned faces where sin(value) = 0)
-   m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(
+   m_Scene.AddInstance(Rectangle2DInstance(
       glm::vec3 {0.0f, 1.0f, 0.0f}                                         /*origin*/,
       glm::vec2 {1000.0f, 1000.0f}                                              /*size*/,
       glm::vec3 {glm::radians(-90.0f), glm::radians(0.0f), glm::radians(0.0f)}  /*rotation*/,
-      Lambertian(                                                               /*material*/
+      m_Scene.AddMaterial(Lambertian(                                                               /*material*/
          CheckerBoard({0.2f, 0.3f, 0.1f}, {0.9, 0.9, 0.9}, 10.0f)                  /*texture*/
-      )
+      ))
    ));
 
    // small random spheres
@@ -423,41 +707,41 @@ void RayTracer::CreateSceneRayTracingTheNextWeekTexturesAndLight() {
             } else {
                material = Light(FlatColor({10.0f, 10.0f, 10.0f}), 0.0f);
             }
-            m_Scene.AddInstance(std::make_unique<SphereInstance>(centre, 0.2f, material));
+            m_Scene.AddInstance(SphereInstance(centre, 0.2f, m_Scene.AddMaterial(material)));
          }
       }
    }
 
    // the three main spheres...
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(
+   m_Scene.AddInstance(SphereInstance(
       glm::vec3 {0.0f, 2.0f, 0.0f}                /*centre*/,
       1.0f                                        /*radius*/,
-      Light(FlatColor({20.0f, 20.0f, 20.0f}), 0.0f) /*material*/
+      m_Scene.AddMaterial(Light(FlatColor({20.0f, 20.0f, 20.0f}), 0.0f)) /*material*/
    ));
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(
+   m_Scene.AddInstance(SphereInstance(
       glm::vec3 {-4.0f, 2.0f, 0.0f}    /*centre*/,
       1.0f                             /*radius*/,
-      Metallic(                           /*material*/
+      m_Scene.AddMaterial(Metallic(                           /*material*/
          FlatColor(                       /*texture*/
             {0.4f, 0.2f, 0.1f}               /*specular*/
          ),
          0.0f                                /*roughness*/
-      )
+      ))
    ));
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(
+   m_Scene.AddInstance(SphereInstance(
       glm::vec3 {4.0f, 2.0f, 0.0f}      /*centre*/,
       1.0f                              /*radius*/,
-      Lambertian(                          /*material*/
+      m_Scene.AddMaterial(Lambertian(                          /*material*/
          FlatColor({0.2f, 0.2f, 0.7f})     /*diffuse*/
-      )
+      ))
    ));
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(
+   m_Scene.AddInstance(SphereInstance(
       glm::vec3 {4.0f, 2.0f, 0.0f}      /*centre*/,
       1.001f                            /*radius*/,
-      Dielectric(                          /*material*/
+      m_Scene.AddMaterial(Dielectric(                          /*material*/
          FlatColor({1.0f, 1.0f, 1.0f})     /*transmittance*/,
          1.5f
-      )
+      ))
    ));
 }
 
@@ -483,46 +767,46 @@ void RayTracer::CreateCornellBox(const glm::vec3 size, const float brightness) {
    const glm::vec3 clockwiseX90 = {glm::radians(90.0f), glm::radians(0.0f), glm::radians(0.0f)};
    const glm::vec3 counterClockwiseX90 = {glm::radians(-90.0f), glm::radians(0.0f), glm::radians(0.0f)};
 
-   m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(
+   m_Scene.AddInstance(Rectangle2DInstance(
       glm::vec3{-halfSize.x, 0.0f, -halfSize.z},
       glm::vec2{size.x, size.y},
       counterClockwiseY90,
-      green
+      m_Scene.AddMaterial(green)
    ));
 
-   m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(
+   m_Scene.AddInstance(Rectangle2DInstance(
       glm::vec3{halfSize.x, 0.0f, -halfSize.z},
       glm::vec2{size.x, size.y},
       clockwiseY90,
-      red
+      m_Scene.AddMaterial(red)
    ));
 
-    m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(
+    m_Scene.AddInstance(Rectangle2DInstance(
        glm::vec3{0.0f, halfSize.y, -halfSize.z},
        glm::vec2{size.x, size.y},
        clockwiseX90,
-       white
+       m_Scene.AddMaterial(white)
     ));
  
-    m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(
+    m_Scene.AddInstance(Rectangle2DInstance(
        glm::vec3{0.0f, -halfSize.y, -halfSize.z},
        glm::vec2{size.x, size.y},
        counterClockwiseX90,
-       white
+       m_Scene.AddMaterial(white)
     ));
  
-    m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(
+    m_Scene.AddInstance(Rectangle2DInstance(
        glm::vec3{0.0f, 0.0f, -size.z},
        glm::vec2{size.x, size.y},
        glm::vec3{0.0f},
-       white
+       m_Scene.AddMaterial(white)
     ));
  
-    m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(
+    m_Scene.AddInstance(Rectangle2DInstance(
        glm::vec3{0.0f, halfSize.y - 0.1f, -halfSize.z},
        lightSize,
        clockwiseX90,
-       light
+       m_Scene.AddMaterial(light)
     ));
 }
 
@@ -538,12 +822,12 @@ void RayTracer::CreateSceneCornellBoxWithBoxes() {
    const glm::vec3 box1Size = {165.0f, 330.0f, 165.0f};
    const glm::vec3 box1Centre = glm::vec3 {-halfSize.x * 0.30f, -(size.y - box1Size.y) * 0.5f, -halfSize.z * 1.25};
    const glm::vec3 box1Rotation = {glm::radians(0.0f), glm::radians(-15.0f), glm::radians(0.0f)};
-   m_Scene.AddInstance(std::make_unique<BoxInstance>(box1Centre, box1Size, box1Rotation, white));
+   m_Scene.AddInstance(BoxInstance(box1Centre, box1Size, box1Rotation, m_Scene.AddMaterial(white)));
 
    const glm::vec3 box2Size = {165.0f, 165.0f, 165.0f};
    const glm::vec3 box2Centre = glm::vec3 {+halfSize.x * 0.35f, -(size.y - box2Size.y) * 0.5f, -halfSize.z * 0.65};
    const glm::vec3 box2Rotation = {glm::radians(0.0f), glm::radians(18.0f), glm::radians(0.0f)};
-   m_Scene.AddInstance(std::make_unique<BoxInstance>(box2Centre, box2Size, box2Rotation, white));
+   m_Scene.AddInstance(BoxInstance(box2Centre, box2Size, box2Rotation, m_Scene.AddMaterial(white)));
 
 }
 
@@ -560,12 +844,12 @@ void RayTracer::CreateSceneCornellBoxWithSmokeBoxes() {
    const glm::vec3 box1Size = {165.0f, 330.0f, 165.0f};
    const glm::vec3 box1Centre = glm::vec3 {-halfSize.x * 0.30f, (-(size.y - box1Size.y) * 0.5f), -halfSize.z * 1.25};
    const glm::vec3 box1Rotation = {glm::radians(0.0f), glm::radians(-15.0f), glm::radians(0.0f)};
-   m_Scene.AddInstance(std::make_unique<ProceduralBoxInstance>(box1Centre, box1Size, box1Rotation, smoke));
+   m_Scene.AddInstance(ProceduralBoxInstance(box1Centre, box1Size, box1Rotation, m_Scene.AddMaterial(smoke)));
 
    const glm::vec3 box2Size = {165.0f, 165.0f, 165.0f};
    const glm::vec3 box2Centre = glm::vec3 {+halfSize.x * 0.35f, (-(size.y - box2Size.y) * 0.5f), -halfSize.z * 0.65};
    const glm::vec3 box2Rotation = {glm::radians(0.0f), glm::radians(18.0f), glm::radians(0.0f)};
-   m_Scene.AddInstance(std::make_unique<ProceduralBoxInstance>(box2Centre, box2Size, box2Rotation, fog));
+   m_Scene.AddInstance(ProceduralBoxInstance(box2Centre, box2Size, box2Rotation, m_Scene.AddMaterial(fog)));
 }
 
 
@@ -577,7 +861,7 @@ void RayTracer::CreateSceneCornellBoxWithEarth() {
 
    const float earthSize = 165.0f;
    const glm::vec3 earthCentre = glm::vec3 {+halfSize.x * 0.35f, (-(size.y - earthSize) * 0.5f), -halfSize.z * 0.65};
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(earthCentre, earthSize / 2.0f, Lambertian(Texture{m_Scene.GetTextureId("Earth")})));
+   m_Scene.AddInstance(SphereInstance(earthCentre, earthSize / 2.0f, m_Scene.AddMaterial(Lambertian(Texture{m_Scene.GetTextureId("Earth")}))));
 }
 
 
@@ -599,51 +883,51 @@ void RayTracer::CreateSceneRayTracingTheNextWeekFinal() {
       for (int j = 0; j < boxesPerSize; ++j) {
          const glm::vec3 centre = {1278.0f - ((i + 0.5f) * boxSize), -278.0f, 1000.0f - ((j + 0.5f) * boxSize)};
          const glm::vec3 size = {boxSize, RandomFloat(1.0f, 101.0f), boxSize};
-         m_Scene.AddInstance(std::make_unique<BoxInstance>(centre, size, glm::vec3 {}, green));
+         m_Scene.AddInstance(BoxInstance(centre, size, glm::vec3 {}, m_Scene.AddMaterial(green)));
       }
    }
 
    // moving sphere. Not done.
 
    // glass sphere
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(glm::vec3{18.0f, -128.0f, -45.0f}, 50.0f, Dielectric(FlatColor({1.0f, 1.0f, 1.0f}), 1.5f)));
+   m_Scene.AddInstance(SphereInstance(glm::vec3{18.0f, -128.0f, -45.0f}, 50.0f, m_Scene.AddMaterial(Dielectric(FlatColor({1.0f, 1.0f, 1.0f}), 1.5f))));
 
    // metal sphere
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(glm::vec3{278.0f, -128.0f, -145.0f}, 50.0f, Metallic(FlatColor({0.8f, 0.8f, 0.9f}), 1.0f)));
+   m_Scene.AddInstance(SphereInstance(glm::vec3{278.0f, -128.0f, -145.0f}, 50.0f, m_Scene.AddMaterial(Metallic(FlatColor({0.8f, 0.8f, 0.9f}), 1.0f))));
 
    // glass ball filled with blue smoke
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(glm::vec3{-82.0f, -128.0f, -145.0f}, 70.0f, Dielectric(FlatColor({1.0f, 1.0f, 1.0f}), 1.5f)));
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(glm::vec3{-82.0f, -128.0f, -145.0f}, 69.99f, Smoke(FlatColor({0.2f, 0.4f, 0.9f}), 0.2f)));
+   m_Scene.AddInstance(SphereInstance(glm::vec3{-82.0f, -128.0f, -145.0f}, 70.0f, m_Scene.AddMaterial(Dielectric(FlatColor({1.0f, 1.0f, 1.0f}), 1.5f))));
+   m_Scene.AddInstance(SphereInstance(glm::vec3{-82.0f, -128.0f, -145.0f}, 69.99f, m_Scene.AddMaterial(Smoke(FlatColor({0.2f, 0.4f, 0.9f}), 0.2f))));
 
    // polystyrene cube
    glm::mat4x4 transform = glm::rotate(glm::translate(glm::identity<glm::mat4x4>(), {213.0f, -8.0f, -560.0f}), glm::radians(15.0f), {0.0f, 1.0f, 0.0f});
    for (int i = 0; i < 1000; ++i) {
       const glm::vec4 centre = {RandomFloat(0.0f, 165.0f), RandomFloat(0.0f, 165.0f), RandomFloat(0.0f, 165.0f), 1.0f};
       const glm::vec4 centreTransformed = transform * centre;
-      m_Scene.AddInstance(std::make_unique<SphereInstance>(centreTransformed, 10.0f, white));
+      m_Scene.AddInstance(SphereInstance(centreTransformed, 10.0f, m_Scene.AddMaterial(white)));
    }
 
    // marble ball
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(glm::vec3{58.0f, 2.0f, -300.0f}, 80.0f, Lambertian(Marble({1.0f, 1.0f, 1.0f}, 0.01f, 0.5f, 7))));
+   m_Scene.AddInstance(SphereInstance(glm::vec3{58.0f, 2.0f, -300.0f}, 80.0f, m_Scene.AddMaterial(Lambertian(Marble({1.0f, 1.0f, 1.0f}, 0.01f, 0.5f, 7)))));
 
    // earth textured sphere
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(glm::vec3{-122.0f, -78.0f, -400.0f}, 100.0f, Lambertian(Texture{m_Scene.GetTextureId("Earth")})));
+   m_Scene.AddInstance(SphereInstance(glm::vec3{-122.0f, -78.0f, -400.0f}, 100.0f, m_Scene.AddMaterial(Lambertian(Texture{m_Scene.GetTextureId("Earth")}))));
 
 
    // ceiling
-   //m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(glm::vec3{5.0f - 1000.0f - 150.f, 276.0f, -278.0f}, glm::vec2{2000.0f, 4132.5f}, glm::vec3{glm::radians(90.0f), glm::radians(0.0f), glm::radians(0.0f)}, black));
-   //m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(glm::vec3{5.0f + 1000.0f + 150.0f, 276.0f, -278.0f}, glm::vec2{2000.0f, 4132.5f}, glm::vec3{glm::radians(90.0f), glm::radians(0.0f), glm::radians(0.0f)}, black));
-   //m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(glm::vec3{5.0f, 276.0f, -278.0f + 132.5 + 1000.0f}, glm::vec2{300.0f, 2000.0f}, glm::vec3{glm::radians(90.0f), glm::radians(0.0f), glm::radians(0.0f)}, black));
-   //m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(glm::vec3{5.0f, 276.0f, -278.0 - 132.5 - 1000.f}, glm::vec2{300.0f, 2000.0f}, glm::vec3{glm::radians(90.0f), glm::radians(0.0f), glm::radians(0.0f)}, black));
+   //m_Scene.AddInstance(Rectangle2DInstance(glm::vec3{5.0f - 1000.0f - 150.f, 276.0f, -278.0f}, glm::vec2{2000.0f, 4132.5f}, glm::vec3{glm::radians(90.0f), glm::radians(0.0f), glm::radians(0.0f)}, m_Scene.AddMaterial(black)));
+   //m_Scene.AddInstance(Rectangle2DInstance(glm::vec3{5.0f + 1000.0f + 150.0f, 276.0f, -278.0f}, glm::vec2{2000.0f, 4132.5f}, glm::vec3{glm::radians(90.0f), glm::radians(0.0f), glm::radians(0.0f)}, m_Scene.AddMaterial(black)));
+   //m_Scene.AddInstance(Rectangle2DInstance(glm::vec3{5.0f, 276.0f, -278.0f + 132.5 + 1000.0f}, glm::vec2{300.0f, 2000.0f}, glm::vec3{glm::radians(90.0f), glm::radians(0.0f), glm::radians(0.0f)}, m_Scene.AddMaterial(black)));
+   //m_Scene.AddInstance(Rectangle2DInstance(glm::vec3{5.0f, 276.0f, -278.0 - 132.5 - 1000.f}, glm::vec2{300.0f, 2000.0f}, glm::vec3{glm::radians(90.0f), glm::radians(0.0f), glm::radians(0.0f)}, m_Scene.AddMaterial(black)));
 
    // mist under ceiling
-   //m_Scene.AddInstance(std::make_unique<ProceduralBoxInstance>(glm::vec3{0.0f, 0.0f, 0.0f}, glm::vec3{2000.0f, 554.0f, 2000.0f}, glm::vec3{}, Smoke(FlatColor({1.0f, 1.0f, 1.0f}), 0.0001f)));
+   //m_Scene.AddInstance(ProceduralBoxInstance(glm::vec3{0.0f, 0.0f, 0.0f}, glm::vec3{2000.0f, 554.0f, 2000.0f}, glm::vec3{}, m_Scene.AddMaterial(Smoke(FlatColor({1.0f, 1.0f, 1.0f}), 0.0001f))));
 
    // mist covering whole scene
-   m_Scene.AddInstance(std::make_unique<SphereInstance>(glm::vec3{0.0f, 0.0f, 0.0f}, 2000.0f, Smoke(FlatColor({1.0f, 1.0f, 1.0f}), 0.0001f)));
+   m_Scene.AddInstance(SphereInstance(glm::vec3{0.0f, 0.0f, 0.0f}, 2000.0f, m_Scene.AddMaterial(Smoke(FlatColor({1.0f, 1.0f, 1.0f}), 0.0001f))));
 
    // The light
-   m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(glm::vec3{5.0f, 276.0f, -279.5f}, glm::vec2{30.0f, 26.0f}, glm::vec3{glm::radians(90.0f), glm::radians(0.0f), glm::radians(0.0f)}, light));
+   m_Scene.AddInstance(Rectangle2DInstance(glm::vec3{5.0f, 276.0f, -279.5f}, glm::vec2{30.0f, 26.0f}, glm::vec3{glm::radians(90.0f), glm::radians(0.0f), glm::radians(0.0f)}, m_Scene.AddMaterial(light)));
 }
 
 
@@ -664,13 +948,13 @@ void RayTracer::CreateSceneWineGlass() {
    const glm::vec2 rectSize = {165.0f, 330.0f};
    const glm::vec3 rectCentre = glm::vec3 {-120.0f, -(size.y - rectSize.y) * 0.5f, -250.0f};
    const glm::vec3 rectRotation = {glm::radians(0.0f), glm::radians(-39.5f), glm::radians(0.0f)};
-   m_Scene.AddInstance(std::make_unique<Rectangle2DInstance>(rectCentre, rectSize, rectRotation, chromium));
+   m_Scene.AddInstance(Rectangle2DInstance(rectCentre, rectSize, rectRotation, m_Scene.AddMaterial(chromium)));
 
    glm::vec3 glassCentre = {130.0f, -278.0f, -170.0f};
    glm::vec3 glassSize = {200.0f, 200.0f, 200.0f};
 
    glm::mat3x4 transform = glm::transpose(glm::scale(glm::translate(glm::identity<glm::mat4x4>(), glassCentre), glassSize));
-   m_Scene.AddInstance(std::make_unique<Instance>(wineGlass, transform, glass));
+   m_Scene.AddInstance(Instance(wineGlass, transform, m_Scene.AddMaterial(glass)));
 
 }
 
@@ -689,11 +973,8 @@ void RayTracer::CreateVertexBuffer() {
    }
 
    vk::DeviceSize size = vertices.size() * sizeof(Vertex);
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-   stagingBuffer.CopyFromHost(0, size, vertices.data());
-
-   m_VertexBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
-   CopyBuffer(stagingBuffer.m_Buffer, m_VertexBuffer->m_Buffer, 0, 0, size);
+   m_VertexBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_UploadManager->UploadBuffer(m_VertexBuffer->m_Buffer, 0, size, vertices.data());
 }
 
 
@@ -718,17 +999,8 @@ void RayTracer::CreateIndexBuffer() {
    uint32_t count = static_cast<uint32_t>(indices.size());
    vk::DeviceSize size = count * sizeof(uint32_t);
 
-   Vulkan::Buffer stagingBuffer = {
-      m_Device,
-      m_PhysicalDevice,
-      size,
-      vk::BufferUsageFlagBits::eTransferSrc,
-      vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
-   };
-   stagingBuffer.CopyFromHost(0, size, indices.data());
-
-   m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(m_Device, m_PhysicalDevice, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
-   CopyBuffer(stagingBuffer.m_Buffer, m_IndexBuffer->m_Buffer, 0, 0, size);
+   m_IndexBuffer = std::make_unique<Vulkan::IndexBuffer>(*m_Allocator, size, count, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_UploadManager->UploadBuffer(m_IndexBuffer->m_Buffer, 0, size, indices.data());
 }
 
 
@@ -739,23 +1011,22 @@ void RayTracer::CreateOffsetBuffer() {
    uint32_t vertexOffset = 0;
    uint32_t indexOffset = 0;
    for (const auto& model : m_Scene.GetModels()) {
-      modelOffsets.push_back({vertexOffset, indexOffset});
+      modelOffsets.push_back({vertexOffset, indexOffset, 0, LIGHT_NONE});
       vertexOffset += static_cast<uint32_t>(model->GetVertices().size());
       indexOffset += static_cast<uint32_t>(model->GetIndices().size());
    }
 
    instanceOffsets.reserve(m_Scene.GetInstances().size());
    for (const auto& instance : m_Scene.GetInstances()) {
-      instanceOffsets.push_back(modelOffsets[instance->GetModelIndex()]);
+      Offset& offset = instanceOffsets.emplace_back(modelOffsets[instance.GetModelIndex()]);
+      offset.materialIndex = instance.GetMaterialIndex();
+      offset.lightIndex = m_Lights.InstanceFirstLights[instanceOffsets.size() - 1];
    };
 
    vk::DeviceSize size = instanceOffsets.size() * sizeof(Offset);
 
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-   stagingBuffer.CopyFromHost(0, size, instanceOffsets.data());
-
-   m_OffsetBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
-   CopyBuffer(stagingBuffer.m_Buffer, m_OffsetBuffer->m_Buffer, 0, 0, size);
+   m_OffsetBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_UploadManager->UploadBuffer(m_OffsetBuffer->m_Buffer, 0, size, instanceOffsets.data());
 }
 
 
@@ -773,14 +1044,17 @@ void RayTracer::CreateAABBBuffer() {
       }
    }
 
+   // followed by the AABBs of each merged group (in world space)
+   for (const auto& group : m_MergedInstances.Groups) {
+      const auto groupAabbs = GetGroupAabbs(m_Scene, group);
+      aabbs.insert(aabbs.end(), groupAabbs.begin(), groupAabbs.end());
+   }
+
    vk::DeviceSize size = aabbs.size() * sizeof(std::array<glm::vec3, 2>);
 
    if (size > 0) {
-      Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-      stagingBuffer.CopyFromHost(0, size, aabbs.data());
-
-      m_AABBBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
-      CopyBuffer(stagingBuffer.m_Buffer, m_AABBBuffer->m_Buffer, 0, 0, size);
+      m_AABBBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+      m_UploadManager->UploadBuffer(m_AABBBuffer->m_Buffer, 0, size, aabbs.data());
    }
 }
 
@@ -791,19 +1065,14 @@ void RayTracer::DestroyAABBBuffer() {
 
 
 void RayTracer::CreateMaterialBuffer() {
-   std::vector<Material> materials;
-   materials.reserve(m_Scene.GetInstances().size());
-   for (const auto& instance : m_Scene.GetInstances()) {
-      materials.emplace_back(instance->GetMaterial());
-   };
+   // the scene's unique materials.  Instances refer to them by index (via the offset and primitive buffers)
+   const std::vector<Material>& materials = m_Scene.GetMaterials();
+   LogMaterialDeduplication(m_SceneName, m_Scene);
 
    vk::DeviceSize size = materials.size() * sizeof(Material);
 
-   Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-   stagingBuffer.CopyFromHost(0, size, materials.data());
-
-   m_MaterialBuffer = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
-   CopyBuffer(stagingBuffer.m_Buffer, m_MaterialBuffer->m_Buffer, 0, 0, size);
+   m_MaterialBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_UploadManager->UploadBuffer(m_MaterialBuffer->m_Buffer, 0, size, materials.data());
 }
 
 
@@ -812,45 +1081,96 @@ void RayTracer::DestroyMaterialBuffer() {
 }
 
 
-void RayTracer::CreateTextureResources() {
-   for (const auto& textureFileName : m_Scene.GetTextureFileNames()) {
-      int texWidth;
-      int texHeight;
-      int texChannels;
+void RayTracer::CreatePrimitiveBuffer() {
+   std::vector<Primitive> primitives = PackPrimitives(m_Scene, m_MergedInstances, m_Lights);
+
+   vk::DeviceSize size = primitives.size() * sizeof(Primitive);
+
+   m_PrimitiveBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_UploadManager->UploadBuffer(m_PrimitiveBuffer->m_Buffer, 0, size, primitives.data());
+}
+
+
+void RayTracer::DestroyPrimitiveBuffer() {
+   m_PrimitiveBuffer.reset(nullptr);
+}
 
-      stbi_uc* pixels = stbi_load(textureFileName.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-      vk::DeviceSize size = static_cast<vk::DeviceSize>(texWidth) * static_cast<vk::DeviceSize>(texHeight) * 4;
-      uint32_t mipLevels = 1; // static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 
-      if (!pixels) {
-         ASSERT(false, "ERROR: failed to load texture '{}'", textureFileName);
+void RayTracer::CreateTextureResources() {
+   // Block compressed textures are optional, and only used if the device supports them
+   const bool isBCEnabled = m_EnabledPhysicalDeviceFeatures.textureCompressionBC;
+
+   // Textures that have a (usable) pre-compressed .ktx2 alongside them are loaded from that.  The rest are decoded.
+   const auto& textureFileNames = m_Scene.GetTextureFileNames();
+   std::vector<std::unique_ptr<Ktx2File>> compressedTextures(textureFileNames.size());
+   m_JobSystem->ParallelFor(0, static_cast<uint32_t>(textureFileNames.size()), 1, [&textureFileNames, &compressedTextures, isBCEnabled] (const uint32_t begin, const uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+         const std::filesystem::path compressedFileName = std::filesystem::path(textureFileNames[i]).replace_extension(".ktx2");
+         if (std::filesystem::exists(compressedFileName)) {
+            try {
+               auto compressed = std::make_unique<Ktx2File>(compressedFileName);
+               if (isBCEnabled || (compressed->GetFormat() == vk::Format::eR8G8B8A8Unorm)) {
+                  compressedTextures[i] = std::move(compressed);
+               }
+            } catch (const std::exception& err) {
+               LOG_WARN("{0}.  Using '{1}' instead", err.what(), textureFileNames[i]);
+            }
+         }
       }
+   });
 
-      Vulkan::Buffer stagingBuffer(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-      stagingBuffer.CopyFromHost(0, size, pixels);
-
-      stbi_image_free(pixels);
-
-      auto texture = std::make_unique<Vulkan::Image>(
-         m_Device,
-         m_PhysicalDevice,
-         texWidth,
-         texHeight,
-         mipLevels,
-         vk::SampleCountFlagBits::e1,
-         vk::Format::eR8G8B8A8Unorm,
-         vk::ImageTiling::eOptimal,
-         vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-         vk::MemoryPropertyFlagBits::eDeviceLocal
-      );
-      TransitionImageLayout(texture->m_Image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, mipLevels);
-      CopyBufferToImage(stagingBuffer.m_Buffer, texture->m_Image, texWidth, texHeight);
-      GenerateMIPMaps(texture->m_Image, vk::Format::eR8G8B8A8Unorm, texWidth, texHeight, mipLevels);
+   std::vector<std::string> decodedFileNames;
+   for (size_t i = 0; i < textureFileNames.size(); ++i) {
+      if (!compressedTextures[i]) {
+         decodedFileNames.emplace_back(textureFileNames[i]);
+      }
+   }
+   Vulkan::TextureLoader loader(m_PhysicalDevice, *m_Allocator, *m_UploadManager, *m_JobSystem);
+   Vulkan::TextureLoader::Result decodedTextures = loader.Load(decodedFileNames, true);
+
+   vk::DeviceSize textureMemory = 0;
+   vk::DeviceSize uncompressedTextureMemory = 0;   // what the textures would take as RGBA8, with full mip chains
+   auto decodedTexture = decodedTextures.Textures.begin();
+   for (auto& compressed : compressedTextures) {
+      vk::DeviceSize texWidth;
+      vk::DeviceSize texHeight;
+      std::unique_ptr<Vulkan::Image> texture;
+      if (compressed) {
+         const vk::Format format = compressed->GetFormat();
+         const uint32_t mipLevels = compressed->GetMipLevels();
+         texWidth = compressed->GetWidth();
+         texHeight = compressed->GetHeight();
+         texture = std::make_unique<Vulkan::Image>(
+            *m_Allocator,
+            compressed->GetWidth(),
+            compressed->GetHeight(),
+            mipLevels,
+            vk::SampleCountFlagBits::e1,
+            format,
+            vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+         );
 
-      texture->CreateImageView(vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor, mipLevels);
+         // level data is copied into staging memory straight away, so the file can be unmapped before the upload completes
+         m_UploadManager->UploadImageLevels(texture->m_Image, compressed->GetWidth(), compressed->GetHeight(), compressed->GetLevelOffsets(), compressed->GetDataSize(), compressed->GetData());
+         compressed.reset();
+         texture->CreateImageView(format, vk::ImageAspectFlagBits::eColor, mipLevels);
+      } else {
+         texWidth = decodedTexture->Width;
+         texHeight = decodedTexture->Height;
+         texture = std::move(decodedTexture->Image);
+         ++decodedTexture;
+      }
+
+      textureMemory += m_Device.getImageMemoryRequirements(texture->m_Image).size;
+      uncompressedTextureMemory += texWidth * texHeight * 4 * 4 / 3;
 
       m_Textures.emplace_back(std::move(texture));
    }
+   if (!m_Textures.empty()) {
+      LOG_INFO("Scene {0}: {1} textures use {2:.2f} MiB of device memory ({3:.2f} MiB as uncompressed RGBA8 with mip maps)", m_SceneName, m_Textures.size(), textureMemory / (1024.0 * 1024.0), uncompressedTextureMemory / (1024.0 * 1024.0));
+   }
 
    vk::SamplerCreateInfo ci = {
       {}                                  /*flags*/,
@@ -866,7 +1186,7 @@ void RayTracer::CreateTextureResources() {
       false                               /*compareEnable*/,
       vk::CompareOp::eAlways              /*compareOp*/,
       0.0f                                /*minLod*/,
-      static_cast<float>(1/*mipLevels*/)       /*maxLod*/,
+      VK_LOD_CLAMP_NONE                   /*maxLod  (textures have differing numbers of mip levels)*/,
       vk::BorderColor::eFloatOpaqueBlack  /*borderColor*/,
       false                               /*unnormalizedCoordinates*/
    };
@@ -886,6 +1206,78 @@ void RayTracer::DestroyTextureResources() {
 }
 
 
+void RayTracer::CreateEnvironmentMapResources() {
+   // Scenes without an environment map still have one bound (black, 1x1), but the shaders are specialized not to use it
+   const std::string& fileName = m_Scene.GetEnvironmentMapFileName();
+   const auto start = std::chrono::steady_clock::now();
+   const EnvironmentMap environmentMap = fileName.empty() ? EnvironmentMap {1, 1, std::vector<glm::vec4>(1), nullptr} : EnvironmentMap {fileName, m_JobSystem.get()};
+   const double loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+   // RGBA32F, one level: the shaders look up single texels, so that radiance matches the alias table's pdf exactly
+   const vk::Format format = vk::Format::eR32G32B32A32Sfloat;
+   const auto& pixels = environmentMap.GetPixels();
+   m_EnvironmentMapImage = std::make_unique<Vulkan::Image>(
+      *m_Allocator,
+      environmentMap.GetWidth(),
+      environmentMap.GetHeight(),
+      1,
+      vk::SampleCountFlagBits::e1,
+      format,
+      vk::ImageTiling::eOptimal,
+      vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+      vk::MemoryPropertyFlagBits::eDeviceLocal
+   );
+   m_UploadManager->UploadImage(m_EnvironmentMapImage->m_Image, environmentMap.GetWidth(), environmentMap.GetHeight(), 1, pixels.size() * sizeof(glm::vec4), pixels.data());
+   m_EnvironmentMapImage->CreateImageView(format, vk::ImageAspectFlagBits::eColor, 1);
+
+   const auto& aliasTable = environmentMap.GetAliasTable();
+   const vk::DeviceSize size = aliasTable.size() * sizeof(AliasEntry);
+   m_EnvironmentTableBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_UploadManager->UploadBuffer(m_EnvironmentTableBuffer->m_Buffer, 0, size, aliasTable.data());
+
+   if (!fileName.empty()) {
+      LOG_INFO("Environment map {0}: {1}x{2}, loaded and alias table ({3:.2f} MiB) built on {4} threads in {5:.2f}ms", fileName, environmentMap.GetWidth(), environmentMap.GetHeight(), size / (1024.0 * 1024.0), m_JobSystem->GetThreadCount(), loadMilliseconds);
+   }
+}
+
+
+void RayTracer::DestroyEnvironmentMapResources() {
+   m_EnvironmentTableBuffer.reset(nullptr);
+   m_EnvironmentMapImage.reset(nullptr);
+}
+
+
+void RayTracer::CreateLightResources() {
+   m_Lights = ExtractLights(m_Scene);
+
+   // Scenes without lights still have a light list bound (of one light, that nothing refers to), but the shaders are
+   // specialized not to use it
+   const std::vector<LightSource> placeholderLights(1, LightSource {});
+   const std::vector<LightNode> placeholderTree(1, LightNode {{}, 0.0f, {}, LIGHT_NONE, {}, 1.0f, 1.0f, 0, LIGHTNODE_LEAF | 0, 0});
+   const std::vector<LightSource>& lights = m_Lights.Lights.empty() ? placeholderLights : m_Lights.Lights;
+   const std::vector<LightNode>& tree = m_Lights.Lights.empty() ? placeholderTree : m_Lights.Tree;
+
+   vk::DeviceSize size = lights.size() * sizeof(LightSource);
+   m_LightBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_UploadManager->UploadBuffer(m_LightBuffer->m_Buffer, 0, size, lights.data());
+
+   size = tree.size() * sizeof(LightNode);
+   m_LightTreeBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_UploadManager->UploadBuffer(m_LightTreeBuffer->m_Buffer, 0, size, tree.data());
+
+   // The staging buffer is kept (for UpdateLights()), so must not go in a linear block (it would stop the block from being reset)
+   size = m_LightBuffer->m_Size + m_LightTreeBuffer->m_Size;
+   m_LightStagingBuffer = std::make_unique<Vulkan::Buffer>(*m_Allocator, size * m_Settings.MaxFramesInFlight, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, Vulkan::AllocationStrategy::eFreeList);
+}
+
+
+void RayTracer::DestroyLightResources() {
+   m_LightStagingBuffer.reset(nullptr);
+   m_LightTreeBuffer.reset(nullptr);
+   m_LightBuffer.reset(nullptr);
+}
+
+
 void RayTracer::CreateAccelerationStructures() {
    vk::DeviceSize vertexOffset = 0;
    vk::DeviceSize indexOffset = 0;
@@ -940,30 +1332,177 @@ void RayTracer::CreateAccelerationStructures() {
       }
    }
 
-   CreateBottomLevelAccelerationStructures(geometryGroups);
+   // Then one BLAS per merged group, of one AABB per instance
+   for (const auto& group : m_MergedInstances.Groups) {
+      const uint32_t aabbCount = static_cast<uint32_t>(group.InstanceIndices.size());
+      geometryGroups.emplace_back(std::vector<vk::GeometryNV> {
+         vk::GeometryNV {
+            vk::GeometryTypeNV::eAabbs                               /*geometryType*/,
+            vk::GeometryDataNV {
+               vk::GeometryTrianglesNV {}                                   /*triangles*/,
+               vk::GeometryAABBNV {
+                  m_AABBBuffer->m_Buffer                                       /*aabbData*/,
+                  aabbCount                                                    /*numAABBs*/,
+                  2 * sizeof(glm::vec3)                                        /*stride*/,
+                  aabbOffset                                                   /*offset*/
+               }                                                            /*aabbs*/
+            }                                                            /*geometry*/,
+            vk::GeometryFlagBitsNV::eOpaque                              /*flags*/
+         }
+      });
+      aabbOffset += aabbCount * 2 * sizeof(glm::vec3);
+   }
 
-   uint32_t i = 0;
-   std::vector<Vulkan::GeometryInstance> geometryInstances;
+   CreateBottomLevelAccelerationStructures(geometryGroups);
 
-   geometryInstances.reserve(m_Scene.GetInstances().size());
-   for (const auto& instance : m_Scene.GetInstances()) {
-      ASSERT(m_BLAS.at(instance->GetModelIndex()).m_Handle, "ERROR: BLAS handle is null.  Have you forgotten to allocate and bind memory?");
-      geometryInstances.emplace_back(
-         instance->GetTransform(),
-         i++                                                                           /*instance index*/,
-         0xff                                                                          /*visibility mask*/,
-         m_Scene.GetModels().at(instance->GetModelIndex())->GetShaderHitGroupIndex()   /*hit group index*/,
-         static_cast<uint32_t>(vk::GeometryInstanceFlagBitsNV::eTriangleCullDisable)   /*instance flags*/,
-         m_BLAS.at(instance->GetModelIndex()).m_Handle                                 /*acceleration structure handle*/
-      );
-   };
+   // Built (and compacted) before the TLAS instances are packed, as compaction replaces the BLASs and their handles
+   BuildBottomLevelAccelerationStructures();
+   if (m_MergedInstances.Groups.empty()) {
+      m_TlasInstances = PackTlasInstances(m_Scene, GetBlasHandles());
+   } else {
+      m_TlasInstances = PackMergedTlasInstances(m_Scene, m_MergedInstances, GetBlasHandles());
+      LOG_INFO("Merged {0} procedural instances into {1} BLASs: TLAS has {2} instances (instead of {3})", m_Scene.GetInstances().size() - m_MergedInstances.UnmergedInstances.size(), m_MergedInstances.Groups.size(), m_TlasInstances.size(), m_Scene.GetInstances().size());
+   }
 
    // Each geometry instance instantiates all of the geometries that are in the BLAS that the instance refers to.
    // If you want to instantiate geometries independently of each other, then they need to be in different BLASs
    // Apparently, a general rule is that the fewer BLASs the better. 
-   CreateTopLevelAccelerationStructure(geometryInstances);
+   CreateTopLevelAccelerationStructure(m_TlasInstances);
+
+   BuildTopLevelAccelerationStructure(m_TlasInstances);
+   m_Scene.ClearInstanceChanges();
+}
+
+
+std::vector<uint64_t> RayTracer::GetBlasHandles() const {
+   std::vector<uint64_t> blasHandles;
+   blasHandles.reserve(m_BLAS.size());
+   for (const auto& blas : m_BLAS) {
+      blasHandles.push_back(blas.m_Handle);
+   }
+   return blasHandles;
+}
+
 
-   BuildAccelerationStructures(geometryInstances);
+void RayTracer::UpdateInstances(vk::CommandBuffer commandBuffer) {
+   const Scene::InstanceChanges& changes = m_Scene.GetInstanceChanges();
+   if (!m_MergedInstances.Groups.empty() && changes.Any()) {
+      // Merged instances are static (and the TLAS instances no longer match the scene's one for one), so stop merging,
+      // and rebuild everything per instance from the scene as it is.  The groups' BLASs are left unused.
+      LOG_WARN("Instances have changed, but merged instances are static: unmerging them");
+      m_MergedInstances = {};
+      RebuildInstances();
+   } else if (changes.IsListChanged) {
+      RebuildInstances();
+   } else if (changes.HasTransformChanges()) {
+      // only transforms have changed: refit the TLAS, uploading just the instances that moved
+      const std::vector<Vulkan::GeometryInstanceRange> ranges = GetInstanceRanges(changes.MovedInstances);
+      UpdateTlasInstanceTransforms(m_Scene, ranges, m_TlasInstances);
+      CmdUpdateTopLevelAccelerationStructure(commandBuffer, m_TlasInstances, ranges);
+
+      // the light list is in world space
+      if (std::any_of(changes.MovedInstances.begin(), changes.MovedInstances.end(), [this] (const uint32_t instanceIndex) { return m_Lights.InstanceFirstLights[instanceIndex] != LIGHT_NONE; })) {
+         UpdateLights(commandBuffer);
+      }
+   }
+   m_Scene.ClearInstanceChanges();
+}
+
+
+void RayTracer::RebuildInstances() {
+   // Instances have been added or removed, so everything that is per instance is rebuilt (the BLASs are not).
+   // Frames in flight may still be using the old resources, so they go via the deletion queue.
+   m_DeletionQueue.Push(std::move(m_OffsetBuffer));
+   m_DeletionQueue.Push(std::move(m_MaterialBuffer));
+   m_DeletionQueue.Push(std::move(m_PrimitiveBuffer));
+   m_DeletionQueue.Push(std::move(m_LightBuffer));
+   m_DeletionQueue.Push(std::move(m_LightTreeBuffer));
+   m_DeletionQueue.Push(std::move(m_LightStagingBuffer));
+   CreateLightResources();
+   CreateOffsetBuffer();
+   CreateMaterialBuffer();
+   CreatePrimitiveBuffer();
+   m_UploadManager->Wait(m_UploadManager->Submit());
+
+   RetireTopLevelAccelerationStructure();
+   m_TlasInstances = PackTlasInstances(m_Scene, GetBlasHandles());
+   CreateTopLevelAccelerationStructure(m_TlasInstances);
+   BuildTopLevelAccelerationStructure(m_TlasInstances);
+   RecreateDescriptorSets();
+
+   // the scene may now use different material or texture types, and have lights or not
+   UpdatePipeline();
+   m_AccumulatedImageCount = 0;
+}
+
+
+void RayTracer::UpdateLights(vk::CommandBuffer commandBuffer) {
+   // Lights have moved.  Their number is the same (though the light tree's shape may not be), so the light list and tree
+   // are updated in place, as the TLAS is
+   m_Lights = ExtractLights(m_Scene);
+   const vk::DeviceSize lightsSize = m_Lights.Lights.size() * sizeof(LightSource);
+   const vk::DeviceSize treeSize = m_Lights.Tree.size() * sizeof(LightNode);
+   ASSERT(lightsSize == m_LightBuffer->m_Size && treeSize == m_LightTreeBuffer->m_Size, "ERROR: Light list has changed size without the instances changing");
+
+   // BeginFrame() has waited for the last frame that used this frame's staging region
+   const vk::DeviceSize stagingOffset = (lightsSize + treeSize) * m_CurrentFrame;
+   m_LightStagingBuffer->CopyFromHost(stagingOffset, lightsSize, m_Lights.Lights.data());
+   m_LightStagingBuffer->CopyFromHost(stagingOffset + lightsSize, treeSize, m_Lights.Tree.data());
+
+   // earlier frames may still be reading the light list, and the previous update may still be writing it
+   vk::MemoryBarrier inUseBarrier = {
+      vk::AccessFlagBits::eTransferWrite /*srcAccessMask*/,
+      vk::AccessFlagBits::eTransferWrite /*dstAccessMask*/
+   };
+   commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderNV | vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, inUseBarrier, nullptr, nullptr);
+
+   commandBuffer.copyBuffer(m_LightStagingBuffer->m_Buffer, m_LightBuffer->m_Buffer, vk::BufferCopy {stagingOffset, 0, lightsSize});
+   commandBuffer.copyBuffer(m_LightStagingBuffer->m_Buffer, m_LightTreeBuffer->m_Buffer, vk::BufferCopy {stagingOffset + lightsSize, 0, treeSize});
+
+   // this frame's ray tracing (recorded after this) must wait for the update
+   vk::MemoryBarrier updatedBarrier = {
+      vk::AccessFlagBits::eTransferWrite /*srcAccessMask*/,
+      vk::AccessFlagBits::eShaderRead    /*dstAccessMask*/
+   };
+   commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eRayTracingShaderNV, {}, updatedBarrier, nullptr, nullptr);
+}
+
+
+void RayTracer::RecreateDescriptorSets() {
+   // the descriptor sets refer to the old resources (the next frame's command buffer binds the new sets).
+   // Frames in flight may still be using the old sets, so their pool is retired whole (destroying it frees them), and the
+   // new sets come from a new pool.  Sets can be recreated on consecutive frames (e.g. while the window is being resized,
+   // or when instances are rebuilt during a resize), so any number of old pools may be waiting in the deletion queue.
+   m_DeletionQueue.Push([device = m_Device, descriptorPool = m_DescriptorPool] {
+      device.destroy(descriptorPool);
+   });
+   m_DescriptorSets.clear();
+   CreateDescriptorPool();
+   CreateDescriptorSets();
+}
+
+
+void RayTracer::AnimateInstances(const double deltaTime) {
+   // Bob everything except the walls and floors (Rectangle2Ds) up and down, by a quarter of its height, out of phase
+   // with its neighbours
+   constexpr double Frequency = 0.5;   // Hz
+   if (m_AnimationBaseTransforms.size() != m_Scene.GetInstances().size()) {
+      m_AnimationBaseTransforms.clear();
+      for (const auto& instance : m_Scene.GetInstances()) {
+         m_AnimationBaseTransforms.push_back(instance.GetTransform());
+      }
+   }
+   m_AnimationTime += deltaTime;
+   for (uint32_t i = 0; i < m_AnimationBaseTransforms.size(); ++i) {
+      const Model* model = m_Scene.GetModels()[m_Scene.GetInstances()[i].GetModelIndex()].get();
+      if (dynamic_cast<const Rectangle2D*>(model)) {
+         continue;
+      }
+      glm::mat3x4 transform = m_AnimationBaseTransforms[i];
+      const float height = glm::length(glm::vec3 {transform[1]});
+      transform[1][3] += 0.25f * height * static_cast<float>(std::sin(2.0 * glm::pi<double>() * Frequency * m_AnimationTime + i));
+      m_Scene.SetInstanceTransform(i, transform);
+   }
 }
 
 
@@ -979,13 +1518,14 @@ void RayTracer::DestroyIndexBuffer() {
 
 
 void RayTracer::CreateStorageImages() {
-   m_OutputImage = std::make_unique<Vulkan::Image>(m_Device, m_PhysicalDevice, m_Extent.width, m_Extent.height, 1, vk::SampleCountFlagBits::e1, m_Format, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eStorage, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_OutputImage = std::make_unique<Vulkan::Image>(*m_Allocator, m_Extent.width, m_Extent.height, 1, vk::SampleCountFlagBits::e1, m_Format, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eStorage, vk::MemoryPropertyFlagBits::eDeviceLocal);
    m_OutputImage->CreateImageView(m_Format, vk::ImageAspectFlagBits::eColor, 1);
-   TransitionImageLayout(m_OutputImage->m_Image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1);
+   // no need to wait for the transitions: the command buffers that use these images are submitted after them anyway
+   TransitionImageLayout(m_OutputImage->m_Image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1, false);
 
-   m_AccumumlationImage = std::make_unique<Vulkan::Image>(m_Device, m_PhysicalDevice, m_Extent.width, m_Extent.height, 1, vk::SampleCountFlagBits::e1, vk::Format::eR32G32B32A32Sfloat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eStorage, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_AccumumlationImage = std::make_unique<Vulkan::Image>(*m_Allocator, m_Extent.width, m_Extent.height, 1, vk::SampleCountFlagBits::e1, vk::Format::eR32G32B32A32Sfloat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eStorage, vk::MemoryPropertyFlagBits::eDeviceLocal);
    m_AccumumlationImage->CreateImageView(vk::Format::eR32G32B32A32Sfloat, vk::ImageAspectFlagBits::eColor, 1);
-   TransitionImageLayout(m_AccumumlationImage->m_Image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1);
+   TransitionImageLayout(m_AccumumlationImage->m_Image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1, false);
 }
 
 
@@ -1007,18 +1547,18 @@ void RayTracer::CreateUniformBuffers() {
    // If we had instead made sure that only one command buffer is ever rendering at once,
    // then we could get away with just one uniform buffer.
 
+   //
+   // The per command buffer uniform buffers are regions of one persistently mapped ring buffer,
+   // selected with a dynamic offset when the descriptor set is bound.
    //
    // TODO: experiment: We are creating the uniform buffers as hostVisible and hostCoherent
    //                   Would it be better to have them as device-local  (and copy after each update)?
-   m_UniformBuffers.reserve(m_CommandBuffers.size());
-   for (const auto& commandBuffer : m_CommandBuffers) {
-      m_UniformBuffers.emplace_back(m_Device, m_PhysicalDevice, size, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-   }
+   m_UniformBuffer = std::make_unique<Vulkan::RingBuffer>(*m_Allocator, size, static_cast<uint32_t>(m_CommandBuffers.size()), vk::BufferUsageFlagBits::eUniformBuffer, m_PhysicalDeviceProperties.limits.minUniformBufferOffsetAlignment);
 }
 
 
 void RayTracer::DestroyUniformBuffers() {
-   m_UniformBuffers.clear();
+   m_UniformBuffer.reset(nullptr);
 }
 
 
@@ -1053,7 +1593,7 @@ void RayTracer::CreateDescriptorSetLayout() {
 
    vk::DescriptorSetLayoutBinding uniformBufferLB = {
       BINDING_UNIFORMBUFFER                                                                                           /*binding*/,
-      vk::DescriptorType::eUniformBuffer                                                                              /*descriptorType*/,
+      vk::DescriptorType::eUniformBufferDynamic                                                                       /*descriptorType*/,
       1                                                                                                               /*descriptorCount*/,
       vk::ShaderStageFlagBits::eRaygenNV | vk::ShaderStageFlagBits::eIntersectionNV | vk::ShaderStageFlagBits::eClosestHitNV | vk::ShaderStageFlagBits::eMissNV  /*stageFlags*/,
       nullptr                                                                                                         /*pImmutableSamplers*/
@@ -1099,6 +1639,46 @@ void RayTracer::CreateDescriptorSetLayout() {
       nullptr                                     /*pImmutableSamplers*/
    };
 
+   vk::DescriptorSetLayoutBinding primitiveBufferLB = {
+      BINDING_PRIMITIVEBUFFER                   /*binding*/,
+      vk::DescriptorType::eStorageBuffer        /*descriptorType*/,
+      1                                         /*descriptorCount*/,
+      vk::ShaderStageFlagBits::eIntersectionNV | vk::ShaderStageFlagBits::eClosestHitNV  /*stageFlags*/,
+      nullptr                                   /*pImmutableSamplers*/
+   };
+
+   vk::DescriptorSetLayoutBinding environmentMapLB = {
+      BINDING_ENVIRONMENTMAP                                              /*binding*/,
+      vk::DescriptorType::eCombinedImageSampler                           /*descriptorType*/,
+      1                                                                   /*descriptorCount*/,
+      vk::ShaderStageFlagBits::eMissNV | vk::ShaderStageFlagBits::eClosestHitNV  /*stageFlags*/,
+      nullptr                                                             /*pImmutableSamplers*/
+   };
+
+   vk::DescriptorSetLayoutBinding environmentTableLB = {
+      BINDING_ENVIRONMENTTABLE                                            /*binding*/,
+      vk::DescriptorType::eStorageBuffer                                  /*descriptorType*/,
+      1                                                                   /*descriptorCount*/,
+      vk::ShaderStageFlagBits::eMissNV | vk::ShaderStageFlagBits::eClosestHitNV  /*stageFlags*/,
+      nullptr                                                             /*pImmutableSamplers*/
+   };
+
+   vk::DescriptorSetLayoutBinding lightBufferLB = {
+      BINDING_LIGHTBUFFER                       /*binding*/,
+      vk::DescriptorType::eStorageBuffer        /*descriptorType*/,
+      1                                         /*descriptorCount*/,
+      vk::ShaderStageFlagBits::eClosestHitNV    /*stageFlags*/,
+      nullptr                                   /*pImmutableSamplers*/
+   };
+
+   vk::DescriptorSetLayoutBinding lightTreeLB = {
+      BINDING_LIGHTTREE                         /*binding*/,
+      vk::DescriptorType::eStorageBuffer        /*descriptorType*/,
+      1                                         /*descriptorCount*/,
+      vk::ShaderStageFlagBits::eClosestHitNV    /*stageFlags*/,
+      nullptr                                   /*pImmutableSamplers*/
+   };
+
    std::array<vk::DescriptorSetLayoutBinding, BINDING_NUMBINDINGS> layoutBindings = {
       accelerationStructureLB,
       accumulationImageLB,
@@ -1108,7 +1688,12 @@ void RayTracer::CreateDescriptorSetLayout() {
       indexBufferLB,
       offsetBufferLB,
       materialBufferLB,
-      textureSamplerLB
+      textureSamplerLB,
+      primitiveBufferLB,
+      environmentMapLB,
+      environmentTableLB,
+      lightBufferLB,
+      lightTreeLB
    };
 
    m_DescriptorSetLayout = m_Device.createDescriptorSetLayout({
@@ -1155,123 +1740,114 @@ void RayTracer::DestroyPipelineLayout() {
 }
 
 void RayTracer::CreatePipeline() {
+   SetPipelineVariant(CreatePipelineVariant(GetPipelineFeatures(m_Scene)));
+}
+
+
+RayTracer::PipelineVariant RayTracer::CreatePipelineVariant(const PipelineFeatures& features) {
    // Create the graphics pipeline used in this example
    // Vulkan uses the concept of rendering pipelines to encapsulate fixed states, replacing OpenGL's complex state machine
    // A pipeline is then stored and hashed on the GPU making pipeline changes very fast
    // Note: There are still a few dynamic states that are not directly part of the pipeline (but the info that they are used is)
 
-   enum {
-      eRayGen,
-      eMiss,
-      eTrianglesClosestHit,
-      eSphereIntersection,
-      eSphereClosestHit,
-      eBoxIntersection,
-      eBoxClosestHit,
-
-      eNumShaders
-   };
-
-   std::array<vk::PipelineShaderStageCreateInfo, eNumShaders> shaderStages;
-
-   shaderStages[eRayGen] = vk::PipelineShaderStageCreateInfo {
-      {}                                                                           /*flags*/,
-      vk::ShaderStageFlagBits::eRaygenNV                                           /*stage*/,
-      CreateShaderModule(Vulkan::ReadFile("Assets/Shaders/RayTrace.rgen.spv"))     /*module*/,
-      "main"                                                                       /*name*/,
-      nullptr                                                                      /*pSpecializationInfo*/
-   };
-
-   shaderStages[eMiss] = vk::PipelineShaderStageCreateInfo {
-      {}                                                                           /*flags*/,
-      vk::ShaderStageFlagBits::eMissNV                                             /*stage*/,
-      CreateShaderModule(Vulkan::ReadFile("Assets/Shaders/RayTrace.rmiss.spv"))    /*module*/,
-      "main"                                                                       /*name*/,
-      nullptr                                                                      /*pSpecializationInfo*/
-   };
-
-   shaderStages[eTrianglesClosestHit] = vk::PipelineShaderStageCreateInfo {
-      {}                                                                           /*flags*/,
-      vk::ShaderStageFlagBits::eClosestHitNV                                       /*stage*/,
-      CreateShaderModule(Vulkan::ReadFile("Assets/Shaders/Triangles.rchit.spv"))   /*module*/,
-      "main"                                                                       /*name*/,
-      nullptr                                                                      /*pSpecializationInfo*/
-   };
-
-   shaderStages[eSphereIntersection] = vk::PipelineShaderStageCreateInfo {
-      {}                                                                           /*flags*/,
-      vk::ShaderStageFlagBits::eIntersectionNV                                     /*stage*/,
-      CreateShaderModule(Vulkan::ReadFile("Assets/Shaders/Sphere.rint.spv"))       /*module*/,
-      "main"                                                                       /*name*/,
-      nullptr                                                                      /*pSpecializationInfo*/
-   };
-
-   shaderStages[eSphereClosestHit] = vk::PipelineShaderStageCreateInfo {
-      {}                                                                           /*flags*/,
-      vk::ShaderStageFlagBits::eClosestHitNV                                       /*stage*/,
-      CreateShaderModule(Vulkan::ReadFile("Assets/Shaders/Sphere.rchit.spv"))      /*module*/,
-      "main"                                                                       /*name*/,
-      nullptr                                                                      /*pSpecializationInfo*/
-   };
-
-   shaderStages[eBoxIntersection] = vk::PipelineShaderStageCreateInfo {
-      {}                                                                           /*flags*/,
-      vk::ShaderStageFlagBits::eIntersectionNV                                     /*stage*/,
-      CreateShaderModule(Vulkan::ReadFile("Assets/Shaders/Box.rint.spv"))          /*module*/,
-      "main"                                                                       /*name*/,
-      nullptr                                                                      /*pSpecializationInfo*/
-   };
-
-   shaderStages[eBoxClosestHit] = vk::PipelineShaderStageCreateInfo {
-      {}                                                                           /*flags*/,
-      vk::ShaderStageFlagBits::eClosestHitNV                                       /*stage*/,
-      CreateShaderModule(Vulkan::ReadFile("Assets/Shaders/Box.rchit.spv"))         /*module*/,
-      "main"                                                                       /*name*/,
-      nullptr                                                                      /*pSpecializationInfo*/
-   };
-
-
-   std::array<vk::RayTracingShaderGroupCreateInfoNV, eNumShaderGroups> groups;
-
-   groups[eRayGenGroup] = vk::RayTracingShaderGroupCreateInfoNV {
-      vk::RayTracingShaderGroupTypeNV::eGeneral /*type*/,
-      eRayGen                                   /*generalShader*/,
-      VK_SHADER_UNUSED_NV                       /*closestHitShader*/,
-      VK_SHADER_UNUSED_NV                       /*anyHitShader*/,
-      VK_SHADER_UNUSED_NV                       /*intersectionShader*/
-   };
-
-   groups[eMissGroup] = vk::RayTracingShaderGroupCreateInfoNV {
-      vk::RayTracingShaderGroupTypeNV::eGeneral /*type*/,
-      eMiss                                     /*generalShader*/,
-      VK_SHADER_UNUSED_NV                       /*closestHitShader*/,
-      VK_SHADER_UNUSED_NV                       /*anyHitShader*/,
-      VK_SHADER_UNUSED_NV                       /*intersectionShader*/
-   };
-
-   groups[eTrianglesHitGroup] = vk::RayTracingShaderGroupCreateInfoNV {
-      vk::RayTracingShaderGroupTypeNV::eTrianglesHitGroup /*type*/,
-      VK_SHADER_UNUSED_NV                       /*generalShader*/,
-      eTrianglesClosestHit                      /*closestHitShader*/,
-      VK_SHADER_UNUSED_NV                       /*anyHitShader*/,
-      VK_SHADER_UNUSED_NV                       /*intersectionShader*/
+   // The shaders are specialized on the scene's features (bounce limits, and which material and texture types to
+   // compile in).  PipelineFeatures is laid out in constant id order, so is the specialization data as is.
+   // Each hit group's closest hit shader is specialized on just the one material type that it handles.
+   const std::array<vk::SpecializationMapEntry, 6> specializationEntries = {
+      vk::SpecializationMapEntry {CONSTANT_MINRAYBOUNCES, offsetof(PipelineFeatures, MinRayBounces), sizeof(uint32_t)},
+      vk::SpecializationMapEntry {CONSTANT_MAXRAYBOUNCES, offsetof(PipelineFeatures, MaxRayBounces), sizeof(uint32_t)},
+      vk::SpecializationMapEntry {CONSTANT_MATERIALTYPES, offsetof(PipelineFeatures, MaterialTypes), sizeof(uint32_t)},
+      vk::SpecializationMapEntry {CONSTANT_TEXTURETYPES, offsetof(PipelineFeatures, TextureTypes), sizeof(uint32_t)},
+      vk::SpecializationMapEntry {CONSTANT_ENVIRONMENTMAP, offsetof(PipelineFeatures, EnvironmentMap), sizeof(uint32_t)},
+      vk::SpecializationMapEntry {CONSTANT_LIGHTS, offsetof(PipelineFeatures, Lights), sizeof(uint32_t)}
    };
+   std::array<PipelineFeatures, MATERIAL_NUMTYPES> materialFeatures;
+   std::array<vk::SpecializationInfo, MATERIAL_NUMTYPES + 1> specializationInfos;   // the last is for the whole scene
+   for (uint32_t i = 0; i < specializationInfos.size(); ++i) {
+      const PipelineFeatures* pFeatures = &features;
+      if (i < MATERIAL_NUMTYPES) {
+         materialFeatures[i] = features;
+         materialFeatures[i].MaterialTypes = 1u << i;
+         pFeatures = &materialFeatures[i];
+      }
+      specializationInfos[i] = vk::SpecializationInfo {
+         static_cast<uint32_t>(specializationEntries.size()) /*mapEntryCount*/,
+         specializationEntries.data()                        /*pMapEntries*/,
+         sizeof(PipelineFeatures)                            /*dataSize*/,
+         pFeatures                                           /*pData*/
+      };
+   }
 
-   groups[eSphereHitGroup] = vk::RayTracingShaderGroupCreateInfoNV {
-      vk::RayTracingShaderGroupTypeNV::eProceduralHitGroup /*type*/,
-      VK_SHADER_UNUSED_NV                       /*generalShader*/,
-      eSphereClosestHit                         /*closestHitShader*/,
-      VK_SHADER_UNUSED_NV                       /*anyHitShader*/,
-      eSphereIntersection                       /*intersectionShader*/
+   // Shader modules are loaded once each, however many stages use them
+   std::unordered_map<std::string, vk::ShaderModule> shaderModules;
+   std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
+   const auto addStage = [this, &shaderModules, &shaderStages] (const vk::ShaderStageFlagBits stage, const char* fileName, const vk::SpecializationInfo* pSpecializationInfo) {
+      vk::ShaderModule& module = shaderModules[fileName];
+      if (!module) {
+         module = CreateShaderModule(Vulkan::ReadFile(fileName));
+      }
+      shaderStages.emplace_back(
+         vk::PipelineShaderStageCreateFlags {} /*flags*/,
+         stage                                 /*stage*/,
+         module                                /*module*/,
+         "main"                                /*name*/,
+         pSpecializationInfo                   /*pSpecializationInfo*/
+      );
+      return static_cast<uint32_t>(shaderStages.size() - 1);
    };
 
-   groups[eBoxHitGroup] = vk::RayTracingShaderGroupCreateInfoNV {
-      vk::RayTracingShaderGroupTypeNV::eProceduralHitGroup /*type*/,
-      VK_SHADER_UNUSED_NV                       /*generalShader*/,
-      eBoxClosestHit                            /*closestHitShader*/,
-      VK_SHADER_UNUSED_NV                       /*anyHitShader*/,
-      eBoxIntersection                          /*intersectionShader*/
-   };
+   std::vector<vk::RayTracingShaderGroupCreateInfoNV> groups;
+
+   groups.emplace_back(
+      vk::RayTracingShaderGroupTypeNV::eGeneral                                                                    /*type*/,
+      addStage(vk::ShaderStageFlagBits::eRaygenNV, "Assets/Shaders/RayTrace.rgen.spv", &specializationInfos.back()) /*generalShader*/,
+      VK_SHADER_UNUSED_NV                                                                                          /*closestHitShader*/,
+      VK_SHADER_UNUSED_NV                                                                                          /*anyHitShader*/,
+      VK_SHADER_UNUSED_NV                                                                                          /*intersectionShader*/
+   );
+
+   groups.emplace_back(
+      vk::RayTracingShaderGroupTypeNV::eGeneral                                                                   /*type*/,
+      addStage(vk::ShaderStageFlagBits::eMissNV, "Assets/Shaders/RayTrace.rmiss.spv", &specializationInfos.back()) /*generalShader*/,
+      VK_SHADER_UNUSED_NV                                                                                         /*closestHitShader*/,
+      VK_SHADER_UNUSED_NV                                                                                         /*anyHitShader*/,
+      VK_SHADER_UNUSED_NV                                                                                         /*intersectionShader*/
+   );
+
+   // shadow rays (from hits that sample lights) find out whether they are blocked, and nothing else
+   groups.emplace_back(
+      vk::RayTracingShaderGroupTypeNV::eGeneral                                             /*type*/,
+      addStage(vk::ShaderStageFlagBits::eMissNV, "Assets/Shaders/Shadow.rmiss.spv", nullptr) /*generalShader*/,
+      VK_SHADER_UNUSED_NV                                                                   /*closestHitShader*/,
+      VK_SHADER_UNUSED_NV                                                                   /*anyHitShader*/,
+      VK_SHADER_UNUSED_NV                                                                   /*intersectionShader*/
+   );
+
+   // one hit group for each (geometry type, material type) that the scene uses.  hitGroupSlots[i] is the group (in
+   // groups) of shader binding table hit group record i, if the scene uses it
+   std::array<uint32_t, sm_HitGroupCount> hitGroupSlots;
+   hitGroupSlots.fill(VK_SHADER_UNUSED_NV);
+   std::array<uint32_t, eNumGeometryTypes> intersectionStages;
+   intersectionStages.fill(VK_SHADER_UNUSED_NV);
+   for (uint32_t hitGroup = 0; hitGroup < sm_HitGroupCount; ++hitGroup) {
+      if ((features.HitGroups & (1u << hitGroup)) == 0) {
+         continue;
+      }
+      const uint32_t geometryType = hitGroup / MATERIAL_NUMTYPES;
+      const uint32_t materialType = hitGroup % MATERIAL_NUMTYPES;
+      const GeometryShaders& shaders = sm_GeometryShaders[geometryType];
+      if (shaders.IntersectionShader && (intersectionStages[geometryType] == VK_SHADER_UNUSED_NV)) {
+         intersectionStages[geometryType] = addStage(vk::ShaderStageFlagBits::eIntersectionNV, shaders.IntersectionShader, nullptr);
+      }
+      hitGroupSlots[hitGroup] = static_cast<uint32_t>(groups.size());
+      groups.emplace_back(
+         shaders.IntersectionShader ? vk::RayTracingShaderGroupTypeNV::eProceduralHitGroup : vk::RayTracingShaderGroupTypeNV::eTrianglesHitGroup /*type*/,
+         VK_SHADER_UNUSED_NV                                                                                                                  /*generalShader*/,
+         addStage(vk::ShaderStageFlagBits::eClosestHitNV, shaders.ClosestHitShader, &specializationInfos[materialType])                      /*closestHitShader*/,
+         VK_SHADER_UNUSED_NV                                                                                                                  /*anyHitShader*/,
+         intersectionStages[geometryType]                                                                                                     /*intersectionShader*/
+      );
+   }
 
    vk::RayTracingPipelineCreateInfoNV pipelineCI = {
       {}                                         /*flags*/,
@@ -1279,21 +1855,31 @@ void RayTracer::CreatePipeline() {
       shaderStages.data()                        /*pStages*/,
       static_cast<uint32_t>(groups.size())       /*groupCount*/,
       groups.data()                              /*pGroups*/,
-      1                                          /*maxRecursionDepth*/,
+      std::min(2u, m_RayTracingProperties.maxRecursionDepth) /*maxRecursionDepth  (closest hit shaders trace shadow rays)*/,
       m_PipelineLayout                           /*layout*/,
       nullptr                                    /*basePipelineHandle*/,
       0                                          /*basePipelineIndex*/
    };
 
    // .value works around bug in Vulkan.hpp (refer https://github.com/KhronosGroup/Vulkan-Hpp/issues/659)
-   m_Pipeline = m_Device.createRayTracingPipelineNV(m_PipelineCache, pipelineCI).value;
+   // Variants go through the pipeline cache (which is internally synchronized), so a variant that has been built
+   // before (in this run or, via the cache file, a previous one) is cheap to build again.
+   PipelineVariant variant;
+   variant.Features = features;
+   const auto start = std::chrono::steady_clock::now();
+   {
+      Vulkan::Profiler::CpuScope scope(m_Profiler.get(), "CreatePipeline");
+      variant.Pipeline = m_Device.createRayTracingPipelineNV(m_PipelineCache, pipelineCI).value;
+   }
+   LOG_INFO("Created ray tracing pipeline variant ({0}) with {1} hit groups in {2:.3f}ms", features.ToString(), groups.size() - eFirstHitGroup, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
 
    // Create buffer for the shader binding table.
    // Note that regardless of the shaderGroupHandleSize, the entries in the shader binding table must be aligned on multiples of m_RayTracingProperties.shaderGroupBaseAlignment
    uint32_t shaderBindingTableEntrySize = (m_RayTracingProperties.shaderGroupHandleSize + m_RayTracingProperties.shaderGroupBaseAlignment - 1) & ~(m_RayTracingProperties.shaderGroupBaseAlignment - 1);
 
-   const vk::DeviceSize tableSize = static_cast<vk::DeviceSize>(shaderBindingTableEntrySize) * eNumShaderGroups;
-   const vk::DeviceSize handlesSize = static_cast<vk::DeviceSize>(m_RayTracingProperties.shaderGroupHandleSize) * eNumShaderGroups;
+   const uint32_t groupCount = static_cast<uint32_t>(groups.size());
+   const vk::DeviceSize tableSize = static_cast<vk::DeviceSize>(shaderBindingTableEntrySize) * (eFirstHitGroup + sm_HitGroupCount);
+   const vk::DeviceSize handlesSize = static_cast<vk::DeviceSize>(m_RayTracingProperties.shaderGroupHandleSize) * groupCount;
 
    uint32_t tableStride = shaderBindingTableEntrySize;
    uint32_t handleStride = m_RayTracingProperties.shaderGroupHandleSize;
@@ -1301,26 +1887,103 @@ void RayTracer::CreatePipeline() {
    // First, get all the handles from the device,  and then copy them to the shader binding table with the correct alignment
    std::vector<uint8_t> shaderHandleStorage;
    shaderHandleStorage.resize(handlesSize);
-   m_Device.getRayTracingShaderGroupHandlesNV<uint8_t>(m_Pipeline, 0, eNumShaderGroups, shaderHandleStorage);
+   m_Device.getRayTracingShaderGroupHandlesNV<uint8_t>(variant.Pipeline, 0, groupCount, shaderHandleStorage);
 
+   // Every hit group has a record, so that instances' hit group indices do not depend on which ones the scene uses.  The
+   // records of hit groups that the scene does not use are never looked at, and are left zero.
    std::vector<uint8_t> shaderBindingTable;
    shaderBindingTable.resize(tableSize);
 
-   for (uint32_t i = 0; i < eNumShaderGroups; ++i) {
-      std::memcpy(shaderBindingTable.data() + (i * tableStride), shaderHandleStorage.data() + (i * handleStride), handleStride);
+   const auto copyHandle = [&] (const uint32_t record, const uint32_t group) {
+      std::memcpy(shaderBindingTable.data() + (record * tableStride), shaderHandleStorage.data() + (group * handleStride), handleStride);
+   };
+   copyHandle(eRayGenGroup, eRayGenGroup);
+   copyHandle(eMissGroup, eMissGroup);
+   copyHandle(eShadowMissGroup, eShadowMissGroup);
+   for (uint32_t hitGroup = 0; hitGroup < sm_HitGroupCount; ++hitGroup) {
+      if (hitGroupSlots[hitGroup] != VK_SHADER_UNUSED_NV) {
+         copyHandle(eFirstHitGroup + hitGroup, hitGroupSlots[hitGroup]);
+      }
    }
 
-   m_ShaderBindingTable = std::make_unique<Vulkan::Buffer>(m_Device, m_PhysicalDevice, tableSize, vk::BufferUsageFlagBits::eRayTracingNV, vk::MemoryPropertyFlagBits::eHostVisible);
-   m_ShaderBindingTable->CopyFromHost(0, tableSize, shaderBindingTable.data());
+   variant.ShaderBindingTable = std::make_unique<Vulkan::Buffer>(*m_Allocator, tableSize, vk::BufferUsageFlagBits::eRayTracingNV, vk::MemoryPropertyFlagBits::eHostVisible);
+   variant.ShaderBindingTable->CopyFromHost(0, tableSize, shaderBindingTable.data());
 
    // Shader modules are no longer needed once the graphics pipeline has been created
-   for (auto& shaderStage : shaderStages) {
-      DestroyShaderModule(shaderStage.module);
+   for (auto& [fileName, module] : shaderModules) {
+      DestroyShaderModule(module);
+   }
+   return variant;
+}
+
+
+void RayTracer::SetPipelineVariant(PipelineVariant variant) {
+   // frames in flight may still be using the current pipeline
+   if (m_Pipeline) {
+      m_DeletionQueue.Push(std::move(m_ShaderBindingTable));
+      m_DeletionQueue.Push([device = m_Device, pipeline = m_Pipeline] {
+         device.destroy(pipeline);
+      });
+   }
+   m_PipelineFeatures = variant.Features;
+   m_Pipeline = variant.Pipeline;
+   m_ShaderBindingTable = std::move(variant.ShaderBindingTable);
+}
+
+
+void RayTracer::FinishPipelineVariantBuild() {
+   // rethrows if the build failed
+   m_JobSystem->Wait(m_PipelineVariantTask);
+   m_PipelineVariantTask.reset();
+   SetPipelineVariant(std::move(*m_PendingPipelineVariant));
+   m_PendingPipelineVariant.reset();
+}
+
+
+void RayTracer::UpdatePipeline() {
+   if (m_PipelineVariantTask) {
+      // let a build that is already under way finish first (it may be superseded below)
+      FinishPipelineVariantBuild();
+   }
+   const PipelineFeatures features = GetPipelineFeatures(m_Scene);
+   if (features == m_PipelineFeatures) {
+      return;
+   }
+   if (m_PipelineFeatures.Covers(features) && (m_JobSystem->GetThreadCount() > 1)) {
+      // the current pipeline still renders the scene correctly, so keep using it until the new one is ready
+      LOG_INFO("Scene features have changed, building pipeline variant ({0}) in the background", features.ToString());
+      m_PendingPipelineVariant = std::make_shared<PipelineVariant>();
+      m_PipelineVariantTask = m_JobSystem->Spawn([this, features, variant = m_PendingPipelineVariant] {
+         *variant = CreatePipelineVariant(features);
+      });
+   } else {
+      // the current pipeline would render the scene wrongly (or there are no worker threads to build in the background)
+      SetPipelineVariant(CreatePipelineVariant(features));
+   }
+}
+
+
+void RayTracer::CheckPipelineVariantBuild() {
+   if (m_PipelineVariantTask && m_PipelineVariantTask->IsComplete()) {
+      FinishPipelineVariantBuild();
    }
 }
 
 
 void RayTracer::DestroyPipeline() {
+   if (m_PipelineVariantTask) {
+      // the background build has to finish before its pipeline can be destroyed
+      try {
+         m_JobSystem->Wait(m_PipelineVariantTask);
+      } catch (const std::exception& e) {
+         LOG_ERROR("Background pipeline variant build failed: {0}", e.what());
+      }
+      m_PipelineVariantTask.reset();
+      if (m_Device && m_PendingPipelineVariant->Pipeline) {
+         m_Device.destroy(m_PendingPipelineVariant->Pipeline);
+      }
+      m_PendingPipelineVariant.reset();
+   }
    m_ShaderBindingTable.reset(nullptr);
    if (m_Device && m_Pipeline) {
       m_Device.destroy(m_Pipeline);
@@ -1329,32 +1992,35 @@ void RayTracer::DestroyPipeline() {
 
 
 void RayTracer::CreateDescriptorPool() {
+   // Room for one descriptor set per frame buffer.  When the sets are recreated, frames in flight may still be using the
+   // old ones, so a new pool is created for the new sets, and the old pool is retired whole (see RecreateDescriptorSets())
+   const uint32_t setCount = static_cast<uint32_t>(m_SwapChainFrameBuffers.size());
    std::array<vk::DescriptorPoolSize, 5> typeCounts = {
       vk::DescriptorPoolSize {
          vk::DescriptorType::eAccelerationStructureNV,
-         static_cast<uint32_t>(m_SwapChainFrameBuffers.size())
+         setCount
       },
       vk::DescriptorPoolSize {
          vk::DescriptorType::eStorageImage,
-         static_cast<uint32_t>(2 * m_SwapChainFrameBuffers.size())
+         2 * setCount
       },
       vk::DescriptorPoolSize {
-         vk::DescriptorType::eUniformBuffer,
-         static_cast<uint32_t>(m_SwapChainFrameBuffers.size())
+         vk::DescriptorType::eUniformBufferDynamic,
+         setCount
       },
       vk::DescriptorPoolSize {
          vk::DescriptorType::eStorageBuffer,
-         static_cast<uint32_t>(4 * m_SwapChainFrameBuffers.size()) // 4 storage buffers:  Vertex, Index, Offset, Material
+         8 * setCount // 8 storage buffers:  Vertex, Index, Offset, Material, Primitive, EnvironmentTable, Light, LightTree
       },
       vk::DescriptorPoolSize {
          vk::DescriptorType::eCombinedImageSampler,
-         static_cast<uint32_t>(m_Textures.size() * m_SwapChainFrameBuffers.size())
+         (static_cast<uint32_t>(m_Textures.size()) + 1) * setCount   // textures, and the environment map
       }
    };
 
    vk::DescriptorPoolCreateInfo descriptorPoolCI = {
       vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet       /*flags*/,
-      static_cast<uint32_t>(54 * m_SwapChainFrameBuffers.size()) /*maxSets*/,
+      54 * setCount                                              /*maxSets*/,
       static_cast<uint32_t>(typeCounts.size())                   /*poolSizeCount*/,
       typeCounts.data()                                          /*pPoolSizes*/
    };
@@ -1433,14 +2099,15 @@ void RayTracer::CreateDescriptorSets() {
          nullptr                                      /*pTexelBufferView*/
       };
 
+      vk::DescriptorBufferInfo uniformBufferDescriptor = m_UniformBuffer->GetDescriptor(sizeof(UniformBufferObject));
       vk::WriteDescriptorSet uniformBufferWrite = {
          m_DescriptorSets[i]                          /*dstSet*/,
          BINDING_UNIFORMBUFFER                        /*dstBinding*/,
          0                                            /*dstArrayElement*/,
          1                                            /*descriptorCount*/,
-         vk::DescriptorType::eUniformBuffer           /*descriptorType*/,
+         vk::DescriptorType::eUniformBufferDynamic    /*descriptorType*/,
          nullptr                                      /*pImageInfo*/,
-         &m_UniformBuffers[i].m_Descriptor            /*pBufferInfo*/,
+         &uniformBufferDescriptor                     /*pBufferInfo*/,
          nullptr                                      /*pTexelBufferView*/
       };
 
@@ -1529,6 +2196,86 @@ void RayTracer::CreateDescriptorSets() {
          nullptr                                      /*pTexelBufferView*/
       };
 
+      vk::DescriptorBufferInfo primitiveBufferDescriptor = {
+         m_PrimitiveBuffer->m_Buffer /*buffer*/,
+         0                           /*offset*/,
+         VK_WHOLE_SIZE               /*range*/
+      };
+      vk::WriteDescriptorSet primitiveBufferWrite = {
+         m_DescriptorSets[i]                          /*dstSet*/,
+         BINDING_PRIMITIVEBUFFER                      /*dstBinding*/,
+         0                                            /*dstArrayElement*/,
+         1                                            /*descriptorCount*/,
+         vk::DescriptorType::eStorageBuffer           /*descriptorType*/,
+         nullptr                                      /*pImageInfo*/,
+         &primitiveBufferDescriptor                   /*pBufferInfo*/,
+         nullptr                                      /*pTexelBufferView*/
+      };
+
+      vk::DescriptorImageInfo environmentMapDescriptor = {
+         m_TextureSampler                          /*sampler  (unused: the shaders fetch texels)*/,
+         m_EnvironmentMapImage->m_ImageView        /*imageView*/,
+         vk::ImageLayout::eShaderReadOnlyOptimal   /*imageLayout*/
+      };
+      vk::WriteDescriptorSet environmentMapWrite = {
+         m_DescriptorSets[i]                          /*dstSet*/,
+         BINDING_ENVIRONMENTMAP                       /*dstBinding*/,
+         0                                            /*dstArrayElement*/,
+         1                                            /*descriptorCount*/,
+         vk::DescriptorType::eCombinedImageSampler    /*descriptorType*/,
+         &environmentMapDescriptor                    /*pImageInfo*/,
+         nullptr                                      /*pBufferInfo*/,
+         nullptr                                      /*pTexelBufferView*/
+      };
+
+      vk::DescriptorBufferInfo environmentTableDescriptor = {
+         m_EnvironmentTableBuffer->m_Buffer /*buffer*/,
+         0                                  /*offset*/,
+         VK_WHOLE_SIZE                      /*range*/
+      };
+      vk::WriteDescriptorSet environmentTableWrite = {
+         m_DescriptorSets[i]                          /*dstSet*/,
+         BINDING_ENVIRONMENTTABLE                     /*dstBinding*/,
+         0                                            /*dstArrayElement*/,
+         1                                            /*descriptorCount*/,
+         vk::DescriptorType::eStorageBuffer           /*descriptorType*/,
+         nullptr                                      /*pImageInfo*/,
+         &environmentTableDescriptor                  /*pBufferInfo*/,
+         nullptr                                      /*pTexelBufferView*/
+      };
+
+      vk::DescriptorBufferInfo lightBufferDescriptor = {
+         m_LightBuffer->m_Buffer /*buffer*/,
+         0                       /*offset*/,
+         VK_WHOLE_SIZE           /*range*/
+      };
+      vk::WriteDescriptorSet lightBufferWrite = {
+         m_DescriptorSets[i]                          /*dstSet*/,
+         BINDING_LIGHTBUFFER                          /*dstBinding*/,
+         0                                            /*dstArrayElement*/,
+         1                                            /*descriptorCount*/,
+         vk::DescriptorType::eStorageBuffer           /*descriptorType*/,
+         nullptr                                      /*pImageInfo*/,
+         &lightBufferDescriptor                       /*pBufferInfo*/,
+         nullptr                                      /*pTexelBufferView*/
+      };
+
+      vk::DescriptorBufferInfo lightTreeDescriptor = {
+         m_LightTreeBuffer->m_Buffer  /*buffer*/,
+         0                            /*offset*/,
+         VK_WHOLE_SIZE                /*range*/
+      };
+      vk::WriteDescriptorSet lightTreeWrite = {
+         m_DescriptorSets[i]                          /*dstSet*/,
+         BINDING_LIGHTTREE                            /*dstBinding*/,
+         0                                            /*dstArrayElement*/,
+         1                                            /*descriptorCount*/,
+         vk::DescriptorType::eStorageBuffer           /*descriptorType*/,
+         nullptr                                      /*pImageInfo*/,
+         &lightTreeDescriptor                         /*pBufferInfo*/,
+         nullptr                                      /*pTexelBufferView*/
+      };
+
       std::array<vk::WriteDescriptorSet, BINDING_NUMBINDINGS> writeDescriptorSets = {
          accelerationStructureWrite,
          accumulationImageWrite,
@@ -1538,7 +2285,12 @@ void RayTracer::CreateDescriptorSets() {
          indexBufferWrite,
          offsetBufferWrite,
          materialBufferWrite,
-         textureSamplersWrite
+         textureSamplersWrite,
+         primitiveBufferWrite,
+         environmentMapWrite,
+         environmentTableWrite,
+         lightBufferWrite,
+         lightTreeWrite
       };
 
       m_Device.updateDescriptorSets(writeDescriptorSets, nullptr);
@@ -1554,17 +2306,10 @@ void RayTracer::DestroyDescriptorSets() {
 }
 
 
-void RayTracer::RecordCommandBuffers() {
-   // Record the command buffers that are submitted to the graphics queue at each render.
-   // We record one commend buffer per frame buffer (this allows us to pre-record the command
-   // buffers, as we can bind the command buffer to its frame buffer here
-   // (as opposed to having just one command buffer that gets built and then bound to appropriate frame buffer
-   // at render time)
-   vk::CommandBufferBeginInfo commandBufferBI = {
-      {}      /*flags*/,
-      nullptr /*pInheritanceInfo*/
-   };
-
+void RayTracer::RecordFrameCommandBuffer(vk::CommandBuffer commandBuffer) {
+   // The command buffer is recorded afresh every frame (see BeginFrameCommandBuffer()), so it always uses the current
+   // pipeline, descriptor sets and push constants, and nothing needs re-recording when they change.
+   const uint32_t imageIndex = m_CurrentImage;
    vk::ImageSubresourceRange subresourceRange = {
       vk::ImageAspectFlagBits::eColor   /*aspectMask*/,
       0                                 /*baseMipLevel*/,
@@ -1573,93 +2318,89 @@ void RayTracer::RecordCommandBuffers() {
       1                                 /*layerCount*/
    };
 
-   // TODO: You probably don't actually want these things to be "constants"
-   //       all of them are things that you might want to be able to change
-   //       (without re-recording the entire command buffer)
-   //       Could just shove them into the uniform buffer object instead.
+   // Ray bounce limits are not in here: the pipeline is specialized on them (see CreatePipelineVariant())
    Constants constants = {
-      3                           /*min ray bounces*/,
-      64                          /*max ray bounces*/,
       0.0                         /*lens aperture            DISABLED IN RAYGEN SHADER*/,
       800.0                       /*lens focal length        DISABLED IN RAYGEN SHADER*/
    };
 
-   for (uint32_t i = 0; i < m_CommandBuffers.size(); ++i) {
-      vk::CommandBuffer& commandBuffer = m_CommandBuffers[i];
-      commandBuffer.begin(commandBufferBI);
-      commandBuffer.pushConstants<Constants>(m_PipelineLayout, vk::ShaderStageFlagBits::eRaygenNV | vk::ShaderStageFlagBits::eMissNV, 0, constants);
-      commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingNV, m_Pipeline);
-      commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingNV, m_PipelineLayout, 0, m_DescriptorSets[i], nullptr);  // (i)th command buffer is bound to the (i)th descriptor set
-
-      uint32_t shaderBindingTableEntrySize = (m_RayTracingProperties.shaderGroupHandleSize + m_RayTracingProperties.shaderGroupBaseAlignment - 1) & ~(m_RayTracingProperties.shaderGroupBaseAlignment - 1);
-
-      commandBuffer.traceRaysNV(
-         m_ShaderBindingTable->m_Buffer, static_cast<vk::DeviceSize>(shaderBindingTableEntrySize) * eRayGenGroup,
-         m_ShaderBindingTable->m_Buffer, static_cast<vk::DeviceSize>(shaderBindingTableEntrySize) * eMissGroup, shaderBindingTableEntrySize,
-         m_ShaderBindingTable->m_Buffer, static_cast<vk::DeviceSize>(shaderBindingTableEntrySize) * eFirstHitGroup, shaderBindingTableEntrySize,
-         nullptr, 0, 0,
-         m_Extent.width, m_Extent.height, 1
-      );
+   m_Profiler->CmdReset(commandBuffer, imageIndex);
+   commandBuffer.pushConstants<Constants>(m_PipelineLayout, vk::ShaderStageFlagBits::eRaygenNV | vk::ShaderStageFlagBits::eMissNV, 0, constants);
+   commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingNV, m_Pipeline);
+   commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingNV, m_PipelineLayout, 0, m_DescriptorSets[imageIndex], m_UniformBuffer->GetFrameOffset(imageIndex));  // the image's descriptor set, and its region of the uniform buffer
 
-      vk::ImageMemoryBarrier barrier = {
-         {}                                    /*srcAccessMask*/,
-         vk::AccessFlagBits::eTransferWrite    /*dstAccessMask*/,
-         vk::ImageLayout::eUndefined           /*oldLayout*/,
-         vk::ImageLayout::eTransferDstOptimal  /*newLayout*/,
-         VK_QUEUE_FAMILY_IGNORED               /*srcQueueFamilyIndex*/,
-         VK_QUEUE_FAMILY_IGNORED               /*dstQueueFamilyIndex*/,
-         m_SwapChainImages[i].m_Image          /*image*/,
-         subresourceRange
-      };
-      commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
-
-      barrier = {
-         {}                                    /*srcAccessMask*/,
-         vk::AccessFlagBits::eTransferRead     /*dstAccessMask*/,
-         vk::ImageLayout::eGeneral             /*oldLayout*/,
-         vk::ImageLayout::eTransferSrcOptimal  /*newLayout*/,
-         VK_QUEUE_FAMILY_IGNORED               /*srcQueueFamilyIndex*/,
-         VK_QUEUE_FAMILY_IGNORED               /*dstQueueFamilyIndex*/,
-         m_OutputImage->m_Image               /*image*/,
-         subresourceRange
-      };
-      commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
-
-      vk::ImageCopy copyRegion = {
-         {vk::ImageAspectFlagBits::eColor, 0, 0, 1 } /*srcSubresource*/,
-         {0, 0, 0}                                   /*srcOffset*/,
-         {vk::ImageAspectFlagBits::eColor, 0, 0, 1 } /*dstSubresource*/,
-         {0, 0, 0}                                   /*dstOffset*/,
-         {m_Extent.width, m_Extent.height, 1}        /*extent*/
-      };
-      commandBuffer.copyImage(m_OutputImage->m_Image, vk::ImageLayout::eTransferSrcOptimal, m_SwapChainImages[i].m_Image, vk::ImageLayout::eTransferDstOptimal, copyRegion);
-
-      barrier = {
-         vk::AccessFlagBits::eTransferWrite    /*srcAccessMask*/,
-         {}                                    /*dstAccessMask*/,
-         vk::ImageLayout::eTransferDstOptimal  /*oldLayout*/,
-         vk::ImageLayout::ePresentSrcKHR       /*newLayout*/,
-         VK_QUEUE_FAMILY_IGNORED               /*srcQueueFamilyIndex*/,
-         VK_QUEUE_FAMILY_IGNORED               /*dstQueueFamilyIndex*/,
-         m_SwapChainImages[i].m_Image          /*image*/,
-         subresourceRange
-      };
-      commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
-
-      barrier = {
-         vk::AccessFlagBits::eTransferRead     /*srcAccessMask*/,
-         {}                                    /*dstAccessMask*/,
-         vk::ImageLayout::eTransferSrcOptimal  /*oldLayout*/,
-         vk::ImageLayout::eGeneral             /*newLayout*/,
-         VK_QUEUE_FAMILY_IGNORED               /*srcQueueFamilyIndex*/,
-         VK_QUEUE_FAMILY_IGNORED               /*dstQueueFamilyIndex*/,
-         m_OutputImage->m_Image               /*image*/,
-         subresourceRange
-      };
-      commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
+   uint32_t shaderBindingTableEntrySize = (m_RayTracingProperties.shaderGroupHandleSize + m_RayTracingProperties.shaderGroupBaseAlignment - 1) & ~(m_RayTracingProperties.shaderGroupBaseAlignment - 1);
 
-      commandBuffer.end();
-   }
+   const uint32_t traceRaysScope = m_Profiler->CmdBeginScope(commandBuffer, imageIndex, "TraceRays");
+   commandBuffer.traceRaysNV(
+      m_ShaderBindingTable->m_Buffer, static_cast<vk::DeviceSize>(shaderBindingTableEntrySize) * eRayGenGroup,
+      m_ShaderBindingTable->m_Buffer, static_cast<vk::DeviceSize>(shaderBindingTableEntrySize) * eMissGroup, shaderBindingTableEntrySize,
+      m_ShaderBindingTable->m_Buffer, static_cast<vk::DeviceSize>(shaderBindingTableEntrySize) * eFirstHitGroup, shaderBindingTableEntrySize,
+      nullptr, 0, 0,
+      m_Extent.width, m_Extent.height, 1
+   );
+   m_Profiler->CmdEndScope(commandBuffer, imageIndex, traceRaysScope);
+
+   const uint32_t copyScope = m_Profiler->CmdBeginScope(commandBuffer, imageIndex, "CopyOutputImage");
+
+   vk::ImageMemoryBarrier barrier = {
+      {}                                    /*srcAccessMask*/,
+      vk::AccessFlagBits::eTransferWrite    /*dstAccessMask*/,
+      vk::ImageLayout::eUndefined           /*oldLayout*/,
+      vk::ImageLayout::eTransferDstOptimal  /*newLayout*/,
+      VK_QUEUE_FAMILY_IGNORED               /*srcQueueFamilyIndex*/,
+      VK_QUEUE_FAMILY_IGNORED               /*dstQueueFamilyIndex*/,
+      m_SwapChainImages[imageIndex].m_Image /*image*/,
+      subresourceRange
+   };
+   commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
+
+   barrier = {
+      {}                                    /*srcAccessMask*/,
+      vk::AccessFlagBits::eTransferRead     /*dstAccessMask*/,
+      vk::ImageLayout::eGeneral             /*oldLayout*/,
+      vk::ImageLayout::eTransferSrcOptimal  /*newLayout*/,
+      VK_QUEUE_FAMILY_IGNORED               /*srcQueueFamilyIndex*/,
+      VK_QUEUE_FAMILY_IGNORED               /*dstQueueFamilyIndex*/,
+      m_OutputImage->m_Image               /*image*/,
+      subresourceRange
+   };
+   commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
+
+   vk::ImageCopy copyRegion = {
+      {vk::ImageAspectFlagBits::eColor, 0, 0, 1 } /*srcSubresource*/,
+      {0, 0, 0}                                   /*srcOffset*/,
+      {vk::ImageAspectFlagBits::eColor, 0, 0, 1 } /*dstSubresource*/,
+      {0, 0, 0}                                   /*dstOffset*/,
+      {m_Extent.width, m_Extent.height, 1}        /*extent*/
+   };
+   commandBuffer.copyImage(m_OutputImage->m_Image, vk::ImageLayout::eTransferSrcOptimal, m_SwapChainImages[imageIndex].m_Image, vk::ImageLayout::eTransferDstOptimal, copyRegion);
+
+   barrier = {
+      vk::AccessFlagBits::eTransferWrite    /*srcAccessMask*/,
+      {}                                    /*dstAccessMask*/,
+      vk::ImageLayout::eTransferDstOptimal  /*oldLayout*/,
+      m_PresentLayout                       /*newLayout*/,
+      VK_QUEUE_FAMILY_IGNORED               /*srcQueueFamilyIndex*/,
+      VK_QUEUE_FAMILY_IGNORED               /*dstQueueFamilyIndex*/,
+      m_SwapChainImages[imageIndex].m_Image /*image*/,
+      subresourceRange
+   };
+   commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
+
+   barrier = {
+      vk::AccessFlagBits::eTransferRead     /*srcAccessMask*/,
+      {}                                    /*dstAccessMask*/,
+      vk::ImageLayout::eTransferSrcOptimal  /*oldLayout*/,
+      vk::ImageLayout::eGeneral             /*newLayout*/,
+      VK_QUEUE_FAMILY_IGNORED               /*srcQueueFamilyIndex*/,
+      VK_QUEUE_FAMILY_IGNORED               /*dstQueueFamilyIndex*/,
+      m_OutputImage->m_Image               /*image*/,
+      subresourceRange
+   };
+   commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
+
+   m_Profiler->CmdEndScope(commandBuffer, imageIndex, copyScope);
 }
 
 
@@ -1667,12 +2408,12 @@ void RayTracer::Update(double deltaTime) {
    __super::Update(deltaTime);
 
    if (
-      (glfwGetKey(m_Window, GLFW_KEY_W) == GLFW_PRESS) ||
-      (glfwGetKey(m_Window, GLFW_KEY_A) == GLFW_PRESS) ||
-      (glfwGetKey(m_Window, GLFW_KEY_S) == GLFW_PRESS) ||
-      (glfwGetKey(m_Window, GLFW_KEY_D) == GLFW_PRESS) ||
-      (glfwGetKey(m_Window, GLFW_KEY_R) == GLFW_PRESS) ||
-      (glfwGetKey(m_Window, GLFW_KEY_F) == GLFW_PRESS) ||
+      IsKeyPressed(GLFW_KEY_W) ||
+      IsKeyPressed(GLFW_KEY_A) ||
+      IsKeyPressed(GLFW_KEY_S) ||
+      IsKeyPressed(GLFW_KEY_D) ||
+      IsKeyPressed(GLFW_KEY_R) ||
+      IsKeyPressed(GLFW_KEY_F) ||
       m_LeftMouseDown
    ) {
       m_AccumulatedImageCount = 0;
@@ -1680,6 +2421,12 @@ void RayTracer::Update(double deltaTime) {
    if (!m_Scene.GetAccumulateFrames()) {
       m_AccumulatedImageCount = 0;
    }
+   if (m_IsAnimating) {
+      AnimateInstances(deltaTime);
+   }
+   if (m_Scene.GetInstanceChanges().Any()) {
+      m_AccumulatedImageCount = 0;
+   }
    ++m_AccumulatedImageCount;
 }
 
@@ -1699,19 +2446,27 @@ void RayTracer::RenderFrame() {
       m_AccumulatedImageCount
    };
 
-   // All the rendering instructions are in pre-recorded command buffer (which gets submitted to the GPU in EndFrame()).  All we have to do here is update the uniform buffer.
+   // The frame's ray tracing is recorded after the scene and pipeline updates, so that it uses their results (a TLAS
+   // refit and light list update go in the same command buffer, ahead of it).  The command buffer gets submitted to the
+   // GPU in EndFrame()
    BeginFrame();
-   m_UniformBuffers[m_CurrentImage].CopyFromHost(0, sizeof(UniformBufferObject), &ubo);
+   const vk::CommandBuffer commandBuffer = BeginFrameCommandBuffer();
+   UpdateInstances(commandBuffer);
+   CheckPipelineVariantBuild();
+   m_UniformBuffer->BeginFrame(m_CurrentImage);
+   m_UniformBuffer->Push(ubo);
+   RecordFrameCommandBuffer(commandBuffer);
    EndFrame();
 }
 
 
 void RayTracer::OnWindowResized() {
    __super::OnWindowResized();
-   DestroyDescriptorSets();
+   // the old storage images and descriptor sets may still be in use by frames in flight
+   m_DeletionQueue.Push(std::move(m_AccumumlationImage));
+   m_DeletionQueue.Push(std::move(m_OutputImage));
    CreateStorageImages();
-   CreateDescriptorSets();
-   RecordCommandBuffers();
+   RecreateDescriptorSets();
    m_AccumulatedImageCount = 0;
 }
 
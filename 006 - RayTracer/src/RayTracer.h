@@ -1,8 +1,14 @@
 #include "Application.h"
 
 #include "Buffer.h"
+#include "CpuPathTracer.h"
 #include "Image.h"
+#include "LightList.h"
+#include "MergedInstances.h"
+#include "PipelineFeatures.h"
+#include "RingBuffer.h"
 #include "Scene.h"
+#include "SceneFile.h"
 
 #include <filesystem>
 #include <memory>
@@ -18,8 +24,27 @@ public:
    virtual vk::PhysicalDeviceFeatures GetRequiredPhysicalDeviceFeatures(vk::PhysicalDeviceFeatures) override;
    virtual void* GetRequiredPhysicalDeviceFeaturesEXT() override;
 
+   // Ray tracer specific command line arguments:
+   //    --cpu-reference=<file>   render the scene with CpuPathTracer (no ray tracing device needed), write it to file (.png or .hdr) and exit
+   //    --samples=<n>            cpu reference: samples per pixel
+   //    --benchmark-bvh          run the CPU BVH benchmarks (no Vulkan device needed) and exit
+   //    --benchmark-mesh-cache[=<dir>]  benchmark .obj import versus MeshCache for every .obj file under dir (default Assets/Models) and exit
+   //    --benchmark-obj-import[=<file.obj>]  benchmark the parallel .obj importer versus tinyobjloader on file (default: generated multi-million triangle files) and exit
+   //    --benchmark-tlas-update  benchmark CPU side instance packing for a TLAS refit versus a rebuild, and exit
+   //    --benchmark-environment-map[=<file.hdr>]  benchmark environment map alias table builds, and CPU reference convergence with and without importance sampling it, on file (default: a generated sky), and exit
+   //    --benchmark-light-sampling  benchmark CPU reference convergence with each way of sampling lights (see CpuPathTracer::LightSampling) on the Cornell box scenes, and exit
+   //    --benchmark-light-tree   benchmark light tree builds, and CPU reference convergence choosing lights via the tree versus by power, on generated scenes of many small lights, and exit
+   //    --environment=<file.hdr> light the scene with an equirectangular environment map (instead of the scene's own, or its sky gradient)
+   //    --animate                move the instances every frame (exercises the TLAS refit path)
+   //    --merge-instances        merge procedural instances that share a model into one BLAS each (ignored with --animate)
+   //    --scene=<scene>          the scene to render: the name of a built in scene (e.g. WineGlass, the default), or a .scene or .scenebin file
+   //    --export-scenes=<dir>    save each built in scene to <dir> as both .scene and .scenebin, check that they load back the same, and exit
+   virtual bool ParseArgument(std::string_view arg, std::string_view value) override;
+
    virtual void Init() override;
 
+   virtual void Run() override;
+
    void CreateScene();
 
    void CreateVertexBuffer();
@@ -37,12 +62,33 @@ public:
    void CreateMaterialBuffer();
    void DestroyMaterialBuffer();
 
+   void CreatePrimitiveBuffer();
+   void DestroyPrimitiveBuffer();
+
    void CreateTextureResources();
    void DestroyTextureResources();
 
+   void CreateEnvironmentMapResources();
+   void DestroyEnvironmentMapResources();
+
+   // The scene's light list (see LightList.h).  The offset and primitive buffers refer to it, so it is created first
+   void CreateLightResources();
+   void DestroyLightResources();
+
    void CreateAccelerationStructures();
    void DestroyAccelerationStructures();
 
+   std::vector<uint64_t> GetBlasHandles() const;   // indexed by model index, followed by those of the merged instance groups
+
+   // Bring the GPU up to date with the scene's instance changes: refit the TLAS (and update the light list, if lights
+   // have moved) if instances have only moved, otherwise rebuild everything that is per instance.  A refit is recorded
+   // into commandBuffer (this frame's, ahead of its ray tracing), as is a light list update.
+   void UpdateInstances(vk::CommandBuffer commandBuffer);
+   void RebuildInstances();
+   void UpdateLights(vk::CommandBuffer commandBuffer);
+
+   void AnimateInstances(const double deltaTime);
+
    void CreateStorageImages();
    void DestroyStorageImages();
 
@@ -55,16 +101,23 @@ public:
    void CreatePipelineLayout(); // depends on descriptor set layout
    void DestroyPipelineLayout();
 
-   void CreatePipeline();
+   void CreatePipeline();    // specialized on the scene's features
    void DestroyPipeline();
 
+   // Bring the pipeline up to date with the scene's features, after the scene has changed.  If the current pipeline can
+   // still render the scene, the new variant is built in the background (and CheckPipelineVariantBuild() swaps it in
+   // once it is ready), otherwise it is built now.
+   void UpdatePipeline();
+   void CheckPipelineVariantBuild();
+
    void CreateDescriptorPool();
    void DestroyDescriptorPool();
 
    void CreateDescriptorSets();
    void DestroyDescriptorSets();
 
-   void RecordCommandBuffers();
+   // Record this frame's ray tracing, and the copy of its output to the swap chain image
+   void RecordFrameCommandBuffer(vk::CommandBuffer commandBuffer);
 
    virtual void Update(double deltaTime) override;
 
@@ -73,6 +126,26 @@ public:
    virtual void OnWindowResized() override;
 
 private:
+   // A ray tracing pipeline with its shaders specialized on Features, and its shader binding table
+   struct PipelineVariant {
+      PipelineFeatures Features;
+      vk::Pipeline Pipeline;
+      std::unique_ptr<Vulkan::Buffer> ShaderBindingTable;
+   };
+   PipelineVariant CreatePipelineVariant(const PipelineFeatures& features);   // safe to call from any thread
+   void SetPipelineVariant(PipelineVariant variant);                        // retires the current one
+   void FinishPipelineVariantBuild();
+
+   void RecreateDescriptorSets();   // after the resources that they refer to have been replaced
+
+   CpuPathTracer::Settings GetCpuReferenceSettings(const uint32_t width, const uint32_t height) const;   // the current camera, and the scene's ray bounces
+   void RenderCpuReference();
+   void ExportScenes();
+   void RunLightSamplingBenchmarks();
+
+   SceneCamera GetCamera() const;
+   void SetCamera(const SceneCamera& camera);
+
    void CreateSceneFurnaceTest();
    void CreateSceneNormalsTest();
    void CreateSceneSimple();
@@ -85,6 +158,12 @@ private:
    void CreateSceneRayTracingTheNextWeekFinal();
    void CreateSceneWineGlass();
 
+   struct BuiltinScene {
+      const char* Name;
+      void (RayTracer::*Create)();
+   };
+   static const BuiltinScene sm_BuiltinScenes[];
+
 
 private:
    Scene m_Scene;
@@ -93,32 +172,75 @@ private:
    std::unique_ptr<Vulkan::Buffer> m_OffsetBuffer;
    std::unique_ptr<Vulkan::Buffer> m_AABBBuffer;
    std::unique_ptr<Vulkan::Buffer> m_MaterialBuffer;
+   std::unique_ptr<Vulkan::Buffer> m_PrimitiveBuffer;
+   MergedInstances m_MergedInstances;                        // no groups unless m_IsMergingInstances
+   std::vector<Vulkan::GeometryInstance> m_TlasInstances;   // as last uploaded to the TLAS instance buffer
    std::vector<std::unique_ptr<Vulkan::Image>> m_Textures;
    vk::Sampler m_TextureSampler;
+   std::unique_ptr<Vulkan::Image> m_EnvironmentMapImage;      // placeholder if the scene has no environment map
+   std::unique_ptr<Vulkan::Buffer> m_EnvironmentTableBuffer;  // its alias table (see EnvironmentMap.h)
+   LightList m_Lights;
+   std::unique_ptr<Vulkan::Buffer> m_LightBuffer;             // placeholder (of one light) if the list is empty
+   std::unique_ptr<Vulkan::Buffer> m_LightTreeBuffer;         // the list's light tree (see LightTree.h)
+   std::unique_ptr<Vulkan::Buffer> m_LightStagingBuffer;      // for UpdateLights(): a region per frame in flight
    std::unique_ptr<Vulkan::Image> m_OutputImage;
    std::unique_ptr<Vulkan::Image> m_AccumumlationImage;
    uint32_t m_AccumulatedImageCount = 0;
-   std::vector<Vulkan::Buffer> m_UniformBuffers;
+   std::unique_ptr<Vulkan::RingBuffer> m_UniformBuffer;
    vk::PhysicalDeviceRayTracingPropertiesNV m_RayTracingProperties;
    vk::DescriptorSetLayout m_DescriptorSetLayout;
    vk::PipelineLayout m_PipelineLayout;
    vk::Pipeline m_Pipeline;
+   PipelineFeatures m_PipelineFeatures;                           // what m_Pipeline is specialized on
+   Vulkan::TaskHandle m_PipelineVariantTask;                      // background build of m_PendingPipelineVariant, if any
+   std::shared_ptr<PipelineVariant> m_PendingPipelineVariant;
    
-   enum EShaderHitGroup {
+   // Shader binding table records: ray generation, miss, shadow ray miss, and then a hit group for every pair of geometry
+   // type and material type (see GetInstanceHitGroupIndex()).  Pipeline variants only have the hit groups that the scene
+   // uses.
+   enum EShaderGroup {
       eRayGenGroup,
       eMissGroup,
-      eFirstHitGroup,
-      eTrianglesHitGroup = eFirstHitGroup,
-      eSphereHitGroup,
-      eBoxHitGroup,
-
-      eNumShaderGroups
+      eShadowMissGroup,
+      eFirstHitGroup
    };
    std::unique_ptr<Vulkan::Buffer> m_ShaderBindingTable;
 
-   const uint32_t m_TrianglesShaderHitGroupIndex = 0;
-   const uint32_t m_SphereShaderHitGroupIndex = 1;
+   // Model geometry types (Model::GetShaderHitGroupIndex()), and their shaders
+   enum EGeometryType {
+      eTrianglesGeometry,
+      eSphereGeometry,
+      eBoxGeometry,
+
+      eNumGeometryTypes
+   };
+   struct GeometryShaders {
+      const char* ClosestHitShader;
+      const char* IntersectionShader;   // nullptr => triangles
+   };
+   static const GeometryShaders sm_GeometryShaders[eNumGeometryTypes];
+   static constexpr uint32_t sm_HitGroupCount = eNumGeometryTypes * MATERIAL_NUMTYPES;
+
    vk::DescriptorPool m_DescriptorPool;
    std::vector<vk::DescriptorSet> m_DescriptorSets;
 
+   std::string m_CpuReferenceFile;
+   uint32_t m_CpuReferenceSampleCount = 16;
+   bool m_IsBvhBenchmark = false;
+   std::string m_MeshCacheBenchmarkDirectory;     // non-empty => run the mesh cache benchmark
+   bool m_IsObjImportBenchmark = false;
+   std::string m_ObjImportBenchmarkFile;          // empty => benchmark on generated files
+   bool m_IsTlasUpdateBenchmark = false;
+   bool m_IsEnvironmentMapBenchmark = false;
+   std::string m_EnvironmentMapBenchmarkFile;     // empty => benchmark on a generated sky
+   std::string m_EnvironmentMapFileName;          // non-empty => overrides the scene's
+   bool m_IsLightSamplingBenchmark = false;
+   bool m_IsLightTreeBenchmark = false;
+   bool m_IsAnimating = false;
+   bool m_IsMergingInstances = false;
+   double m_AnimationTime = 0.0;
+   std::vector<glm::mat3x4> m_AnimationBaseTransforms;
+   std::string m_SceneName = "WineGlass";
+   std::string m_ExportScenesDirectory;
+
 };
@@ -6,7 +6,7 @@ uint32_t Rectangle2DInstance::sm_ModelIndex = ~0;
 Rectangle2D::Rectangle2D() : Model("Assets/Models/Rectangle2D.obj") {}
 
 
-Rectangle2DInstance::Rectangle2DInstance(const glm::vec3& centre, const glm::vec2& size, const glm::vec3& rotateRadians, const Material& material)
+Rectangle2DInstance::Rectangle2DInstance(const glm::vec3& centre, const glm::vec2& size, const glm::vec3& rotateRadians, const uint32_t materialIndex)
 : Instance {
    sm_ModelIndex,
    glm::transpose(
@@ -27,7 +27,7 @@ Rectangle2DInstance::Rectangle2DInstance(const glm::vec3& centre, const glm::vec
          glm::vec3 {size, 1.0}
       )
    ),
-   material
+   materialIndex
 } {
    ASSERT(sm_ModelIndex != ~0, "ERROR: Rectangle2D model instance has not been set.  You must set the Rectangle2D model index (via SetModelIndex()) before instantiating a Rectangle2D.");
 }
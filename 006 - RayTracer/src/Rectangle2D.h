@@ -11,7 +11,7 @@ public:
 
 class Rectangle2DInstance : public Instance {
 public:
-   Rectangle2DInstance(const glm::vec3& centre, const glm::vec2& size, const glm::vec3& rotationRadians, const Material& material);
+   Rectangle2DInstance(const glm::vec3& centre, const glm::vec2& size, const glm::vec3& rotationRadians, const uint32_t materialIndex);
 
 public:
    static void SetModelIndex(const uint32_t modelIndex);
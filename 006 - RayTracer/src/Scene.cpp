@@ -1,5 +1,7 @@
 #include "Scene.h"
 
+#include <algorithm>
+
 glm::vec3 Scene::GetHorizonColor() const {
    return m_HorizonColor;
 }
@@ -20,6 +22,16 @@ void Scene::SetZenithColor(const glm::vec3& color) {
 }
 
 
+const std::string& Scene::GetEnvironmentMapFileName() const {
+   return m_EnvironmentMapFileName;
+}
+
+
+void Scene::SetEnvironmentMapFileName(std::string fileName) {
+   m_EnvironmentMapFileName = std::move(fileName);
+}
+
+
 bool Scene::GetAccumulateFrames() const {
    return m_AccumulateFrames;
 }
@@ -30,6 +42,22 @@ void Scene::SetAccumulateFrames(const bool b) {
 }
 
 
+uint32_t Scene::GetMinRayBounces() const {
+   return m_MinRayBounces;
+}
+
+
+uint32_t Scene::GetMaxRayBounces() const {
+   return m_MaxRayBounces;
+}
+
+
+void Scene::SetRayBounces(const uint32_t minBounces, const uint32_t maxBounces) {
+   m_MinRayBounces = std::min(minBounces, maxBounces);
+   m_MaxRayBounces = maxBounces;
+}
+
+
 uint32_t
 Scene::AddModel(std::unique_ptr<Model> model) {
    m_Models.emplace_back(std::move(model));
@@ -44,18 +72,76 @@ uint32_t Scene::AddTextureResource(std::string name, std::string fileName) {
 }
 
 
+uint32_t Scene::AddMaterial(const Material& material) {
+   auto [it, isNew] = m_MaterialIndices.try_emplace(std::string(reinterpret_cast<const char*>(&material), sizeof(Material)), static_cast<uint32_t>(m_Materials.size()));
+   if (isNew) {
+      m_Materials.emplace_back(material);
+   }
+   return it->second;
+}
+
+
 uint32_t
-Scene::AddInstance(std::unique_ptr<Instance> instance) {
-   m_Instances.emplace_back(std::move(instance));
+Scene::AddInstance(const Instance& instance) {
+   ASSERT(instance.GetMaterialIndex() < m_Materials.size(), "ERROR: Instance material index {} is out of range.  Materials must be added to the scene (via AddMaterial()) before the instances that use them", instance.GetMaterialIndex());
+   m_Instances.emplace_back(instance);
+   m_InstanceChanges.IsListChanged = true;
    return static_cast<uint32_t>(m_Instances.size() - 1);
 }
 
 
+void Scene::RemoveInstance(const uint32_t instanceIndex) {
+   m_Instances.erase(m_Instances.begin() + instanceIndex);
+   m_InstanceChanges.IsListChanged = true;
+}
+
+
+void Scene::ReserveInstances(const size_t count) {
+   m_Instances.reserve(m_Instances.size() + count);
+}
+
+
+void Scene::SetInstanceTransform(const uint32_t instanceIndex, const glm::mat3x4& transform) {
+   m_Instances.at(instanceIndex).SetTransform(transform);
+   if (m_IsInstanceMoved.size() < m_Instances.size()) {
+      m_IsInstanceMoved.resize(m_Instances.size(), false);
+   }
+   if (!m_IsInstanceMoved[instanceIndex]) {
+      m_IsInstanceMoved[instanceIndex] = true;
+      m_InstanceChanges.MovedInstances.push_back(instanceIndex);
+   }
+}
+
+
+const Scene::InstanceChanges& Scene::GetInstanceChanges() const {
+   return m_InstanceChanges;
+}
+
+
+void Scene::ClearInstanceChanges() {
+   for (const uint32_t instanceIndex : m_InstanceChanges.MovedInstances) {
+      m_IsInstanceMoved[instanceIndex] = false;
+   }
+   m_InstanceChanges.MovedInstances.clear();   // (keeping its capacity, for the next frame's moves)
+   m_InstanceChanges.IsListChanged = false;
+}
+
+
 const std::vector<std::unique_ptr<Model>>& Scene::GetModels() const {
    return m_Models;
 }
 
 
+const std::vector<Material>& Scene::GetMaterials() const {
+   return m_Materials;
+}
+
+
+const std::vector<std::string>& Scene::GetTextureNames() const {
+   return m_TextureNames;
+}
+
+
 const std::vector<std::string>& Scene::GetTextureFileNames() const {
    return m_TextureFileNames;
 }
@@ -74,6 +160,6 @@ int Scene::GetTextureId(const std::string& name) const {
 }
 
 
-const std::vector<std::unique_ptr<Instance>>& Scene::GetInstances() const {
+const std::vector<Instance>& Scene::GetInstances() const {
    return m_Instances;
 }
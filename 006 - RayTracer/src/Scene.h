@@ -1,8 +1,11 @@
 #pragma once
 
 #include "Instance.h"
+#include "Material.h"
 #include "Model.h"
 
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 class Scene {
@@ -13,24 +16,68 @@ public:
    glm::vec3 GetZenithColor() const;
    void SetZenithColor(const glm::vec3& color);
 
+   // Equirectangular HDR image (e.g. a Radiance .hdr file) that lights the scene from all around, in place of the
+   // horizon to zenith gradient.  Empty => none
+   const std::string& GetEnvironmentMapFileName() const;
+   void SetEnvironmentMapFileName(std::string fileName);
+
    bool GetAccumulateFrames() const;
    void SetAccumulateFrames(const bool b);
 
+   // Path length limits: rays bounce at least minBounces times before Russian roulette may terminate them, and at most
+   // maxBounces times
+   uint32_t GetMinRayBounces() const;
+   uint32_t GetMaxRayBounces() const;
+   void SetRayBounces(const uint32_t minBounces, const uint32_t maxBounces);
+
    uint32_t AddModel(std::unique_ptr<Model> model);
    uint32_t AddTextureResource(std::string name, std::string fileName);
-   uint32_t AddInstance(std::unique_ptr<Instance> instance);
+
+   // Materials are interned: adding a material that is identical to one already added returns the existing index, so
+   // instances that look the same share one material
+   uint32_t AddMaterial(const Material& material);
+
+   uint32_t AddInstance(const Instance& instance);
+   void RemoveInstance(const uint32_t instanceIndex);   // instances after it move down one
+
+   // Reserve space for count more instances (so that adding them does not reallocate)
+   void ReserveInstances(const size_t count);
+
+   // Move an instance.  Unlike adding or removing instances, this only needs the renderer to refit its acceleration
+   // structure (and upload the changed transforms), rather than rebuild everything that is per instance.
+   void SetInstanceTransform(const uint32_t instanceIndex, const glm::mat3x4& transform);
+
+   // What has happened to the instances since ClearInstanceChanges() was last called
+   struct InstanceChanges {
+      std::vector<uint32_t> MovedInstances;   // indices of the instances that have been moved, each just once, in the order they were first moved
+      bool IsListChanged = false;             // instances have been added or removed (so everything per instance has to be rebuilt, and MovedInstances may be out of date)
+
+      bool HasTransformChanges() const { return !MovedInstances.empty(); }
+      bool Any() const { return IsListChanged || HasTransformChanges(); }
+   };
+   const InstanceChanges& GetInstanceChanges() const;
+   void ClearInstanceChanges();
 
    const std::vector<std::unique_ptr<Model>>& GetModels() const;
+   const std::vector<Material>& GetMaterials() const;
+   const std::vector<std::string>& GetTextureNames() const;
    const std::vector<std::string>& GetTextureFileNames() const;
    int GetTextureId(const std::string& name) const;
-   const std::vector<std::unique_ptr<Instance>>& GetInstances() const;
+   const std::vector<Instance>& GetInstances() const;
 
 private:
    glm::vec3 m_HorizonColor = glm::one<glm::vec3>();
    glm::vec3 m_ZenithColor = glm::one<glm::vec3>();
+   std::string m_EnvironmentMapFileName;
    std::vector<std::unique_ptr<Model>> m_Models;                 // unique models
    std::vector<std::string> m_TextureNames;
    std::vector<std::string> m_TextureFileNames;
-   std::vector<std::unique_ptr<Instance>> m_Instances;           // instances of models (i.e. tuples of model, transform, texture, material)
+   std::vector<Material> m_Materials;                            // unique materials
+   std::unordered_map<std::string, uint32_t> m_MaterialIndices;  // material (bytes) -> index into m_Materials
+   std::vector<Instance> m_Instances;                            // instances of models (i.e. tuples of model, transform, material)
+   InstanceChanges m_InstanceChanges;
+   std::vector<bool> m_IsInstanceMoved;                          // indexed by instance, true if it is in m_InstanceChanges.MovedInstances
    bool m_AccumulateFrames = true;
+   uint32_t m_MinRayBounces = 3;
+   uint32_t m_MaxRayBounces = 64;
 };
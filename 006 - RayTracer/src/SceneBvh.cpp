@@ -0,0 +1,112 @@
+#include "SceneBvh.h"
+
+#include "JobSystem.h"
+
+#include <cmath>
+#include <limits>
+
+
+SceneBvh::SceneBvh(const Scene& scene, Vulkan::JobSystem* jobSystem, const Vulkan::BvhBuildSettings& settings) {
+   // models one at a time, each spread across the threads (there are few models, of very different sizes)
+   const auto& models = scene.GetModels();
+   m_ModelBvhs.reserve(models.size());
+   for (const auto& model : models) {
+      if (model->IsProcedural()) {
+         m_ModelBvhs.emplace_back();
+      } else {
+         m_ModelBvhs.emplace_back(GetTriangleBounds(model->GetVertices(), model->GetIndices()), jobSystem, settings);
+      }
+   }
+
+   const auto& instances = scene.GetInstances();
+   m_InstanceBounds.reserve(instances.size());
+   for (const auto& instance : instances) {
+      // instance transforms are the first three rows of the object to world matrix
+      m_InstanceBounds.emplace_back(GetWorldBounds(*models.at(instance.GetModelIndex()), glm::transpose(glm::mat4 {instance.GetTransform()})));
+   }
+   m_InstanceBvh = Vulkan::Bvh {m_InstanceBounds, jobSystem, settings};
+}
+
+
+const Vulkan::Bvh& SceneBvh::GetModelBvh(const uint32_t modelIndex) const {
+   return m_ModelBvhs.at(modelIndex);
+}
+
+
+const Vulkan::Bvh& SceneBvh::GetInstanceBvh() const {
+   return m_InstanceBvh;
+}
+
+
+const Vulkan::Aabb& SceneBvh::GetInstanceBounds(const uint32_t instanceIndex) const {
+   return m_InstanceBounds.at(instanceIndex);
+}
+
+
+double SceneBvh::GetBuildSeconds() const {
+   double seconds = m_InstanceBvh.GetStats().BuildSeconds;
+   for (const auto& bvh : m_ModelBvhs) {
+      seconds += bvh.GetStats().BuildSeconds;
+   }
+   return seconds;
+}
+
+
+std::vector<Vulkan::Aabb> SceneBvh::GetTriangleBounds(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+   std::vector<Vulkan::Aabb> bounds(indices.size() / 3);
+   for (size_t triangle = 0; triangle < bounds.size(); ++triangle) {
+      bounds[triangle].Grow(vertices[indices[3 * triangle + 0]].pos);
+      bounds[triangle].Grow(vertices[indices[3 * triangle + 1]].pos);
+      bounds[triangle].Grow(vertices[indices[3 * triangle + 2]].pos);
+   }
+   return bounds;
+}
+
+
+Vulkan::Aabb SceneBvh::GetWorldBounds(const Model& model, const glm::mat4& objectToWorld) {
+   Vulkan::Aabb bounds;
+   if (model.IsProcedural()) {
+      const auto [boxMin, boxMax] = model.GetBoundingBox();
+      for (uint32_t corner = 0; corner < 8; ++corner) {
+         const glm::vec4 point = {(corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z, 1.0f};
+         bounds.Grow(glm::vec3 {objectToWorld * point});
+      }
+   } else {
+      for (const auto& vertex : model.GetVertices()) {
+         bounds.Grow(glm::vec3 {objectToWorld * glm::vec4 {vertex.pos, 1.0f}});
+      }
+   }
+
+   // pad, so that flat geometry (e.g. Rectangle2D) still has some volume
+   if (!bounds.IsEmpty()) {
+      const glm::vec3 padding = 0.001f * (glm::vec3 {1.0f} + glm::abs(bounds.Max - bounds.Min));
+      bounds.Min -= padding;
+      bounds.Max += padding;
+   }
+   return bounds;
+}
+
+
+bool SceneBvh::IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, float& t, glm::vec2& barycentrics) {
+   const glm::vec3 edge1 = p1 - p0;
+   const glm::vec3 edge2 = p2 - p0;
+   const glm::vec3 p = glm::cross(direction, edge2);
+   const float determinant = glm::dot(edge1, p);
+   if (std::abs(determinant) < std::numeric_limits<float>::min()) {
+      return false;
+   }
+   const float inverseDeterminant = 1.0f / determinant;
+   const glm::vec3 s = origin - p0;
+   const float u = glm::dot(s, p) * inverseDeterminant;
+   if ((u < 0.0f) || (u > 1.0f)) {
+      return false;
+   }
+   const glm::vec3 q = glm::cross(s, edge1);
+   const float v = glm::dot(direction, q) * inverseDeterminant;
+   if ((v < 0.0f) || (u + v > 1.0f)) {
+      return false;
+   }
+   t = glm::dot(edge2, q) * inverseDeterminant;
+   barycentrics = {u, v};
+   return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Bvh.h"
+#include "Scene.h"
+
+#include <vector>
+
+// CPU side acceleration structure for a Scene, in the same two levels as the GPU one:
+// a bottom level BVH over the triangles of each (non procedural) Model, in object space, and a top level BVH over the
+// world space bounds of each Instance.
+// Intersecting the primitives (triangles, instances, procedural shapes) is left to the caller (see Vulkan::Bvh)
+class SceneBvh {
+public:
+   // Builds all of the BVHs.  If jobSystem is not null, the builds are spread across its threads
+   SceneBvh(const Scene& scene, Vulkan::JobSystem* jobSystem, const Vulkan::BvhBuildSettings& settings = {});
+
+   // Empty for procedural models.  Primitive i is triangle i, i.e. indices [3i, 3i + 2] of the model
+   const Vulkan::Bvh& GetModelBvh(const uint32_t modelIndex) const;
+
+   // Primitive i is scene instance i
+   const Vulkan::Bvh& GetInstanceBvh() const;
+
+   // World space bounds of scene instance i
+   const Vulkan::Aabb& GetInstanceBounds(const uint32_t instanceIndex) const;
+
+   // Total over all the BVHs
+   double GetBuildSeconds() const;
+
+public:
+   // Bounds of each triangle of an indexed triangle list
+   static std::vector<Vulkan::Aabb> GetTriangleBounds(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+   // World space bounds of model, when transformed by objectToWorld.
+   // For procedural models, these are the bounds of the model's bounding box.
+   static Vulkan::Aabb GetWorldBounds(const Model& model, const glm::mat4& objectToWorld);
+
+   // Ray vs. triangle (Möller-Trumbore), both sides.  Returns t, and the barycentrics of p1 and p2 (as for the
+   // hitAttributeNV of a triangle hit)
+   static bool IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, float& t, glm::vec2& barycentrics);
+
+private:
+   std::vector<Vulkan::Bvh> m_ModelBvhs;
+   std::vector<Vulkan::Aabb> m_InstanceBounds;
+   Vulkan::Bvh m_InstanceBvh;
+};
@@ -0,0 +1,660 @@
+#include "SceneFile.h"
+
+#include "Box.h"
+#include "Sphere.h"
+#include "Utility.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+// Text form
+// ---------
+//    # comment
+//    horizon <r> <g> <b>
+//    zenith <r> <g> <b>
+//    environment <file>
+//    accumulate <0 or 1>
+//    bounces <min> <max>
+//    eye <x> <y> <z>
+//    direction <x> <y> <z>
+//    up <x> <y> <z>
+//    fov <degrees>
+//    texture <name> <file>
+//    model <name> mesh <file>
+//    model <name> sphere
+//    model <name> procedural-box
+//    material <name> <material type> <parameter1> <parameter2> <parameter3> diffuse <texture> specular <texture>
+//    instance <model name> <material name> <transform>
+//
+// <material type> is one of lambertian, phong, metallic, dielectric, light, smoke.
+// <texture> is a texture type followed by the 8 texture parameters (param1 and param2 of Texture.h).  The texture type
+// is one of flat, checkerboard, simplex3d, turbulence, marble, normals, uv, red, or image:<texture name>, or a texture
+// id (i.e. index of the texture, in the order they are defined).
+// <transform> is 12 numbers: the first three rows of the object to world matrix (as per Instance).
+// Names cannot contain whitespace, and things must be defined before they are referred to.
+//
+// Binary form
+// -----------
+// BinaryHeader, then TextureCount BinaryTextures, ModelCount BinaryModels, MaterialCount Materials, InstanceCount
+// BinaryInstances, and finally StringsSize bytes of nul terminated strings (which the other records refer to by offset).
+
+namespace {
+
+constexpr char BinaryMagic[8] = {'V', 'K', 'S', 'C', 'E', 'N', 'E', '\0'};
+constexpr uint32_t BinaryVersion = 3;
+
+enum class ModelType : uint32_t {
+   Mesh,
+   Sphere,
+   ProceduralBox
+};
+
+
+struct BinaryHeader {
+   char Magic[8];
+   uint32_t Version;
+   uint32_t TextureCount;
+   uint32_t ModelCount;
+   uint32_t MaterialCount;
+   uint32_t InstanceCount;
+   uint32_t StringsSize;
+   float HorizonColor[3];
+   float ZenithColor[3];
+   uint32_t EnvironmentMapOffset;          // empty string => none
+   uint32_t AccumulateFrames;
+   uint32_t MinRayBounces;
+   uint32_t MaxRayBounces;
+   float Eye[3];
+   float Direction[3];
+   float Up[3];
+   float FoVRadians;
+};
+
+
+struct BinaryTexture {
+   uint32_t NameOffset;
+   uint32_t FileNameOffset;
+};
+
+
+struct BinaryModel {
+   ModelType Type;
+   uint32_t FileNameOffset;                // meshes only
+};
+
+
+// Also the in memory form, so that instances are read in one go
+struct BinaryInstance {
+   uint32_t ModelIndex;
+   uint32_t MaterialIndex;
+   float Transform[12];
+};
+
+static_assert(sizeof(Material) == 96, "Material layout has changed.  Bump BinaryVersion");
+static_assert(sizeof(BinaryInstance::Transform) == sizeof(glm::mat3x4), "Unexpected mat3x4 layout");
+
+
+struct ModelDescription {
+   ModelType Type = ModelType::Mesh;
+   std::string FileName;
+};
+
+
+// Everything in a scene file
+struct SceneDescription {
+   glm::vec3 HorizonColor = glm::one<glm::vec3>();
+   glm::vec3 ZenithColor = glm::one<glm::vec3>();
+   std::string EnvironmentMapFileName;
+   bool AccumulateFrames = true;
+   uint32_t MinRayBounces = 3;
+   uint32_t MaxRayBounces = 64;
+   SceneCamera Camera;
+   std::vector<std::string> TextureNames;
+   std::vector<std::string> TextureFileNames;
+   std::vector<ModelDescription> Models;
+   std::vector<Material> Materials;
+   std::vector<BinaryInstance> Instances;
+};
+
+
+constexpr const char* MaterialTypeNames[] = {
+   "lambertian",    // MATERIAL_LAMBERTIAN
+   "phong",         // MATERIAL_PHONG
+   "metallic",      // MATERIAL_METALLIC
+   "dielectric",    // MATERIAL_DIELECTRIC
+   "light",         // MATERIAL_LIGHT
+   "smoke"          // MATERIAL_SMOKE
+};
+
+
+struct TextureTypeName {
+   int Type;
+   const char* Name;
+};
+
+constexpr TextureTypeName TextureTypeNames[] = {
+   {TEXTURE_FLATCOLOR,    "flat"},
+   {TEXTURE_CHECKERBOARD, "checkerboard"},
+   {TEXTURE_SIMPLEX3D,    "simplex3d"},
+   {TEXTURE_TURBULENCE,   "turbulence"},
+   {TEXTURE_MARBLE,       "marble"},
+   {TEXTURE_NORMALS,      "normals"},
+   {TEXTURE_UV,           "uv"},
+   {TEXTURE_RED,          "red"}
+};
+
+
+// Scene -> SceneDescription
+
+SceneDescription Describe(const Scene& scene, const SceneCamera& camera) {
+   SceneDescription description;
+   description.HorizonColor = scene.GetHorizonColor();
+   description.ZenithColor = scene.GetZenithColor();
+   description.EnvironmentMapFileName = scene.GetEnvironmentMapFileName();
+   description.AccumulateFrames = scene.GetAccumulateFrames();
+   description.MinRayBounces = scene.GetMinRayBounces();
+   description.MaxRayBounces = scene.GetMaxRayBounces();
+   description.Camera = camera;
+   description.TextureNames = scene.GetTextureNames();
+   description.TextureFileNames = scene.GetTextureFileNames();
+
+   for (const auto& model : scene.GetModels()) {
+      const Box* box = dynamic_cast<const Box*>(model.get());
+      if (dynamic_cast<const Sphere*>(model.get())) {
+         description.Models.push_back({ModelType::Sphere});
+      } else if (box && box->IsProcedural()) {
+         description.Models.push_back({ModelType::ProceduralBox});
+      } else if (!model->IsProcedural()) {
+         description.Models.push_back({ModelType::Mesh, model->GetFileName()});
+      } else {
+         throw std::runtime_error("Cannot save scene: model '" + model->GetFileName() + "' is of an unknown procedural type");
+      }
+   }
+
+   // the scene has already deduplicated its materials
+   description.Materials = scene.GetMaterials();
+   description.Instances.reserve(scene.GetInstances().size());
+   for (const auto& instance : scene.GetInstances()) {
+      BinaryInstance& binaryInstance = description.Instances.emplace_back();
+      binaryInstance.ModelIndex = instance.GetModelIndex();
+      binaryInstance.MaterialIndex = instance.GetMaterialIndex();
+      std::memcpy(binaryInstance.Transform, &instance.GetTransform(), sizeof(binaryInstance.Transform));
+   }
+   return description;
+}
+
+
+// SceneDescription -> Scene
+
+void Populate(const SceneDescription& description, Scene& scene, Vulkan::JobSystem& jobSystem) {
+   if (!scene.GetModels().empty() || !scene.GetInstances().empty()) {
+      throw std::runtime_error("Scene files can only be loaded into an empty scene");
+   }
+   for (const auto& instance : description.Instances) {
+      if ((instance.ModelIndex >= description.Models.size()) || (instance.MaterialIndex >= description.Materials.size())) {
+         throw std::runtime_error("Scene file instance refers to a model or material that does not exist");
+      }
+   }
+
+   scene.SetHorizonColor(description.HorizonColor);
+   scene.SetZenithColor(description.ZenithColor);
+   scene.SetEnvironmentMapFileName(description.EnvironmentMapFileName);
+   scene.SetAccumulateFrames(description.AccumulateFrames);
+   scene.SetRayBounces(description.MinRayBounces, description.MaxRayBounces);
+   for (size_t i = 0; i < description.TextureNames.size(); ++i) {
+      scene.AddTextureResource(description.TextureNames[i], description.TextureFileNames[i]);
+   }
+
+   // loading (parsing .obj files) is the slow part, so do that in parallel and then add the models in order
+   std::vector<std::unique_ptr<Model>> models(description.Models.size());
+   jobSystem.ParallelFor(0, static_cast<uint32_t>(models.size()), 1, [&description, &models] (const uint32_t begin, const uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+         switch (description.Models[i].Type) {
+            case ModelType::Mesh:
+               models[i] = std::make_unique<Model>(description.Models[i].FileName.c_str());
+               break;
+            case ModelType::Sphere:
+               models[i] = std::make_unique<Sphere>();
+               break;
+            case ModelType::ProceduralBox:
+               models[i] = std::make_unique<Box>(true);
+               break;
+            default:
+               throw std::runtime_error("Scene file contains a model of unknown type");
+         }
+      }
+   });
+   for (auto& model : models) {
+      scene.AddModel(std::move(model));
+   }
+
+   // (materials in a file that were saved from a scene are already unique, but hand written ones might not be)
+   std::vector<uint32_t> materialIndices;
+   materialIndices.reserve(description.Materials.size());
+   for (const auto& material : description.Materials) {
+      materialIndices.push_back(scene.AddMaterial(material));
+   }
+
+   scene.ReserveInstances(description.Instances.size());
+   for (const auto& instance : description.Instances) {
+      glm::mat3x4 transform;
+      std::memcpy(&transform, instance.Transform, sizeof(transform));
+      scene.AddInstance(Instance {instance.ModelIndex, transform, materialIndices[instance.MaterialIndex]});
+   }
+}
+
+
+// Text form
+
+std::string TextureTypeToString(const int type) {
+   for (const auto& [textureType, name] : TextureTypeNames) {
+      if (type == textureType) {
+         return name;
+      }
+   }
+   return std::to_string(type);
+}
+
+
+int TextureTypeFromString(const std::string& token, const std::unordered_map<std::string, uint32_t>& textureIndices) {
+   for (const auto& [type, name] : TextureTypeNames) {
+      if (token == name) {
+         return type;
+      }
+   }
+   if (token.compare(0, 6, "image:") == 0) {
+      const auto texture = textureIndices.find(token.substr(6));
+      if (texture == textureIndices.end()) {
+         throw std::runtime_error("unknown texture '" + token.substr(6) + "'");
+      }
+      return static_cast<int>(texture->second);
+   }
+   size_t length = 0;
+   const int type = std::stoi(token, &length);
+   if (length != token.size()) {
+      throw std::runtime_error("unknown texture type '" + token + "'");
+   }
+   return type;
+}
+
+
+std::string SaveText(const SceneDescription& description) {
+   std::ostringstream text;
+   text << std::setprecision(std::numeric_limits<float>::max_digits10);
+   const auto vec3 = [] (const glm::vec3& v) {
+      std::ostringstream stream;
+      stream << std::setprecision(std::numeric_limits<float>::max_digits10) << v.x << ' ' << v.y << ' ' << v.z;
+      return stream.str();
+   };
+
+   text << "# Scene file.  See SceneFile.cpp for the syntax\n\n";
+   text << "horizon " << vec3(description.HorizonColor) << '\n';
+   text << "zenith " << vec3(description.ZenithColor) << '\n';
+   if (!description.EnvironmentMapFileName.empty()) {
+      text << "environment " << description.EnvironmentMapFileName << '\n';
+   }
+   text << "accumulate " << (description.AccumulateFrames ? 1 : 0) << '\n';
+   text << "bounces " << description.MinRayBounces << ' ' << description.MaxRayBounces << "\n\n";
+   text << "eye " << vec3(description.Camera.Eye) << '\n';
+   text << "direction " << vec3(description.Camera.Direction) << '\n';
+   text << "up " << vec3(description.Camera.Up) << '\n';
+   text << "fov " << glm::degrees(description.Camera.FoVRadians) << "\n\n";
+
+   for (size_t i = 0; i < description.TextureNames.size(); ++i) {
+      text << "texture " << description.TextureNames[i] << ' ' << description.TextureFileNames[i] << '\n';
+   }
+
+   // models are named after their file (or type), with the index appended if that is not unique
+   std::vector<std::string> modelNames;
+   std::unordered_map<std::string, uint32_t> modelNameCounts;
+   for (const auto& model : description.Models) {
+      modelNames.emplace_back((model.Type == ModelType::Sphere) ? "sphere" : (model.Type == ModelType::ProceduralBox) ? "procedural-box" : std::filesystem::path(model.FileName).stem().string());
+      ++modelNameCounts[modelNames.back()];
+   }
+   for (size_t i = 0; i < description.Models.size(); ++i) {
+      const ModelDescription& model = description.Models[i];
+      if (modelNameCounts[modelNames[i]] > 1) {
+         modelNames[i] += std::to_string(i);
+      }
+      text << "model " << modelNames[i] << ' ' << ((model.Type == ModelType::Sphere) ? "sphere" : (model.Type == ModelType::ProceduralBox) ? "procedural-box" : "mesh " + model.FileName) << '\n';
+   }
+   text << '\n';
+
+   std::vector<std::string> materialNames;
+   for (const auto& material : description.Materials) {
+      if (material.type >= std::size(MaterialTypeNames)) {
+         throw std::runtime_error("Cannot save scene: material has unknown type " + std::to_string(material.type));
+      }
+      materialNames.emplace_back(MaterialTypeNames[material.type] + std::to_string(materialNames.size()));
+      text << "material " << materialNames.back() << ' ' << MaterialTypeNames[material.type] << ' ' << material.materialParameter1 << ' ' << material.materialParameter2 << ' ' << material.materialParameter3;
+      text << " diffuse " << TextureTypeToString(material.diffuseTextureType);
+      for (const glm::vec4& param : {material.diffuseTextureParam1, material.diffuseTextureParam2}) {
+         text << ' ' << param.x << ' ' << param.y << ' ' << param.z << ' ' << param.w;
+      }
+      text << " specular " << TextureTypeToString(material.specularTextureType);
+      for (const glm::vec4& param : {material.specularTextureParam1, material.specularTextureParam2}) {
+         text << ' ' << param.x << ' ' << param.y << ' ' << param.z << ' ' << param.w;
+      }
+      text << '\n';
+   }
+   text << '\n';
+
+   for (const auto& instance : description.Instances) {
+      text << "instance " << modelNames[instance.ModelIndex] << ' ' << materialNames[instance.MaterialIndex];
+      for (const float value : instance.Transform) {
+         text << ' ' << value;
+      }
+      text << '\n';
+   }
+   return text.str();
+}
+
+
+SceneDescription LoadText(const std::filesystem::path& fileName) {
+   std::ifstream file(fileName);
+   if (!file.is_open()) {
+      throw std::runtime_error("failed to open file '" + fileName.string() + "'");
+   }
+
+   SceneDescription description;
+   std::unordered_map<std::string, uint32_t> textureIndices;
+   std::unordered_map<std::string, uint32_t> modelIndices;
+   std::unordered_map<std::string, uint32_t> materialIndices;
+
+   std::string line;
+   uint32_t lineNumber = 0;
+   while (std::getline(file, line)) {
+      ++lineNumber;
+      std::istringstream tokens(line);
+      const auto error = [&fileName, lineNumber] (const std::string& message) {
+         return std::runtime_error(fileName.string() + "(" + std::to_string(lineNumber) + "): " + message);
+      };
+      const auto readFloat = [&tokens, &error] () {
+         float value;
+         if (!(tokens >> value)) {
+            throw error("expected a number");
+         }
+         return value;
+      };
+      const auto readVec3 = [&readFloat] () {
+         const float x = readFloat();
+         const float y = readFloat();
+         return glm::vec3 {x, y, readFloat()};
+      };
+      const auto readToken = [&tokens, &error] () {
+         std::string token;
+         if (!(tokens >> token)) {
+            throw error("unexpected end of line");
+         }
+         return token;
+      };
+      const auto readTexture = [&] (int& type, glm::vec4& param1, glm::vec4& param2) {
+         try {
+            type = TextureTypeFromString(readToken(), textureIndices);
+         } catch (const std::exception& e) {
+            throw error(e.what());
+         }
+         for (glm::vec4* param : {&param1, &param2}) {
+            for (int i = 0; i < 4; ++i) {
+               (*param)[i] = readFloat();
+            }
+         }
+      };
+      const auto lookup = [&error] (const std::unordered_map<std::string, uint32_t>& indices, const std::string& name, const char* what) {
+         const auto it = indices.find(name);
+         if (it == indices.end()) {
+            throw error(std::string("unknown ") + what + " '" + name + "'");
+         }
+         return it->second;
+      };
+      const auto define = [&error] (std::unordered_map<std::string, uint32_t>& indices, const std::string& name, const size_t index) {
+         if (!indices.try_emplace(name, static_cast<uint32_t>(index)).second) {
+            throw error("'" + name + "' is already defined");
+         }
+      };
+
+      std::string keyword;
+      if (!(tokens >> keyword) || (keyword[0] == '#')) {
+         continue;
+      }
+      if (keyword == "horizon") {
+         description.HorizonColor = readVec3();
+      } else if (keyword == "zenith") {
+         description.ZenithColor = readVec3();
+      } else if (keyword == "environment") {
+         description.EnvironmentMapFileName = readToken();
+      } else if (keyword == "accumulate") {
+         description.AccumulateFrames = readFloat() != 0.0f;
+      } else if (keyword == "bounces") {
+         const float minBounces = readFloat();
+         const float maxBounces = readFloat();
+         if ((minBounces < 0.0f) || (maxBounces < 0.0f)) {
+            throw error("bounces cannot be negative");
+         }
+         description.MinRayBounces = static_cast<uint32_t>(minBounces);
+         description.MaxRayBounces = static_cast<uint32_t>(maxBounces);
+      } else if (keyword == "eye") {
+         description.Camera.Eye = readVec3();
+      } else if (keyword == "direction") {
+         description.Camera.Direction = readVec3();
+      } else if (keyword == "up") {
+         description.Camera.Up = readVec3();
+      } else if (keyword == "fov") {
+         description.Camera.FoVRadians = glm::radians(readFloat());
+      } else if (keyword == "texture") {
+         const std::string name = readToken();
+         define(textureIndices, name, description.TextureNames.size());
+         description.TextureNames.emplace_back(name);
+         description.TextureFileNames.emplace_back(readToken());
+      } else if (keyword == "model") {
+         const std::string name = readToken();
+         define(modelIndices, name, description.Models.size());
+         const std::string type = readToken();
+         if (type == "mesh") {
+            description.Models.push_back({ModelType::Mesh, readToken()});
+         } else if (type == "sphere") {
+            description.Models.push_back({ModelType::Sphere});
+         } else if (type == "procedural-box") {
+            description.Models.push_back({ModelType::ProceduralBox});
+         } else {
+            throw error("unknown model type '" + type + "'");
+         }
+      } else if (keyword == "material") {
+         const std::string name = readToken();
+         define(materialIndices, name, description.Materials.size());
+         Material& material = description.Materials.emplace_back();
+         const std::string type = readToken();
+         const auto typeName = std::find(std::begin(MaterialTypeNames), std::end(MaterialTypeNames), type);
+         if (typeName == std::end(MaterialTypeNames)) {
+            throw error("unknown material type '" + type + "'");
+         }
+         material.type = static_cast<uint32_t>(typeName - std::begin(MaterialTypeNames));
+         material.materialParameter1 = readFloat();
+         material.materialParameter2 = readFloat();
+         material.materialParameter3 = readFloat();
+         material.materialParameter4 = 0;
+         material.materialParameter5 = 0;
+         if (readToken() != "diffuse") {
+            throw error("expected 'diffuse'");
+         }
+         readTexture(material.diffuseTextureType, material.diffuseTextureParam1, material.diffuseTextureParam2);
+         if (readToken() != "specular") {
+            throw error("expected 'specular'");
+         }
+         readTexture(material.specularTextureType, material.specularTextureParam1, material.specularTextureParam2);
+      } else if (keyword == "instance") {
+         BinaryInstance& instance = description.Instances.emplace_back();
+         instance.ModelIndex = lookup(modelIndices, readToken(), "model");
+         instance.MaterialIndex = lookup(materialIndices, readToken(), "material");
+         for (float& value : instance.Transform) {
+            value = readFloat();
+         }
+      } else {
+         throw error("unknown keyword '" + keyword + "'");
+      }
+
+      std::string extra;
+      if (tokens >> extra) {
+         throw error("unexpected '" + extra + "'");
+      }
+   }
+   return description;
+}
+
+
+// Binary form
+
+std::vector<char> SaveBinary(const SceneDescription& description) {
+   std::string strings;
+   const auto addString = [&strings] (const std::string& s) {
+      const uint32_t offset = static_cast<uint32_t>(strings.size());
+      strings.append(s.c_str(), s.size() + 1);
+      return offset;
+   };
+
+   const uint32_t environmentMapOffset = addString(description.EnvironmentMapFileName);
+   std::vector<BinaryTexture> textures;
+   for (size_t i = 0; i < description.TextureNames.size(); ++i) {
+      textures.push_back({addString(description.TextureNames[i]), addString(description.TextureFileNames[i])});
+   }
+   std::vector<BinaryModel> models;
+   for (const auto& model : description.Models) {
+      models.push_back({model.Type, addString(model.FileName)});
+   }
+
+   BinaryHeader header = {};
+   std::memcpy(header.Magic, BinaryMagic, sizeof(header.Magic));
+   header.Version = BinaryVersion;
+   header.TextureCount = static_cast<uint32_t>(textures.size());
+   header.ModelCount = static_cast<uint32_t>(models.size());
+   header.MaterialCount = static_cast<uint32_t>(description.Materials.size());
+   header.InstanceCount = static_cast<uint32_t>(description.Instances.size());
+   header.StringsSize = static_cast<uint32_t>(strings.size());
+   std::memcpy(header.HorizonColor, &description.HorizonColor, sizeof(header.HorizonColor));
+   std::memcpy(header.ZenithColor, &description.ZenithColor, sizeof(header.ZenithColor));
+   header.EnvironmentMapOffset = environmentMapOffset;
+   header.AccumulateFrames = description.AccumulateFrames ? 1 : 0;
+   header.MinRayBounces = description.MinRayBounces;
+   header.MaxRayBounces = description.MaxRayBounces;
+   std::memcpy(header.Eye, &description.Camera.Eye, sizeof(header.Eye));
+   std::memcpy(header.Direction, &description.Camera.Direction, sizeof(header.Direction));
+   std::memcpy(header.Up, &description.Camera.Up, sizeof(header.Up));
+   header.FoVRadians = description.Camera.FoVRadians;
+
+   std::vector<char> data;
+   const auto append = [&data] (const void* pData, const size_t size) {
+      data.insert(data.end(), static_cast<const char*>(pData), static_cast<const char*>(pData) + size);
+   };
+   append(&header, sizeof(header));
+   append(textures.data(), textures.size() * sizeof(BinaryTexture));
+   append(models.data(), models.size() * sizeof(BinaryModel));
+   append(description.Materials.data(), description.Materials.size() * sizeof(Material));
+   append(description.Instances.data(), description.Instances.size() * sizeof(BinaryInstance));
+   append(strings.data(), strings.size());
+   return data;
+}
+
+
+SceneDescription LoadBinary(const std::filesystem::path& fileName) {
+   const std::vector<char> data = Vulkan::ReadFile(fileName.string());
+   const auto error = [&fileName] (const std::string& message) {
+      return std::runtime_error("'" + fileName.string() + "' " + message);
+   };
+
+   BinaryHeader header;
+   if (data.size() < sizeof(header)) {
+      throw error("is not a binary scene file");
+   }
+   std::memcpy(&header, data.data(), sizeof(header));
+   if (std::memcmp(header.Magic, BinaryMagic, sizeof(BinaryMagic)) != 0) {
+      throw error("is not a binary scene file");
+   }
+   if (header.Version != BinaryVersion) {
+      throw error("is binary scene version " + std::to_string(header.Version) + ", expected version " + std::to_string(BinaryVersion));
+   }
+   const size_t expectedSize =
+      sizeof(header) +
+      header.TextureCount * sizeof(BinaryTexture) +
+      header.ModelCount * sizeof(BinaryModel) +
+      header.MaterialCount * sizeof(Material) +
+      static_cast<size_t>(header.InstanceCount) * sizeof(BinaryInstance) +
+      header.StringsSize
+   ;
+   if ((data.size() != expectedSize) || ((header.StringsSize > 0) && (data.back() != '\0'))) {
+      throw error("is truncated or corrupt");
+   }
+
+   SceneDescription description;
+   std::memcpy(&description.HorizonColor, header.HorizonColor, sizeof(header.HorizonColor));
+   std::memcpy(&description.ZenithColor, header.ZenithColor, sizeof(header.ZenithColor));
+   description.AccumulateFrames = header.AccumulateFrames != 0;
+   description.MinRayBounces = header.MinRayBounces;
+   description.MaxRayBounces = header.MaxRayBounces;
+   std::memcpy(&description.Camera.Eye, header.Eye, sizeof(header.Eye));
+   std::memcpy(&description.Camera.Direction, header.Direction, sizeof(header.Direction));
+   std::memcpy(&description.Camera.Up, header.Up, sizeof(header.Up));
+   description.Camera.FoVRadians = header.FoVRadians;
+
+   // the arrays are copied out (rather than pointed into), as they are not necessarily aligned within data
+   const char* pData = data.data() + sizeof(header);
+   const auto read = [&pData] (auto& array, const uint32_t count) {
+      array.resize(count);
+      std::memcpy(array.data(), pData, count * sizeof(array[0]));
+      pData += count * sizeof(array[0]);
+   };
+   std::vector<BinaryTexture> textures;
+   std::vector<BinaryModel> models;
+   read(textures, header.TextureCount);
+   read(models, header.ModelCount);
+   read(description.Materials, header.MaterialCount);
+   read(description.Instances, header.InstanceCount);
+
+   const char* pStrings = pData;
+   const auto getString = [pStrings, &header, &error] (const uint32_t offset) {
+      if (offset >= header.StringsSize) {
+         throw error("is truncated or corrupt");
+      }
+      return std::string(pStrings + offset);
+   };
+   description.EnvironmentMapFileName = getString(header.EnvironmentMapOffset);
+   for (const auto& texture : textures) {
+      description.TextureNames.emplace_back(getString(texture.NameOffset));
+      description.TextureFileNames.emplace_back(getString(texture.FileNameOffset));
+   }
+   for (const auto& model : models) {
+      description.Models.push_back({model.Type, getString(model.FileNameOffset)});
+   }
+   return description;
+}
+
+
+bool IsBinary(const std::filesystem::path& fileName) {
+   return fileName.extension() == ".scenebin";
+}
+
+}
+
+
+SceneCamera SceneFile::Load(const std::filesystem::path& fileName, Scene& scene, Vulkan::JobSystem& jobSystem) {
+   const SceneDescription description = IsBinary(fileName) ? LoadBinary(fileName) : LoadText(fileName);
+   Populate(description, scene, jobSystem);
+   return description.Camera;
+}
+
+
+void SceneFile::Save(const std::filesystem::path& fileName, const Scene& scene, const SceneCamera& camera) {
+   const SceneDescription description = Describe(scene, camera);
+   if (IsBinary(fileName)) {
+      const std::vector<char> data = SaveBinary(description);
+      Vulkan::WriteFileAtomic(fileName.string(), data.data(), data.size());
+   } else {
+      const std::string text = SaveText(description);
+      Vulkan::WriteFileAtomic(fileName.string(), text.data(), text.size());
+   }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "JobSystem.h"
+#include "Scene.h"
+
+#include <glm/glm.hpp>
+
+#include <filesystem>
+
+// Camera, as saved with a scene
+struct SceneCamera {
+   glm::vec3 Eye = {0.0f, 0.0f, 4.0f};
+   glm::vec3 Direction = {0.0f, 0.0f, -1.0f};
+   glm::vec3 Up = {0.0f, 1.0f, 0.0f};
+   float FoVRadians = glm::radians(45.0f);
+};
+
+
+// Scene description files: models, textures, materials, instances (with their transforms), sky colours and environment
+// map, frame accumulation and camera.
+//
+// There are two forms, chosen by file extension:
+//    .scene      text, for editing.  One item per line (see SceneFile.cpp for the syntax)
+//    .scenebin   binary, for loading quickly.  A header followed by flat arrays of models, textures, materials and
+//                instances, which are copied straight into the Scene.
+//
+// Models are either triangle meshes (.obj files), or one of the procedural models (Sphere, procedural Box).
+// Materials are shared between instances (each instance refers to one by name or index), and are saved exactly, so
+// that a scene round trips through either form unchanged.
+class SceneFile {
+public:
+   // Load fileName into scene, which must be empty.  Returns the camera.
+   // Models are loaded in parallel on jobSystem.  Textures are added to the scene (as per Scene::AddTextureResource())
+   // and are decoded by whoever uploads them.
+   static SceneCamera Load(const std::filesystem::path& fileName, Scene& scene, Vulkan::JobSystem& jobSystem);
+
+   // Save scene and camera to fileName (replacing it, if it exists).
+   // Throws if the scene contains a model that cannot be described (e.g. a Model subclass that is not a mesh, Sphere or Box)
+   static void Save(const std::filesystem::path& fileName, const Scene& scene, const SceneCamera& camera);
+};
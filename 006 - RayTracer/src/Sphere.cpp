@@ -23,7 +23,7 @@ void Sphere::SetDefaultShaderHitGroupIndex(const uint32_t shaderHitGroupIndex) {
 }
 
 
-SphereInstance::SphereInstance(const glm::vec3& centre, const float radius, const Material& material)
+SphereInstance::SphereInstance(const glm::vec3& centre, const float radius, const uint32_t materialIndex)
 : Instance {
    sm_ModelIndex,
    glm::mat3x4 {
@@ -31,7 +31,7 @@ SphereInstance::SphereInstance(const glm::vec3& centre, const float radius, cons
       {0.0f, radius, 0.0f, centre.y},
       {0.0f, 0.0f, radius, centre.z},
    },
-   material
+   materialIndex
 }
 {
    ASSERT(sm_ModelIndex != ~0, "ERROR: Sphere model index has not been set.  You must set the model index (via SetModelIndex()) before instantiating a Sphere");
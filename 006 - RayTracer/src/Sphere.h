@@ -23,7 +23,7 @@ private:
 
 class SphereInstance : public Instance {
 public:
-   SphereInstance(const glm::vec3& centre, const float radius, const Material& material);
+   SphereInstance(const glm::vec3& centre, const float radius, const uint32_t materialIndex);
 
 public:
    static void SetModelIndex(uint32_t modelIndex);
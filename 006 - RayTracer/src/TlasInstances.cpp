@@ -0,0 +1,57 @@
+#include "TlasInstances.h"
+
+#include "Core.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+
+
+uint32_t GetInstanceHitGroupIndex(const Scene& scene, const Instance& instance) {
+   const uint32_t geometryType = scene.GetModels().at(instance.GetModelIndex())->GetShaderHitGroupIndex();
+   return (geometryType * MATERIAL_NUMTYPES) + scene.GetMaterials().at(instance.GetMaterialIndex()).type;
+}
+
+
+std::vector<Vulkan::GeometryInstance> PackTlasInstances(const Scene& scene, const std::vector<uint64_t>& blasHandles) {
+   uint32_t i = 0;
+   std::vector<Vulkan::GeometryInstance> tlasInstances;
+
+   tlasInstances.reserve(scene.GetInstances().size());
+   for (const auto& instance : scene.GetInstances()) {
+      ASSERT(blasHandles.at(instance.GetModelIndex()), "ERROR: BLAS handle is null.  Have you forgotten to allocate and bind memory?");
+      tlasInstances.emplace_back(
+         instance.GetTransform(),
+         i++                                                                           /*instance index*/,
+         0xff                                                                          /*visibility mask*/,
+         GetInstanceHitGroupIndex(scene, instance)                                     /*hit group index*/,
+         static_cast<uint32_t>(vk::GeometryInstanceFlagBitsNV::eTriangleCullDisable)   /*instance flags*/,
+         blasHandles.at(instance.GetModelIndex())                                     /*acceleration structure handle*/
+      );
+   };
+   return tlasInstances;
+}
+
+
+std::vector<Vulkan::GeometryInstanceRange> GetInstanceRanges(std::vector<uint32_t> instanceIndices) {
+   std::sort(instanceIndices.begin(), instanceIndices.end());
+   std::vector<Vulkan::GeometryInstanceRange> ranges;
+   for (const uint32_t i : instanceIndices) {
+      if (!ranges.empty() && (i <= ranges.back().End)) {
+         ranges.back().End = std::max(ranges.back().End, i + 1);
+      } else {
+         ranges.push_back({i, i + 1});
+      }
+   }
+   return ranges;
+}
+
+
+void UpdateTlasInstanceTransforms(const Scene& scene, const std::vector<Vulkan::GeometryInstanceRange>& ranges, std::vector<Vulkan::GeometryInstance>& tlasInstances) {
+   const auto& instances = scene.GetInstances();
+   for (const auto& range : ranges) {
+      for (uint32_t i = range.Begin; i < range.End; ++i) {
+         tlasInstances[i].Transform = instances[i].GetTransform();
+      }
+   }
+}
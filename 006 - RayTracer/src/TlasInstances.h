@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Scene.h"
+
+#include "GeometryInstance.h"
+
+#include <vector>
+
+// Hit group (relative to the first hit group in the shader binding table) of an instance of scene.
+// The shader binding table has a hit group record for each pair of model geometry type (Model::GetShaderHitGroupIndex())
+// and material type, so that each closest hit shader handles just one type of material.
+uint32_t GetInstanceHitGroupIndex(const Scene& scene, const Instance& instance);
+
+// Pack every instance in scene into the layout that the top level acceleration structure is built from.
+// blasHandles are the acceleration structure handles of the scene's models (indexed by model index).
+// This is what a full TLAS rebuild has to do.
+std::vector<Vulkan::GeometryInstance> PackTlasInstances(const Scene& scene, const std::vector<uint64_t>& blasHandles);
+
+// Sort instance indices (such as Scene::InstanceChanges::MovedInstances) into ranges of consecutive instances.  The ranges
+// are in order, and neither overlap nor touch.
+std::vector<Vulkan::GeometryInstanceRange> GetInstanceRanges(std::vector<uint32_t> instanceIndices);
+
+// Update just the transforms of the instances in ranges of tlasInstances (previously packed from scene) from scene.
+// This is all that a TLAS refit has to do, when instances have only moved.
+void UpdateTlasInstanceTransforms(const Scene& scene, const std::vector<Vulkan::GeometryInstanceRange>& ranges, std::vector<Vulkan::GeometryInstance>& tlasInstances);
@@ -0,0 +1,163 @@
+// CPU only tests of how instance changes reach the TLAS instances: Scene records which instances have moved
+// (SetInstanceTransform(), GetInstanceChanges(), ClearInstanceChanges()), GetInstanceRanges() turns them into the ranges
+// that a refit uploads, and UpdateTlasInstanceTransforms() must then leave the TLAS instances exactly as
+// PackTlasInstances() would have packed them from scratch.
+
+#include "Sphere.h"
+#include "TlasInstances.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+int s_FailureCount = 0;
+
+#define CHECK(condition)                                                                   \
+   do {                                                                                    \
+      if (!(condition)) {                                                                  \
+         std::fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition);\
+         ++s_FailureCount;                                                                 \
+      }                                                                                    \
+   } while (false)
+
+
+constexpr uint32_t InstanceCount = 32;
+const std::vector<uint64_t> s_BlasHandles = {1};   // any non-null handle will do
+
+
+// A scene of InstanceCount spheres in a row, with no changes pending
+Scene CreateScene() {
+   Scene scene;
+   SphereInstance::SetModelIndex(scene.AddModel(std::make_unique<Sphere>()));
+   const uint32_t grey = scene.AddMaterial(Lambertian(FlatColor({0.5f, 0.5f, 0.5f})));
+   for (uint32_t i = 0; i < InstanceCount; ++i) {
+      scene.AddInstance(SphereInstance({static_cast<float>(i), 0.0f, 0.0f}, 0.4f, grey));
+   }
+   scene.ClearInstanceChanges();
+   return scene;
+}
+
+
+void MoveInstance(Scene& scene, const uint32_t instanceIndex, const float height) {
+   glm::mat3x4 transform = scene.GetInstances()[instanceIndex].GetTransform();
+   transform[1][3] = height;
+   scene.SetInstanceTransform(instanceIndex, transform);
+}
+
+
+bool IsEqual(const std::vector<Vulkan::GeometryInstanceRange>& ranges, const std::vector<Vulkan::GeometryInstanceRange>& expected) {
+   if (ranges.size() != expected.size()) {
+      return false;
+   }
+   for (size_t i = 0; i < ranges.size(); ++i) {
+      if ((ranges[i].Begin != expected[i].Begin) || (ranges[i].End != expected[i].End)) {
+         return false;
+      }
+   }
+   return true;
+}
+
+
+// Each moved instance is recorded once, however often it moves, until the changes are cleared
+void TestMovedInstances() {
+   Scene scene = CreateScene();
+   CHECK(!scene.GetInstanceChanges().Any());
+
+   MoveInstance(scene, 20, 1.0f);
+   MoveInstance(scene, 3, 1.0f);
+   MoveInstance(scene, 20, 2.0f);
+   MoveInstance(scene, 31, 1.0f);
+   const Scene::InstanceChanges& changes = scene.GetInstanceChanges();
+   CHECK(changes.HasTransformChanges());
+   CHECK(changes.Any());
+   CHECK(!changes.IsListChanged);
+   CHECK((changes.MovedInstances == std::vector<uint32_t> {20, 3, 31}));
+
+   scene.ClearInstanceChanges();
+   CHECK(!scene.GetInstanceChanges().Any());
+   CHECK(scene.GetInstanceChanges().MovedInstances.empty());
+
+   // an instance that moved before the clear is recorded again when it next moves
+   MoveInstance(scene, 20, 3.0f);
+   CHECK((scene.GetInstanceChanges().MovedInstances == std::vector<uint32_t> {20}));
+}
+
+
+// Adding and removing instances is a list change, not a transform change
+void TestListChanges() {
+   Scene scene = CreateScene();
+   scene.AddInstance(SphereInstance({0.0f, 1.0f, 0.0f}, 0.4f, 0));
+   CHECK(scene.GetInstanceChanges().IsListChanged);
+   CHECK(!scene.GetInstanceChanges().HasTransformChanges());
+   scene.ClearInstanceChanges();
+   CHECK(!scene.GetInstanceChanges().Any());
+
+   scene.RemoveInstance(0);
+   CHECK(scene.GetInstanceChanges().IsListChanged);
+   scene.ClearInstanceChanges();
+   CHECK(!scene.GetInstanceChanges().Any());
+}
+
+
+// Indices are sorted, and consecutive (or repeated) ones merged, so ranges neither overlap nor touch
+void TestInstanceRanges() {
+   CHECK(GetInstanceRanges({}).empty());
+   CHECK(IsEqual(GetInstanceRanges({5}), {{5, 6}}));
+   CHECK(IsEqual(GetInstanceRanges({9, 1, 2, 7, 3, 0, 10, 7}), {{0, 4}, {7, 8}, {9, 11}}));
+   CHECK(IsEqual(GetInstanceRanges({4, 2, 0}), {{0, 1}, {2, 3}, {4, 5}}));
+}
+
+
+// A refit of just the moved ranges leaves the TLAS instances exactly as a rebuild would, whether the moved instances are
+// together or scattered
+void TestRefitMatchesRebuild() {
+   Scene scene = CreateScene();
+   std::vector<Vulkan::GeometryInstance> tlasInstances = PackTlasInstances(scene, s_BlasHandles);
+
+   const std::vector<std::vector<uint32_t>> moves = {
+      {0, 1, 2, 3},                 // together, at the start
+      {31, 0},                      // at both ends
+      {5, 10, 15, 20, 25, 30},      // scattered
+      {}
+   };
+   for (uint32_t frame = 0; frame < moves.size(); ++frame) {
+      for (const uint32_t instanceIndex : moves[frame]) {
+         MoveInstance(scene, instanceIndex, static_cast<float>(frame + 1));
+      }
+      const std::vector<Vulkan::GeometryInstanceRange> ranges = GetInstanceRanges(scene.GetInstanceChanges().MovedInstances);
+      uint32_t rangeInstanceCount = 0;
+      for (const auto& range : ranges) {
+         rangeInstanceCount += range.End - range.Begin;
+      }
+      CHECK(rangeInstanceCount == moves[frame].size());   // nothing in between the moved instances is uploaded
+
+      UpdateTlasInstanceTransforms(scene, ranges, tlasInstances);
+      scene.ClearInstanceChanges();
+
+      const std::vector<Vulkan::GeometryInstance> packed = PackTlasInstances(scene, s_BlasHandles);
+      CHECK(packed.size() == tlasInstances.size());
+      CHECK(std::memcmp(packed.data(), tlasInstances.data(), packed.size() * sizeof(Vulkan::GeometryInstance)) == 0);
+   }
+}
+
+}
+
+
+int main() {
+   // The hit group index does not matter here, but must be set
+   Sphere::SetDefaultShaderHitGroupIndex(0);
+
+   TestMovedInstances();
+   TestListChanges();
+   TestInstanceRanges();
+   TestRefitMatchesRebuild();
+   if (s_FailureCount > 0) {
+      std::fprintf(stderr, "%d check(s) failed\n", s_FailureCount);
+      return EXIT_FAILURE;
+   }
+   std::printf("All checks passed\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#include "TlasUpdateBenchmark.h"
+
+#include "Benchmark.h"
+#include "Log.h"
+#include "Sphere.h"
+#include "TlasInstances.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr uint32_t InstanceCount = 100'000;
+constexpr uint32_t FrameCount = 64;        // per timing
+
+
+template<typename Fn>
+double BestMillisecondsPerFrame(Fn&& fn) {
+   return Benchmark::BestMilliseconds([&fn] {
+      for (uint32_t frame = 0; frame < FrameCount; ++frame) {
+         fn(frame);
+      }
+   }) / FrameCount;
+}
+
+
+// Move count instances: [0, count) if stride is 1, otherwise every stride'th instance
+void MoveInstances(Scene& scene, const std::vector<glm::mat3x4>& baseTransforms, const uint32_t count, const uint32_t stride, const uint32_t frame) {
+   for (uint32_t i = 0; i < count * stride; i += stride) {
+      glm::mat3x4 transform = baseTransforms[i];
+      transform[1][3] += std::sin(0.1f * (frame + i));
+      scene.SetInstanceTransform(i, transform);
+   }
+}
+
+}
+
+
+void RunTlasUpdateBenchmarks() {
+   // The hit group index does not matter here, but must be set
+   Sphere::SetDefaultShaderHitGroupIndex(0);
+   Scene scene;
+   SphereInstance::SetModelIndex(scene.AddModel(std::make_unique<Sphere>()));
+   const uint32_t grey = scene.AddMaterial(Lambertian(FlatColor({0.5f, 0.5f, 0.5f})));
+   scene.ReserveInstances(InstanceCount);
+   const uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(InstanceCount)));
+   for (uint32_t i = 0; i < InstanceCount; ++i) {
+      scene.AddInstance(SphereInstance({static_cast<float>(i % gridSize), 0.0f, static_cast<float>(i / gridSize)}, 0.4f, grey));
+   }
+   std::vector<glm::mat3x4> baseTransforms;
+   baseTransforms.reserve(InstanceCount);
+   for (const auto& instance : scene.GetInstances()) {
+      baseTransforms.push_back(instance.GetTransform());
+   }
+
+   const std::vector<uint64_t> blasHandles = {1};   // any non-null handle will do
+   std::vector<Vulkan::GeometryInstance> tlasInstances = PackTlasInstances(scene, blasHandles);
+   scene.ClearInstanceChanges();
+
+   for (const bool isScattered : {false, true}) {
+      for (const uint32_t movingCount : {InstanceCount / 1000, InstanceCount / 100, InstanceCount / 10, InstanceCount}) {
+         const uint32_t stride = isScattered ? InstanceCount / movingCount : 1;
+         const double rebuildMilliseconds = BestMillisecondsPerFrame([&] (const uint32_t frame) {
+            MoveInstances(scene, baseTransforms, movingCount, stride, frame);
+            tlasInstances = PackTlasInstances(scene, blasHandles);
+            scene.ClearInstanceChanges();
+         });
+         size_t rangeCount = 0;
+         const double refitMilliseconds = BestMillisecondsPerFrame([&] (const uint32_t frame) {
+            MoveInstances(scene, baseTransforms, movingCount, stride, frame);
+            const std::vector<Vulkan::GeometryInstanceRange> ranges = GetInstanceRanges(scene.GetInstanceChanges().MovedInstances);
+            UpdateTlasInstanceTransforms(scene, ranges, tlasInstances);
+            rangeCount = ranges.size();
+            scene.ClearInstanceChanges();
+         });
+
+         // the refit must have left the instances exactly as a rebuild would
+         const std::vector<Vulkan::GeometryInstance> packed = PackTlasInstances(scene, blasHandles);
+         if (std::memcmp(packed.data(), tlasInstances.data(), packed.size() * sizeof(Vulkan::GeometryInstance)) != 0) {
+            LOG_ERROR("TLAS update: refit instances differ from rebuilt instances");
+         }
+
+         LOG_INFO("TLAS update: {0} of {1} instances moving per frame ({2}).  Rebuild {3:.3f}ms (uploads {4} KB), refit {5:.3f}ms (uploads {6} KB in {7} region(s)), {8:.1f}x faster", movingCount, InstanceCount, isScattered ? "scattered" : "together", rebuildMilliseconds, InstanceCount * sizeof(Vulkan::GeometryInstance) / 1024, refitMilliseconds, movingCount * sizeof(Vulkan::GeometryInstance) / 1024, rangeCount, rebuildMilliseconds / refitMilliseconds);
+      }
+   }
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Benchmark of the CPU side of moving instances: packing every instance for a TLAS rebuild (PackTlasInstances()) versus
+// updating only the moved instances' transforms for a refit (UpdateTlasInstanceTransforms()).
+// Uses a generated scene of many spheres, with various fractions of them moving each frame, either all together at the
+// start of the instance list, or scattered evenly through it.  Reports the time per frame, and how much instance data
+// (and in how many copy regions) each approach has to upload.  Results are logged.
+void RunTlasUpdateBenchmarks();
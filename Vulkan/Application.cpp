@@ -1,12 +1,20 @@
 #include "Application.h"
+#include "JobSystemBenchmark.h"
 #include "Log.h"
+#include "MeshCache.h"
 #include "Utility.h"
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <glm/gtx/rotate_vector.hpp>
 
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
 #include <set>
+#include <string_view>
 
 namespace Vulkan {
 
@@ -17,7 +25,10 @@ Application::Application(const ApplicationSettings& settings, const bool enableV
 
 
 Application::~Application() {
+   m_DeletionQueue.Flush();
    DestroyPipelineCache();
+   DestroyProfiler();
+   DestroyFrameCommandBuffers();
    DestroySyncObjects();
    DestroyCommandBuffers();
    DestroyCommandPool();
@@ -26,25 +37,181 @@ Application::~Application() {
    DestroyDepthStencil();
    DestroyImageViews();
    DestroySwapChain(m_SwapChain);
+   DestroyUploadManager();
+   DestroyMemoryAllocator();
    DestroyDevice();
    DestroySurface();
    DestroyInstance();
    DestroyWindow();
+   DestroyJobSystem();
 }
 
 
 void Application::Run() {
-   glfwSetTime(m_LastTime);
-   while (!glfwWindowShouldClose(m_Window)) {
-      glfwPollEvents();
-      //
-      // TODO: do nothing if window is minimized
-      double currentTime = glfwGetTime();
-      Update(currentTime - m_LastTime);
-      RenderFrame();
-      m_LastTime = currentTime;
+   if (m_Settings.IsJobSystemBenchmark) {
+      RunJobSystemBenchmarks();
+      return;
+   }
+   if (m_Settings.IsHeadless) {
+      RunHeadless();
+   } else {
+      glfwSetTime(m_LastTime);
+      while (!glfwWindowShouldClose(m_Window)) {
+         glfwPollEvents();
+         //
+         // TODO: do nothing if window is minimized
+         double currentTime = glfwGetTime();
+         {
+            Profiler::CpuScope scope(m_Profiler.get(), "Update");
+            Update(currentTime - m_LastTime);
+         }
+         {
+            Profiler::CpuScope scope(m_Profiler.get(), "RenderFrame");
+            RenderFrame();
+         }
+         m_LastTime = currentTime;
+      }
+      m_Device.waitIdle();
+   }
+   // before derived class destructors run, as retired resources may belong to them
+   m_DeletionQueue.Flush();
+   ReportProfile();
+}
+
+
+void Application::ParseCommandLine(const int argc, const char* argv[]) {
+   if ((argc > 0) && m_Settings.PipelineCacheFile.empty()) {
+      m_Settings.PipelineCacheFile = std::filesystem::path(argv[0]).replace_extension(".pipelinecache").string();
+   }
+   if ((argc > 0) && m_Settings.MeshCacheDirectory.empty()) {
+      m_Settings.MeshCacheDirectory = std::filesystem::path(argv[0]).replace_extension(".meshcache").string();
+   }
+   for (int i = 1; i < argc; ++i) {
+      std::string_view arg = argv[i];
+      std::string_view value;
+      if (size_t pos = arg.find('='); pos != std::string_view::npos) {
+         value = arg.substr(pos + 1);
+         arg = arg.substr(0, pos);
+      }
+      if (arg == "--headless") {
+         m_Settings.IsHeadless = true;
+      } else if (arg == "--frames") {
+         m_Settings.HeadlessFrameCount = static_cast<uint32_t>(std::stoul(std::string(value)));
+      } else if (arg == "--seconds") {
+         m_Settings.HeadlessTimeBudget = std::stod(std::string(value));
+         if (m_Settings.HeadlessTimeBudget > 0.0) {
+            m_Settings.HeadlessFrameCount = 0;
+         }
+      } else if (arg == "--timing") {
+         m_Settings.FrameTimingFile = value;
+      } else if (arg == "--width") {
+         m_Settings.WindowWidth = static_cast<uint32_t>(std::stoul(std::string(value)));
+      } else if (arg == "--height") {
+         m_Settings.WindowHeight = static_cast<uint32_t>(std::stoul(std::string(value)));
+      } else if (arg == "--trace") {
+         m_Settings.TraceFile = value;
+      } else if (arg == "--pipeline-cache") {
+         m_Settings.PipelineCacheFile = value;
+      } else if (arg == "--mesh-cache") {
+         m_Settings.MeshCacheDirectory = value;
+      } else if (arg == "--threads") {
+         m_Settings.ThreadCount = static_cast<uint32_t>(std::stoul(std::string(value)));
+      } else if (arg == "--benchmark-jobs") {
+         m_Settings.IsJobSystemBenchmark = true;
+      } else if (arg == "--no-blas-compaction") {
+         m_Settings.CompactAccelerationStructures = false;
+      } else if (!ParseArgument(arg, value)) {
+         CORE_LOG_WARN("Ignoring unrecognised command line argument '{0}'", argv[i]);
+      }
+   }
+   MeshCache::SetDirectory(m_Settings.MeshCacheDirectory);
+}
+
+
+bool Application::ParseArgument(std::string_view arg, std::string_view value) {
+   return false;
+}
+
+
+void Application::RunHeadless() {
+   std::ofstream file;
+   if (!m_Settings.FrameTimingFile.empty()) {
+      file.open(m_Settings.FrameTimingFile);
+      if (!file.is_open()) {
+         throw std::runtime_error("failed to open frame timing file '" + m_Settings.FrameTimingFile + "'");
+      }
+   }
+   std::ostream& out = file.is_open() ? file : std::cout;
+   out << "frame,milliseconds\n";
+
+   using Clock = std::chrono::steady_clock;
+   const Clock::time_point startTime = Clock::now();
+   Clock::time_point frameStartTime = startTime;
+
+   uint32_t frameCount = 0;
+   double totalMilliseconds = 0.0;
+   double minMilliseconds = std::numeric_limits<double>::max();
+   double maxMilliseconds = 0.0;
+
+   // With MaxFramesInFlight frames queued, BeginFrame() waits for the GPU to finish an earlier frame, so in the steady state
+   // the time between successive frames is the time the GPU takes to render one.
+   for (;;) {
+      const double elapsedSeconds = std::chrono::duration<double>(frameStartTime - startTime).count();
+      if ((m_Settings.HeadlessFrameCount > 0) && (frameCount >= m_Settings.HeadlessFrameCount)) {
+         break;
+      }
+      if ((m_Settings.HeadlessTimeBudget > 0.0) && (elapsedSeconds >= m_Settings.HeadlessTimeBudget)) {
+         break;
+      }
+
+      {
+         Profiler::CpuScope scope(m_Profiler.get(), "Update");
+         Update(elapsedSeconds - m_LastTime);
+      }
+      {
+         Profiler::CpuScope scope(m_Profiler.get(), "RenderFrame");
+         RenderFrame();
+      }
+      m_LastTime = elapsedSeconds;
+
+      const Clock::time_point frameEndTime = Clock::now();
+      const double milliseconds = std::chrono::duration<double, std::milli>(frameEndTime - frameStartTime).count();
+      out << frameCount << ',' << milliseconds << '\n';
+
+      totalMilliseconds += milliseconds;
+      minMilliseconds = std::min(minMilliseconds, milliseconds);
+      maxMilliseconds = std::max(maxMilliseconds, milliseconds);
+      ++frameCount;
+      frameStartTime = frameEndTime;
    }
    m_Device.waitIdle();
+   out.flush();
+
+   if (frameCount > 0) {
+      const double avgMilliseconds = totalMilliseconds / frameCount;
+      CORE_LOG_INFO("Headless: {0} frames at {1}x{2}, frame time min {3:.3f}ms, avg {4:.3f}ms, max {5:.3f}ms ({6:.1f} fps)", frameCount, m_Extent.width, m_Extent.height, minMilliseconds, avgMilliseconds, maxMilliseconds, 1000.0 / avgMilliseconds);
+   }
+}
+
+
+void Application::ReportProfile() {
+   if (m_Profiler) {
+      m_Profiler->CollectAll();
+      m_Profiler->LogStats();
+
+      ProfileStats pipelineStats = m_Profiler->GetStats("CreatePipeline");
+      if (pipelineStats.Count > 0) {
+         CORE_LOG_INFO("Pipeline creation took {0:.3f}ms in total, with a {1} pipeline cache", pipelineStats.Avg * pipelineStats.Count, m_IsPipelineCacheWarm ? "warm" : "cold");
+      }
+      if (!m_Settings.TraceFile.empty()) {
+         m_Profiler->WriteChromeTrace(m_Settings.TraceFile);
+      }
+   }
+}
+
+
+bool Application::IsKeyPressed(const int key) const {
+   return m_Window && (glfwGetKey(m_Window, key) == GLFW_PRESS);
 }
 
 
@@ -69,18 +236,27 @@ void Application::OnMouseButton(const int button, const int action, const int mo
 
 
 void Application::Init() {
-   glfwSetErrorCallback(glfwErrorCallback);
-   if (!glfwInit()) {
-      throw std::runtime_error("glfwInit() failed");
-   }
-   if (!glfwVulkanSupported()) {
-      throw std::runtime_error("glfwVulkanSupported() failed");
+   CreateJobSystem();
+   if (m_Settings.IsHeadless) {
+      m_PresentLayout = vk::ImageLayout::eTransferSrcOptimal;
+   } else {
+      glfwSetErrorCallback(glfwErrorCallback);
+      if (!glfwInit()) {
+         throw std::runtime_error("glfwInit() failed");
+      }
+      if (!glfwVulkanSupported()) {
+         throw std::runtime_error("glfwVulkanSupported() failed");
+      }
+      CreateWindow();
    }
-   CreateWindow();
    CreateInstance();
-   CreateSurface();
+   if (!m_Settings.IsHeadless) {
+      CreateSurface();
+   }
    SelectPhysicalDevice();
    CreateDevice();
+   CreateMemoryAllocator();
+   CreateUploadManager();
    CreateSwapChain();
    CreateImageViews();
    CreateDepthStencil();
@@ -89,6 +265,8 @@ void Application::Init() {
    CreateCommandPool();
    CreateCommandBuffers();
    CreateSyncObjects();
+   CreateFrameCommandBuffers();
+   CreateProfiler();
    CreatePipelineCache();
    // TODO: UI overlay
 }
@@ -142,8 +320,10 @@ void Application::CreateWindow() {
 
 
 void Application::DestroyWindow() {
-   glfwDestroyWindow(m_Window);
-   m_Window = nullptr;
+   if (m_Window) {
+      glfwDestroyWindow(m_Window);
+      m_Window = nullptr;
+   }
 }
 
 
@@ -152,7 +332,10 @@ void Application::CreateInstance() {
    PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = dl.getProcAddress<PFN_vkGetInstanceProcAddr>("vkGetInstanceProcAddr");
    VULKAN_HPP_DEFAULT_DISPATCHER.init(vkGetInstanceProcAddr);
 
-   std::vector<const char*> layers = {"VK_LAYER_LUNARG_monitor"};
+   std::vector<const char*> layers;
+   if (!m_Settings.IsHeadless) {
+      layers.push_back("VK_LAYER_LUNARG_monitor");
+   }
    if (m_EnableValidation) {
       layers.push_back("VK_LAYER_KHRONOS_validation");
    }
@@ -160,11 +343,13 @@ void Application::CreateInstance() {
 
    std::vector<const char*> extensions = GetRequiredInstanceExtensions();
 
-   uint32_t glfwExtensionCount = 0;
-   const char** glfwExtensions;
-   glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+   if (!m_Settings.IsHeadless) {
+      uint32_t glfwExtensionCount = 0;
+      const char** glfwExtensions;
+      glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-   extensions.insert(extensions.end(), glfwExtensions, glfwExtensions + glfwExtensionCount);
+      extensions.insert(extensions.end(), glfwExtensions, glfwExtensions + glfwExtensionCount);
+   }
 
    if (m_EnableValidation) {
       extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -305,8 +490,12 @@ bool Application::IsPhysicalDeviceSuitable(vk::PhysicalDevice physicalDevice) {
    if (indices.IsComplete()) {
       extensionsSupported = CheckDeviceExtensionSupport(physicalDevice, GetRequiredDeviceExtensions());
       if (extensionsSupported) {
-         SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(physicalDevice, m_Surface);
-         swapChainAdequate = !swapChainSupport.Formats.empty() && !swapChainSupport.PresentModes.empty();
+         if (m_Settings.IsHeadless) {
+            swapChainAdequate = true;
+         } else {
+            SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(physicalDevice, m_Surface);
+            swapChainAdequate = !swapChainSupport.Formats.empty() && !swapChainSupport.PresentModes.empty();
+         }
       }
    }
    return indices.IsComplete() && extensionsSupported && swapChainAdequate;
@@ -318,6 +507,9 @@ void Application::CreateDevice() {
 
    std::vector<vk::DeviceQueueCreateInfo> deviceQueueCIs;
    std::set<uint32_t> uniqueQueueFamilies = {m_QueueFamilyIndices.GraphicsFamily.value(), m_QueueFamilyIndices.PresentFamily.value()};
+   if (m_QueueFamilyIndices.TransferFamily.has_value()) {
+      uniqueQueueFamilies.insert(m_QueueFamilyIndices.TransferFamily.value());
+   }
 
    for (uint32_t queueFamily : uniqueQueueFamilies) {
       deviceQueueCIs.emplace_back(
@@ -330,8 +522,10 @@ void Application::CreateDevice() {
 
    std::vector<const char*> deviceExtensions = GetRequiredDeviceExtensions();
 
-   // We always need swap chain extension
-   deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+   // We always need swap chain extension (unless headless)
+   if (!m_Settings.IsHeadless) {
+      deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+   }
 
    m_EnabledPhysicalDeviceFeatures = GetRequiredPhysicalDeviceFeatures(m_PhysicalDeviceFeatures);
 
@@ -357,6 +551,7 @@ void Application::CreateDevice() {
 
    m_GraphicsQueue = m_Device.getQueue(m_QueueFamilyIndices.GraphicsFamily.value(), 0);
    m_PresentQueue = m_Device.getQueue(m_QueueFamilyIndices.PresentFamily.value(), 0);
+   m_TransferQueue = m_QueueFamilyIndices.TransferFamily.has_value() ? m_Device.getQueue(m_QueueFamilyIndices.TransferFamily.value(), 0) : m_GraphicsQueue;
 }
 
 
@@ -373,7 +568,45 @@ std::vector<const char*> Application::GetRequiredDeviceExtensions() {
 }
 
 
+void Application::CreateMemoryAllocator() {
+   m_Allocator = std::make_unique<MemoryAllocator>(m_Device, m_PhysicalDevice);
+}
+
+
+void Application::DestroyMemoryAllocator() {
+   if (m_Allocator) {
+      m_Allocator->LogStats();
+      m_Allocator.reset(nullptr);
+   }
+}
+
+
+void Application::CreateUploadManager() {
+   const uint32_t graphicsFamily = m_QueueFamilyIndices.GraphicsFamily.value();
+   const uint32_t transferFamily = m_QueueFamilyIndices.TransferFamily.value_or(graphicsFamily);
+   m_UploadManager = std::make_unique<UploadManager>(*m_Allocator, graphicsFamily, m_GraphicsQueue, transferFamily, m_TransferQueue);
+}
+
+
+void Application::DestroyUploadManager() {
+   m_UploadManager.reset(nullptr);
+}
+
+
 void Application::CreateSwapChain() {
+   if (m_Settings.IsHeadless) {
+      // No swap chain.  Render into offscreen images instead, one per frame in flight.
+      // eTransferDst is for apps that copy their output into the "swap chain" image, eTransferSrc is for reading back the result.
+      m_Format = vk::Format::eB8G8R8A8Unorm;
+      m_Extent = vk::Extent2D {m_Settings.WindowWidth, m_Settings.WindowHeight};
+      m_SwapChainImages.clear();
+      m_SwapChainImages.reserve(m_Settings.MaxFramesInFlight);
+      for (uint32_t i = 0; i < m_Settings.MaxFramesInFlight; ++i) {
+         m_SwapChainImages.emplace_back(*m_Allocator, m_Extent.width, m_Extent.height, 1, vk::SampleCountFlagBits::e1, m_Format, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal);
+      }
+      return;
+   }
+
    vk::SwapchainKHR oldSwapChain = m_SwapChain;
 
    SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_PhysicalDevice, m_Surface);
@@ -445,7 +678,13 @@ void Application::CreateSwapChain() {
    }
 
    m_SwapChain = m_Device.createSwapchainKHR(ci);
-   DestroySwapChain(oldSwapChain);
+   if (oldSwapChain) {
+      // Frames in flight may still be presenting from the old swap chain images, so retire rather than destroy.
+      // (the image views go first, since deleters run in order)
+      m_DeletionQueue.Push(std::make_unique<std::vector<Image>>(std::move(m_SwapChainImages)));
+      m_DeletionQueue.Push([device = m_Device, oldSwapChain] { device.destroy(oldSwapChain); });
+      m_SwapChainImages.clear();
+   }
    std::vector<vk::Image> swapChainImages = m_Device.getSwapchainImagesKHR(m_SwapChain);
    for (const auto& image : swapChainImages) {
       m_SwapChainImages.emplace_back(m_Device, image);
@@ -458,6 +697,9 @@ void Application::DestroySwapChain(vk::SwapchainKHR& swapChain) {
       m_SwapChainImages.clear();
       m_Device.destroy(swapChain);
       swapChain = nullptr;
+   } else if (m_Settings.IsHeadless) {
+      // offscreen images
+      m_SwapChainImages.clear();
    }
 }
 
@@ -500,7 +742,7 @@ vk::Extent2D Application::SelectSwapExtent(const vk::SurfaceCapabilitiesKHR& cap
 
 void Application::CreateDepthStencil() {
    // TODO anti-aliasing
-   m_DepthImage = std::make_unique<Image>(m_Device, m_PhysicalDevice, m_Extent.width, m_Extent.height, 1, vk::SampleCountFlagBits::e1, m_DepthFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   m_DepthImage = std::make_unique<Image>(*m_Allocator, m_Extent.width, m_Extent.height, 1, vk::SampleCountFlagBits::e1, m_DepthFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal);
    m_DepthImage->CreateImageView(m_DepthFormat, vk::ImageAspectFlagBits::eDepth, 1);
 }
 
@@ -521,7 +763,7 @@ void Application::CreateRenderPass() {
          vk::AttachmentLoadOp::eDontCare            /*stencilLoadOp*/,
          vk::AttachmentStoreOp::eDontCare           /*stencilStoreOp*/,
          vk::ImageLayout::eUndefined                /*initialLayout*/,
-         vk::ImageLayout::ePresentSrcKHR            /*finalLayout*/     // anti-aliasing = vk::ImageLayout::eColorAttachmentOptimal here
+         m_PresentLayout                            /*finalLayout*/     // anti-aliasing = vk::ImageLayout::eColorAttachmentOptimal here
       },
       {
          {}                                              /*flags*/,
@@ -721,14 +963,75 @@ void Application::DestroySyncObjects() {
 }
 
 
+void Application::CreateJobSystem() {
+   m_JobSystem = std::make_unique<JobSystem>(m_Settings.ThreadCount);
+   CORE_LOG_INFO("JobSystem running on {0} threads", m_JobSystem->GetThreadCount());
+}
+
+
+void Application::DestroyJobSystem() {
+   m_JobSystem.reset(nullptr);
+}
+
+
+void Application::CreateFrameCommandBuffers() {
+   m_FrameCommandBuffers = std::make_unique<FrameCommandBuffers>(m_Device, m_QueueFamilyIndices.GraphicsFamily.value(), m_Settings.MaxFramesInFlight, *m_JobSystem);
+}
+
+
+void Application::DestroyFrameCommandBuffers() {
+   m_FrameCommandBuffers.reset(nullptr);
+}
+
+
+void Application::CreateProfiler() {
+   const uint32_t timestampValidBits = m_PhysicalDevice.getQueueFamilyProperties()[m_QueueFamilyIndices.GraphicsFamily.value()].timestampValidBits;
+   m_Profiler = std::make_unique<Profiler>(m_Device, m_PhysicalDeviceProperties.limits.timestampPeriod, timestampValidBits);
+   m_Profiler->CreateQueryPools(static_cast<uint32_t>(m_CommandBuffers.size()));
+}
+
+
+void Application::DestroyProfiler() {
+   m_Profiler.reset(nullptr);
+}
+
+
 void Application::CreatePipelineCache() {
-   m_PipelineCache = m_Device.createPipelineCache({});
+   std::vector<char> data;
+   if (!m_Settings.PipelineCacheFile.empty() && std::filesystem::exists(m_Settings.PipelineCacheFile)) {
+      try {
+         data = ReadFile(m_Settings.PipelineCacheFile);
+      } catch (std::exception& err) {
+         CORE_LOG_WARN("Failed to read pipeline cache: {0}", err.what());
+      }
+      if (!data.empty() && !IsPipelineCacheCompatible(data, m_PhysicalDeviceProperties)) {
+         CORE_LOG_WARN("Pipeline cache '{0}' was created by a different device or driver, ignoring it", m_Settings.PipelineCacheFile);
+         data.clear();
+      }
+   }
+   m_IsPipelineCacheWarm = !data.empty();
+   m_PipelineCache = m_Device.createPipelineCache({
+      {}            /*flags*/,
+      data.size()   /*initialDataSize*/,
+      data.data()   /*pInitialData*/
+   });
+   CORE_LOG_INFO("Pipeline cache is {0} ({1} bytes loaded)", m_IsPipelineCacheWarm ? "warm" : "cold", data.size());
 }
 
 
 void Application::DestroyPipelineCache() {
    if (m_Device && m_PipelineCache) {
+      if (!m_Settings.PipelineCacheFile.empty()) {
+         // we are probably in a destructor here, so do not let exceptions escape
+         try {
+            std::vector<uint8_t> data = m_Device.getPipelineCacheData(m_PipelineCache);
+            WriteFileAtomic(m_Settings.PipelineCacheFile, data.data(), data.size());
+         } catch (std::exception& err) {
+            CORE_LOG_ERROR("Failed to save pipeline cache: {0}", err.what());
+         }
+      }
       m_Device.destroy(m_PipelineCache);
+      m_PipelineCache = nullptr;
    }
 }
 
@@ -737,21 +1040,21 @@ void Application::Update(double dt) {
    auto deltaTime = static_cast<float>(dt);
 
    // TODO: abstract this into a camera controller
-   if (glfwGetKey(m_Window, GLFW_KEY_W) == GLFW_PRESS) {
+   if (IsKeyPressed(GLFW_KEY_W)) {
       m_Eye += deltaTime * m_Direction;
-   } else if (glfwGetKey(m_Window, GLFW_KEY_S) == GLFW_PRESS) {
+   } else if (IsKeyPressed(GLFW_KEY_S)) {
       m_Eye -= deltaTime * m_Direction;
    }
 
-   if (glfwGetKey(m_Window, GLFW_KEY_A) == GLFW_PRESS) {
+   if (IsKeyPressed(GLFW_KEY_A)) {
       m_Eye -= deltaTime * glm::cross(m_Direction, m_Up);
-   } else if (glfwGetKey(m_Window, GLFW_KEY_D) == GLFW_PRESS) {
+   } else if (IsKeyPressed(GLFW_KEY_D)) {
       m_Eye += deltaTime * glm::cross(m_Direction, m_Up);
    }
 
-   if (glfwGetKey(m_Window, GLFW_KEY_R) == GLFW_PRESS) {
+   if (IsKeyPressed(GLFW_KEY_R)) {
       m_Eye += deltaTime * m_Up * glm::length(m_Direction);
-   } else if (glfwGetKey(m_Window, GLFW_KEY_F) == GLFW_PRESS) {
+   } else if (IsKeyPressed(GLFW_KEY_F)) {
       m_Eye -= deltaTime * m_Up * glm::length(m_Direction);
    }
 
@@ -777,30 +1080,50 @@ void Application::Update(double dt) {
 
 
 void Application::BeginFrame() {
+   Profiler::CpuScope scope(m_Profiler.get(), "BeginFrame");
    m_Device.waitForFences(m_InFlightFences[m_CurrentFrame], true, UINT64_MAX);
-   auto rv = m_Device.acquireNextImageKHR(m_SwapChain, UINT64_MAX, m_ImageAvailableSemaphores[m_CurrentFrame], nullptr);
 
-   if (rv.result == vk::Result::eErrorOutOfDateKHR) {
-      OnWindowResized();
-      return;
-   } else if ((rv.result != vk::Result::eSuccess) && (rv.result != vk::Result::eSuboptimalKHR)) {
-      throw std::runtime_error("failed to acquire swap chain image!");
+   // The fence we just waited on belongs to the frame that was submitted MaxFramesInFlight frames ago.
+   // That frame, and every frame before it, has now completed.
+   const uint64_t submittedFrameCount = m_DeletionQueue.GetSubmittedFrameCount();
+   if (submittedFrameCount >= m_Settings.MaxFramesInFlight) {
+      m_DeletionQueue.Collect(submittedFrameCount - m_Settings.MaxFramesInFlight + 1);
    }
 
-   // acquireNextImage returns as soon as it has decided which image is the next one.
-   // That doesn't necessarily mean the image is available for either the CPU or the GPU to start doing stuff to it,
-   // it's just that we now know which image is *going to be* the next one.
-   // The semaphore that was passed in gets signaled when the image really is available (so need to tell the GPU to wait on that sempahore
-   // before doing anything to the image).
-   //
-   // The CPU also needs to wait.. but on what?
-   // That's where our in flight fences come in.  If we know which frame it was that last used this image, then we wait on that frame's fence before
-   // queuing up more stuff for the image.
-   m_CurrentImage = rv.value;
+   if (m_Settings.IsHeadless) {
+      // Nothing to acquire.  There is one offscreen image per frame in flight, and we have just waited for the fence of
+      // the frame that last used this one.
+      m_CurrentImage = m_CurrentFrame;
+   } else {
+      auto rv = m_Device.acquireNextImageKHR(m_SwapChain, UINT64_MAX, m_ImageAvailableSemaphores[m_CurrentFrame], nullptr);
+
+      if (rv.result == vk::Result::eErrorOutOfDateKHR) {
+         OnWindowResized();
+         return;
+      } else if ((rv.result != vk::Result::eSuccess) && (rv.result != vk::Result::eSuboptimalKHR)) {
+         throw std::runtime_error("failed to acquire swap chain image!");
+      }
+
+      // acquireNextImage returns as soon as it has decided which image is the next one.
+      // That doesn't necessarily mean the image is available for either the CPU or the GPU to start doing stuff to it,
+      // it's just that we now know which image is *going to be* the next one.
+      // The semaphore that was passed in gets signaled when the image really is available (so need to tell the GPU to wait on that sempahore
+      // before doing anything to the image).
+      //
+      // The CPU also needs to wait.. but on what?
+      // That's where our in flight fences come in.  If we know which frame it was that last used this image, then we wait on that frame's fence before
+      // queuing up more stuff for the image.
+      m_CurrentImage = rv.value;
+   }
 
    if (m_ImagesInFlight[m_CurrentImage]) {
       m_Device.waitForFences(m_ImagesInFlight[m_CurrentImage], true, UINT64_MAX);
    }
+
+   // The previous submission of this image's command buffer has now completed, so its timestamps can be read without stalling
+   if (m_Profiler) {
+      m_Profiler->Collect(m_CurrentImage);
+   }
    // Mark the image as now being in use by this frame
    m_ImagesInFlight[m_CurrentImage] = m_InFlightFences[m_CurrentFrame];
 }
@@ -811,20 +1134,47 @@ void Application::RenderFrame() {
 
 
 void Application::EndFrame() {
+   Profiler::CpuScope scope(m_Profiler.get(), "EndFrame");
+   vk::CommandBuffer commandBuffer = m_CommandBuffers[m_CurrentImage];
+   if (m_FrameCommandBuffer) {
+      m_FrameCommandBuffer.end();
+      commandBuffer = m_FrameCommandBuffer;
+      m_FrameCommandBuffer = nullptr;
+   }
+
    vk::PipelineStageFlags waitStages[] = {{vk::PipelineStageFlagBits::eColorAttachmentOutput}};
    vk::SubmitInfo si = {
       1                                             /*waitSemaphoreCount*/,
       &m_ImageAvailableSemaphores[m_CurrentFrame]   /*pWaitSemaphores*/,
       waitStages                                    /*pWaitDstStageMask*/,
       1                                             /*commandBufferCount*/,
-      &m_CommandBuffers[m_CurrentImage]             /*pCommandBuffers*/,
+      &commandBuffer                                /*pCommandBuffers*/,
       1                                             /*signalSemaphoreCount*/,
       &m_RenderFinishedSemaphores[m_CurrentFrame]   /*pSignalSemaphores*/
    };
 
+   if (m_Settings.IsHeadless) {
+      // nothing to wait for, and nothing to present
+      si.waitSemaphoreCount = 0;
+      si.signalSemaphoreCount = 0;
+   }
+
    m_Device.resetFences(m_InFlightFences[m_CurrentFrame]);
    m_GraphicsQueue.submit(si, m_InFlightFences[m_CurrentFrame]);
+   m_DeletionQueue.OnSubmit();
+   if (m_Profiler) {
+      m_Profiler->OnSubmit(m_CurrentImage);
+   }
+
+   if (!m_Settings.IsHeadless) {
+      Present();
+   }
+
+   m_CurrentFrame = ++m_CurrentFrame % m_Settings.MaxFramesInFlight;
+}
+
 
+void Application::Present() {
    vk::PresentInfoKHR pi = {
       1                                            /*waitSemaphoreCount*/,
       &m_RenderFinishedSemaphores[m_CurrentFrame]  /*pWaitSemaphores*/,
@@ -845,28 +1195,39 @@ void Application::EndFrame() {
    } else if (result != VK_SUCCESS) {
       throw std::runtime_error("failed to present swap chain image!");
    }
-
-   m_CurrentFrame = ++m_CurrentFrame % m_Settings.MaxFramesInFlight;
 }
 
 
 void Application::OnWindowResized() {
-   m_Device.waitIdle();
-   DestroyImageViews();
-   CreateSwapChain();
+   // No waitIdle() here.  Frames that are still in flight keep using the old resources, which are handed to the
+   // deletion queue and freed once those frames have completed.  New resources are created alongside them.
+   CreateSwapChain();   // retires the old swap chain (and its image views)
    CreateImageViews();
+   m_ImagesInFlight.resize(m_SwapChainImages.size(), nullptr);
 
-   DestroyDepthStencil();
+   m_DeletionQueue.Push(std::move(m_DepthImage));
    CreateDepthStencil();
 
-   DestroyFrameBuffers();
+   m_DeletionQueue.Push([device = m_Device, frameBuffers = std::move(m_SwapChainFrameBuffers)] {
+      for (auto frameBuffer : frameBuffers) {
+         device.destroy(frameBuffer);
+      }
+   });
+   m_SwapChainFrameBuffers.clear();
    CreateFrameBuffers();
 
    // TODO: resize UI overlay?
 
-   // Command buffers need to be recreated as they may store references to the recreated frame buffers
-   DestroyCommandBuffers();
+   // Command buffers need to be recreated as they may store references to the recreated frame buffers.
+   // The old ones may still be pending execution, so they cannot be re-recorded or freed yet.
+   m_DeletionQueue.Push([device = m_Device, commandPool = m_CommandPool, commandBuffers = std::move(m_CommandBuffers)] {
+      device.freeCommandBuffers(commandPool, commandBuffers);
+   });
+   m_CommandBuffers.clear();
    CreateCommandBuffers();
+   if (m_Profiler) {
+      m_Profiler->CreateQueryPools(static_cast<uint32_t>(m_CommandBuffers.size()));
+   }
    m_WantResize = false;
 }
 
@@ -895,24 +1256,34 @@ void Application::DestroyShaderModule(vk::ShaderModule& module) {
 QueueFamilyIndices Application::FindQueueFamilies(vk::PhysicalDevice physicalDevice) {
    QueueFamilyIndices indices;
 
+   // For transfers, prefer a family that can do only transfers (typically backed by a DMA engine),
+   // otherwise any family without graphics.
+   bool isTransferOnly = false;
+
    std::vector<vk::QueueFamilyProperties> queueFamilies = physicalDevice.getQueueFamilyProperties();
-   int i = 0;
+   uint32_t i = 0;
    for (const auto& queueFamily : queueFamilies) {
-      if (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics) {
+      if ((queueFamily.queueFlags & vk::QueueFlagBits::eGraphics) && !indices.GraphicsFamily.has_value()) {
          indices.GraphicsFamily = i;
       }
 
-      if (physicalDevice.getSurfaceSupportKHR(i, m_Surface)) {
+      if (m_Surface && physicalDevice.getSurfaceSupportKHR(i, m_Surface) && !indices.PresentFamily.has_value()) {
          indices.PresentFamily = i;
       }
 
-      if (indices.IsComplete()) {
-         break;
+      if ((queueFamily.queueFlags & vk::QueueFlagBits::eTransfer) && !(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics) && !isTransferOnly) {
+         indices.TransferFamily = i;
+         isTransferOnly = !(queueFamily.queueFlags & vk::QueueFlagBits::eCompute);
       }
 
       ++i;
    }
 
+   // headless: there is no surface, and nothing is presented
+   if (!m_Surface) {
+      indices.PresentFamily = indices.GraphicsFamily;
+   }
+
    return indices;
 }
 
@@ -930,7 +1301,14 @@ vk::Format Application::FindSupportedFormat(const std::vector<vk::Format>& candi
 }
 
 
-void Application::SubmitSingleTimeCommands(const std::function<void(vk::CommandBuffer)>& action) {
+vk::CommandBuffer Application::BeginFrameCommandBuffer() {
+   // BeginFrame() has waited for the fence of the frame that last used m_CurrentFrame's command pools
+   m_FrameCommandBuffer = m_FrameCommandBuffers->BeginFrame(m_CurrentFrame);
+   return m_FrameCommandBuffer;
+}
+
+
+void Application::SubmitSingleTimeCommands(const std::function<void(vk::CommandBuffer)>& action, const bool wait) {
    std::vector<vk::CommandBuffer> commandBuffers = m_Device.allocateCommandBuffers({
       m_CommandPool                    /*commandPool*/,
       vk::CommandBufferLevel::ePrimary /*level*/,
@@ -944,8 +1322,20 @@ void Application::SubmitSingleTimeCommands(const std::function<void(vk::CommandB
    vk::SubmitInfo si;
    si.commandBufferCount = 1;
    si.pCommandBuffers = commandBuffers.data();
-   m_GraphicsQueue.submit(si, nullptr);
-   m_GraphicsQueue.waitIdle();
+   if (!wait) {
+      m_GraphicsQueue.submit(si, nullptr);
+      m_DeletionQueue.Push([device = m_Device, commandPool = m_CommandPool, commandBuffers] {
+         device.freeCommandBuffers(commandPool, commandBuffers);
+      });
+      return;
+   }
+
+   vk::Fence fence = m_Device.createFence({});
+   m_GraphicsQueue.submit(si, fence);
+   if (m_Device.waitForFences(fence, true, UINT64_MAX) != vk::Result::eSuccess) {
+      throw std::runtime_error("failed to wait for single time commands!");
+   }
+   m_Device.destroy(fence);
    m_Device.freeCommandBuffers(m_CommandPool, commandBuffers);
 }
 
@@ -962,7 +1352,7 @@ void Application::CopyBuffer(vk::Buffer src, vk::Buffer dst, const vk::DeviceSiz
 }
 
 
-void Application::TransitionImageLayout(vk::Image image, const vk::ImageLayout oldLayout, const vk::ImageLayout newLayout, const uint32_t mipLevels) {
+void Application::TransitionImageLayout(vk::Image image, const vk::ImageLayout oldLayout, const vk::ImageLayout newLayout, const uint32_t mipLevels, const bool wait) {
    SubmitSingleTimeCommands([image, oldLayout, newLayout, mipLevels] (vk::CommandBuffer cmd) {
       vk::ImageMemoryBarrier barrier = {
          {}                                  /*srcAccessMask*/,
@@ -1004,101 +1394,7 @@ void Application::TransitionImageLayout(vk::Image image, const vk::ImageLayout o
       }
 
       cmd.pipelineBarrier(sourceStage, destinationStage, {}, nullptr, nullptr, barrier);
-   });
-}
-
-
-void Application::CopyBufferToImage(vk::Buffer buffer, vk::Image image, const uint32_t width, const uint32_t height) {
-   SubmitSingleTimeCommands([buffer, image, width, height] (vk::CommandBuffer cmd) {
-      vk::BufferImageCopy region = {
-         0                                    /*bufferOffset*/,
-         0                                    /*bufferRowLength*/,
-         0                                    /*bufferImageHeight*/,
-         vk::ImageSubresourceLayers {
-            vk::ImageAspectFlagBits::eColor      /*aspectMask*/,
-            0                                    /*mipLevel*/,
-            0                                    /*baseArrayLayer*/,
-            1                                    /*layerCount*/
-         }                                    /*imageSubresource*/,
-         {0, 0, 0}                            /*imageOffset*/,
-         {width, height, 1}                   /*imageExtent*/
-      };
-      cmd.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, region);
-   });
-}
-
-
-void Application::GenerateMIPMaps(vk::Image image, const vk::Format format, const uint32_t width, const uint32_t height, uint32_t mipLevels) {
-   // Check if image format supports linear blitting
-   vk::FormatProperties formatProperties = m_PhysicalDevice.getFormatProperties(format);
-   if (!(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear)) {
-      throw std::runtime_error("texture image format does not support linear blitting!");
-   }
-
-   SubmitSingleTimeCommands([image, width, height, mipLevels] (vk::CommandBuffer cmd) {
-      vk::ImageMemoryBarrier barrier = {
-         {}                                   /*srcAccessMask*/,
-         {}                                   /*dstAccessMask*/,
-         vk::ImageLayout::eUndefined          /*oldLayout*/,
-         vk::ImageLayout::eUndefined          /*newLayout*/,
-         VK_QUEUE_FAMILY_IGNORED              /*srcQueueFamilyIndex*/,
-         VK_QUEUE_FAMILY_IGNORED              /*dstQueueFamilyIndex*/,
-         image                                /*image*/,
-         vk::ImageSubresourceRange {
-            {vk::ImageAspectFlagBits::eColor}    /*aspectMask*/,
-            0                                    /*baseMipLevel*/,
-            1                                    /*levelCount*/,
-            0                                    /*baseArrayLayer*/,
-            1                                    /*layerCount*/
-         }                                    /*subresourceRange*/
-      };
-
-      int32_t mipWidth = static_cast<int32_t>(width);
-      int32_t mipHeight = static_cast<int32_t>(height);
-
-      for (uint32_t i = 1; i < mipLevels; i++) {
-         barrier.subresourceRange.baseMipLevel = i - 1;
-         barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-         barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
-         barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-         barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
-         cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
-
-         vk::ImageBlit blit;
-         blit.srcOffsets[0] = {0, 0, 0};
-         blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
-         blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-         blit.srcSubresource.mipLevel = i - 1;
-         blit.srcSubresource.baseArrayLayer = 0;
-         blit.srcSubresource.layerCount = 1;
-         blit.dstOffsets[0] = {0, 0, 0};
-         blit.dstOffsets[1] = {mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1};
-         blit.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-         blit.dstSubresource.mipLevel = i;
-         blit.dstSubresource.baseArrayLayer = 0;
-         blit.dstSubresource.layerCount = 1;
-         cmd.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, blit, vk::Filter::eLinear);
-
-         barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
-         barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-         barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
-         barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-         cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, barrier);
-
-         if (mipWidth > 1) {
-            mipWidth /= 2;
-         }
-         if (mipHeight > 1) {
-            mipHeight /= 2;
-         }
-      }
-      barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-      barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-      barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-      barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-      barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-      cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, barrier);
-   });
+   }, wait);
 }
 
 
@@ -1109,9 +1405,13 @@ void Application::CreateBottomLevelAccelerationStructures(vk::ArrayProxy<const s
    // We create all of the BLAS, and then allocate one buffer for all of them (each one is offset into buffer)
    //
    for (const auto& geometries : geometryGroups) {
+      vk::BuildAccelerationStructureFlagsNV flags = vk::BuildAccelerationStructureFlagBitsNV::ePreferFastTrace;
+      if (m_Settings.CompactAccelerationStructures) {
+         flags |= vk::BuildAccelerationStructureFlagBitsNV::eAllowCompaction;
+      }
       vk::AccelerationStructureInfoNV accelerationStructureInfo = {
          vk::AccelerationStructureTypeNV::eBottomLevel                /*type*/,
-         vk::BuildAccelerationStructureFlagBitsNV::ePreferFastTrace   /*flags*/,
+         flags                                                        /*flags*/,
          0                                                            /*instanceCount*/,
          static_cast<uint32_t>(geometries.size())                     /*geometryCount*/,
          geometries.data()                                            /*pGeometries*/
@@ -1135,32 +1435,19 @@ void Application::CreateBottomLevelAccelerationStructures(vk::ArrayProxy<const s
       );
    }
 
-   vk::DeviceSize totalMemorySize = 0;
-   uint32_t memoryType = 0;
-   for (const auto& memoryRequirement : memoryRequirements) {
-      totalMemorySize += memoryRequirement.memoryRequirements.size;
-      memoryType = memoryRequirement.memoryRequirements.memoryTypeBits;
-   }
-
-   vk::DeviceMemory objectMemory = m_Device.allocateMemory({
-      totalMemorySize,
-      Buffer::FindMemoryType(m_PhysicalDevice, memoryType, vk::MemoryPropertyFlagBits::eDeviceLocal)
-   });
-
-   vk::DeviceSize memoryOffset = 0;
+   // All of the BLAS get sub-allocated from the same (device local) memory block(s)
    uint32_t i = 0;
    for (auto& blas : m_BLAS) {
-      blas.m_Memory = objectMemory;
+      blas.m_Allocation = m_Allocator->Allocate(memoryRequirements[i++].memoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal);
       vk::BindAccelerationStructureMemoryInfoNV accelerationStructureMemoryInfo = {
-         blas.m_AccelerationStructure /*accelerationStructure*/,
-         blas.m_Memory                /*memory*/,
-         memoryOffset                 /*memoryOffset*/,
-         0                            /*deviceIndexCount*/,
-         nullptr                      /*pDeviceIndices*/
+         blas.m_AccelerationStructure       /*accelerationStructure*/,
+         blas.m_Allocation.m_Memory         /*memory*/,
+         blas.m_Allocation.m_Offset         /*memoryOffset*/,
+         0                                  /*deviceIndexCount*/,
+         nullptr                            /*pDeviceIndices*/
       };
       m_Device.bindAccelerationStructureMemoryNV(accelerationStructureMemoryInfo);
       m_Device.getAccelerationStructureHandleNV<uint64_t>(blas.m_AccelerationStructure, blas.m_Handle);
-      memoryOffset += memoryRequirements[i++].memoryRequirements.size;
    }
 }
 
@@ -1173,11 +1460,7 @@ void Application::DestroyBottomLevelAccelerationStructures() {
          m_Device.destroyAccelerationStructureNV(blas.m_AccelerationStructure);
          blas.m_AccelerationStructure = nullptr;
          blas.m_Handle = 0;
-      }
-      if (m_BLAS.size() > 0) {
-         if (m_BLAS.front().m_Memory) {
-            m_Device.free(m_BLAS.front().m_Memory);
-         }
+         m_Allocator->Free(blas.m_Allocation);
       }
    }
 }
@@ -1186,7 +1469,8 @@ void Application::DestroyBottomLevelAccelerationStructures() {
 void Application::CreateTopLevelAccelerationStructure(vk::ArrayProxy<const Vulkan::GeometryInstance> geometryInstances) {
    m_TLAS.m_AccelerationStructureInfo = {
       vk::AccelerationStructureTypeNV::eTopLevel                   /*type*/,
-      vk::BuildAccelerationStructureFlagBitsNV::ePreferFastTrace   /*flags*/,
+      vk::BuildAccelerationStructureFlagBitsNV::ePreferFastTrace |
+      vk::BuildAccelerationStructureFlagBitsNV::eAllowUpdate       /*flags*/,
       geometryInstances.size()                                     /*instanceCount*/,
       0                                                            /*geometryCount*/,
       nullptr                                                      /*pGeometries*/
@@ -1202,20 +1486,38 @@ void Application::CreateTopLevelAccelerationStructure(vk::ArrayProxy<const Vulka
       m_TLAS.m_AccelerationStructure                             /*accelerationStructure*/
    });
 
-   m_TLAS.m_Memory = m_Device.allocateMemory({
-      memoryRequirementsTLAS.memoryRequirements.size /*allocationSize*/,
-      Buffer::FindMemoryType(m_PhysicalDevice, memoryRequirementsTLAS.memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal)
-   });
+   m_TLAS.m_Allocation = m_Allocator->Allocate(memoryRequirementsTLAS.memoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal);
 
    vk::BindAccelerationStructureMemoryInfoNV accelerationStructureMemoryInfo = {
       m_TLAS.m_AccelerationStructure /*accelerationStructure*/,
-      m_TLAS.m_Memory                /*memory*/,
-      0                              /*memoryOffset*/,
+      m_TLAS.m_Allocation.m_Memory   /*memory*/,
+      m_TLAS.m_Allocation.m_Offset   /*memoryOffset*/,
       0                              /*deviceIndexCount*/,
       nullptr                        /*pDeviceIndices*/
    };
    m_Device.bindAccelerationStructureMemoryNV(accelerationStructureMemoryInfo);
    m_Device.getAccelerationStructureHandleNV<uint64_t>(m_TLAS.m_AccelerationStructure, m_TLAS.m_Handle);
+
+   // The instance and scratch buffers are kept, so that the TLAS can be updated without allocating anything
+   const vk::DeviceSize instancesSize = std::max<vk::DeviceSize>(sizeof(Vulkan::GeometryInstance) * geometryInstances.size(), sizeof(Vulkan::GeometryInstance));
+   m_TLASInstanceBuffer = std::make_unique<Buffer>(*m_Allocator, instancesSize, vk::BufferUsageFlagBits::eRayTracingNV | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal);
+   // The staging buffer lives as long as the TLAS, so must not go in a linear block (it would stop the block from being reset)
+   m_TLASInstanceStagingBuffer = std::make_unique<Buffer>(*m_Allocator, instancesSize * m_Settings.MaxFramesInFlight, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, AllocationStrategy::eFreeList);
+
+   const vk::MemoryRequirements2 buildScratchRequirements = m_Device.getAccelerationStructureMemoryRequirementsNV({
+      vk::AccelerationStructureMemoryRequirementsTypeNV::eBuildScratch /*type*/,
+      m_TLAS.m_AccelerationStructure                                   /*accelerationStructure*/
+   });
+   const vk::MemoryRequirements2 updateScratchRequirements = m_Device.getAccelerationStructureMemoryRequirementsNV({
+      vk::AccelerationStructureMemoryRequirementsTypeNV::eUpdateScratch /*type*/,
+      m_TLAS.m_AccelerationStructure                                    /*accelerationStructure*/
+   });
+   m_TLASScratchBuffer = std::make_unique<Buffer>(
+      *m_Allocator,
+      std::max(buildScratchRequirements.memoryRequirements.size, updateScratchRequirements.memoryRequirements.size),
+      vk::BufferUsageFlagBits::eRayTracingNV,
+      vk::MemoryPropertyFlagBits::eDeviceLocal
+   );
 }
 
 
@@ -1227,16 +1529,81 @@ void Application::DestroyTopLevelAccelerationStructure() {
       m_Device.destroyAccelerationStructureNV(m_TLAS.m_AccelerationStructure);
 
       m_TLAS.m_AccelerationStructure = nullptr;
-      if (m_TLAS.m_Memory) {
-         m_Device.free(m_TLAS.m_Memory);
-         m_TLAS.m_Memory = nullptr;
-      }
+      m_Allocator->Free(m_TLAS.m_Allocation);
+      m_TLAS.m_Handle = 0;
+   }
+   m_TLASInstanceBuffer.reset(nullptr);
+   m_TLASInstanceStagingBuffer.reset(nullptr);
+   m_TLASScratchBuffer.reset(nullptr);
+}
+
+
+void Application::RetireTopLevelAccelerationStructure() {
+   if (m_TLAS.m_AccelerationStructure) {
+      m_DeletionQueue.Push([device = m_Device, allocator = m_Allocator.get(), tlas = m_TLAS] () mutable {
+         device.destroyAccelerationStructureNV(tlas.m_AccelerationStructure);
+         allocator->Free(tlas.m_Allocation);
+      });
+      m_TLAS.m_AccelerationStructure = nullptr;
+      m_TLAS.m_Allocation = {};
       m_TLAS.m_Handle = 0;
    }
+   m_DeletionQueue.Push(std::move(m_TLASInstanceBuffer));
+   m_DeletionQueue.Push(std::move(m_TLASInstanceStagingBuffer));
+   m_DeletionQueue.Push(std::move(m_TLASScratchBuffer));
 }
 
 
-void Application::BuildAccelerationStructures(vk::ArrayProxy<const Vulkan::GeometryInstance> geometryInstances) {
+void Application::BuildBottomLevelAccelerationStructures() {
+   const uint32_t blasCount = static_cast<uint32_t>(m_BLAS.size());
+   vk::QueryPool queryPool;
+   if (m_Settings.CompactAccelerationStructures && (blasCount > 0)) {
+      queryPool = m_Device.createQueryPool({
+         {}                                                  /*flags*/,
+         vk::QueryType::eAccelerationStructureCompactedSizeNV /*queryType*/,
+         blasCount                                           /*queryCount*/,
+         {}                                                  /*pipelineStatistics*/
+      });
+   }
+
+   std::unique_ptr<Buffer> scratchBuffer;
+   SubmitSingleTimeCommands([queryPool, blasCount, &scratchBuffer, this] (vk::CommandBuffer cmd) {
+      if (queryPool) {
+         cmd.resetQueryPool(queryPool, 0, blasCount);
+      }
+      CmdBuildBottomLevelAccelerationStructures(cmd, scratchBuffer);
+      if (queryPool) {
+         // compacted sizes are only known once the builds have finished
+         vk::MemoryBarrier memoryBarrier = {
+            vk::AccessFlagBits::eAccelerationStructureWriteNV /*srcAccesMask*/,
+            vk::AccessFlagBits::eAccelerationStructureReadNV  /*dstAccessMask*/
+         };
+         cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, {}, memoryBarrier, nullptr, nullptr);
+
+         std::vector<vk::AccelerationStructureNV> accelerationStructures;
+         accelerationStructures.reserve(blasCount);
+         for (const auto& blas : m_BLAS) {
+            accelerationStructures.push_back(blas.m_AccelerationStructure);
+         }
+         cmd.writeAccelerationStructuresPropertiesNV(accelerationStructures, vk::QueryType::eAccelerationStructureCompactedSizeNV, queryPool, 0);
+      }
+   });
+   scratchBuffer.reset(nullptr);
+
+   if (queryPool) {
+      std::vector<vk::DeviceSize> compactedSizes(blasCount);
+      vk::Result result = m_Device.getQueryPoolResults(queryPool, 0, blasCount, compactedSizes.size() * sizeof(vk::DeviceSize), compactedSizes.data(), sizeof(vk::DeviceSize), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+      m_Device.destroy(queryPool);
+      if (result != vk::Result::eSuccess) {
+         CORE_LOG_WARN("BLAS compaction skipped: compacted sizes not available ({0})", vk::to_string(result));
+         return;
+      }
+      CompactBottomLevelAccelerationStructures(compactedSizes);
+   }
+}
+
+
+void Application::CmdBuildBottomLevelAccelerationStructures(vk::CommandBuffer cmd, std::unique_ptr<Buffer>& scratchBuffer) {
    std::vector<vk::MemoryRequirements2> memoryRequirements;
    for (const auto& blas : m_BLAS) {
       memoryRequirements.emplace_back(
@@ -1251,61 +1618,163 @@ void Application::BuildAccelerationStructures(vk::ArrayProxy<const Vulkan::Geome
    for (const auto& memoryRequirement : memoryRequirements) {
       totalMemorySize += memoryRequirement.memoryRequirements.size;
    }
+   if (totalMemorySize == 0) {
+      return;
+   }
 
-   Vulkan::Buffer scratchBufferBLAS = {
-      m_Device,
-      m_PhysicalDevice,
+   scratchBuffer = std::make_unique<Buffer>(
+      *m_Allocator,
       totalMemorySize,
       vk::BufferUsageFlagBits::eRayTracingNV,
       vk::MemoryPropertyFlagBits::eDeviceLocal
-   };
+   );
 
-   Vulkan::Buffer instanceBuffer = {
-      m_Device,
-      m_PhysicalDevice,
-      sizeof(Vulkan::GeometryInstance) * geometryInstances.size(),
-      vk::BufferUsageFlagBits::eRayTracingNV,
-      vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
-   };
-   instanceBuffer.CopyFromHost(0, sizeof(Vulkan::GeometryInstance) * geometryInstances.size(), geometryInstances.data());
+   vk::DeviceSize scratchOffset = 0;
+   uint32_t i = 0;
+   for (const auto& blas : m_BLAS) {
+      // each build here has its own section of scratch memory.
+      // so we can queue them all up and do not need a memory barrier between BLAS builds
+      cmd.buildAccelerationStructureNV(blas.m_AccelerationStructureInfo, nullptr, 0, false, blas.m_AccelerationStructure, nullptr, scratchBuffer->m_Buffer, scratchOffset);
+      scratchOffset += memoryRequirements[i++].memoryRequirements.size;
+   }
+}
 
-   vk::MemoryRequirements2 memoryRequirementsTLAS = m_Device.getAccelerationStructureMemoryRequirementsNV({
-      vk::AccelerationStructureMemoryRequirementsTypeNV::eBuildScratch /*type*/,
-      m_TLAS.m_AccelerationStructure                                   /*accelerationStructure*/
-   });
 
-   Vulkan::Buffer scratchBufferTLAS = {
-      m_Device,
-      m_PhysicalDevice,
-      memoryRequirementsTLAS.memoryRequirements.size,
-      vk::BufferUsageFlagBits::eRayTracingNV,
-      vk::MemoryPropertyFlagBits::eDeviceLocal
-   };
+void Application::CompactBottomLevelAccelerationStructures(const std::vector<vk::DeviceSize>& compactedSizes) {
+   std::vector<AccelerationStructure> compacted;
+   std::vector<vk::DeviceSize> originalSizes;
+   compacted.reserve(m_BLAS.size());
+   originalSizes.reserve(m_BLAS.size());
+   uint32_t i = 0;
+   for (const auto& blas : m_BLAS) {
+      originalSizes.push_back(m_Device.getAccelerationStructureMemoryRequirementsNV({
+         vk::AccelerationStructureMemoryRequirementsTypeNV::eObject /*type*/,
+         blas.m_AccelerationStructure                               /*accelerationStructure*/
+      }).memoryRequirements.size);
+
+      // A compacted acceleration structure is created from just its size: it gets its geometry by being copied into
+      AccelerationStructure& compact = compacted.emplace_back(vk::AccelerationStructureInfoNV {
+         vk::AccelerationStructureTypeNV::eBottomLevel      /*type*/,
+         blas.m_AccelerationStructureInfo.flags             /*flags*/,
+         0                                                  /*instanceCount*/,
+         0                                                  /*geometryCount*/,
+         nullptr                                            /*pGeometries*/
+      });
+      compact.m_AccelerationStructure = m_Device.createAccelerationStructureNV({
+         compactedSizes[i++]                   /*compactedSize*/,
+         compact.m_AccelerationStructureInfo   /*info*/
+      });
+      vk::MemoryRequirements2 memoryRequirements = m_Device.getAccelerationStructureMemoryRequirementsNV({
+         vk::AccelerationStructureMemoryRequirementsTypeNV::eObject /*type*/,
+         compact.m_AccelerationStructure                            /*accelerationStructure*/
+      });
+      compact.m_Allocation = m_Allocator->Allocate(memoryRequirements.memoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal);
+      vk::BindAccelerationStructureMemoryInfoNV accelerationStructureMemoryInfo = {
+         compact.m_AccelerationStructure    /*accelerationStructure*/,
+         compact.m_Allocation.m_Memory      /*memory*/,
+         compact.m_Allocation.m_Offset      /*memoryOffset*/,
+         0                                  /*deviceIndexCount*/,
+         nullptr                            /*pDeviceIndices*/
+      };
+      m_Device.bindAccelerationStructureMemoryNV(accelerationStructureMemoryInfo);
+      m_Device.getAccelerationStructureHandleNV<uint64_t>(compact.m_AccelerationStructure, compact.m_Handle);
+   }
 
-   SubmitSingleTimeCommands([&memoryRequirements, &scratchBufferBLAS, &instanceBuffer, &scratchBufferTLAS, this] (vk::CommandBuffer cmd) {
-      vk::DeviceSize scratchOffset = 0;
-      uint32_t i = 0;
-      for (const auto& blas : m_BLAS) {
-         // each build here has its own section of scratch memory.
-         // so we can queue them all up and do not need a memory barrier between BLAS builds
-         cmd.buildAccelerationStructureNV(blas.m_AccelerationStructureInfo, nullptr, 0, false, blas.m_AccelerationStructure, nullptr, scratchBufferBLAS.m_Buffer, scratchOffset);
-         scratchOffset += memoryRequirements[i++].memoryRequirements.size;
+   SubmitSingleTimeCommands([&compacted, this] (vk::CommandBuffer cmd) {
+      for (size_t i = 0; i < m_BLAS.size(); ++i) {
+         cmd.copyAccelerationStructureNV(compacted[i].m_AccelerationStructure, m_BLAS[i].m_AccelerationStructure, vk::CopyAccelerationStructureModeNV::eCompact);
       }
+   });
 
-      // GPU must wait for BLAS build to finish before doing TLAS build
-      // Also, you need to make sure the geometry instances have finished being copied to GPU before doing the TLAS build
-      // but that is already covered because instanceBuffer.CopyFromHost() above blocks until the GPU has done it
-      vk::MemoryBarrier memoryBarrier = {
-         vk::AccessFlagBits::eAccelerationStructureWriteNV | vk::AccessFlagBits::eAccelerationStructureReadNV /*srcAccesMask*/,
-         vk::AccessFlagBits::eAccelerationStructureWriteNV | vk::AccessFlagBits::eAccelerationStructureReadNV /*dstAccessMask*/
-      };
-      cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, {}, memoryBarrier, nullptr, nullptr);
+   vk::DeviceSize totalOriginalSize = 0;
+   vk::DeviceSize totalCompactedSize = 0;
+   for (size_t i = 0; i < m_BLAS.size(); ++i) {
+      const vk::DeviceSize compactedSize = m_Device.getAccelerationStructureMemoryRequirementsNV({
+         vk::AccelerationStructureMemoryRequirementsTypeNV::eObject /*type*/,
+         compacted[i].m_AccelerationStructure                       /*accelerationStructure*/
+      }).memoryRequirements.size;
+      CORE_LOG_INFO("BLAS {0} compacted: {1} bytes -> {2} bytes ({3:.1f}%)", i, originalSizes[i], compactedSize, 100.0 * compactedSize / originalSizes[i]);
+      totalOriginalSize += originalSizes[i];
+      totalCompactedSize += compactedSize;
 
-      cmd.buildAccelerationStructureNV(m_TLAS.m_AccelerationStructureInfo, instanceBuffer.m_Buffer, 0, false, m_TLAS.m_AccelerationStructure, nullptr, scratchBufferTLAS.m_Buffer, 0);
+      // Workaround bug in vulkan.hpp (from Vulkan SDK version 1.2.141.2). Refer https://github.com/KhronosGroup/Vulkan-Hpp/issues/633
+      m_Device.destroyAccelerationStructureNV(m_BLAS[i].m_AccelerationStructure);
+      m_Allocator->Free(m_BLAS[i].m_Allocation);
+   }
+   m_BLAS = std::move(compacted);
+   CORE_LOG_INFO("BLAS compaction: {0} acceleration structures, {1} bytes -> {2} bytes (saved {3} bytes)", m_BLAS.size(), totalOriginalSize, totalCompactedSize, totalOriginalSize - totalCompactedSize);
+}
+
+
+void Application::BuildTopLevelAccelerationStructure(vk::ArrayProxy<const Vulkan::GeometryInstance> geometryInstances) {
+   SubmitSingleTimeCommands([&geometryInstances, this] (vk::CommandBuffer cmd) {
+      CmdUploadTopLevelInstances(cmd, geometryInstances, {{0, static_cast<uint32_t>(geometryInstances.size())}});
+      cmd.buildAccelerationStructureNV(m_TLAS.m_AccelerationStructureInfo, m_TLASInstanceBuffer->m_Buffer, 0, false, m_TLAS.m_AccelerationStructure, nullptr, m_TLASScratchBuffer->m_Buffer, 0);
    });
 }
 
 
+void Application::CmdUpdateTopLevelAccelerationStructure(vk::CommandBuffer cmd, vk::ArrayProxy<const Vulkan::GeometryInstance> geometryInstances, const std::vector<Vulkan::GeometryInstanceRange>& ranges) {
+   if (geometryInstances.size() != m_TLAS.m_AccelerationStructureInfo.instanceCount) {
+      throw std::runtime_error("TLAS update has the wrong number of instances (adding or removing instances needs the TLAS to be rebuilt)");
+   }
+   if (ranges.empty()) {
+      return;
+   }
+   // Earlier frames may still be tracing rays against the TLAS, and the previous update may still be reading the
+   // instance buffer (and writing the TLAS)
+   vk::MemoryBarrier inUseBarrier = {
+      vk::AccessFlagBits::eAccelerationStructureWriteNV                                                    /*srcAccessMask*/,
+      vk::AccessFlagBits::eAccelerationStructureReadNV | vk::AccessFlagBits::eAccelerationStructureWriteNV /*dstAccessMask*/
+   };
+   cmd.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderNV | vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, {}, inUseBarrier, nullptr, nullptr);
+
+   CmdUploadTopLevelInstances(cmd, geometryInstances, ranges);
+   cmd.buildAccelerationStructureNV(m_TLAS.m_AccelerationStructureInfo, m_TLASInstanceBuffer->m_Buffer, 0, true, m_TLAS.m_AccelerationStructure, m_TLAS.m_AccelerationStructure, m_TLASScratchBuffer->m_Buffer, 0);
+
+   // ray tracing recorded after this must wait for the update
+   vk::MemoryBarrier updatedBarrier = {
+      vk::AccessFlagBits::eAccelerationStructureWriteNV /*srcAccessMask*/,
+      vk::AccessFlagBits::eAccelerationStructureReadNV  /*dstAccessMask*/
+   };
+   cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, vk::PipelineStageFlagBits::eRayTracingShaderNV, {}, updatedBarrier, nullptr, nullptr);
+}
+
+
+void Application::CmdUploadTopLevelInstances(vk::CommandBuffer cmd, vk::ArrayProxy<const Vulkan::GeometryInstance> geometryInstances, const std::vector<Vulkan::GeometryInstanceRange>& ranges) {
+   // The ranges are packed one after another into this frame's region of the staging buffer, and copied from there with
+   // one region each.  As they do not overlap, they fit in a region, which is sized for every instance.
+   // BeginFrame() has waited for the last frame that used this frame's staging region (and anything submitted before it)
+   const vk::DeviceSize regionSize = m_TLASInstanceStagingBuffer->m_Size / m_Settings.MaxFramesInFlight;
+   vk::DeviceSize stagingOffset = regionSize * m_CurrentFrame;
+   std::vector<vk::BufferCopy> copyRegions;
+   copyRegions.reserve(ranges.size());
+   for (const auto& range : ranges) {
+      if ((range.Begin >= range.End) || (range.End > geometryInstances.size())) {
+         throw std::runtime_error("TLAS instance range is empty or out of range");
+      }
+      const vk::DeviceSize size = sizeof(Vulkan::GeometryInstance) * (range.End - range.Begin);
+      m_TLASInstanceStagingBuffer->CopyFromHost(stagingOffset, size, geometryInstances.data() + range.Begin);
+      copyRegions.push_back({
+         stagingOffset                                       /*srcOffset*/,
+         sizeof(Vulkan::GeometryInstance) * range.Begin      /*dstOffset*/,
+         size                                                /*size*/
+      });
+      stagingOffset += size;
+   }
+   if (copyRegions.empty()) {
+      return;
+   }
+   cmd.copyBuffer(m_TLASInstanceStagingBuffer->m_Buffer, m_TLASInstanceBuffer->m_Buffer, copyRegions);
+
+   vk::MemoryBarrier memoryBarrier = {
+      vk::AccessFlagBits::eTransferWrite                                                 /*srcAccessMask*/,
+      vk::AccessFlagBits::eAccelerationStructureReadNV | vk::AccessFlagBits::eShaderRead /*dstAccessMask*/
+   };
+   cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAccelerationStructureBuildNV, {}, memoryBarrier, nullptr, nullptr);
+}
+
+
 void glfwKeyCallback(GLFWwindow* window, const int key, const int scancode, const int action, const int mods) {
    const auto app = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
    app->OnKey(key, scancode, action, mods);
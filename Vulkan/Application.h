@@ -1,15 +1,23 @@
 #pragma once
 
 #include "Buffer.h"
+#include "DeletionQueue.h"
+#include "FrameCommandBuffers.h"
 #include "GeometryInstance.h"
 #include "Image.h"
+#include "JobSystem.h"
+#include "MemoryAllocator.h"
+#include "Profiler.h"
 #include "QueueFamilyIndices.h"
+#include "UploadManager.h"
 
 #include <glm/glm.hpp>
 #include <vulkan/vulkan.hpp>
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <string_view>
 
 struct GLFWwindow;
 
@@ -24,6 +32,39 @@ struct ApplicationSettings {
    bool IsResizable = true;
    bool IsFullScreen = false;
    bool IsCursorEnabled = true;
+
+   // Headless mode renders into offscreen images (WindowWidth x WindowHeight) instead of a window and swap chain.
+   // No GLFW functions are called, and no surface or swap chain extensions are required, so this works on a
+   // software ICD (e.g. lavapipe) on a machine with no display.
+   // The app runs until HeadlessFrameCount frames have been rendered, or HeadlessTimeBudget seconds have elapsed
+   // (whichever comes first; 0 means no limit).  Per-frame timings are written as CSV to FrameTimingFile, or to
+   // stdout if that is empty.
+   bool IsHeadless = false;
+   uint32_t HeadlessFrameCount = 1000;
+   double HeadlessTimeBudget = 0.0;
+   std::string FrameTimingFile;
+
+   // If set, a Chrome trace of the profiled CPU and GPU scopes is written here when the app exits
+   std::string TraceFile;
+
+   // If set, the pipeline cache is loaded from here at startup (if it exists, and was saved by the same device and driver),
+   // and saved back here on shutdown.  ParseCommandLine() defaults this to <executable>.pipelinecache
+   std::string PipelineCacheFile;
+
+   // Directory for the MeshCache (cooked copies of imported meshes).  ParseCommandLine() defaults this to
+   // <executable>.meshcache.  Empty disables the cache
+   std::string MeshCacheDirectory;
+
+   // Number of threads in the JobSystem (including the main thread), which is used for loading during Init() and for
+   // per-frame work such as recording command buffers.  0 => all cores
+   uint32_t ThreadCount = 0;
+
+   // If set, Run() runs the JobSystem micro-benchmarks (and logs the results) instead of rendering
+   bool IsJobSystemBenchmark = false;
+
+   // If set, BuildBottomLevelAccelerationStructures() compacts each BLAS after building it (copying it into memory of
+   // just its compacted size, and freeing the original).  Saves memory, at the cost of a little more work at load.
+   bool CompactAccelerationStructures = true;
 };
 
 
@@ -32,7 +73,7 @@ struct AccelerationStructure {
    AccelerationStructure(vk::AccelerationStructureInfoNV accelerationStructureInfo) : m_AccelerationStructureInfo(accelerationStructureInfo) {}
    vk::AccelerationStructureInfoNV m_AccelerationStructureInfo;
    vk::AccelerationStructureNV m_AccelerationStructure;
-   vk::DeviceMemory m_Memory;
+   MemoryAllocation m_Allocation;
    uint64_t m_Handle = 0;
 };
 
@@ -43,13 +84,33 @@ public:
    Application(const ApplicationSettings& settings, const bool enableValidation);
    virtual ~Application();
 
-   void Run();
+   virtual void Run();
+
+   // Override settings from command line:
+   //    --headless             render offscreen, without a window
+   //    --frames=<n>           headless: number of frames to render
+   //    --seconds=<s>          headless: time budget in seconds
+   //    --timing=<file>        headless: write per-frame timings to file instead of stdout
+   //    --width=<w>            window (or offscreen image) width
+   //    --height=<h>           window (or offscreen image) height
+   //    --trace=<file>         write Chrome trace of profiled scopes to file on exit
+   //    --pipeline-cache=<file>  load/save pipeline cache from/to file (empty to disable)
+   //    --mesh-cache=<dir>     keep cooked meshes in dir (empty to disable)
+   //    --threads=<n>          number of JobSystem threads (including the main thread)
+   //    --benchmark-jobs       run JobSystem micro-benchmarks instead of rendering
+   // Anything else is passed to ParseArgument()
+   // Must be called before Init()
+   void ParseCommandLine(const int argc, const char* argv[]);
 
    virtual void OnKey(const int key, const int scancode, const int action, const int mods);
    virtual void OnCursorPos(const double xpos, const double ypos);
    virtual void OnMouseButton(const int button, const int action, const int mods);
 
 protected:
+   // Handle an app specific command line argument (of the form arg, or arg=value).
+   // Return false if the argument is not recognised.  Base implementation recognises nothing
+   virtual bool ParseArgument(std::string_view arg, std::string_view value);
+
    // Initialise self.
    // This will create most of the vulkan objects required for a working app.
    // At a minimum, derived app must override Init() to provide the graphics pipeline.
@@ -103,6 +164,11 @@ protected:
    // Base implementation returns nothing.
    virtual std::vector<const char*> GetRequiredDeviceExtensions();
 
+   virtual void CreateMemoryAllocator();
+   virtual void DestroyMemoryAllocator();
+
+   virtual void CreateUploadManager();
+   virtual void DestroyUploadManager();
 
    ////////////////////////////////////////////////
    //
@@ -136,6 +202,17 @@ protected:
    virtual void CreateSyncObjects();
    virtual void DestroySyncObjects();
 
+   virtual void CreateJobSystem();
+   virtual void DestroyJobSystem();
+
+   virtual void CreateFrameCommandBuffers();
+   virtual void DestroyFrameCommandBuffers();
+
+   virtual void CreateProfiler(); // depends on command buffers
+   virtual void DestroyProfiler();
+
+   // Pipeline creation time is reported on exit (if derived app times it in a "CreatePipeline" profiler scope),
+   // so that startup with a cold versus warm pipeline cache can be compared.
    virtual void CreatePipelineCache();
    virtual void DestroyPipelineCache();
 
@@ -145,12 +222,26 @@ protected:
 
    virtual void RenderFrame();
 
+   // Submits this frame's command buffer: the one begun by BeginFrameCommandBuffer() if there is one, otherwise the
+   // pre-recorded m_CommandBuffers[m_CurrentImage]
    virtual void EndFrame();
 
+   void Present();
+
+   // Recreates the swap chain and everything that depends on it, without waiting for the device to go idle.
+   // Overrides must hand anything that frames in flight may still be using to m_DeletionQueue rather than destroying it.
    virtual void OnWindowResized();
 
 protected:
 
+   void RunHeadless();
+
+   // Log profiler statistics, and write trace file (if requested)
+   void ReportProfile();
+
+   // Returns true if key is currently pressed.  Always false when headless (there is no window)
+   bool IsKeyPressed(const int key) const;
+
    vk::ShaderModule CreateShaderModule(std::vector<char> code);
    void DestroyShaderModule(vk::ShaderModule& module);
 
@@ -158,15 +249,31 @@ protected:
 
    vk::Format FindSupportedFormat(const std::vector<vk::Format>& candidates, vk::ImageTiling tiling, vk::FormatFeatureFlags features);
 
-   void SubmitSingleTimeCommands(const std::function<void(vk::CommandBuffer)>& action);
+   // Record this frame's commands from scratch, instead of submitting a pre-recorded command buffer.
+   // Call between BeginFrame() and EndFrame().  Returns a primary command buffer (from m_FrameCommandBuffers) that has
+   // been begun.  EndFrame() ends and submits it.
+   vk::CommandBuffer BeginFrameCommandBuffer();
 
-   void CopyBuffer(vk::Buffer src, vk::Buffer dst, const vk::DeviceSize srcOffset, const vk::DeviceSize dstOffset, const vk::DeviceSize size);
+   // Record building every BLAS, each in its own part of a scratch buffer, which is created here (and must be kept until
+   // the commands have completed)
+   void CmdBuildBottomLevelAccelerationStructures(vk::CommandBuffer cmd, std::unique_ptr<Buffer>& scratchBuffer);
+
+   // Replace each BLAS with a copy in just compactedSizes[i] bytes
+   void CompactBottomLevelAccelerationStructures(const std::vector<vk::DeviceSize>& compactedSizes);
 
-   void TransitionImageLayout(vk::Image image, const vk::ImageLayout oldLayout, const vk::ImageLayout newLayout, const uint32_t mipLevels);
+   // Record copying the given ranges of geometryInstances (via this frame's region of the staging buffer) to the same
+   // places in the TLAS instance buffer, followed by a barrier that makes them visible to acceleration structure builds.
+   // The ranges must not overlap (see GeometryInstanceRange).
+   void CmdUploadTopLevelInstances(vk::CommandBuffer cmd, vk::ArrayProxy<const Vulkan::GeometryInstance> geometryInstances, const std::vector<Vulkan::GeometryInstanceRange>& ranges);
 
-   void CopyBufferToImage(vk::Buffer buffer, vk::Image image, const uint32_t width, const uint32_t height);
+   // Record commands with action and submit them to the graphics queue.
+   // If wait is false, returns without waiting for the commands to complete (the command buffer is then freed via
+   // m_DeletionQueue).  That is fine for work that only later submissions depend on, such as a layout transition.
+   void SubmitSingleTimeCommands(const std::function<void(vk::CommandBuffer)>& action, const bool wait = true);
 
-   void GenerateMIPMaps(vk::Image image, const vk::Format format, const uint32_t width, const uint32_t height, uint32_t mipLevels);
+   void CopyBuffer(vk::Buffer src, vk::Buffer dst, const vk::DeviceSize srcOffset, const vk::DeviceSize dstOffset, const vk::DeviceSize size);
+
+   void TransitionImageLayout(vk::Image image, const vk::ImageLayout oldLayout, const vk::ImageLayout newLayout, const uint32_t mipLevels, const bool wait = true);
 
    ///////////////////////////////
    // Ray tracing stuff
@@ -174,10 +281,29 @@ protected:
    void CreateBottomLevelAccelerationStructures(vk::ArrayProxy<const std::vector<vk::GeometryNV>> geometryGroups);
    void DestroyBottomLevelAccelerationStructures();
 
+   // The TLAS is created for geometryInstances.size() instances, and allows updates (see CmdUpdateTopLevelAccelerationStructure()).
+   // Its instance and scratch buffers are kept for as long as it is.
    void CreateTopLevelAccelerationStructure(vk::ArrayProxy<const Vulkan::GeometryInstance> geometryInstances);
    void DestroyTopLevelAccelerationStructure();
 
-   void BuildAccelerationStructures(vk::ArrayProxy<const Vulkan::GeometryInstance> geometryInstances);
+   // As DestroyTopLevelAccelerationStructure(), but the TLAS (and its buffers) are handed to m_DeletionQueue, as frames in
+   // flight may still be using them.  For rebuilding the TLAS while rendering (e.g. when instances are added or removed).
+   void RetireTopLevelAccelerationStructure();
+
+   // Build every BLAS, then (if m_Settings.CompactAccelerationStructures) compact them.  Compaction replaces each BLAS,
+   // so get the handles for the TLAS instances only after this.
+   void BuildBottomLevelAccelerationStructures();
+
+   // Build the TLAS (only).  The BLASs that geometryInstances refer to must already have been built.
+   void BuildTopLevelAccelerationStructure(vk::ArrayProxy<const Vulkan::GeometryInstance> geometryInstances);
+
+   // Record refitting the TLAS after the instances in ranges (of geometryInstances, which is all of them) have changed.
+   // Typically only transforms change: the number of instances, and the BLAS that each refers to, must stay as they were
+   // built.  Only the changed ranges are uploaded (via this frame's region of a staging buffer), one copy region each, so
+   // scattered changes do not upload everything in between.  The commands are ordered after any ray tracing that is still
+   // in flight, and before any that is recorded after them.
+   // Record into this frame's command buffer (see BeginFrameCommandBuffer()), at most once per frame.
+   void CmdUpdateTopLevelAccelerationStructure(vk::CommandBuffer cmd, vk::ArrayProxy<const Vulkan::GeometryInstance> geometryInstances, const std::vector<Vulkan::GeometryInstanceRange>& ranges);
    //
    //////////////////////////////
 
@@ -202,12 +328,17 @@ protected:
 
    vk::Queue m_GraphicsQueue;
    vk::Queue m_PresentQueue;
+   vk::Queue m_TransferQueue;   // same as m_GraphicsQueue if the device has no separate transfer queue family
+
+   std::unique_ptr<MemoryAllocator> m_Allocator;   // all Buffer and Image memory is sub-allocated from here
+   std::unique_ptr<UploadManager> m_UploadManager;
 
    // swap chain stuff (encapsulate?) ///////////////
    vk::Format m_Format = vk::Format::eUndefined;
    vk::Extent2D m_Extent;
    vk::SwapchainKHR m_SwapChain;
-   std::vector<Image> m_SwapChainImages;
+   std::vector<Image> m_SwapChainImages;   // when headless, these are offscreen images (one per frame in flight)
+   vk::ImageLayout m_PresentLayout = vk::ImageLayout::ePresentSrcKHR;   // layout that swap chain images must be in at the end of a frame
    bool m_WantResize = false;
    //////////////////////////////////////////////////
 
@@ -221,6 +352,10 @@ protected:
    vk::CommandPool m_CommandPool;
    std::vector<vk::CommandBuffer> m_CommandBuffers;
 
+   std::unique_ptr<JobSystem> m_JobSystem;                       // created first, destroyed last, so usable throughout
+   std::unique_ptr<FrameCommandBuffers> m_FrameCommandBuffers;   // per frame in flight command pools, reset each frame
+   vk::CommandBuffer m_FrameCommandBuffer;                       // set by BeginFrameCommandBuffer(), submitted by EndFrame()
+
    uint32_t m_CurrentFrame = 0; // which frame (up to MaxFramesInFlight) are we currently rendering
    uint32_t m_CurrentImage = 0; // which swap chain image are we currently rendering to
    std::vector<vk::Semaphore> m_ImageAvailableSemaphores;
@@ -229,6 +364,10 @@ protected:
    std::vector<vk::Fence> m_ImagesInFlight;
 
    vk::PipelineCache m_PipelineCache;
+   bool m_IsPipelineCacheWarm = false;   // true if m_PipelineCache was loaded from disk
+
+   std::unique_ptr<Profiler> m_Profiler;   // derived apps add GPU scopes (one query pool per entry in m_CommandBuffers) when recording command buffers
+   DeletionQueue m_DeletionQueue;          // resources retired while frames in flight may still be using them (e.g. on resize).  Collected in BeginFrame()
 
    double m_LastTime = 0.0;
 
@@ -236,6 +375,9 @@ protected:
    // Ray tracing stuff
    std::vector<AccelerationStructure> m_BLAS;
    AccelerationStructure m_TLAS;
+   std::unique_ptr<Buffer> m_TLASInstanceBuffer;          // device local, read by TLAS builds and updates
+   std::unique_ptr<Buffer> m_TLASInstanceStagingBuffer;   // host visible, one region (big enough for all instances) per frame in flight
+   std::unique_ptr<Buffer> m_TLASScratchBuffer;           // big enough for either a build or an update of the TLAS
    //
    ///////////////////////////
 
@@ -1,9 +1,12 @@
 #include "Buffer.h"
 
+#include "Core.h"
+
 namespace Vulkan {
 
-Buffer::Buffer(vk::Device device, const vk::PhysicalDevice physicalDevice, const vk::DeviceSize size, const vk::BufferUsageFlags usage, const vk::MemoryPropertyFlags properties)
-: m_Device(device)
+Buffer::Buffer(MemoryAllocator& allocator, const vk::DeviceSize size, const vk::BufferUsageFlags usage, const vk::MemoryPropertyFlags properties, const std::optional<AllocationStrategy> strategy)
+: m_Device(allocator.GetDevice())
+, m_Allocator(&allocator)
 , m_Size(size)
 , m_Usage(usage)
 , m_Properties(properties)
@@ -19,11 +22,12 @@ Buffer::Buffer(vk::Device device, const vk::PhysicalDevice physicalDevice, const
    m_Buffer = m_Device.createBuffer(ci);
 
    const auto requirements = m_Device.getBufferMemoryRequirements(m_Buffer);
-   m_Memory = m_Device.allocateMemory({
-      requirements.size                                                        /*allocationSize*/,
-      FindMemoryType(physicalDevice, requirements.memoryTypeBits, properties)  /*memoryTypeIndex*/
-   });
-   m_Device.bindBufferMemory(m_Buffer, m_Memory, 0);
+
+   // Staging buffers are usually short lived, so by default sub-allocate them linearly (their block is reset as soon as they
+   // have all been freed)
+   const AllocationStrategy defaultStrategy = (usage == vk::BufferUsageFlagBits::eTransferSrc) ? AllocationStrategy::eLinear : AllocationStrategy::eFreeList;
+   m_Allocation = m_Allocator->Allocate(requirements, properties, vk::ImageTiling::eLinear, strategy.value_or(defaultStrategy));
+   m_Device.bindBufferMemory(m_Buffer, m_Allocation.m_Memory, m_Allocation.m_Offset);
    m_Descriptor.buffer = m_Buffer;
    m_Descriptor.offset = 0;
    m_Descriptor.range = size;
@@ -38,15 +42,17 @@ Buffer::Buffer(Buffer&& that) {
 Buffer& Buffer::operator=(Buffer&& that) {
    if (this != &that) {
       m_Device = that.m_Device;
+      m_Allocator = that.m_Allocator;
       m_Buffer = that.m_Buffer;
-      m_Memory = that.m_Memory;
+      m_Allocation = that.m_Allocation;
       m_Descriptor = that.m_Descriptor;
       m_Size = that.m_Size;
       m_Usage = that.m_Usage;
       m_Properties = that.m_Properties;
       that.m_Device = nullptr;
+      that.m_Allocator = nullptr;
       that.m_Buffer = nullptr;
-      that.m_Memory = nullptr;
+      that.m_Allocation = {};
       that.m_Descriptor = {};
       that.m_Size = 0;
       that.m_Usage = {};
@@ -62,34 +68,27 @@ Buffer::~Buffer() {
          m_Device.destroy(m_Buffer);
          m_Buffer = nullptr;
       }
-      if (m_Memory) {
-         m_Device.freeMemory(m_Memory);
-         m_Memory = nullptr;
+      if (m_Allocation) {
+         m_Allocator->Free(m_Allocation);
       }
    }
 }
 
 
-uint32_t Buffer::FindMemoryType(const vk::PhysicalDevice physicalDevice, const uint32_t typeFilter, const vk::MemoryPropertyFlags properties) {
-   vk::PhysicalDeviceMemoryProperties memProperties = physicalDevice.getMemoryProperties();
-   for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i) {
-      if ((typeFilter & (1 << i)) && ((memProperties.memoryTypes[i].propertyFlags & properties) == properties)) {
-         return i;
-      }
-   }
-   throw std::runtime_error("failed to find suitable memory type!");
+void Buffer::CopyFromHost(const vk::DeviceSize offset, const vk::DeviceSize size, const void* pData) {
+   CORE_ASSERT(m_Allocation.m_pMapped, "Buffer::CopyFromHost() called on a buffer that is not host visible!");
+   memcpy(static_cast<char*>(m_Allocation.m_pMapped) + offset, pData, static_cast<size_t>(size));
+   Flush(offset, size);
 }
 
 
-void Buffer::CopyFromHost(const vk::DeviceSize offset, const vk::DeviceSize size, const void* pData) {
-   void* pDataDst = m_Device.mapMemory(m_Memory, offset, size);
-   memcpy(pDataDst, pData, static_cast<size_t>(size));
-   m_Device.unmapMemory(m_Memory);
+void Buffer::Flush(const vk::DeviceSize offset, const vk::DeviceSize size) {
+   m_Allocator->Flush(m_Allocation, offset, size);
 }
 
 
-IndexBuffer::IndexBuffer(vk::Device device, const vk::PhysicalDevice physicalDevice, const vk::DeviceSize size, const uint32_t count, const vk::BufferUsageFlags usage, const vk::MemoryPropertyFlags properties)
-: Buffer(device, physicalDevice, size, usage, properties)
+IndexBuffer::IndexBuffer(MemoryAllocator& allocator, const vk::DeviceSize size, const uint32_t count, const vk::BufferUsageFlags usage, const vk::MemoryPropertyFlags properties)
+: Buffer(allocator, size, usage, properties)
 , m_Count(count)
 {}
 
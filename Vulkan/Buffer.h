@@ -1,13 +1,20 @@
 #pragma once
 
+#include "MemoryAllocator.h"
+
 #include <vulkan/vulkan.hpp>
 
+#include <optional>
+
 namespace Vulkan {
 
 class Buffer {
 public:
 
-   Buffer(vk::Device device, const vk::PhysicalDevice physicalDevice, const vk::DeviceSize size, const vk::BufferUsageFlags usage, const vk::MemoryPropertyFlags properties);
+   // strategy defaults to eLinear for staging buffers (usage eTransferSrc only), on the assumption that they are short lived,
+   // and eFreeList for everything else.  Staging buffers that are kept for a long time must ask for eFreeList, as a linear
+   // block is only reset once every allocation in it has been freed.
+   Buffer(MemoryAllocator& allocator, const vk::DeviceSize size, const vk::BufferUsageFlags usage, const vk::MemoryPropertyFlags properties, const std::optional<AllocationStrategy> strategy = {});
    Buffer(const Buffer&) = delete;   // You cannot copy Vulkan::Buffer wrapper object
    Buffer(Buffer&& that);            // but you can move it (i.e. move the underlying vulkan resources to another Vulkan::Buffer wrapper)
 
@@ -20,25 +27,29 @@ public:
    vk::BufferUsageFlags m_Usage;
    vk::MemoryPropertyFlags m_Properties;
    vk::Buffer m_Buffer;
-   vk::DeviceMemory m_Memory;
+   MemoryAllocation m_Allocation;
    vk::DescriptorBufferInfo m_Descriptor;
 
    // Copy memory from host (pData) to the GPU buffer
    // You can do this only if buffer was created with host visible property
+   // (host visible buffers are persistently mapped, so this is just a memcpy, plus a flush if the memory is not host coherent)
    void CopyFromHost(const vk::DeviceSize offset, const vk::DeviceSize size, const void* pData);
 
-public:
-   static uint32_t FindMemoryType(const vk::PhysicalDevice physicalDevice, const uint32_t typeFilter, const vk::MemoryPropertyFlags flags);
+   // Host address of the start of the buffer.  nullptr if the buffer is not host visible.
+   // If you write through this directly, call Flush() afterwards
+   void* GetMappedData() const { return m_Allocation.m_pMapped; }
+   void Flush(const vk::DeviceSize offset, const vk::DeviceSize size);
 
 protected:
    vk::Device m_Device;
+   MemoryAllocator* m_Allocator = nullptr;
 };
 
 
 class IndexBuffer : public Buffer {
 public:
 
-   IndexBuffer(vk::Device device, const vk::PhysicalDevice physicalDevice, const vk::DeviceSize size, const uint32_t count, const vk::BufferUsageFlags usage, const vk::MemoryPropertyFlags properties);
+   IndexBuffer(MemoryAllocator& allocator, const vk::DeviceSize size, const uint32_t count, const vk::BufferUsageFlags usage, const vk::MemoryPropertyFlags properties);
 
    uint32_t m_Count;
 };
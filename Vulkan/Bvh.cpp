@@ -0,0 +1,281 @@
+#include "Bvh.h"
+
+#include "JobSystem.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <numeric>
+
+namespace Vulkan {
+
+namespace {
+
+// Nodes with at least this many primitives have their bounds and bins computed in parallel
+constexpr uint32_t ParallelBinningThreshold = 64 * 1024;
+
+
+// Builds the BVH top down.  Each node sorts its range of the primitive index array into [left child, right child]
+// so that, when done, each leaf refers to a contiguous range of primitive indices.
+class BvhBuilder {
+public:
+   BvhBuilder(const std::vector<Aabb>& primitiveBounds, const BvhBuildSettings& settings, JobSystem* jobSystem, Bvh::NodeArray& nodes, std::vector<uint32_t>& primitiveIndices)
+   : m_PrimitiveBounds(primitiveBounds)
+   , m_Settings(settings)
+   , m_JobSystem(jobSystem)
+   , m_Nodes(nodes)
+   , m_PrimitiveIndices(primitiveIndices)
+   , m_BinCount(std::clamp(settings.BinCount, 2u, Bvh::MaxBinCount))
+   {}
+
+   void Build() {
+      const uint32_t primitiveCount = static_cast<uint32_t>(m_PrimitiveBounds.size());
+      m_PrimitiveIndices.resize(primitiveCount);
+      std::iota(m_PrimitiveIndices.begin(), m_PrimitiveIndices.end(), 0);
+      m_Centroids.resize(primitiveCount);
+      ForRange(0, primitiveCount, [this] (const uint32_t begin, const uint32_t end) {
+         for (uint32_t i = begin; i < end; ++i) {
+            m_Centroids[i] = m_PrimitiveBounds[i].GetCenter();
+         }
+      });
+
+      // a binary tree with n leaves has 2n - 1 nodes, plus one for the padding at index 1
+      m_Nodes.resize(2 * static_cast<size_t>(primitiveCount));
+      m_NodeCount = 2;
+      BuildNode(0, 0, primitiveCount, 0);
+      m_Nodes.resize(m_NodeCount);
+   }
+
+private:
+   struct Bin {
+      Aabb Bounds;
+      uint32_t Count = 0;
+   };
+
+   struct Split {
+      int Axis = -1;                                      // -1 => no split found
+      uint32_t Bin = 0;                                   // bins [0, Bin] go left
+      float Cost = std::numeric_limits<float>::max();
+   };
+
+   // fn(rangeBegin, rangeEnd) over [begin, end), spread across threads if there is a job system
+   template<typename Fn>
+   void ForRange(const uint32_t begin, const uint32_t end, const Fn& fn) const {
+      if (m_JobSystem && (end - begin >= ParallelBinningThreshold)) {
+         m_JobSystem->ParallelFor(begin, end, 0, fn);
+      } else {
+         fn(begin, end);
+      }
+   }
+
+
+   void ComputeBounds(const uint32_t begin, const uint32_t end, Aabb& bounds, Aabb& centroidBounds) const {
+      std::mutex mutex;
+      ForRange(begin, end, [&] (const uint32_t rangeBegin, const uint32_t rangeEnd) {
+         Aabb rangeBounds;
+         Aabb rangeCentroidBounds;
+         for (uint32_t i = rangeBegin; i < rangeEnd; ++i) {
+            const uint32_t primitive = m_PrimitiveIndices[i];
+            rangeBounds.Grow(m_PrimitiveBounds[primitive]);
+            rangeCentroidBounds.Grow(m_Centroids[primitive]);
+         }
+         std::lock_guard lock(mutex);
+         bounds.Grow(rangeBounds);
+         centroidBounds.Grow(rangeCentroidBounds);
+      });
+   }
+
+
+   uint32_t GetBinIndex(const glm::vec3& centroid, const int axis, const Aabb& centroidBounds, const glm::vec3& binScale, const uint32_t binCount) const {
+      const float bin = (centroid[axis] - centroidBounds.Min[axis]) * binScale[axis];
+      return std::min(static_cast<uint32_t>(std::max(bin, 0.0f)), binCount - 1);
+   }
+
+
+   // bins[axis * binCount + bin]
+   void BinPrimitives(const uint32_t begin, const uint32_t end, const Aabb& centroidBounds, const glm::vec3& binScale, const uint32_t binCount, std::vector<Bin>& bins) const {
+      for (uint32_t i = begin; i < end; ++i) {
+         const uint32_t primitive = m_PrimitiveIndices[i];
+         for (int axis = 0; axis < 3; ++axis) {
+            Bin& bin = bins[axis * binCount + GetBinIndex(m_Centroids[primitive], axis, centroidBounds, binScale, binCount)];
+            bin.Bounds.Grow(m_PrimitiveBounds[primitive]);
+            ++bin.Count;
+         }
+      }
+   }
+
+
+   Split FindSplit(const uint32_t begin, const uint32_t end, const Aabb& bounds, const Aabb& centroidBounds, const glm::vec3& binScale, const uint32_t binCount) const {
+      std::vector<Bin> bins(3 * binCount);
+      if (m_JobSystem && (end - begin >= ParallelBinningThreshold)) {
+         std::mutex mutex;
+         m_JobSystem->ParallelFor(begin, end, 0, [&] (const uint32_t rangeBegin, const uint32_t rangeEnd) {
+            std::vector<Bin> rangeBins(bins.size());
+            BinPrimitives(rangeBegin, rangeEnd, centroidBounds, binScale, binCount, rangeBins);
+            std::lock_guard lock(mutex);
+            for (size_t i = 0; i < bins.size(); ++i) {
+               bins[i].Bounds.Grow(rangeBins[i].Bounds);
+               bins[i].Count += rangeBins[i].Count;
+            }
+         });
+      } else {
+         BinPrimitives(begin, end, centroidBounds, binScale, binCount, bins);
+      }
+
+      // cost(split) = traversal + (area(left) * count(left) + area(right) * count(right)) / area(node)
+      Split best;
+      const float inverseArea = 1.0f / std::max(bounds.GetSurfaceArea(), std::numeric_limits<float>::min());
+      for (int axis = 0; axis < 3; ++axis) {
+         if (binScale[axis] <= 0.0f) {
+            continue;
+         }
+         const Bin* axisBins = &bins[axis * binCount];
+
+         // sweep from the right, recording the area x count of everything right of each split plane
+         std::array<float, Bvh::MaxBinCount> rightCost;
+         Aabb rightBounds;
+         uint32_t rightCount = 0;
+         for (uint32_t bin = binCount - 1; bin > 0; --bin) {
+            rightBounds.Grow(axisBins[bin].Bounds);
+            rightCount += axisBins[bin].Count;
+            rightCost[bin - 1] = rightBounds.GetSurfaceArea() * rightCount;
+         }
+
+         // then from the left
+         Aabb leftBounds;
+         uint32_t leftCount = 0;
+         for (uint32_t bin = 0; bin < binCount - 1; ++bin) {
+            leftBounds.Grow(axisBins[bin].Bounds);
+            leftCount += axisBins[bin].Count;
+            if ((leftCount == 0) || (leftCount == end - begin)) {
+               continue;
+            }
+            const float cost = m_Settings.TraversalCost + (leftBounds.GetSurfaceArea() * leftCount + rightCost[bin]) * inverseArea;
+            if (cost < best.Cost) {
+               best = {axis, bin, cost};
+            }
+         }
+      }
+      return best;
+   }
+
+
+   void BuildNode(const uint32_t nodeIndex, const uint32_t begin, const uint32_t end, const uint32_t depth) {
+      Aabb bounds;
+      Aabb centroidBounds;
+      ComputeBounds(begin, end, bounds, centroidBounds);
+
+      BvhNode& node = m_Nodes[nodeIndex];
+      node.BoundsMin = bounds.Min;
+      node.BoundsMax = bounds.Max;
+
+      const uint32_t count = end - begin;
+      uint32_t mid = begin;
+      if ((count > 1) && (depth + 1 < Bvh::MaxDepth)) {
+         // no point having (many) more bins than primitives
+         const uint32_t binCount = std::min(m_BinCount, std::max(count, 4u));
+         const glm::vec3 extent = centroidBounds.Max - centroidBounds.Min;
+         glm::vec3 binScale;
+         for (int axis = 0; axis < 3; ++axis) {
+            binScale[axis] = (extent[axis] > 0.0f) ? binCount / extent[axis] : 0.0f;
+         }
+
+         const Split split = FindSplit(begin, end, bounds, centroidBounds, binScale, binCount);
+         const float leafCost = static_cast<float>(count);
+         if ((split.Axis >= 0) && ((split.Cost < leafCost) || (count > m_Settings.MaxLeafSize))) {
+            mid = static_cast<uint32_t>(std::partition(m_PrimitiveIndices.begin() + begin, m_PrimitiveIndices.begin() + end, [&] (const uint32_t primitive) {
+               return GetBinIndex(m_Centroids[primitive], split.Axis, centroidBounds, binScale, binCount) <= split.Bin;
+            }) - m_PrimitiveIndices.begin());
+         } else if ((split.Axis < 0) && (count > m_Settings.MaxLeafSize)) {
+            // all centroids coincide, so no plane separates them.  Split down the middle (of the array) anyway.
+            mid = begin + count / 2;
+         }
+      }
+
+      if ((mid == begin) || (mid == end)) {
+         node.Index = begin;
+         node.PrimitiveCount = count;
+         return;
+      }
+
+      const uint32_t childIndex = m_NodeCount.fetch_add(2);
+      node.Index = childIndex;
+      node.PrimitiveCount = 0;
+      if (m_JobSystem && (count >= m_Settings.ParallelThreshold)) {
+         TaskHandle right = m_JobSystem->Spawn([this, childIndex, mid, end, depth] { BuildNode(childIndex + 1, mid, end, depth + 1); });
+         BuildNode(childIndex, begin, mid, depth + 1);
+         m_JobSystem->Wait(right);
+      } else {
+         BuildNode(childIndex, begin, mid, depth + 1);
+         BuildNode(childIndex + 1, mid, end, depth + 1);
+      }
+   }
+
+private:
+   const std::vector<Aabb>& m_PrimitiveBounds;
+   const BvhBuildSettings& m_Settings;
+   JobSystem* m_JobSystem;
+   Bvh::NodeArray& m_Nodes;
+   std::vector<uint32_t>& m_PrimitiveIndices;
+   std::vector<glm::vec3> m_Centroids;
+   std::atomic<uint32_t> m_NodeCount {0};
+   const uint32_t m_BinCount;
+};
+
+}
+
+
+Bvh::Bvh(const std::vector<Aabb>& primitiveBounds, JobSystem* jobSystem, const BvhBuildSettings& settings) {
+   const auto startTime = std::chrono::steady_clock::now();
+   if (!primitiveBounds.empty()) {
+      BvhBuilder builder(primitiveBounds, settings, jobSystem, m_Nodes, m_PrimitiveIndices);
+      builder.Build();
+   }
+   m_Stats.BuildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+   ComputeStats(settings);
+}
+
+
+Aabb Bvh::GetBounds() const {
+   if (m_Nodes.empty()) {
+      return {};
+   }
+   return {m_Nodes[0].BoundsMin, m_Nodes[0].BoundsMax};
+}
+
+
+void Bvh::ComputeStats(const BvhBuildSettings& settings) {
+   m_Stats.PrimitiveCount = static_cast<uint32_t>(m_PrimitiveIndices.size());
+   m_Stats.NodeCount = 0;
+   m_Stats.LeafCount = 0;
+   m_Stats.MaxDepth = 0;
+   m_Stats.SahCost = 0.0f;
+   if (m_Nodes.empty()) {
+      return;
+   }
+
+   // The probability of a random ray that hits the root also hitting a node is (roughly) area(node) / area(root)
+   const float inverseRootArea = 1.0f / std::max(GetBounds().GetSurfaceArea(), std::numeric_limits<float>::min());
+   double cost = 0.0;
+   std::vector<std::pair<uint32_t, uint32_t>> stack = {{0, 0}};   // node index, depth
+   while (!stack.empty()) {
+      const auto [nodeIndex, depth] = stack.back();
+      stack.pop_back();
+      const BvhNode& node = m_Nodes[nodeIndex];
+      const float probability = Aabb {node.BoundsMin, node.BoundsMax}.GetSurfaceArea() * inverseRootArea;
+      ++m_Stats.NodeCount;
+      m_Stats.MaxDepth = std::max(m_Stats.MaxDepth, depth);
+      if (node.IsLeaf()) {
+         ++m_Stats.LeafCount;
+         cost += probability * node.PrimitiveCount;
+      } else {
+         cost += probability * settings.TraversalCost;
+         stack.emplace_back(node.Index, depth + 1);
+         stack.emplace_back(node.Index + 1, depth + 1);
+      }
+   }
+   m_Stats.SahCost = static_cast<float>(cost);
+}
+
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <vector>
+
+namespace Vulkan {
+
+class JobSystem;
+
+// Axis aligned bounding box.  Default constructed box is empty (and growing it by anything gives that thing's bounds)
+struct Aabb {
+   glm::vec3 Min = glm::vec3 {std::numeric_limits<float>::max()};
+   glm::vec3 Max = glm::vec3 {-std::numeric_limits<float>::max()};
+
+   bool IsEmpty() const { return (Min.x > Max.x) || (Min.y > Max.y) || (Min.z > Max.z); }
+
+   void Grow(const glm::vec3& point) {
+      Min = glm::min(Min, point);
+      Max = glm::max(Max, point);
+   }
+
+   void Grow(const Aabb& other) {
+      Min = glm::min(Min, other.Min);
+      Max = glm::max(Max, other.Max);
+   }
+
+   glm::vec3 GetCenter() const { return 0.5f * (Min + Max); }
+
+   float GetSurfaceArea() const {
+      if (IsEmpty()) {
+         return 0.0f;
+      }
+      const glm::vec3 extent = Max - Min;
+      return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+   }
+};
+
+
+// Node of a flattened BVH.
+// Nodes are 32 bytes, and the two children of an interior node are stored next to each other starting at an even
+// index, so that (with the node array 64 byte aligned) both children are fetched in one cache line.
+struct alignas(32) BvhNode {
+   glm::vec3 BoundsMin;
+   uint32_t Index = 0;            // interior node: index of first child (second child is Index + 1).  Leaf: index of first primitive in primitive index array
+   glm::vec3 BoundsMax;
+   uint32_t PrimitiveCount = 0;   // 0 => interior node
+
+   bool IsLeaf() const { return PrimitiveCount > 0; }
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode is expected to be half a cache line");
+
+
+// Minimal allocator for std::vector of over aligned (e.g. cache line aligned) data
+template<typename T, size_t Alignment>
+struct AlignedAllocator {
+   using value_type = T;
+
+   template<typename U>
+   struct rebind {
+      using other = AlignedAllocator<U, Alignment>;
+   };
+
+   AlignedAllocator() = default;
+
+   template<typename U>
+   AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+   T* allocate(const size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t {Alignment})); }
+   void deallocate(T* p, const size_t) { ::operator delete(p, std::align_val_t {Alignment}); }
+
+   template<typename U>
+   bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+
+   template<typename U>
+   bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+
+struct BvhBuildSettings {
+   uint32_t BinCount = 16;             // SAH bins per axis, up to Bvh::MaxBinCount
+   uint32_t MaxLeafSize = 4;           // nodes with more primitives than this are always split (unless they cannot be)
+   float TraversalCost = 1.0f;         // cost of visiting a node, relative to intersecting one primitive
+   uint32_t ParallelThreshold = 4096;  // nodes with at least this many primitives build their children as separate tasks
+};
+
+
+struct BvhStats {
+   double BuildSeconds = 0.0;
+   uint32_t PrimitiveCount = 0;
+   uint32_t NodeCount = 0;             // including leaves (but not the padding node at index 1)
+   uint32_t LeafCount = 0;
+   uint32_t MaxDepth = 0;
+   float SahCost = 0.0f;               // expected cost of a random ray that hits the root, in units of primitive intersections
+};
+
+
+// Bounding volume hierarchy over a set of primitives, for CPU side ray queries (picking, culling, CPU ray tracing etc.)
+//
+// The BVH only knows the bounds of each primitive.  What a primitive actually is (triangle, instance, procedural
+// shape, ...) is up to the caller, who supplies a function to intersect a primitive with the ray when querying.
+//
+// Built top down with binned surface area heuristic (SAH).  Given a JobSystem, large subtrees are built as separate
+// tasks and the binning of large nodes is spread across threads.
+class Bvh {
+public:
+   using NodeArray = std::vector<BvhNode, AlignedAllocator<BvhNode, 64>>;
+
+   static constexpr uint32_t MaxBinCount = 64;
+   static constexpr uint32_t MaxDepth = 64;
+
+   Bvh() = default;
+
+   // Build over primitives with the given bounds.  Primitive i of the BVH is primitiveBounds[i].
+   // If jobSystem is not null, then the build is spread across its threads.
+   Bvh(const std::vector<Aabb>& primitiveBounds, JobSystem* jobSystem, const BvhBuildSettings& settings = {});
+
+   bool IsEmpty() const { return m_Nodes.empty(); }
+
+   // Bounds of all the primitives
+   Aabb GetBounds() const;
+
+   const BvhStats& GetStats() const { return m_Stats; }
+
+   const NodeArray& GetNodes() const { return m_Nodes; }
+
+   // Leaf nodes refer to ranges of this array, which in turn holds the indices of the original primitives
+   const std::vector<uint32_t>& GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+
+   // Find the closest primitive hit by ray origin + t * direction, for t in [tMin, tMax].
+   // intersectPrimitive(primitiveIndex, float& tMax) is called for candidate primitives.  It must return true (and
+   // reduce tMax to the hit distance) only if the primitive is hit closer than tMax.  Record whatever else is needed
+   // about the hit (e.g. primitive index and barycentrics) in intersectPrimitive.
+   // Returns true if anything was hit, in which case tMax is the distance to the closest hit.
+   template<typename IntersectPrimitive>
+   bool ClosestHit(const glm::vec3& origin, const glm::vec3& direction, const float tMin, float& tMax, IntersectPrimitive&& intersectPrimitive) const {
+      return Traverse<false>(origin, direction, tMin, tMax, intersectPrimitive);
+   }
+
+   // As per ClosestHit(), but stop at the first hit found (which is not necessarily the closest).  e.g. for shadow rays
+   template<typename IntersectPrimitive>
+   bool AnyHit(const glm::vec3& origin, const glm::vec3& direction, const float tMin, const float tMax, IntersectPrimitive&& intersectPrimitive) const {
+      float t = tMax;
+      return Traverse<true>(origin, direction, tMin, t, intersectPrimitive);
+   }
+
+private:
+   static bool IntersectNode(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, const float tMin, const float tMax, float& tNear) {
+      const glm::vec3 t0 = (node.BoundsMin - origin) * inverseDirection;
+      const glm::vec3 t1 = (node.BoundsMax - origin) * inverseDirection;
+      const glm::vec3 tNear3 = glm::min(t0, t1);
+      const glm::vec3 tFar3 = glm::max(t0, t1);
+      tNear = std::max({tNear3.x, tNear3.y, tNear3.z, tMin});
+      const float tFar = std::min({tFar3.x, tFar3.y, tFar3.z, tMax});
+      return tNear <= tFar;
+   }
+
+   // Front to back traversal: at each interior node visit the nearer child first, and push the other (with its entry
+   // distance, so that it can be skipped if a closer hit has been found by the time it is popped)
+   template<bool IsAnyHit, typename IntersectPrimitive>
+   bool Traverse(const glm::vec3& origin, const glm::vec3& direction, const float tMin, float& tMax, IntersectPrimitive& intersectPrimitive) const {
+      const glm::vec3 inverseDirection = 1.0f / direction;
+      float tNear;
+      if (m_Nodes.empty() || !IntersectNode(m_Nodes[0], origin, inverseDirection, tMin, tMax, tNear)) {
+         return false;
+      }
+
+      struct StackEntry {
+         uint32_t NodeIndex;
+         float TNear;
+      };
+      StackEntry stack[MaxDepth];
+      uint32_t stackSize = 0;
+
+      bool isHit = false;
+      uint32_t nodeIndex = 0;
+      for (;;) {
+         const BvhNode& node = m_Nodes[nodeIndex];
+         if (node.IsLeaf()) {
+            for (uint32_t i = node.Index; i < node.Index + node.PrimitiveCount; ++i) {
+               if (intersectPrimitive(m_PrimitiveIndices[i], tMax)) {
+                  isHit = true;
+                  if constexpr (IsAnyHit) {
+                     return true;
+                  }
+               }
+            }
+         } else {
+            float tLeft;
+            float tRight;
+            const bool isLeftHit = IntersectNode(m_Nodes[node.Index], origin, inverseDirection, tMin, tMax, tLeft);
+            const bool isRightHit = IntersectNode(m_Nodes[node.Index + 1], origin, inverseDirection, tMin, tMax, tRight);
+            if (isLeftHit && isRightHit) {
+               if (tLeft <= tRight) {
+                  stack[stackSize++] = {node.Index + 1, tRight};
+                  nodeIndex = node.Index;
+               } else {
+                  stack[stackSize++] = {node.Index, tLeft};
+                  nodeIndex = node.Index + 1;
+               }
+               continue;
+            } else if (isLeftHit) {
+               nodeIndex = node.Index;
+               continue;
+            } else if (isRightHit) {
+               nodeIndex = node.Index + 1;
+               continue;
+            }
+         }
+
+         // pop the next node that could still contain a hit
+         do {
+            if (stackSize == 0) {
+               return isHit;
+            }
+            --stackSize;
+         } while (stack[stackSize].TNear > tMax);
+         nodeIndex = stack[stackSize].NodeIndex;
+      }
+   }
+
+   void ComputeStats(const BvhBuildSettings& settings);
+
+private:
+   NodeArray m_Nodes;                          // m_Nodes[0] is the root.  m_Nodes[1] is unused (so that sibling pairs start at even indices)
+   std::vector<uint32_t> m_PrimitiveIndices;
+   BvhStats m_Stats;
+};
+
+}
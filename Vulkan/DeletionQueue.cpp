@@ -0,0 +1,29 @@
+#include "DeletionQueue.h"
+
+namespace Vulkan {
+
+DeletionQueue::~DeletionQueue() {
+   Flush();
+}
+
+
+void DeletionQueue::Push(std::function<void()> deleter) {
+   m_Entries.push_back({m_SubmittedFrameCount, std::move(deleter)});
+}
+
+
+void DeletionQueue::Collect(const uint64_t completedFrameCount) {
+   while (!m_Entries.empty() && (m_Entries.front().FrameCount < completedFrameCount)) {
+      // pop before running, so that a deleter may safely push more entries
+      std::function<void()> deleter = std::move(m_Entries.front().Deleter);
+      m_Entries.pop_front();
+      deleter();
+   }
+}
+
+
+void DeletionQueue::Flush() {
+   Collect(UINT64_MAX);
+}
+
+}
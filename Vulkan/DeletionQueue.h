@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+
+namespace Vulkan {
+
+// Defers destruction of resources until the GPU has finished with them.
+//
+// Everything pushed is freed once the next frame to be submitted has completed.  Frame fences signal in queue submission
+// order, so by then the frames that were already in flight have completed too, as has any other work submitted to the
+// same queue in the meantime (such as a one-off layout transition).
+// The owner of the frame fences tells the queue how many frames have completed (see Collect()), so this never waits on
+// anything itself.
+//
+// Deleters run in the order they were pushed.
+class DeletionQueue {
+public:
+   DeletionQueue() = default;
+   DeletionQueue(const DeletionQueue&) = delete;
+   DeletionQueue(DeletionQueue&&) = delete;
+
+   DeletionQueue& operator=(const DeletionQueue&) = delete;
+   DeletionQueue& operator=(DeletionQueue&&) = delete;
+
+   ~DeletionQueue();
+
+   // Run deleter once the next frame to be submitted has completed
+   void Push(std::function<void()> deleter);
+
+   // Destroy object once the next frame to be submitted has completed
+   template<typename T>
+   void Push(std::unique_ptr<T> object) {
+      std::shared_ptr<T> retired = std::move(object);   // std::function requires a copyable callable
+      Push([retired]() mutable { retired.reset(); });
+   }
+
+   // Call each time a frame has been submitted
+   void OnSubmit() { ++m_SubmittedFrameCount; }
+
+   // Call when the first completedFrameCount frames are known to have completed.
+   // Runs the deleters for everything that was pushed before the last of those frames was submitted.
+   void Collect(const uint64_t completedFrameCount);
+
+   // Run all outstanding deleters.  Device must be idle.
+   void Flush();
+
+   uint64_t GetSubmittedFrameCount() const { return m_SubmittedFrameCount; }
+   size_t GetPendingCount() const { return m_Entries.size(); }
+
+private:
+   struct Entry {
+      uint64_t FrameCount;   // number of frames that had been submitted when the entry was pushed
+      std::function<void()> Deleter;
+   };
+
+   std::deque<Entry> m_Entries;
+   uint64_t m_SubmittedFrameCount = 0;
+};
+
+}
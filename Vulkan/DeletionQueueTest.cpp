@@ -0,0 +1,165 @@
+// CPU only tests of DeletionQueue, driven the way Application drives it: BeginFrame() collects what the frames that have
+// completed no longer need, EndFrame() submits.
+// The main case is the one that the apps' descriptor pools rely on: a new generation of resources (e.g. a descriptor
+// pool and its sets) replacing the old one on every frame, or several times in one frame, as happens while the window is
+// being drag-resized, or when instances are rebuilt during a resize.  Each retired generation must outlive every frame
+// that used it, and must be freed soon after.
+
+#include "DeletionQueue.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+int s_FailureCount = 0;
+
+#define CHECK(condition)                                                                   \
+   do {                                                                                    \
+      if (!(condition)) {                                                                  \
+         std::fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition);\
+         ++s_FailureCount;                                                                 \
+      }                                                                                    \
+   } while (false)
+
+
+// Frames complete in submission order, exactly MaxFramesInFlight frames behind (i.e. the CPU always has to wait for
+// the GPU, which is the worst case for how long retired resources are kept)
+class FrameLoop {
+public:
+   explicit FrameLoop(const uint32_t maxFramesInFlight)
+   : m_MaxFramesInFlight(maxFramesInFlight)
+   {}
+
+   // As Application::BeginFrame().  Waiting on this frame's fence means the frame submitted MaxFramesInFlight frames ago
+   // has completed, as has everything before it.
+   void BeginFrame() {
+      const uint64_t submittedFrameCount = m_Queue.GetSubmittedFrameCount();
+      if (submittedFrameCount >= m_MaxFramesInFlight) {
+         m_CompletedFrameCount = submittedFrameCount - m_MaxFramesInFlight + 1;
+         m_Queue.Collect(m_CompletedFrameCount);
+      }
+   }
+
+   void EndFrame() { m_Queue.OnSubmit(); }
+
+   // As the apps' shutdown: once the device is idle, every frame has completed
+   void WaitIdle() {
+      m_CompletedFrameCount = m_Queue.GetSubmittedFrameCount();
+      m_Queue.Flush();
+   }
+
+   Vulkan::DeletionQueue& GetQueue() { return m_Queue; }
+   uint64_t GetSubmittedFrameCount() const { return m_Queue.GetSubmittedFrameCount(); }
+   uint64_t GetCompletedFrameCount() const { return m_CompletedFrameCount; }
+
+private:
+   Vulkan::DeletionQueue m_Queue;
+   uint32_t m_MaxFramesInFlight;
+   uint64_t m_CompletedFrameCount = 0;
+};
+
+
+// A generation of resources, e.g. a descriptor pool
+struct Generation {
+   bool IsLive = true;
+   uint64_t LastUsedFrame = 0;   // index of the last frame submitted with it
+   bool IsUsed = false;
+};
+
+
+// Replace the current generation retirementsPerFrame times on each of frameCount frames (as RecreateDescriptorSets()
+// does), and check that no generation is freed while a frame that used it might still be executing, and that each is
+// freed no later than MaxFramesInFlight frames after it was retired.
+void TestRepeatedRetirement(const uint32_t maxFramesInFlight, const uint32_t retirementsPerFrame) {
+   constexpr uint32_t FrameCount = 100;
+   FrameLoop loop(maxFramesInFlight);
+   std::vector<Generation> generations(1);
+   std::vector<uint64_t> retiredAt;   // frame count when each generation was retired
+   uint32_t freedCount = 0;
+
+   for (uint32_t frame = 0; frame < FrameCount; ++frame) {
+      loop.BeginFrame();
+      for (uint32_t i = 0; i < retirementsPerFrame; ++i) {
+         const size_t current = generations.size() - 1;
+         retiredAt.push_back(loop.GetSubmittedFrameCount());
+         loop.GetQueue().Push([&loop, &generations, &freedCount, current] {
+            Generation& generation = generations[current];
+            CHECK(generation.IsLive);
+            CHECK(!generation.IsUsed || (generation.LastUsedFrame < loop.GetCompletedFrameCount()));
+            generation.IsLive = false;
+            ++freedCount;
+         });
+         generations.emplace_back();
+      }
+
+      // the frame uses the current generation
+      generations.back().LastUsedFrame = loop.GetSubmittedFrameCount();
+      generations.back().IsUsed = true;
+      loop.EndFrame();
+
+      // everything retired MaxFramesInFlight or more frames ago has been freed, so only a bounded number of generations
+      // are ever live at once.  (Though with two frames in flight, that is already three generations, more than a pool
+      // sized for two could hold)
+      for (size_t i = 0; i < retiredAt.size(); ++i) {
+         if (retiredAt[i] + maxFramesInFlight < loop.GetSubmittedFrameCount()) {
+            CHECK(!generations[i].IsLive);
+         }
+      }
+      size_t liveCount = 0;
+      for (const Generation& generation : generations) {
+         liveCount += generation.IsLive ? 1 : 0;
+      }
+      CHECK(liveCount <= 1 + static_cast<size_t>(maxFramesInFlight) * retirementsPerFrame);
+   }
+
+   loop.WaitIdle();
+   CHECK(freedCount == FrameCount * retirementsPerFrame);
+   CHECK(loop.GetQueue().GetPendingCount() == 0);
+}
+
+
+// Deleters run in the order they were pushed, and a deleter may push more (which wait for the next frame)
+void TestOrder() {
+   FrameLoop loop(2);
+   std::vector<int> order;
+   loop.GetQueue().Push([&order] { order.push_back(0); });
+   loop.GetQueue().Push([&loop, &order] {
+      order.push_back(1);
+      loop.GetQueue().Push([&order] { order.push_back(3); });
+   });
+   loop.GetQueue().Push([&order] { order.push_back(2); });
+
+   loop.BeginFrame();
+   loop.EndFrame();
+   loop.BeginFrame();
+   loop.EndFrame();
+   CHECK(order.empty());   // the frame submitted after the pushes has not completed yet
+
+   loop.BeginFrame();
+   CHECK((order == std::vector<int> {0, 1, 2}));
+   loop.EndFrame();
+   loop.BeginFrame();
+   loop.EndFrame();
+   loop.BeginFrame();
+   CHECK((order == std::vector<int> {0, 1, 2, 3}));
+}
+
+}
+
+
+int main() {
+   TestOrder();
+   for (const uint32_t maxFramesInFlight : {1u, 2u, 3u}) {
+      for (const uint32_t retirementsPerFrame : {1u, 2u, 3u}) {
+         TestRepeatedRetirement(maxFramesInFlight, retirementsPerFrame);
+      }
+   }
+   if (s_FailureCount > 0) {
+      std::fprintf(stderr, "%d check(s) failed\n", s_FailureCount);
+      return EXIT_FAILURE;
+   }
+   std::printf("All checks passed\n");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#include "FrameCommandBuffers.h"
+
+namespace Vulkan {
+
+FrameCommandBuffers::FrameCommandBuffers(vk::Device device, const uint32_t queueFamilyIndex, const uint32_t framesInFlight, JobSystem& jobSystem)
+: m_Device(device)
+, m_JobSystem(jobSystem)
+{
+   vk::CommandPoolCreateInfo ci = {
+      {vk::CommandPoolCreateFlagBits::eTransient}   /*flags*/,
+      queueFamilyIndex                             /*queueFamilyIndex*/
+   };
+
+   m_Frames.resize(framesInFlight);
+   for (auto& frame : m_Frames) {
+      frame.PrimaryPool = m_Device.createCommandPool(ci);
+      frame.PrimaryCommandBuffer = m_Device.allocateCommandBuffers({
+         frame.PrimaryPool                  /*commandPool*/,
+         vk::CommandBufferLevel::ePrimary   /*level*/,
+         1                                  /*commandBufferCount*/
+      }).front();
+
+      frame.SecondaryPools.resize(m_JobSystem.GetThreadCount());
+      for (auto& threadPool : frame.SecondaryPools) {
+         threadPool.Pool = m_Device.createCommandPool(ci);
+      }
+   }
+}
+
+
+FrameCommandBuffers::~FrameCommandBuffers() {
+   // destroying the pools frees their command buffers
+   for (auto& frame : m_Frames) {
+      for (auto& threadPool : frame.SecondaryPools) {
+         m_Device.destroy(threadPool.Pool);
+      }
+      m_Device.destroy(frame.PrimaryPool);
+   }
+}
+
+
+vk::CommandBuffer FrameCommandBuffers::BeginFrame(const uint32_t frameIndex) {
+   Frame& frame = m_Frames[frameIndex];
+   for (auto& threadPool : frame.SecondaryPools) {
+      m_Device.resetCommandPool(threadPool.Pool, {});
+      threadPool.UsedCount = 0;
+   }
+   m_Device.resetCommandPool(frame.PrimaryPool, {});
+
+   frame.PrimaryCommandBuffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+   return frame.PrimaryCommandBuffer;
+}
+
+
+std::vector<vk::CommandBuffer> FrameCommandBuffers::RecordSecondary(const uint32_t frameIndex, const vk::CommandBufferInheritanceInfo& inheritance, const uint32_t taskCount, const RecordFn& record) {
+   std::vector<vk::CommandBuffer> commandBuffers(taskCount);
+   vk::CommandBufferBeginInfo bi = {
+      vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue   /*flags*/,
+      &inheritance                                                                                           /*pInheritanceInfo*/
+   };
+   m_JobSystem.ParallelFor(0, taskCount, 1, [&] (const uint32_t begin, const uint32_t end) {
+      const uint32_t threadIndex = m_JobSystem.GetThreadIndex();
+      for (uint32_t task = begin; task < end; ++task) {
+         vk::CommandBuffer cmd = GetSecondaryCommandBuffer(frameIndex, threadIndex);
+         cmd.begin(bi);
+         record(cmd, task);
+         cmd.end();
+         commandBuffers[task] = cmd;
+      }
+   });
+   return commandBuffers;
+}
+
+
+vk::CommandBuffer FrameCommandBuffers::GetSecondaryCommandBuffer(const uint32_t frameIndex, const uint32_t threadIndex) {
+   // Only thread threadIndex ever touches this pool, so no locking needed
+   ThreadPool& threadPool = m_Frames[frameIndex].SecondaryPools[threadIndex];
+   if (threadPool.UsedCount == threadPool.CommandBuffers.size()) {
+      threadPool.CommandBuffers.push_back(m_Device.allocateCommandBuffers({
+         threadPool.Pool                      /*commandPool*/,
+         vk::CommandBufferLevel::eSecondary   /*level*/,
+         1                                    /*commandBufferCount*/
+      }).front());
+   }
+   return threadPool.CommandBuffers[threadPool.UsedCount++];
+}
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "JobSystem.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <functional>
+#include <vector>
+
+namespace Vulkan {
+
+// Command buffers that are recorded afresh every frame, as an alternative to pre-recording one per swap chain image.
+//
+// Each frame in flight has its own command pools: one for its primary command buffer, and one per recording thread for
+// secondary command buffers (a command pool may only be used by one thread at a time).  When a frame in flight comes
+// around again, all of its pools are reset in one go, which is much cheaper than resetting or freeing command buffers
+// individually.  Command buffers are allocated the first time they are needed and then reused.
+//
+// Secondary command buffers are recorded in parallel on the threads of a JobSystem (the calling thread included).
+class FrameCommandBuffers {
+public:
+   using RecordFn = std::function<void(vk::CommandBuffer cmd, const uint32_t taskIndex)>;
+
+   // jobSystem must outlive this object
+   FrameCommandBuffers(vk::Device device, const uint32_t queueFamilyIndex, const uint32_t framesInFlight, JobSystem& jobSystem);
+   FrameCommandBuffers(const FrameCommandBuffers&) = delete;
+   FrameCommandBuffers(FrameCommandBuffers&&) = delete;
+
+   FrameCommandBuffers& operator=(const FrameCommandBuffers&) = delete;
+   FrameCommandBuffers& operator=(FrameCommandBuffers&&) = delete;
+
+   ~FrameCommandBuffers();
+
+   // Reset all of frameIndex's command pools, and begin (one time submit) its primary command buffer.
+   // The previous submission of frameIndex's command buffers must have completed.
+   vk::CommandBuffer BeginFrame(const uint32_t frameIndex);
+
+   // Record taskCount secondary command buffers for use inside the render pass (and subpass) given by inheritance.
+   // record is called once for each task, concurrently from several threads, with a secondary command buffer that has
+   // already been begun (and is ended afterwards).  Buffers do not inherit any state from the primary, so each task must
+   // bind whatever it needs.
+   // Returns the command buffers in task order, ready for executeCommands() in a render pass that was begun with
+   // eSecondaryCommandBuffers.
+   std::vector<vk::CommandBuffer> RecordSecondary(const uint32_t frameIndex, const vk::CommandBufferInheritanceInfo& inheritance, const uint32_t taskCount, const RecordFn& record);
+
+   uint32_t GetThreadCount() const { return m_JobSystem.GetThreadCount(); }
+
+private:
+   struct ThreadPool {
+      vk::CommandPool Pool;
+      std::vector<vk::CommandBuffer> CommandBuffers;
+      uint32_t UsedCount = 0;
+   };
+
+   struct Frame {
+      vk::CommandPool PrimaryPool;
+      vk::CommandBuffer PrimaryCommandBuffer;
+      std::vector<ThreadPool> SecondaryPools;   // indexed by JobSystem thread index
+   };
+
+   vk::CommandBuffer GetSecondaryCommandBuffer(const uint32_t frameIndex, const uint32_t threadIndex);
+
+private:
+   vk::Device m_Device;
+   JobSystem& m_JobSystem;
+   std::vector<Frame> m_Frames;
+};
+
+}
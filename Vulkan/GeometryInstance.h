@@ -31,4 +31,11 @@ struct GeometryInstance {
 
 };
 
+
+// Instances [Begin, End) of an array of GeometryInstances, e.g. those to upload for a TLAS update
+struct GeometryInstanceRange {
+   uint32_t Begin = 0;
+   uint32_t End = 0;
+};
+
 }
@@ -1,11 +1,10 @@
 #include "Image.h"
 
-#include "Buffer.h"
-
 namespace Vulkan {
 
-Image::Image(vk::Device device, const vk::PhysicalDevice physicalDevice, const uint32_t width, const uint32_t height, const uint32_t mipLevels, vk::SampleCountFlagBits numSamples, const vk::Format format, const vk::ImageTiling tiling, const vk::ImageUsageFlags usage, const vk::MemoryPropertyFlags properties)
-: m_Device(device)
+Image::Image(MemoryAllocator& allocator, const uint32_t width, const uint32_t height, const uint32_t mipLevels, vk::SampleCountFlagBits numSamples, const vk::Format format, const vk::ImageTiling tiling, const vk::ImageUsageFlags usage, const vk::MemoryPropertyFlags properties)
+: m_Device(allocator.GetDevice())
+, m_Allocator(&allocator)
 {
    m_Image = m_Device.createImage({
       {}                               /*flags*/,
@@ -24,11 +23,8 @@ Image::Image(vk::Device device, const vk::PhysicalDevice physicalDevice, const u
    });
 
    vk::MemoryRequirements memRequirements = m_Device.getImageMemoryRequirements(m_Image);
-   m_Memory = m_Device.allocateMemory({
-      memRequirements.size                                        /*allocationSize*/,
-      Buffer::FindMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties)  /*memoryTypeIndex*/
-   });
-   m_Device.bindImageMemory(m_Image, m_Memory, 0);
+   m_Allocation = m_Allocator->Allocate(memRequirements, properties, tiling);
+   m_Device.bindImageMemory(m_Image, m_Allocation.m_Memory, m_Allocation.m_Offset);
 }
 
 
@@ -49,7 +45,7 @@ Image::~Image() {
          m_Device.destroy(m_ImageView);
          m_ImageView = nullptr;
       }
-      if(m_Memory) {
+      if(m_Allocation) {
          //
          // only destroy the image if it has some memory
          // i.e. we allocated the image, so we destroy it.
@@ -59,8 +55,7 @@ Image::~Image() {
             m_Device.destroy(m_Image);
             m_Image = nullptr;
          }
-         m_Device.freeMemory(m_Memory);
-         m_Memory = nullptr;
+         m_Allocator->Free(m_Allocation);
       }
    }
 }
@@ -69,10 +64,14 @@ Image::~Image() {
 Image& Image::operator=(Image&& that) {
    if (this != &that) {
       m_Device = that.m_Device;
+      m_Allocator = that.m_Allocator;
       m_Image = that.m_Image;
+      m_Allocation = that.m_Allocation;
       m_ImageView = that.m_ImageView;
       that.m_Device = nullptr;
+      that.m_Allocator = nullptr;
       that.m_Image = nullptr;
+      that.m_Allocation = {};
       that.m_ImageView = nullptr;
    }
    return *this;
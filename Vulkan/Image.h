@@ -1,5 +1,7 @@
 #pragma once
 
+#include "MemoryAllocator.h"
+
 #include <vulkan/vulkan.hpp>
 
 namespace Vulkan {
@@ -9,7 +11,7 @@ class Application;
 class Image {
 public:
 
-   Image(vk::Device device, const vk::PhysicalDevice physicalDevice, const uint32_t width, const uint32_t height, const uint32_t mipLevels, vk::SampleCountFlagBits numSamples, const vk::Format format, const vk::ImageTiling tiling, const vk::ImageUsageFlags usage, const vk::MemoryPropertyFlags properties);
+   Image(MemoryAllocator& allocator, const uint32_t width, const uint32_t height, const uint32_t mipLevels, vk::SampleCountFlagBits numSamples, const vk::Format format, const vk::ImageTiling tiling, const vk::ImageUsageFlags usage, const vk::MemoryPropertyFlags properties);
    Image(vk::Device device, const vk::Image& image);
    Image(const Image&) = delete;   // You cannot copy Vulkan::Image wrapper object
    Image(Image&& that);  // but you can move it (i.e. move the underlying vulkan resources to another Vulkan::Image wrapper)
@@ -22,7 +24,7 @@ public:
    Image(Application& app);
 
    vk::Image m_Image;
-   vk::DeviceMemory m_Memory;
+   MemoryAllocation m_Allocation;
    vk::ImageView m_ImageView;
 
    void CreateImageView(const vk::Format format, const vk::ImageAspectFlags imageAspect, const uint32_t mipLevels);
@@ -30,6 +32,7 @@ public:
 
 protected:
    vk::Device m_Device;
+   MemoryAllocator* m_Allocator = nullptr;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+namespace Vulkan {
+
+namespace {
+
+// Which JobSystem (if any) the current thread is a worker of, and its index in that system
+thread_local const JobSystem* t_JobSystem = nullptr;
+thread_local uint32_t t_ThreadIndex = 0;
+
+// Number of times an idle worker looks for work before going to sleep
+constexpr uint32_t IdleSpinCount = 64;
+
+}
+
+
+Task::Task(std::function<void()> fn)
+: m_Fn(std::move(fn))
+{}
+
+
+JobSystem::JobSystem(const uint32_t threadCount) {
+   const uint32_t count = (threadCount > 0) ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+   m_Queues.reserve(count);
+   for (uint32_t i = 0; i < count; ++i) {
+      m_Queues.emplace_back(std::make_unique<WorkQueue>());
+   }
+   m_Workers.reserve(count - 1);
+   for (uint32_t threadIndex = 1; threadIndex < count; ++threadIndex) {
+      m_Workers.emplace_back(&JobSystem::WorkerMain, this, threadIndex);
+   }
+}
+
+
+JobSystem::~JobSystem() {
+   m_IsStopping = true;
+   {
+      std::lock_guard lock(m_SleepMutex);
+   }
+   m_WakeCondition.notify_all();
+   for (auto& worker : m_Workers) {
+      worker.join();
+   }
+}
+
+
+TaskHandle JobSystem::Spawn(std::function<void()> fn) {
+   return Spawn(std::move(fn), {});
+}
+
+
+TaskHandle JobSystem::Spawn(std::function<void()> fn, const std::vector<TaskHandle>& dependencies) {
+   TaskHandle task = std::make_shared<Task>(std::move(fn));
+   for (const auto& dependency : dependencies) {
+      std::lock_guard lock(dependency->m_Mutex);
+      if (!dependency->m_IsComplete.load(std::memory_order_relaxed)) {
+         ++task->m_UnfinishedDependencyCount;
+         dependency->m_Continuations.push_back(task);
+      }
+   }
+
+   // drop the count that was held while the task was being spawned.  If the dependencies have all completed
+   // (or there were none) then the task is ready to go.
+   if (--task->m_UnfinishedDependencyCount == 0) {
+      Schedule(task);
+   }
+   return task;
+}
+
+
+TaskHandle JobSystem::Then(const TaskHandle& task, std::function<void()> fn) {
+   return Spawn(std::move(fn), {task});
+}
+
+
+void JobSystem::Wait(const TaskHandle& task) {
+   const uint32_t threadIndex = GetThreadIndex();
+   while (!task->IsComplete()) {
+      if (!TryRunTask(threadIndex)) {
+         std::this_thread::yield();
+      }
+   }
+   if (task->m_Exception) {
+      std::rethrow_exception(task->m_Exception);
+   }
+}
+
+
+void JobSystem::Wait(const std::vector<TaskHandle>& tasks) {
+   // wait for all of them, even if one has thrown, and then rethrow the first exception
+   std::exception_ptr exception;
+   for (const auto& task : tasks) {
+      try {
+         Wait(task);
+      } catch (...) {
+         if (!exception) {
+            exception = std::current_exception();
+         }
+      }
+   }
+   if (exception) {
+      std::rethrow_exception(exception);
+   }
+}
+
+
+void JobSystem::ParallelFor(const uint32_t begin, const uint32_t end, const uint32_t grainSize, const std::function<void(uint32_t rangeBegin, uint32_t rangeEnd)>& fn) {
+   if (begin >= end) {
+      return;
+   }
+   const uint32_t count = end - begin;
+   const uint32_t threadCount = GetThreadCount();
+   const uint32_t grain = (grainSize > 0) ? grainSize : std::max(1u, count / (4 * threadCount));
+   const uint32_t rangeCount = static_cast<uint32_t>((uint64_t(count) + grain - 1) / grain);
+
+   // Rather than one task per range, each participating thread runs a loop that claims the next unprocessed range.
+   // This keeps the number of tasks spawned down to (at most) one per thread, while still balancing the load.
+   std::atomic<uint32_t> nextRange {0};
+   auto processRanges = [&] {
+      try {
+         for (uint32_t range = nextRange++; range < rangeCount; range = nextRange++) {
+            const uint32_t rangeBegin = static_cast<uint32_t>(begin + uint64_t(range) * grain);
+            const uint32_t rangeEnd = static_cast<uint32_t>(std::min<uint64_t>(end, uint64_t(rangeBegin) + grain));
+            fn(rangeBegin, rangeEnd);
+         }
+      } catch (...) {
+         nextRange = rangeCount;   // abandon remaining ranges
+         throw;
+      }
+   };
+
+   std::vector<TaskHandle> helpers;
+   const uint32_t helperCount = std::min(threadCount, rangeCount) - 1;
+   helpers.reserve(helperCount);
+   for (uint32_t i = 0; i < helperCount; ++i) {
+      helpers.push_back(Spawn(processRanges));
+   }
+
+   // the helpers reference locals, so they must be waited for even if this thread throws
+   std::exception_ptr exception;
+   try {
+      processRanges();
+   } catch (...) {
+      exception = std::current_exception();
+   }
+   try {
+      Wait(helpers);
+   } catch (...) {
+      if (!exception) {
+         exception = std::current_exception();
+      }
+   }
+   if (exception) {
+      std::rethrow_exception(exception);
+   }
+}
+
+
+uint32_t JobSystem::GetThreadIndex() const {
+   return (t_JobSystem == this) ? t_ThreadIndex : 0;
+}
+
+
+void JobSystem::Schedule(TaskHandle task) {
+   // count first, so that m_QueuedTaskCount is never less than the number of tasks actually queued
+   ++m_QueuedTaskCount;
+   WorkQueue& queue = *m_Queues[GetThreadIndex()];
+   {
+      std::lock_guard lock(queue.Mutex);
+      queue.Tasks.push_back(std::move(task));
+   }
+
+   // A worker that is about to sleep increments m_SleepingCount before it checks m_QueuedTaskCount, so either it sees
+   // the task queued above, or we see it sleeping here (and taking the lock ensures it is actually waiting before we notify)
+   if (m_SleepingCount > 0) {
+      {
+         std::lock_guard lock(m_SleepMutex);
+      }
+      m_WakeCondition.notify_one();
+   }
+}
+
+
+bool JobSystem::TryRunTask(const uint32_t threadIndex) {
+   TaskHandle task = Pop(threadIndex);
+   if (!task) {
+      task = Steal(threadIndex);
+   }
+   if (!task) {
+      return false;
+   }
+   Run(task);
+   return true;
+}
+
+
+TaskHandle JobSystem::Pop(const uint32_t threadIndex) {
+   WorkQueue& queue = *m_Queues[threadIndex];
+   std::lock_guard lock(queue.Mutex);
+   if (queue.Tasks.empty()) {
+      return nullptr;
+   }
+   TaskHandle task = std::move(queue.Tasks.back());
+   queue.Tasks.pop_back();
+   --m_QueuedTaskCount;
+   return task;
+}
+
+
+TaskHandle JobSystem::Steal(const uint32_t threadIndex) {
+   const uint32_t threadCount = GetThreadCount();
+   for (uint32_t i = 1; i < threadCount; ++i) {
+      WorkQueue& queue = *m_Queues[(threadIndex + i) % threadCount];
+      std::lock_guard lock(queue.Mutex);
+      if (!queue.Tasks.empty()) {
+         TaskHandle task = std::move(queue.Tasks.front());
+         queue.Tasks.pop_front();
+         --m_QueuedTaskCount;
+         return task;
+      }
+   }
+   return nullptr;
+}
+
+
+void JobSystem::Run(const TaskHandle& task) {
+   try {
+      task->m_Fn();
+   } catch (...) {
+      task->m_Exception = std::current_exception();
+   }
+   task->m_Fn = nullptr;   // release anything the task captured
+
+   std::vector<TaskHandle> continuations;
+   {
+      std::lock_guard lock(task->m_Mutex);
+      continuations.swap(task->m_Continuations);
+      task->m_IsComplete.store(true, std::memory_order_release);
+   }
+   for (auto& continuation : continuations) {
+      if (--continuation->m_UnfinishedDependencyCount == 0) {
+         Schedule(std::move(continuation));
+      }
+   }
+}
+
+
+void JobSystem::WorkerMain(const uint32_t threadIndex) {
+   t_JobSystem = this;
+   t_ThreadIndex = threadIndex;
+
+   uint32_t idleCount = 0;
+   while (!m_IsStopping) {
+      if (TryRunTask(threadIndex)) {
+         idleCount = 0;
+         continue;
+      }
+      if (++idleCount < IdleSpinCount) {
+         std::this_thread::yield();
+         continue;
+      }
+      std::unique_lock lock(m_SleepMutex);
+      ++m_SleepingCount;
+      m_WakeCondition.wait(lock, [this] { return m_IsStopping || (m_QueuedTaskCount > 0); });
+      --m_SleepingCount;
+      idleCount = 0;
+   }
+}
+
+}
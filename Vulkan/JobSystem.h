@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Vulkan {
+
+class JobSystem;
+
+// A unit of work for the JobSystem.  Tasks are referred to by TaskHandle, which can be waited on, or passed as a
+// dependency when spawning other tasks.
+class Task {
+public:
+   explicit Task(std::function<void()> fn);
+   Task(const Task&) = delete;
+   Task& operator=(const Task&) = delete;
+
+   bool IsComplete() const { return m_IsComplete.load(std::memory_order_acquire); }
+
+private:
+   friend class JobSystem;
+
+   std::function<void()> m_Fn;
+   std::atomic<uint32_t> m_UnfinishedDependencyCount {1};   // +1 while the task is being spawned
+   std::atomic<bool> m_IsComplete {false};
+   std::exception_ptr m_Exception;
+   std::mutex m_Mutex;                                     // guards m_Continuations, and the transition to complete
+   std::vector<std::shared_ptr<Task>> m_Continuations;     // tasks that depend on this one
+};
+
+using TaskHandle = std::shared_ptr<Task>;
+
+
+// Work-stealing thread pool.
+//
+// Each thread has its own deque of ready tasks.  A thread pushes and pops at the back of its own deque (so it works on
+// the most recently spawned, cache-warm, task first), and when that is empty it steals from the front of another
+// thread's deque.  Idle workers spin briefly and then sleep until more tasks are spawned.
+//
+// Thread 0 is whichever thread is not a worker (normally the main thread).  It does not run tasks on its own, but
+// Wait() and ParallelFor() execute tasks while they are waiting rather than blocking.
+//
+// A task runs once all of its dependencies have completed.  If a task throws, the exception is rethrown by Wait().
+// All tasks must have completed before the JobSystem is destroyed.
+class JobSystem {
+public:
+   // threadCount is the total number of threads, including thread 0.  0 => all cores
+   explicit JobSystem(const uint32_t threadCount = 0);
+   JobSystem(const JobSystem&) = delete;
+   JobSystem(JobSystem&&) = delete;
+
+   JobSystem& operator=(const JobSystem&) = delete;
+   JobSystem& operator=(JobSystem&&) = delete;
+
+   ~JobSystem();
+
+   // Run fn as soon as a thread is available
+   TaskHandle Spawn(std::function<void()> fn);
+
+   // Run fn once all of dependencies have completed
+   TaskHandle Spawn(std::function<void()> fn, const std::vector<TaskHandle>& dependencies);
+
+   // Run fn once task has completed
+   TaskHandle Then(const TaskHandle& task, std::function<void()> fn);
+
+   // Wait for task (or tasks) to complete, executing other tasks in the meantime.
+   // Rethrows the exception if a task threw one.
+   void Wait(const TaskHandle& task);
+   void Wait(const std::vector<TaskHandle>& tasks);
+
+   // Call fn(rangeBegin, rangeEnd) over [begin, end) split into ranges of (at most) grainSize, spread across all threads.
+   // grainSize 0 => pick one that gives each thread a few ranges.
+   // Returns when all ranges have been processed.  fn may be called concurrently, and may itself spawn and wait on tasks.
+   void ParallelFor(const uint32_t begin, const uint32_t end, const uint32_t grainSize, const std::function<void(uint32_t rangeBegin, uint32_t rangeEnd)>& fn);
+
+   uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Queues.size()); }
+
+   // Index (in [0, GetThreadCount())) of the calling thread.  0 for any thread that is not one of this system's workers.
+   // Use to index per-thread data (e.g. command pools) from inside a task.
+   uint32_t GetThreadIndex() const;
+
+private:
+   struct WorkQueue {
+      std::mutex Mutex;
+      std::deque<TaskHandle> Tasks;
+   };
+
+   void Schedule(TaskHandle task);
+   bool TryRunTask(const uint32_t threadIndex);
+   TaskHandle Pop(const uint32_t threadIndex);
+   TaskHandle Steal(const uint32_t threadIndex);
+   void Run(const TaskHandle& task);
+   void WorkerMain(const uint32_t threadIndex);
+
+private:
+   std::vector<std::unique_ptr<WorkQueue>> m_Queues;   // indexed by thread
+   std::vector<std::thread> m_Workers;                 // m_Workers[i] is thread i + 1
+
+   std::atomic<uint32_t> m_QueuedTaskCount {0};
+   std::atomic<uint32_t> m_SleepingCount {0};
+   std::atomic<bool> m_IsStopping {false};
+   std::mutex m_SleepMutex;
+   std::condition_variable m_WakeCondition;
+};
+
+}
@@ -0,0 +1,99 @@
+#include "JobSystemBenchmark.h"
+
+#include "JobSystem.h"
+#include "Log.h"
+#include "Utility.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace Vulkan {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void BenchmarkSpawn(const uint32_t threadCount) {
+   constexpr uint32_t TaskCount = 100000;
+   JobSystem jobSystem(threadCount);
+   std::atomic<uint32_t> counter {0};
+
+   // independent empty tasks, all spawned from this thread and then waited on
+   std::vector<TaskHandle> tasks;
+   tasks.reserve(TaskCount);
+   Clock::time_point start = Clock::now();
+   for (uint32_t i = 0; i < TaskCount; ++i) {
+      tasks.push_back(jobSystem.Spawn([&counter] { ++counter; }));
+   }
+   const double spawnMilliseconds = MillisecondsSince(start);
+   jobSystem.Wait(tasks);
+   const double totalMilliseconds = MillisecondsSince(start);
+   tasks.clear();
+
+   // a chain of continuations, each of which can only run once the previous one has completed
+   start = Clock::now();
+   TaskHandle task = jobSystem.Spawn([&counter] { ++counter; });
+   for (uint32_t i = 1; i < TaskCount; ++i) {
+      task = jobSystem.Then(task, [&counter] { ++counter; });
+   }
+   jobSystem.Wait(task);
+   const double chainMilliseconds = MillisecondsSince(start);
+
+   if (counter != 2 * TaskCount) {
+      CORE_LOG_ERROR("JobSystem benchmark: expected {0} tasks to have run, but {1} did", 2 * TaskCount, counter.load());
+   }
+   CORE_LOG_INFO("JobSystem, {0} thread(s): spawn {1:.0f}ns/task, spawn and run {2:.0f}ns/task, continuation chain {3:.0f}ns/task", threadCount, 1e6 * spawnMilliseconds / TaskCount, 1e6 * totalMilliseconds / TaskCount, 1e6 * chainMilliseconds / TaskCount);
+}
+
+
+double BenchmarkParallelFor(const uint32_t threadCount, std::vector<float>& data) {
+   constexpr uint32_t RepeatCount = 5;
+   JobSystem jobSystem(threadCount);
+
+   // some compute bound work per element
+   auto process = [&data] (const uint32_t begin, const uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+         float x = static_cast<float>(i);
+         for (uint32_t j = 0; j < 32; ++j) {
+            x = std::sqrt(x * 1.0001f + 1.0f);
+         }
+         data[i] = x;
+      }
+   };
+
+   // best of several runs (the first of which also warms up the workers)
+   double bestMilliseconds = std::numeric_limits<double>::max();
+   for (uint32_t repeat = 0; repeat <= RepeatCount; ++repeat) {
+      const Clock::time_point start = Clock::now();
+      jobSystem.ParallelFor(0, static_cast<uint32_t>(data.size()), 0, process);
+      bestMilliseconds = std::min(bestMilliseconds, MillisecondsSince(start));
+   }
+   return bestMilliseconds;
+}
+
+}
+
+
+void RunJobSystemBenchmarks() {
+   const uint32_t maxThreadCount = std::max(1u, std::thread::hardware_concurrency());
+
+   BenchmarkSpawn(1);
+   if (maxThreadCount > 1) {
+      BenchmarkSpawn(maxThreadCount);
+   }
+
+   std::vector<float> data(4 * 1024 * 1024);
+   double singleThreadMilliseconds = 0.0;
+   for (uint32_t threadCount = 1; threadCount <= maxThreadCount; ++threadCount) {
+      const double milliseconds = BenchmarkParallelFor(threadCount, data);
+      if (threadCount == 1) {
+         singleThreadMilliseconds = milliseconds;
+      }
+      const double speedup = singleThreadMilliseconds / milliseconds;
+      CORE_LOG_INFO("JobSystem ParallelFor over {0} elements, {1} thread(s): {2:.3f}ms, {3:.2f}x speedup ({4:.0f}% efficiency)", data.size(), threadCount, milliseconds, speedup, 100.0 * speedup / threadCount);
+   }
+}
+
+}
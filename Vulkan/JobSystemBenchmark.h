@@ -0,0 +1,9 @@
+#pragma once
+
+namespace Vulkan {
+
+// Micro-benchmarks for JobSystem: task spawn overhead, and parallel-for scaling from one thread up to all cores.
+// Results are logged.
+void RunJobSystemBenchmarks();
+
+}
@@ -0,0 +1,92 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Vulkan {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& fileName) {
+   m_File = ::CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+   if (m_File == INVALID_HANDLE_VALUE) {
+      m_File = nullptr;
+      throw std::runtime_error("failed to open file '" + fileName.string() + "'");
+   }
+   LARGE_INTEGER size;
+   if (!::GetFileSizeEx(m_File, &size)) {
+      ::CloseHandle(m_File);
+      throw std::runtime_error("failed to get size of file '" + fileName.string() + "'");
+   }
+   m_Size = static_cast<size_t>(size.QuadPart);
+   if (m_Size > 0) {
+      m_Mapping = ::CreateFileMappingW(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      m_pData = m_Mapping ? ::MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+      if (!m_pData) {
+         if (m_Mapping) {
+            ::CloseHandle(m_Mapping);
+         }
+         ::CloseHandle(m_File);
+         throw std::runtime_error("failed to map file '" + fileName.string() + "'");
+      }
+   }
+}
+
+
+MappedFile::~MappedFile() {
+   if (m_pData) {
+      ::UnmapViewOfFile(m_pData);
+   }
+   if (m_Mapping) {
+      ::CloseHandle(m_Mapping);
+   }
+   if (m_File) {
+      ::CloseHandle(m_File);
+   }
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& fileName) {
+   const int file = ::open(fileName.c_str(), O_RDONLY);
+   if (file < 0) {
+      throw std::runtime_error("failed to open file '" + fileName.string() + "'");
+   }
+   struct stat status;
+   if (::fstat(file, &status) != 0) {
+      ::close(file);
+      throw std::runtime_error("failed to get size of file '" + fileName.string() + "'");
+   }
+   m_Size = static_cast<size_t>(status.st_size);
+   if (m_Size > 0) {
+      void* pData = ::mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0);
+      if (pData == MAP_FAILED) {
+         ::close(file);
+         throw std::runtime_error("failed to map file '" + fileName.string() + "'");
+      }
+      m_pData = pData;
+   }
+   // the mapping keeps its own reference to the file
+   ::close(file);
+}
+
+
+MappedFile::~MappedFile() {
+   if (m_pData) {
+      ::munmap(const_cast<void*>(m_pData), m_Size);
+   }
+}
+
+#endif
+
+}
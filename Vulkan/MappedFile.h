@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+namespace Vulkan {
+
+// Read only memory mapping of a whole file.
+// The mapping starts on a page boundary, so data at suitably aligned offsets within the file can be read in place.
+class MappedFile {
+public:
+   // Throws if the file cannot be opened or mapped
+   MappedFile(const std::filesystem::path& fileName);
+   MappedFile(const MappedFile&) = delete;
+   MappedFile(MappedFile&&) = delete;
+
+   MappedFile& operator=(const MappedFile&) = delete;
+   MappedFile& operator=(MappedFile&&) = delete;
+
+   ~MappedFile();
+
+   // null if the file is empty
+   const void* GetData() const { return m_pData; }
+   size_t GetSize() const { return m_Size; }
+
+private:
+   const void* m_pData = nullptr;
+   size_t m_Size = 0;
+#ifdef _WIN32
+   void* m_File = nullptr;
+   void* m_Mapping = nullptr;
+#endif
+};
+
+}
@@ -0,0 +1,430 @@
+#include "MemoryAllocator.h"
+
+#include "Log.h"
+#include "Utility.h"
+
+#include <algorithm>
+#include <map>
+
+namespace Vulkan {
+
+namespace {
+
+// true if the last byte of resource A and the first byte of resource B fall on the same "page" (of size pageSize)
+bool IsOnSamePage(const vk::DeviceSize offsetA, const vk::DeviceSize sizeA, const vk::DeviceSize offsetB, const vk::DeviceSize pageSize) {
+   const vk::DeviceSize endPageA = (offsetA + sizeA - 1) & ~(pageSize - 1);
+   const vk::DeviceSize startPageB = offsetB & ~(pageSize - 1);
+   return endPageA == startPageB;
+}
+
+}
+
+
+float MemoryStats::Fragmentation() const {
+   const vk::DeviceSize bytesFree = BytesAllocated - BytesUsed;
+   if (bytesFree == 0) {
+      return 0.0f;
+   }
+   return 1.0f - static_cast<float>(LargestFreeRange) / static_cast<float>(bytesFree);
+}
+
+
+class MemoryBlock {
+public:
+   MemoryBlock(vk::DeviceMemory memory, const uint32_t memoryTypeIndex, const vk::DeviceSize size, const AllocationStrategy strategy, const bool isDedicated)
+   : m_Memory(memory)
+   , m_MemoryTypeIndex(memoryTypeIndex)
+   , m_Size(size)
+   , m_Strategy(strategy)
+   , m_IsDedicated(isDedicated)
+   {
+      m_Ranges.emplace(0, Range {size, true, vk::ImageTiling::eLinear});
+   }
+
+   // Returns true (and sets offset) if there is room for the requested allocation in this block
+   bool Allocate(const vk::DeviceSize size, const vk::DeviceSize alignment, const vk::ImageTiling tiling, const vk::DeviceSize granularity, vk::DeviceSize& offset) {
+      if (m_Strategy == AllocationStrategy::eLinear) {
+         return AllocateLinear(size, alignment, tiling, granularity, offset);
+      }
+      return AllocateFreeList(size, alignment, tiling, granularity, offset);
+   }
+
+   void Free(const vk::DeviceSize offset, const vk::DeviceSize size) {
+      CORE_ASSERT(m_AllocationCount > 0, "MemoryBlock::Free() called on an empty block!");
+      --m_AllocationCount;
+      m_BytesUsed -= size;
+      if (m_Strategy == AllocationStrategy::eLinear) {
+         if (m_AllocationCount == 0) {
+            m_Head = 0;
+         }
+         return;
+      }
+
+      auto it = m_Ranges.find(offset);
+      CORE_ASSERT((it != m_Ranges.end()) && !it->second.IsFree, "MemoryBlock::Free() called with an offset that was not allocated from this block!");
+      it->second.IsFree = true;
+
+      // coalesce with following range
+      auto next = std::next(it);
+      if ((next != m_Ranges.end()) && next->second.IsFree) {
+         it->second.Size += next->second.Size;
+         m_Ranges.erase(next);
+      }
+
+      // coalesce with preceding range
+      if (it != m_Ranges.begin()) {
+         auto prev = std::prev(it);
+         if (prev->second.IsFree) {
+            prev->second.Size += it->second.Size;
+            m_Ranges.erase(it);
+         }
+      }
+   }
+
+   bool IsEmpty() const { return m_AllocationCount == 0; }
+
+   void AccumulateStats(MemoryStats& stats) const {
+      ++stats.BlockCount;
+      stats.AllocationCount += m_AllocationCount;
+      stats.BytesAllocated += m_Size;
+      stats.BytesUsed += m_BytesUsed;
+      if (m_Strategy == AllocationStrategy::eLinear) {
+         // space behind the head is not reusable until the block is reset, so only the tail counts as free
+         if (m_Head < m_Size) {
+            ++stats.FreeRangeCount;
+            stats.LargestFreeRange = std::max(stats.LargestFreeRange, m_Size - m_Head);
+         }
+         return;
+      }
+      for (const auto& [offset, range] : m_Ranges) {
+         if (range.IsFree) {
+            ++stats.FreeRangeCount;
+            stats.LargestFreeRange = std::max(stats.LargestFreeRange, range.Size);
+         }
+      }
+   }
+
+   vk::DeviceMemory m_Memory;
+   uint32_t m_MemoryTypeIndex;
+   vk::DeviceSize m_Size;
+   AllocationStrategy m_Strategy;
+   bool m_IsDedicated;
+   void* m_pMapped = nullptr;
+
+private:
+   bool AllocateLinear(const vk::DeviceSize size, const vk::DeviceSize alignment, const vk::ImageTiling tiling, const vk::DeviceSize granularity, vk::DeviceSize& offset) {
+      vk::DeviceSize start = AlignUp(m_Head, alignment);
+      if ((m_AllocationCount > 0) && (granularity > 1) && (m_LastTiling != tiling) && IsOnSamePage(0, m_Head, start, granularity)) {
+         start = AlignUp(start, granularity);
+      }
+      if (start + size > m_Size) {
+         return false;
+      }
+      offset = start;
+      m_Head = start + size;
+      m_LastTiling = tiling;
+      ++m_AllocationCount;
+      m_BytesUsed += size;
+      return true;
+   }
+
+
+   bool AllocateFreeList(const vk::DeviceSize size, const vk::DeviceSize alignment, const vk::ImageTiling tiling, const vk::DeviceSize granularity, vk::DeviceSize& offset) {
+      // best fit: smallest free range that can hold the allocation
+      auto best = m_Ranges.end();
+      vk::DeviceSize bestStart = 0;
+      for (auto it = m_Ranges.begin(); it != m_Ranges.end(); ++it) {
+         const vk::DeviceSize rangeOffset = it->first;
+         const Range& range = it->second;
+         if (!range.IsFree || (range.Size < size)) {
+            continue;
+         }
+         if ((best != m_Ranges.end()) && (range.Size >= best->second.Size)) {
+            continue;
+         }
+
+         vk::DeviceSize start = AlignUp(rangeOffset, alignment);
+
+         // neighbouring ranges are never both free (they get coalesced), so if there is a previous range it is in use
+         if ((granularity > 1) && (it != m_Ranges.begin())) {
+            const auto prev = std::prev(it);
+            if ((prev->second.Tiling != tiling) && IsOnSamePage(prev->first, prev->second.Size, start, granularity)) {
+               start = AlignUp(start, granularity);
+            }
+         }
+
+         const vk::DeviceSize end = start + size;
+         if (end > rangeOffset + range.Size) {
+            continue;
+         }
+
+         if (granularity > 1) {
+            const auto next = std::next(it);
+            if ((next != m_Ranges.end()) && (next->second.Tiling != tiling) && IsOnSamePage(start, size, next->first, granularity)) {
+               continue;
+            }
+         }
+
+         best = it;
+         bestStart = start;
+      }
+
+      if (best == m_Ranges.end()) {
+         return false;
+      }
+
+      // split the free range into [free padding] [allocation] [free remainder]
+      const vk::DeviceSize rangeOffset = best->first;
+      const vk::DeviceSize rangeEnd = rangeOffset + best->second.Size;
+      m_Ranges.erase(best);
+      if (bestStart > rangeOffset) {
+         m_Ranges.emplace(rangeOffset, Range {bestStart - rangeOffset, true, vk::ImageTiling::eLinear});
+      }
+      m_Ranges.emplace(bestStart, Range {size, false, tiling});
+      if (bestStart + size < rangeEnd) {
+         m_Ranges.emplace(bestStart + size, Range {rangeEnd - (bestStart + size), true, vk::ImageTiling::eLinear});
+      }
+
+      offset = bestStart;
+      ++m_AllocationCount;
+      m_BytesUsed += size;
+      return true;
+   }
+
+private:
+   struct Range {
+      vk::DeviceSize Size;
+      bool IsFree;
+      vk::ImageTiling Tiling;
+   };
+
+   std::map<vk::DeviceSize, Range> m_Ranges; // keyed by offset. (free list strategy only)
+   vk::DeviceSize m_Head = 0;                // next free offset (linear strategy only)
+   vk::ImageTiling m_LastTiling = vk::ImageTiling::eLinear;
+   uint32_t m_AllocationCount = 0;
+   vk::DeviceSize m_BytesUsed = 0;
+};
+
+
+MemoryAllocator::MemoryAllocator(vk::Device device, const vk::PhysicalDevice physicalDevice, const vk::DeviceSize preferredBlockSize)
+: MemoryAllocator(
+   physicalDevice.getMemoryProperties(),
+   physicalDevice.getProperties().limits.bufferImageGranularity,
+   [device] (const uint32_t memoryTypeIndex, const vk::DeviceSize size) {
+      return device.allocateMemory({
+         size               /*allocationSize*/,
+         memoryTypeIndex    /*memoryTypeIndex*/
+      });
+   },
+   [device] (vk::DeviceMemory memory) {
+      device.freeMemory(memory);   // implicitly unmaps
+   },
+   [device] (vk::DeviceMemory memory) {
+      return device.mapMemory(memory, 0, VK_WHOLE_SIZE);
+   },
+   preferredBlockSize
+)
+{
+   m_Device = device;
+   m_NonCoherentAtomSize = physicalDevice.getProperties().limits.nonCoherentAtomSize;
+}
+
+
+MemoryAllocator::MemoryAllocator(const vk::PhysicalDeviceMemoryProperties& memoryProperties, const vk::DeviceSize bufferImageGranularity, AllocateDeviceMemoryFn allocateFn, FreeDeviceMemoryFn freeFn, MapDeviceMemoryFn mapFn, const vk::DeviceSize preferredBlockSize)
+: m_MemoryProperties(memoryProperties)
+, m_BufferImageGranularity(bufferImageGranularity)
+, m_PreferredBlockSize(preferredBlockSize)
+, m_AllocateFn(std::move(allocateFn))
+, m_FreeFn(std::move(freeFn))
+, m_MapFn(std::move(mapFn))
+, m_Blocks(memoryProperties.memoryTypeCount)
+{}
+
+
+MemoryAllocator::~MemoryAllocator() {
+   MemoryStats stats = GetStats();
+   if (stats.AllocationCount > 0) {
+      CORE_LOG_WARN("MemoryAllocator destroyed with {0} allocation(s) ({1} bytes) still live!", stats.AllocationCount, stats.BytesUsed);
+   }
+   for (auto& blocks : m_Blocks) {
+      for (auto& block : blocks) {
+         m_FreeFn(block->m_Memory);
+      }
+   }
+   m_Blocks.clear();
+}
+
+
+MemoryAllocation MemoryAllocator::Allocate(const vk::MemoryRequirements& requirements, const vk::MemoryPropertyFlags properties, const vk::ImageTiling tiling, const AllocationStrategy strategy) {
+   const uint32_t memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, properties);
+   const vk::DeviceSize blockSize = GetBlockSize(memoryTypeIndex);
+
+   // Flushes of non-coherent memory must be in multiples of nonCoherentAtomSize.  Pad such allocations out
+   // so that flushing an allocation never touches its neighbours.
+   vk::DeviceSize size = requirements.size;
+   vk::DeviceSize alignment = requirements.alignment;
+   if (!IsHostCoherent(memoryTypeIndex) && IsHostVisible(memoryTypeIndex)) {
+      size = AlignUp(size, m_NonCoherentAtomSize);
+      alignment = std::max(alignment, m_NonCoherentAtomSize);
+   }
+
+   std::lock_guard lock(m_Mutex);
+
+   MemoryAllocation allocation;
+   allocation.m_Size = size;
+   allocation.m_MemoryTypeIndex = memoryTypeIndex;
+
+   const auto bindToBlock = [&allocation] (MemoryBlock& block) {
+      allocation.m_Memory = block.m_Memory;
+      allocation.m_Block = &block;
+      if (block.m_pMapped) {
+         allocation.m_pMapped = static_cast<char*>(block.m_pMapped) + allocation.m_Offset;
+      }
+      return allocation;
+   };
+
+   // Big allocations get a block to themselves.  Sub-allocating them would just waste the rest of the block.
+   if (size > blockSize / 2) {
+      MemoryBlock& block = CreateBlock(memoryTypeIndex, size, AllocationStrategy::eFreeList, /*isDedicated=*/true);
+      block.Allocate(size, alignment, tiling, m_BufferImageGranularity, allocation.m_Offset);
+      return bindToBlock(block);
+   }
+
+   for (auto& block : m_Blocks[memoryTypeIndex]) {
+      if (!block->m_IsDedicated && (block->m_Strategy == strategy) && block->Allocate(size, alignment, tiling, m_BufferImageGranularity, allocation.m_Offset)) {
+         return bindToBlock(*block);
+      }
+   }
+
+   MemoryBlock& block = CreateBlock(memoryTypeIndex, blockSize, strategy, /*isDedicated=*/false);
+   if (!block.Allocate(size, alignment, tiling, m_BufferImageGranularity, allocation.m_Offset)) {
+      throw std::runtime_error("MemoryAllocator: failed to sub-allocate from new memory block!");
+   }
+   return bindToBlock(block);
+}
+
+
+void MemoryAllocator::Flush(const MemoryAllocation& allocation, const vk::DeviceSize offset, const vk::DeviceSize size) {
+   if (!allocation || !m_Device || IsHostCoherent(allocation.m_MemoryTypeIndex)) {
+      return;
+   }
+   // allocation offset and size are already multiples of the atom size (see Allocate())
+   const vk::DeviceSize begin = offset & ~(m_NonCoherentAtomSize - 1);
+   const vk::DeviceSize end = std::min(AlignUp(offset + size, m_NonCoherentAtomSize), allocation.m_Size);
+   m_Device.flushMappedMemoryRanges(vk::MappedMemoryRange {
+      allocation.m_Memory                   /*memory*/,
+      allocation.m_Offset + begin           /*offset*/,
+      end - begin                           /*size*/
+   });
+}
+
+
+void MemoryAllocator::Free(MemoryAllocation& allocation) {
+   if (!allocation) {
+      return;
+   }
+
+   std::lock_guard lock(m_Mutex);
+
+   MemoryBlock* pBlock = allocation.m_Block;
+   pBlock->Free(allocation.m_Offset, allocation.m_Size);
+
+   if (pBlock->IsEmpty()) {
+      // Release empty blocks, but keep one spare (per memory type and strategy) to avoid thrashing vkAllocateMemory
+      // when resources are repeatedly created and destroyed.
+      auto& blocks = m_Blocks[pBlock->m_MemoryTypeIndex];
+      bool release = pBlock->m_IsDedicated;
+      if (!release) {
+         for (const auto& block : blocks) {
+            if ((block.get() != pBlock) && !block->m_IsDedicated && (block->m_Strategy == pBlock->m_Strategy) && block->IsEmpty()) {
+               release = true;
+               break;
+            }
+         }
+      }
+      if (release) {
+         m_FreeFn(pBlock->m_Memory);
+         blocks.erase(std::find_if(blocks.begin(), blocks.end(), [pBlock] (const auto& block) { return block.get() == pBlock; }));
+      }
+   }
+
+   allocation = {};
+}
+
+
+MemoryStats MemoryAllocator::GetStats() const {
+   std::lock_guard lock(m_Mutex);
+   MemoryStats stats;
+   for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; ++i) {
+      AccumulateStats(i, stats);
+   }
+   return stats;
+}
+
+
+MemoryStats MemoryAllocator::GetStats(const uint32_t memoryTypeIndex) const {
+   std::lock_guard lock(m_Mutex);
+   MemoryStats stats;
+   AccumulateStats(memoryTypeIndex, stats);
+   return stats;
+}
+
+
+void MemoryAllocator::LogStats() const {
+   for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; ++i) {
+      MemoryStats stats = GetStats(i);
+      if (stats.BlockCount > 0) {
+         CORE_LOG_INFO("Memory type {0} ({1}): {2} block(s), {3} allocation(s), {4} / {5} bytes used, {6} free range(s), fragmentation {7:.2f}", i, vk::to_string(m_MemoryProperties.memoryTypes[i].propertyFlags), stats.BlockCount, stats.AllocationCount, stats.BytesUsed, stats.BytesAllocated, stats.FreeRangeCount, stats.Fragmentation());
+      }
+   }
+}
+
+
+bool MemoryAllocator::IsHostVisible(const uint32_t memoryTypeIndex) const {
+   return static_cast<bool>(m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+}
+
+
+bool MemoryAllocator::IsHostCoherent(const uint32_t memoryTypeIndex) const {
+   return static_cast<bool>(m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+}
+
+
+uint32_t MemoryAllocator::FindMemoryType(const uint32_t typeFilter, const vk::MemoryPropertyFlags properties) const {
+   for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; ++i) {
+      if ((typeFilter & (1 << i)) && ((m_MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)) {
+         return i;
+      }
+   }
+   throw std::runtime_error("failed to find suitable memory type!");
+}
+
+
+vk::DeviceSize MemoryAllocator::GetBlockSize(const uint32_t memoryTypeIndex) const {
+   // Don't let a single block eat a large chunk of a small heap (e.g. the 256MB device local + host visible heap on some GPUs)
+   const vk::DeviceSize heapSize = m_MemoryProperties.memoryHeaps[m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+   return std::min(m_PreferredBlockSize, AlignUp(heapSize / 8, 1024));
+}
+
+
+MemoryBlock& MemoryAllocator::CreateBlock(const uint32_t memoryTypeIndex, const vk::DeviceSize size, const AllocationStrategy strategy, const bool isDedicated) {
+   vk::DeviceMemory memory = m_AllocateFn(memoryTypeIndex, size);
+   m_Blocks[memoryTypeIndex].emplace_back(std::make_unique<MemoryBlock>(memory, memoryTypeIndex, size, strategy, isDedicated));
+   MemoryBlock& block = *m_Blocks[memoryTypeIndex].back();
+
+   // Host visible blocks are mapped once, for their whole lifetime.  (A vk::DeviceMemory can only be mapped once
+   // at a time, so mapping has to be done per block rather than per allocation)
+   if (m_MapFn && IsHostVisible(memoryTypeIndex)) {
+      block.m_pMapped = m_MapFn(memory);
+   }
+   return block;
+}
+
+
+void MemoryAllocator::AccumulateStats(const uint32_t memoryTypeIndex, MemoryStats& stats) const {
+   for (const auto& block : m_Blocks[memoryTypeIndex]) {
+      block->AccumulateStats(stats);
+   }
+}
+
+}
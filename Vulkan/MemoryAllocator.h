@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Vulkan {
+
+class MemoryBlock;
+
+// How allocations are placed within a block of device memory.
+// eFreeList: general purpose.  Best-fit over a list of free ranges, freed ranges are coalesced with their neighbours.
+// eLinear:   bump pointer.  Cheap to allocate, but space is only reclaimed once every allocation in the block has been freed.
+//            Intended for short lived resources such as staging buffers.
+enum class AllocationStrategy {
+   eFreeList,
+   eLinear
+};
+
+
+// Handle to a sub-allocated range of device memory.
+// Bind resources to m_Memory at m_Offset.
+struct MemoryAllocation {
+   vk::DeviceMemory m_Memory;
+   vk::DeviceSize m_Offset = 0;
+   vk::DeviceSize m_Size = 0;
+   uint32_t m_MemoryTypeIndex = 0;
+   void* m_pMapped = nullptr;          // host address of m_Offset, if the allocation is in host visible memory
+   MemoryBlock* m_Block = nullptr;
+
+   explicit operator bool() const { return m_Block != nullptr; }
+};
+
+
+struct MemoryStats {
+   uint32_t BlockCount = 0;
+   uint32_t AllocationCount = 0;
+   vk::DeviceSize BytesAllocated = 0;    // total size of device memory blocks
+   vk::DeviceSize BytesUsed = 0;         // total size of live sub-allocations
+   uint32_t FreeRangeCount = 0;
+   vk::DeviceSize LargestFreeRange = 0;
+
+   // 0 => all free space is in one contiguous range.  Approaches 1 as the free space is split into many small ranges
+   float Fragmentation() const;
+};
+
+
+// Sub-allocates device memory out of large blocks, one set of blocks per memory type.
+// Avoids hitting maxMemoryAllocationCount and the cost of a vkAllocateMemory() per resource.
+//
+// The allocator itself only deals in offsets, the actual vk::DeviceMemory blocks are obtained via the
+// allocate/free/map functions.  The device constructor uses vkAllocateMemory/vkFreeMemory/vkMapMemory, alternatively you can
+// supply a memory type table and your own functions (e.g. to exercise the allocator without a GPU).
+class MemoryAllocator {
+public:
+   using AllocateDeviceMemoryFn = std::function<vk::DeviceMemory(const uint32_t memoryTypeIndex, const vk::DeviceSize size)>;
+   using FreeDeviceMemoryFn = std::function<void(vk::DeviceMemory memory)>;
+   using MapDeviceMemoryFn = std::function<void*(vk::DeviceMemory memory)>;
+
+   static constexpr vk::DeviceSize DefaultBlockSize = 64 * 1024 * 1024;
+
+   MemoryAllocator(vk::Device device, const vk::PhysicalDevice physicalDevice, const vk::DeviceSize preferredBlockSize = DefaultBlockSize);
+   MemoryAllocator(const vk::PhysicalDeviceMemoryProperties& memoryProperties, const vk::DeviceSize bufferImageGranularity, AllocateDeviceMemoryFn allocateFn, FreeDeviceMemoryFn freeFn, MapDeviceMemoryFn mapFn = {}, const vk::DeviceSize preferredBlockSize = DefaultBlockSize);
+   MemoryAllocator(const MemoryAllocator&) = delete;
+   MemoryAllocator(MemoryAllocator&&) = delete;
+
+   MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+   MemoryAllocator& operator=(MemoryAllocator&&) = delete;
+
+   ~MemoryAllocator();
+
+   // tiling is used to keep linear resources (buffers, linear images) and optimal images at least bufferImageGranularity apart
+   MemoryAllocation Allocate(const vk::MemoryRequirements& requirements, const vk::MemoryPropertyFlags properties, const vk::ImageTiling tiling = vk::ImageTiling::eLinear, const AllocationStrategy strategy = AllocationStrategy::eFreeList);
+   void Free(MemoryAllocation& allocation);
+
+   // Make host writes to a (persistently mapped) allocation visible to the device.  Does nothing for host coherent memory.
+   // offset and size are relative to the allocation.
+   void Flush(const MemoryAllocation& allocation, const vk::DeviceSize offset, const vk::DeviceSize size);
+
+   MemoryStats GetStats() const;
+   MemoryStats GetStats(const uint32_t memoryTypeIndex) const;
+   void LogStats() const;
+
+   uint32_t FindMemoryType(const uint32_t typeFilter, const vk::MemoryPropertyFlags properties) const;
+
+   vk::Device GetDevice() const { return m_Device; }
+   vk::DeviceSize GetBufferImageGranularity() const { return m_BufferImageGranularity; }
+
+private:
+   bool IsHostVisible(const uint32_t memoryTypeIndex) const;
+   bool IsHostCoherent(const uint32_t memoryTypeIndex) const;
+   vk::DeviceSize GetBlockSize(const uint32_t memoryTypeIndex) const;
+   MemoryBlock& CreateBlock(const uint32_t memoryTypeIndex, const vk::DeviceSize size, const AllocationStrategy strategy, const bool isDedicated);
+   void AccumulateStats(const uint32_t memoryTypeIndex, MemoryStats& stats) const;
+
+private:
+   vk::Device m_Device;
+   vk::PhysicalDeviceMemoryProperties m_MemoryProperties;
+   vk::DeviceSize m_BufferImageGranularity;
+   vk::DeviceSize m_NonCoherentAtomSize = 1;
+   vk::DeviceSize m_PreferredBlockSize;
+   AllocateDeviceMemoryFn m_AllocateFn;
+   FreeDeviceMemoryFn m_FreeFn;
+   MapDeviceMemoryFn m_MapFn;
+
+   std::vector<std::vector<std::unique_ptr<MemoryBlock>>> m_Blocks; // indexed by memory type
+   mutable std::mutex m_Mutex;
+};
+
+}
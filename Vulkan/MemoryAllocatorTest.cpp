@@ -0,0 +1,265 @@
+// CPU only tests of MemoryAllocator's placement logic.
+// The allocator is given a mock memory type table, and allocate/free/map functions that hand out fake vk::DeviceMemory
+// handles (and, for mapping, ordinary host memory), so no device is needed.
+
+#include "Log.h"
+#include "MemoryAllocator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+
+namespace {
+
+int s_FailureCount = 0;
+
+#define CHECK(condition)                                                                   \
+   do {                                                                                    \
+      if (!(condition)) {                                                                  \
+         std::fprintf(stderr, "%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition);\
+         ++s_FailureCount;                                                                 \
+      }                                                                                    \
+   } while (false)
+
+constexpr vk::DeviceSize KiB = 1024;
+constexpr vk::DeviceSize MiB = 1024 * KiB;
+constexpr vk::DeviceSize BlockSize = 1 * MiB;
+constexpr vk::DeviceSize Granularity = 4 * KiB;
+constexpr uint32_t DeviceLocal = 0;   // memory type indices of the mock table
+constexpr uint32_t HostVisible = 1;
+
+
+// Fake device memory: counts blocks, and backs each with host memory so that host visible blocks can be "mapped"
+class MockDevice {
+public:
+   vk::DeviceMemory Allocate(const uint32_t, const vk::DeviceSize size) {
+      const uint64_t id = ++m_NextId;
+      VkDeviceMemory handle = {};
+      std::memcpy(&handle, &id, sizeof(handle));
+      m_Blocks.emplace(handle, std::make_unique<char[]>(size));
+      ++m_AllocateCount;
+      return handle;
+   }
+
+   void Free(vk::DeviceMemory memory) {
+      CHECK(m_Blocks.erase(static_cast<VkDeviceMemory>(memory)) == 1);
+   }
+
+   void* Map(vk::DeviceMemory memory) {
+      return m_Blocks.at(static_cast<VkDeviceMemory>(memory)).get();
+   }
+
+   size_t GetLiveBlockCount() const { return m_Blocks.size(); }
+   uint32_t GetAllocateCount() const { return m_AllocateCount; }
+
+private:
+   std::map<VkDeviceMemory, std::unique_ptr<char[]>> m_Blocks;
+   uint64_t m_NextId = 0;
+   uint32_t m_AllocateCount = 0;
+};
+
+
+std::unique_ptr<Vulkan::MemoryAllocator> CreateAllocator(MockDevice& device) {
+   vk::PhysicalDeviceMemoryProperties properties;
+   properties.memoryTypeCount = 2;
+   properties.memoryTypes[DeviceLocal] = {vk::MemoryPropertyFlagBits::eDeviceLocal, 0};
+   properties.memoryTypes[HostVisible] = {vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, 1};
+   properties.memoryHeapCount = 2;
+   properties.memoryHeaps[0] = {1024 * MiB, vk::MemoryHeapFlagBits::eDeviceLocal};
+   properties.memoryHeaps[1] = {256 * MiB, {}};
+   return std::make_unique<Vulkan::MemoryAllocator>(
+      properties,
+      Granularity,
+      [&device] (const uint32_t memoryTypeIndex, const vk::DeviceSize size) { return device.Allocate(memoryTypeIndex, size); },
+      [&device] (vk::DeviceMemory memory) { device.Free(memory); },
+      [&device] (vk::DeviceMemory memory) { return device.Map(memory); },
+      BlockSize
+   );
+}
+
+
+vk::MemoryRequirements Requirements(const vk::DeviceSize size, const vk::DeviceSize alignment, const uint32_t memoryTypeIndex) {
+   return {size, alignment, 1u << memoryTypeIndex};
+}
+
+
+bool IsOnSamePage(const Vulkan::MemoryAllocation& a, const Vulkan::MemoryAllocation& b) {
+   const Vulkan::MemoryAllocation& first = (a.m_Offset < b.m_Offset) ? a : b;
+   const Vulkan::MemoryAllocation& second = (a.m_Offset < b.m_Offset) ? b : a;
+   return ((first.m_Offset + first.m_Size - 1) / Granularity) == (second.m_Offset / Granularity);
+}
+
+
+// Linear resources (buffers) and optimal images never share a bufferImageGranularity page, whichever order they are
+// allocated in, but resources of the same tiling pack together
+void TestGranularity() {
+   MockDevice device;
+   {
+      auto allocator = CreateAllocator(device);
+      const vk::MemoryPropertyFlags properties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+
+      Vulkan::MemoryAllocation buffer = allocator->Allocate(Requirements(100, 16, DeviceLocal), properties, vk::ImageTiling::eLinear);
+      Vulkan::MemoryAllocation image = allocator->Allocate(Requirements(100, 16, DeviceLocal), properties, vk::ImageTiling::eOptimal);
+      CHECK(buffer.m_Memory == image.m_Memory);
+      CHECK(!IsOnSamePage(buffer, image));
+
+      // a second buffer fits in the padding between the first buffer and the image
+      Vulkan::MemoryAllocation buffer2 = allocator->Allocate(Requirements(100, 16, DeviceLocal), properties, vk::ImageTiling::eLinear);
+      CHECK(buffer2.m_Offset == 112);
+      CHECK(!IsOnSamePage(buffer2, image));
+
+      // another image packs against the first, and a buffer too big for the gap is pushed onto the page after them
+      Vulkan::MemoryAllocation image2 = allocator->Allocate(Requirements(100, 16, DeviceLocal), properties, vk::ImageTiling::eOptimal);
+      CHECK(image2.m_Offset == image.m_Offset + 112);
+      Vulkan::MemoryAllocation buffer3 = allocator->Allocate(Requirements(3900, 16, DeviceLocal), properties, vk::ImageTiling::eLinear);
+      CHECK(buffer3.m_Offset == 2 * Granularity);
+      CHECK(!IsOnSamePage(buffer3, image2));
+
+      for (auto* allocation : {&buffer, &image, &buffer2, &image2, &buffer3}) {
+         allocator->Free(*allocation);
+         CHECK(!*allocation);
+      }
+      CHECK(allocator->GetStats().AllocationCount == 0);
+   }
+   CHECK(device.GetLiveBlockCount() == 0);
+}
+
+
+// Freed ranges merge with free neighbours on either side, so the block ends up as one free range again
+void TestCoalescing() {
+   MockDevice device;
+   {
+      auto allocator = CreateAllocator(device);
+      const vk::MemoryPropertyFlags properties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+
+      Vulkan::MemoryAllocation a = allocator->Allocate(Requirements(256 * KiB, 256, DeviceLocal), properties);
+      Vulkan::MemoryAllocation b = allocator->Allocate(Requirements(256 * KiB, 256, DeviceLocal), properties);
+      Vulkan::MemoryAllocation c = allocator->Allocate(Requirements(256 * KiB, 256, DeviceLocal), properties);
+      CHECK(allocator->GetStats().BlockCount == 1);
+      CHECK(allocator->GetStats().FreeRangeCount == 1);
+
+      allocator->Free(a);
+      allocator->Free(c);   // merges with the free tail of the block
+      Vulkan::MemoryStats stats = allocator->GetStats();
+      CHECK(stats.FreeRangeCount == 2);
+      CHECK(stats.LargestFreeRange == BlockSize - 512 * KiB);
+      CHECK(stats.Fragmentation() > 0.0f);
+
+      allocator->Free(b);   // merges with both neighbours
+      stats = allocator->GetStats();
+      CHECK(stats.BlockCount == 1);   // the last empty block is kept as a spare
+      CHECK(stats.FreeRangeCount == 1);
+      CHECK(stats.LargestFreeRange == BlockSize);
+      CHECK(stats.Fragmentation() == 0.0f);
+
+      // the whole block is usable again
+      Vulkan::MemoryAllocation whole = allocator->Allocate(Requirements(BlockSize / 2, 256, DeviceLocal), properties);
+      Vulkan::MemoryAllocation rest = allocator->Allocate(Requirements(BlockSize / 2, 256, DeviceLocal), properties);
+      CHECK(allocator->GetStats().BlockCount == 1);
+      CHECK(whole.m_Offset == 0);
+      CHECK(rest.m_Offset == BlockSize / 2);
+      allocator->Free(whole);
+      allocator->Free(rest);
+   }
+   CHECK(device.GetLiveBlockCount() == 0);
+}
+
+
+// Requests for more than half a block get a block of their own, which is released as soon as they are freed
+void TestDedicated() {
+   MockDevice device;
+   {
+      auto allocator = CreateAllocator(device);
+      const vk::MemoryPropertyFlags properties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+
+      Vulkan::MemoryAllocation shared = allocator->Allocate(Requirements(64 * KiB, 256, DeviceLocal), properties);
+      Vulkan::MemoryAllocation big = allocator->Allocate(Requirements(768 * KiB, 256, DeviceLocal), properties);
+      CHECK(big.m_Memory != shared.m_Memory);
+      CHECK(big.m_Offset == 0);
+      CHECK(device.GetAllocateCount() == 2);
+
+      Vulkan::MemoryStats stats = allocator->GetStats();
+      CHECK(stats.BlockCount == 2);
+      CHECK(stats.BytesAllocated == BlockSize + 768 * KiB);   // the dedicated block is exactly the size of the request
+
+      // the dedicated block is not shared, even though it is not full
+      Vulkan::MemoryAllocation shared2 = allocator->Allocate(Requirements(1 * KiB, 256, DeviceLocal), properties);
+      CHECK(shared2.m_Memory == shared.m_Memory);
+
+      allocator->Free(big);
+      CHECK(allocator->GetStats().BlockCount == 1);
+      CHECK(device.GetLiveBlockCount() == 1);
+
+      // bigger than a whole block
+      Vulkan::MemoryAllocation huge = allocator->Allocate(Requirements(3 * MiB, 256, DeviceLocal), properties);
+      CHECK(allocator->GetStats(DeviceLocal).BytesAllocated == BlockSize + 3 * MiB);
+      allocator->Free(huge);
+      allocator->Free(shared);
+      allocator->Free(shared2);
+   }
+   CHECK(device.GetLiveBlockCount() == 0);
+}
+
+
+// GetStats() is the sum over the memory types, and counts what has been allocated
+void TestStats() {
+   MockDevice device;
+   {
+      auto allocator = CreateAllocator(device);
+      Vulkan::MemoryAllocation allocations[] = {
+         allocator->Allocate(Requirements(100 * KiB, 256, DeviceLocal), vk::MemoryPropertyFlagBits::eDeviceLocal),
+         allocator->Allocate(Requirements(200 * KiB, 256, DeviceLocal), vk::MemoryPropertyFlagBits::eDeviceLocal),
+         allocator->Allocate(Requirements(600 * KiB, 256, DeviceLocal), vk::MemoryPropertyFlagBits::eDeviceLocal),   // dedicated
+         allocator->Allocate(Requirements(10 * KiB, 256, HostVisible), vk::MemoryPropertyFlagBits::eHostVisible),
+         allocator->Allocate(Requirements(20 * KiB, 256, HostVisible), vk::MemoryPropertyFlagBits::eHostVisible, vk::ImageTiling::eLinear, Vulkan::AllocationStrategy::eLinear)
+      };
+
+      const Vulkan::MemoryStats deviceLocal = allocator->GetStats(DeviceLocal);
+      const Vulkan::MemoryStats hostVisible = allocator->GetStats(HostVisible);
+      const Vulkan::MemoryStats total = allocator->GetStats();
+      CHECK(deviceLocal.BlockCount == 2);
+      CHECK(deviceLocal.AllocationCount == 3);
+      CHECK(deviceLocal.BytesUsed == 900 * KiB);
+      CHECK(hostVisible.BlockCount == 2);   // one per strategy
+      CHECK(hostVisible.AllocationCount == 2);
+      CHECK(hostVisible.BytesUsed == 30 * KiB);
+      CHECK(total.BlockCount == deviceLocal.BlockCount + hostVisible.BlockCount);
+      CHECK(total.AllocationCount == deviceLocal.AllocationCount + hostVisible.AllocationCount);
+      CHECK(total.BytesAllocated == deviceLocal.BytesAllocated + hostVisible.BytesAllocated);
+      CHECK(total.BytesUsed == deviceLocal.BytesUsed + hostVisible.BytesUsed);
+      CHECK(total.BytesAllocated == 3 * BlockSize + 600 * KiB);
+      CHECK(total.FreeRangeCount == deviceLocal.FreeRangeCount + hostVisible.FreeRangeCount);
+
+      // host visible allocations are mapped, at their offset within the block
+      CHECK(allocations[0].m_pMapped == nullptr);
+      CHECK(allocations[3].m_pMapped == static_cast<char*>(device.Map(allocations[3].m_Memory)) + allocations[3].m_Offset);
+      CHECK(allocations[4].m_pMapped == static_cast<char*>(device.Map(allocations[4].m_Memory)) + allocations[4].m_Offset);
+
+      for (auto& allocation : allocations) {
+         allocator->Free(allocation);
+      }
+      const Vulkan::MemoryStats empty = allocator->GetStats();
+      CHECK(empty.AllocationCount == 0);
+      CHECK(empty.BytesUsed == 0);
+   }
+   CHECK(device.GetLiveBlockCount() == 0);
+}
+
+}
+
+
+int main() {
+   Vulkan::Log::Init();
+   TestGranularity();
+   TestCoalescing();
+   TestDedicated();
+   TestStats();
+   if (s_FailureCount > 0) {
+      std::fprintf(stderr, "%d check(s) failed\n", s_FailureCount);
+      return EXIT_FAILURE;
+   }
+   std::printf("All checks passed\n");
+   return EXIT_SUCCESS;
+}
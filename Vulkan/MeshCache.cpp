@@ -0,0 +1,195 @@
+#include "MeshCache.h"
+
+#include "Log.h"
+#include "Utility.h"
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <system_error>
+
+// Cache file layout:
+//    Header
+//    key (source path and layout name, Header::KeySize bytes)
+//    vertices (Header::VertexCount * Header::VertexSize bytes), starting at a multiple of DataAlignment
+//    indices (Header::IndexCount uint32_t), starting at a multiple of DataAlignment
+
+namespace Vulkan {
+
+namespace {
+
+constexpr char CacheMagic[8] = {'V', 'K', 'M', 'E', 'S', 'H', '\0', '\0'};
+constexpr uint32_t CacheFormatVersion = 1;
+constexpr size_t DataAlignment = 16;
+
+
+struct CacheHeader {
+   char Magic[8];
+   uint32_t FormatVersion;
+   uint32_t VertexSize;
+   uint64_t SourceSize;
+   int64_t SourceWriteTime;
+   uint64_t VertexCount;
+   uint64_t IndexCount;
+   uint32_t KeySize;
+   uint32_t Reserved;
+};
+
+
+struct CacheLayout {
+   size_t VerticesOffset;
+   size_t IndicesOffset;
+   size_t Size;
+};
+
+
+CacheLayout GetCacheLayout(const size_t keySize, const size_t vertexSize, const size_t vertexCount, const size_t indexCount) {
+   CacheLayout layout;
+   layout.VerticesOffset = AlignUp(sizeof(CacheHeader) + keySize, DataAlignment);
+   layout.IndicesOffset = AlignUp(layout.VerticesOffset + vertexCount * vertexSize, DataAlignment);
+   layout.Size = layout.IndicesOffset + indexCount * sizeof(uint32_t);
+   return layout;
+}
+
+
+// Entries are identified by the (absolute) path of the source file plus the layout name
+std::string GetKey(const std::filesystem::path& sourceFileName, const std::string_view layout) {
+   std::error_code error;
+   std::filesystem::path path = std::filesystem::absolute(sourceFileName, error);
+   if (error) {
+      path = sourceFileName;
+   }
+   return path.lexically_normal().generic_string() + '|' + std::string(layout);
+}
+
+
+// FNV-1a
+uint64_t Hash(const std::string_view s) {
+   uint64_t hash = 14695981039346656037ull;
+   for (const char c : s) {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+   }
+   return hash;
+}
+
+
+bool GetSourceVersion(const std::filesystem::path& sourceFileName, uint64_t& size, int64_t& writeTime) {
+   std::error_code error;
+   size = std::filesystem::file_size(sourceFileName, error);
+   if (error) {
+      return false;
+   }
+   writeTime = std::filesystem::last_write_time(sourceFileName, error).time_since_epoch().count();
+   return !error;
+}
+
+}
+
+
+std::filesystem::path MeshCache::sm_Directory;
+
+
+void MeshCache::SetDirectory(const std::filesystem::path& directory) {
+   sm_Directory = directory;
+}
+
+
+const std::filesystem::path& MeshCache::GetDirectory() {
+   return sm_Directory;
+}
+
+
+std::filesystem::path MeshCache::GetCacheFileName(const std::filesystem::path& sourceFileName, const std::string_view layout) {
+   std::ostringstream name;
+   name << sourceFileName.stem().string() << '-' << std::hex << std::setw(16) << std::setfill('0') << Hash(GetKey(sourceFileName, layout)) << ".mesh";
+   return sm_Directory / name.str();
+}
+
+
+std::unique_ptr<MappedFile> MeshCache::Open(const std::filesystem::path& sourceFileName, const std::string_view layout, const size_t vertexSize, const size_t vertexAlignment, const void*& pVertices, size_t& vertexCount, const uint32_t*& pIndices, size_t& indexCount) {
+   uint64_t sourceSize;
+   int64_t sourceWriteTime;
+   if (sm_Directory.empty() || (vertexAlignment > DataAlignment) || !GetSourceVersion(sourceFileName, sourceSize, sourceWriteTime)) {
+      return nullptr;
+   }
+
+   const std::filesystem::path cacheFileName = GetCacheFileName(sourceFileName, layout);
+   std::error_code error;
+   if (!std::filesystem::exists(cacheFileName, error)) {
+      return nullptr;
+   }
+   std::unique_ptr<MappedFile> file;
+   try {
+      file = std::make_unique<MappedFile>(cacheFileName);
+   } catch (const std::exception& e) {
+      CORE_LOG_WARN("Mesh cache: {0}", e.what());
+      return nullptr;
+   }
+
+   // anything that does not match is a miss (the entry is then overwritten)
+   CacheHeader header;
+   if (file->GetSize() < sizeof(header)) {
+      return nullptr;
+   }
+   const char* pData = static_cast<const char*>(file->GetData());
+   std::memcpy(&header, pData, sizeof(header));
+   const std::string key = GetKey(sourceFileName, layout);
+   if (
+      (std::memcmp(header.Magic, CacheMagic, sizeof(CacheMagic)) != 0) ||
+      (header.FormatVersion != CacheFormatVersion) ||
+      (header.VertexSize != vertexSize) ||
+      (header.SourceSize != sourceSize) ||
+      (header.SourceWriteTime != sourceWriteTime) ||
+      (header.KeySize != key.size()) ||
+      (file->GetSize() < sizeof(header) + key.size()) ||
+      (std::memcmp(pData + sizeof(header), key.data(), key.size()) != 0)
+   ) {
+      return nullptr;
+   }
+   const CacheLayout cacheLayout = GetCacheLayout(key.size(), vertexSize, header.VertexCount, header.IndexCount);
+   if (cacheLayout.Size != file->GetSize()) {
+      return nullptr;
+   }
+
+   pVertices = pData + cacheLayout.VerticesOffset;
+   vertexCount = header.VertexCount;
+   pIndices = reinterpret_cast<const uint32_t*>(pData + cacheLayout.IndicesOffset);
+   indexCount = header.IndexCount;
+   return file;
+}
+
+
+void MeshCache::Write(const std::filesystem::path& sourceFileName, const std::string_view layout, const size_t vertexSize, const void* pVertices, const size_t vertexCount, const uint32_t* pIndices, const size_t indexCount) {
+   CacheHeader header = {};
+   if (sm_Directory.empty() || !GetSourceVersion(sourceFileName, header.SourceSize, header.SourceWriteTime)) {
+      return;
+   }
+   const std::string key = GetKey(sourceFileName, layout);
+   std::memcpy(header.Magic, CacheMagic, sizeof(CacheMagic));
+   header.FormatVersion = CacheFormatVersion;
+   header.VertexSize = static_cast<uint32_t>(vertexSize);
+   header.VertexCount = vertexCount;
+   header.IndexCount = indexCount;
+   header.KeySize = static_cast<uint32_t>(key.size());
+
+   const CacheLayout cacheLayout = GetCacheLayout(key.size(), vertexSize, vertexCount, indexCount);
+   std::vector<char> data(cacheLayout.Size);
+   std::memcpy(data.data(), &header, sizeof(header));
+   std::memcpy(data.data() + sizeof(header), key.data(), key.size());
+   if (vertexCount > 0) {
+      std::memcpy(data.data() + cacheLayout.VerticesOffset, pVertices, vertexCount * vertexSize);
+   }
+   if (indexCount > 0) {
+      std::memcpy(data.data() + cacheLayout.IndicesOffset, pIndices, indexCount * sizeof(uint32_t));
+   }
+
+   const std::filesystem::path cacheFileName = GetCacheFileName(sourceFileName, layout);
+   try {
+      std::filesystem::create_directories(sm_Directory);
+      WriteFileAtomic(cacheFileName.string(), data.data(), data.size());
+   } catch (const std::exception& e) {
+      CORE_LOG_WARN("Mesh cache: failed to write '{0}': {1}", cacheFileName.string(), e.what());
+   }
+}
+
+}
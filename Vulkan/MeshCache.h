@@ -0,0 +1,76 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace Vulkan {
+
+// On disk cache of imported meshes.
+// Vertices and indices are stored exactly as they are laid out in memory, so a cache hit is a memory map and two copies,
+// with no parsing and no vertex deduplication.
+//
+// Entries are keyed by the source file's path, size and last write time, so an entry is regenerated automatically when
+// its source changes.  They are also keyed by a layout name, supplied by the caller, which identifies both the vertex
+// struct and how it was filled in from the source (so that two apps importing the same file differently do not share an
+// entry).  Change the layout name whenever either of those changes.
+//
+// The cache is best effort: anything wrong with an entry just makes it a miss, and failing to write one is only a warning.
+// It is safe to use from several threads at once.
+class MeshCache {
+public:
+   // Directory in which to keep the cache files (created when first needed).  Empty disables the cache.
+   // Set this before loading anything (Application::ParseCommandLine() does so)
+   static void SetDirectory(const std::filesystem::path& directory);
+   static const std::filesystem::path& GetDirectory();
+
+   // Load the cached mesh for sourceFileName into vertices and indices.  Returns false on a miss.
+   template<typename VertexT>
+   static bool Load(const std::filesystem::path& sourceFileName, const std::string_view layout, std::vector<VertexT>& vertices, std::vector<uint32_t>& indices) {
+      static_assert(std::is_trivially_copyable_v<VertexT>, "cached vertices must be trivially copyable");
+      const void* pVertices;
+      const uint32_t* pIndices;
+      size_t vertexCount;
+      size_t indexCount;
+      const std::unique_ptr<MappedFile> file = Open(sourceFileName, layout, sizeof(VertexT), alignof(VertexT), pVertices, vertexCount, pIndices, indexCount);
+      if (!file) {
+         return false;
+      }
+      vertices.assign(static_cast<const VertexT*>(pVertices), static_cast<const VertexT*>(pVertices) + vertexCount);
+      indices.assign(pIndices, pIndices + indexCount);
+      return true;
+   }
+
+   // Save vertices and indices as the cached mesh for sourceFileName
+   template<typename VertexT>
+   static void Save(const std::filesystem::path& sourceFileName, const std::string_view layout, const std::vector<VertexT>& vertices, const std::vector<uint32_t>& indices) {
+      static_assert(std::is_trivially_copyable_v<VertexT>, "cached vertices must be trivially copyable");
+      Write(sourceFileName, layout, sizeof(VertexT), vertices.data(), vertices.size(), indices.data(), indices.size());
+   }
+
+   // Load from the cache if possible.  Otherwise call import(vertices, indices) and save the result to the cache.
+   template<typename VertexT, typename ImportFn>
+   static void LoadOrImport(const std::filesystem::path& sourceFileName, const std::string_view layout, std::vector<VertexT>& vertices, std::vector<uint32_t>& indices, ImportFn&& import) {
+      if (!Load(sourceFileName, layout, vertices, indices)) {
+         import(vertices, indices);
+         Save(sourceFileName, layout, vertices, indices);
+      }
+   }
+
+   // Name of the cache file for sourceFileName and layout (whether or not it exists)
+   static std::filesystem::path GetCacheFileName(const std::filesystem::path& sourceFileName, const std::string_view layout);
+
+private:
+   static std::unique_ptr<MappedFile> Open(const std::filesystem::path& sourceFileName, const std::string_view layout, const size_t vertexSize, const size_t vertexAlignment, const void*& pVertices, size_t& vertexCount, const uint32_t*& pIndices, size_t& indexCount);
+   static void Write(const std::filesystem::path& sourceFileName, const std::string_view layout, const size_t vertexSize, const void* pVertices, const size_t vertexCount, const uint32_t* pIndices, const size_t indexCount);
+
+private:
+   static std::filesystem::path sm_Directory;
+};
+
+}
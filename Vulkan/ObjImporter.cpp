@@ -0,0 +1,472 @@
+#include "ObjImporter.h"
+
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace Vulkan {
+
+namespace {
+
+constexpr size_t MinChunkSize = 1 << 20;     // bytes
+constexpr uint32_t ChunksPerThread = 4;      // more chunks than threads, so that an unlucky chunk does not hold up the rest
+constexpr int32_t None = -1;
+
+
+bool IsSpace(const char c) {
+   return (c == ' ') || (c == '\t');
+}
+
+
+bool IsDigit(const char c) {
+   return (c >= '0') && (c <= '9');
+}
+
+
+// Exactly as tinyobjloader's tryParseDouble(), so that the results are bit identical
+bool TryParseDouble(const char* s, const char* const sEnd, double& result) {
+   if (s >= sEnd) {
+      return false;
+   }
+   double mantissa = 0.0;
+   int exponent = 0;
+   char sign = '+';
+   char exponentSign = '+';
+   const char* p = s;
+   int read = 0;
+   bool leadingDecimalPoint = false;
+
+   if ((*p == '+') || (*p == '-')) {
+      sign = *p;
+      ++p;
+      if ((p != sEnd) && (*p == '.')) {
+         leadingDecimalPoint = true;
+      }
+   } else if (*p == '.') {
+      leadingDecimalPoint = true;
+   } else if (!IsDigit(*p)) {
+      return false;
+   }
+
+   // integer part
+   if (!leadingDecimalPoint) {
+      while ((p != sEnd) && IsDigit(*p)) {
+         mantissa *= 10;
+         mantissa += static_cast<int>(*p - '0');
+         ++p;
+         ++read;
+      }
+      if (read == 0) {
+         return false;
+      }
+   }
+
+   // fraction
+   if ((p != sEnd) && (*p == '.')) {
+      static const double powers[] = {1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001};
+      constexpr int powerCount = sizeof(powers) / sizeof(powers[0]);
+      ++p;
+      read = 1;
+      while ((p != sEnd) && IsDigit(*p)) {
+         mantissa += static_cast<int>(*p - '0') * (read < powerCount ? powers[read] : std::pow(10.0, -read));
+         ++read;
+         ++p;
+      }
+   }
+
+   // exponent
+   if ((p != sEnd) && ((*p == 'e') || (*p == 'E'))) {
+      ++p;
+      if ((p != sEnd) && ((*p == '+') || (*p == '-'))) {
+         exponentSign = *p;
+         ++p;
+      } else if ((p == sEnd) || !IsDigit(*p)) {
+         return false;
+      }
+      read = 0;
+      while ((p != sEnd) && IsDigit(*p)) {
+         if (exponent > (2147483647 / 10)) {
+            return false;
+         }
+         exponent *= 10;
+         exponent += static_cast<int>(*p - '0');
+         ++p;
+         ++read;
+      }
+      exponent *= (exponentSign == '+') ? 1 : -1;
+      if (read == 0) {
+         return false;
+      }
+   }
+
+   result = ((sign == '+') ? 1 : -1) * (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+   return true;
+}
+
+
+// The next whitespace separated number from [p, lineEnd), or 0 if there is not one (as tinyobjloader's parseReal())
+float ParseFloat(const char*& p, const char* const lineEnd) {
+   while ((p < lineEnd) && IsSpace(*p)) {
+      ++p;
+   }
+   const char* end = p;
+   while ((end < lineEnd) && !IsSpace(*end) && (*end != '\r')) {
+      ++end;
+   }
+   double value = 0.0;
+   TryParseDouble(p, end, value);
+   p = end;
+   return static_cast<float>(value);
+}
+
+
+// As atoi()
+int ParseInt(const char* p, const char* const lineEnd) {
+   bool isNegative = false;
+   if ((p < lineEnd) && ((*p == '+') || (*p == '-'))) {
+      isNegative = (*p == '-');
+      ++p;
+   }
+   int value = 0;
+   while ((p < lineEnd) && IsDigit(*p)) {
+      value = value * 10 + (*p - '0');
+      ++p;
+   }
+   return isNegative ? -value : value;
+}
+
+
+const char* SkipIndex(const char* p, const char* const lineEnd) {
+   while ((p < lineEnd) && (*p != '/') && !IsSpace(*p) && (*p != '\r')) {
+      ++p;
+   }
+   return p;
+}
+
+
+struct Chunk {
+   const char* Begin;
+   const char* End;
+
+   std::vector<float> Positions;
+   std::vector<float> Normals;
+   std::vector<float> TexCoords;
+
+   // face vertices, as read.  Relative (negative) indices are relative to the start of this chunk's attributes (and
+   // so might still be negative), and are listed in RelativeIndices so that they can be fixed up once that is known.
+   std::vector<ObjIndex> FaceIndices;
+   std::vector<uint8_t> FaceSizes;
+   std::vector<uint32_t> RelativeIndices;      // 3 * (index into FaceIndices) + (0: position, 1: normal, 2: texcoord)
+   size_t TriangleCount = 0;
+   bool HasPolygons = false;
+   bool HasZeroIndex = false;
+
+   // offsets into the combined ObjData arrays, in elements (i.e. positions, not floats)
+   size_t PositionsOffset = 0;
+   size_t NormalsOffset = 0;
+   size_t TexCoordsOffset = 0;
+   size_t TrianglesOffset = 0;
+};
+
+
+// Parse one face index (as tinyobjloader's parseTriple(): i, i/j, i//k or i/j/k)
+bool ParseFaceIndex(const char*& p, const char* const lineEnd, Chunk& chunk, ObjIndex& index) {
+   const auto fix = [&chunk] (const int value, const size_t count, const uint32_t field, int32_t& result) {
+      if (value > 0) {
+         result = value - 1;
+      } else if (value < 0) {
+         result = static_cast<int32_t>(count) + value;
+         chunk.RelativeIndices.push_back(static_cast<uint32_t>(3 * chunk.FaceIndices.size() + field));
+      } else {
+         chunk.HasZeroIndex = true;
+         return false;
+      }
+      return true;
+   };
+
+   index = {None, None, None};
+   if (!fix(ParseInt(p, lineEnd), chunk.Positions.size() / 3, 0, index.Position)) {
+      return false;
+   }
+   p = SkipIndex(p, lineEnd);
+   if ((p == lineEnd) || (*p != '/')) {
+      return true;
+   }
+   ++p;
+   if ((p != lineEnd) && (*p == '/')) {
+      ++p;
+      const bool isValid = fix(ParseInt(p, lineEnd), chunk.Normals.size() / 3, 1, index.Normal);
+      p = SkipIndex(p, lineEnd);
+      return isValid;
+   }
+   if (!fix(ParseInt(p, lineEnd), chunk.TexCoords.size() / 2, 2, index.TexCoord)) {
+      return false;
+   }
+   p = SkipIndex(p, lineEnd);
+   if ((p == lineEnd) || (*p != '/')) {
+      return true;
+   }
+   ++p;
+   const bool isValid = fix(ParseInt(p, lineEnd), chunk.Normals.size() / 3, 1, index.Normal);
+   p = SkipIndex(p, lineEnd);
+   return isValid;
+}
+
+
+void ParseChunk(Chunk& chunk) {
+   const char* p = chunk.Begin;
+   while (p < chunk.End) {
+      const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', chunk.End - p));
+      if (!lineEnd) {
+         lineEnd = chunk.End;
+      }
+      while ((p < lineEnd) && IsSpace(*p)) {
+         ++p;
+      }
+
+      if ((lineEnd - p >= 2) && (p[0] == 'v') && IsSpace(p[1])) {
+         p += 2;
+         const float x = ParseFloat(p, lineEnd);
+         const float y = ParseFloat(p, lineEnd);
+         const float z = ParseFloat(p, lineEnd);
+         chunk.Positions.insert(chunk.Positions.end(), {x, y, z});
+      } else if ((lineEnd - p >= 3) && (p[0] == 'v') && (p[1] == 'n') && IsSpace(p[2])) {
+         p += 3;
+         const float x = ParseFloat(p, lineEnd);
+         const float y = ParseFloat(p, lineEnd);
+         const float z = ParseFloat(p, lineEnd);
+         chunk.Normals.insert(chunk.Normals.end(), {x, y, z});
+      } else if ((lineEnd - p >= 3) && (p[0] == 'v') && (p[1] == 't') && IsSpace(p[2])) {
+         p += 3;
+         const float u = ParseFloat(p, lineEnd);
+         const float v = ParseFloat(p, lineEnd);
+         chunk.TexCoords.insert(chunk.TexCoords.end(), {u, v});
+      } else if ((lineEnd - p >= 2) && (p[0] == 'f') && IsSpace(p[1])) {
+         p += 2;
+         while ((p < lineEnd) && IsSpace(*p)) {
+            ++p;
+         }
+         const size_t firstIndex = chunk.FaceIndices.size();
+         while ((p < lineEnd) && (*p != '\r')) {
+            ObjIndex index;
+            if (!ParseFaceIndex(p, lineEnd, chunk, index)) {
+               return;
+            }
+            chunk.FaceIndices.push_back(index);
+            while ((p < lineEnd) && (IsSpace(*p) || (*p == '\r'))) {
+               ++p;
+            }
+         }
+         const size_t size = chunk.FaceIndices.size() - firstIndex;
+         if (size > 4) {
+            chunk.HasPolygons = true;
+         }
+         if ((size < 3) || (size > 4)) {
+            // tinyobjloader skips faces of fewer than three vertices.  Polygons are not supported (see ObjData)
+            chunk.FaceIndices.resize(firstIndex);
+            chunk.RelativeIndices.erase(std::lower_bound(chunk.RelativeIndices.begin(), chunk.RelativeIndices.end(), static_cast<uint32_t>(3 * firstIndex)), chunk.RelativeIndices.end());
+         } else {
+            chunk.FaceSizes.push_back(static_cast<uint8_t>(size));
+            chunk.TriangleCount += size - 2;
+         }
+      }
+      p = lineEnd + 1;
+   }
+}
+
+
+// Resolve the chunk's face indices against the combined attribute arrays, and write its triangles into obj.Corners
+void TriangulateChunk(Chunk& chunk, ObjData& obj) {
+   const int32_t positionCount = static_cast<int32_t>(obj.Positions.size() / 3);
+   const int32_t normalCount = static_cast<int32_t>(obj.Normals.size() / 3);
+   const int32_t texCoordCount = static_cast<int32_t>(obj.TexCoords.size() / 2);
+
+   for (const uint32_t relativeIndex : chunk.RelativeIndices) {
+      ObjIndex& index = chunk.FaceIndices[relativeIndex / 3];
+      switch (relativeIndex % 3) {
+         case 0: index.Position += static_cast<int32_t>(chunk.PositionsOffset); break;
+         case 1: index.Normal += static_cast<int32_t>(chunk.NormalsOffset); break;
+         case 2: index.TexCoord += static_cast<int32_t>(chunk.TexCoordsOffset); break;
+      }
+   }
+   for (const ObjIndex& index : chunk.FaceIndices) {
+      if (
+         (index.Position < 0) || (index.Position >= positionCount) ||
+         (index.Normal < None) || (index.Normal >= normalCount) ||
+         (index.TexCoord < None) || (index.TexCoord >= texCoordCount)
+      ) {
+         throw std::runtime_error("face index out of range");
+      }
+   }
+
+   ObjIndex* corner = obj.Corners.data() + 3 * chunk.TrianglesOffset;
+   const ObjIndex* face = chunk.FaceIndices.data();
+   for (const uint8_t size : chunk.FaceSizes) {
+      if (size == 3) {
+         corner = std::copy(face, face + 3, corner);
+      } else {
+         // quad: split along the shorter diagonal (computed exactly as tinyobjloader does)
+         const float* v0 = &obj.Positions[3 * face[0].Position];
+         const float* v1 = &obj.Positions[3 * face[1].Position];
+         const float* v2 = &obj.Positions[3 * face[2].Position];
+         const float* v3 = &obj.Positions[3 * face[3].Position];
+         const float e02x = v2[0] - v0[0];
+         const float e02y = v2[1] - v0[1];
+         const float e02z = v2[2] - v0[2];
+         const float e13x = v3[0] - v1[0];
+         const float e13y = v3[1] - v1[1];
+         const float e13z = v3[2] - v1[2];
+         const float sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+         const float sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+         if (sqr02 < sqr13) {
+            *corner++ = face[0]; *corner++ = face[1]; *corner++ = face[2];
+            *corner++ = face[0]; *corner++ = face[2]; *corner++ = face[3];
+         } else {
+            *corner++ = face[0]; *corner++ = face[1]; *corner++ = face[3];
+            *corner++ = face[1]; *corner++ = face[2]; *corner++ = face[3];
+         }
+      }
+      face += size;
+   }
+}
+
+
+void ForEachChunk(std::vector<Chunk>& chunks, JobSystem* jobSystem, const std::function<void(Chunk&)>& fn) {
+   if (jobSystem) {
+      jobSystem->ParallelFor(0, static_cast<uint32_t>(chunks.size()), 1, [&chunks, &fn] (const uint32_t begin, const uint32_t end) {
+         for (uint32_t i = begin; i < end; ++i) {
+            fn(chunks[i]);
+         }
+      });
+   } else {
+      std::for_each(chunks.begin(), chunks.end(), fn);
+   }
+}
+
+
+uint64_t HashObjIndex(const ObjIndex& index) {
+   uint64_t hash = (static_cast<uint64_t>(static_cast<uint32_t>(index.Position)) << 32) | static_cast<uint32_t>(index.Normal);
+   hash ^= static_cast<uint64_t>(static_cast<uint32_t>(index.TexCoord)) * 0x9E3779B97F4A7C15ull;
+   hash ^= hash >> 32;
+   hash *= 0xD6E8FEB86659FD93ull;
+   hash ^= hash >> 32;
+   return hash;
+}
+
+}
+
+
+ObjData ImportObj(const std::filesystem::path& fileName, JobSystem* jobSystem) {
+   const MappedFile file(fileName);
+   const char* const pBegin = static_cast<const char*>(file.GetData());
+   const char* const pEnd = pBegin + file.GetSize();
+
+   // split at line boundaries
+   const uint32_t threadCount = jobSystem ? jobSystem->GetThreadCount() : 1;
+   const size_t chunkSize = std::max(MinChunkSize, file.GetSize() / (threadCount * ChunksPerThread) + 1);
+   std::vector<Chunk> chunks;
+   for (const char* p = pBegin; p < pEnd;) {
+      const char* end = pEnd;
+      if (static_cast<size_t>(pEnd - p) > chunkSize) {
+         end = static_cast<const char*>(std::memchr(p + chunkSize, '\n', pEnd - (p + chunkSize)));
+         end = end ? end + 1 : pEnd;
+      }
+      Chunk& chunk = chunks.emplace_back();
+      chunk.Begin = p;
+      chunk.End = end;
+      p = end;
+   }
+
+   ForEachChunk(chunks, jobSystem, ParseChunk);
+
+   ObjData obj;
+   size_t positionCount = 0;
+   size_t normalCount = 0;
+   size_t texCoordCount = 0;
+   size_t triangleCount = 0;
+   for (auto& chunk : chunks) {
+      if (chunk.HasZeroIndex) {
+         throw std::runtime_error("'" + fileName.string() + "': face index of zero");
+      }
+      obj.HasPolygons = obj.HasPolygons || chunk.HasPolygons;
+      chunk.PositionsOffset = positionCount;
+      chunk.NormalsOffset = normalCount;
+      chunk.TexCoordsOffset = texCoordCount;
+      chunk.TrianglesOffset = triangleCount;
+      positionCount += chunk.Positions.size() / 3;
+      normalCount += chunk.Normals.size() / 3;
+      texCoordCount += chunk.TexCoords.size() / 2;
+      triangleCount += chunk.TriangleCount;
+   }
+   if (std::max({positionCount, normalCount, texCoordCount}) > INT32_MAX) {
+      throw std::runtime_error("'" + fileName.string() + "' is too large");
+   }
+
+   obj.Positions.resize(3 * positionCount);
+   obj.Normals.resize(3 * normalCount);
+   obj.TexCoords.resize(2 * texCoordCount);
+   obj.Corners.resize(3 * triangleCount);
+   ForEachChunk(chunks, jobSystem, [&obj] (Chunk& chunk) {
+      std::copy(chunk.Positions.begin(), chunk.Positions.end(), obj.Positions.begin() + 3 * chunk.PositionsOffset);
+      std::copy(chunk.Normals.begin(), chunk.Normals.end(), obj.Normals.begin() + 3 * chunk.NormalsOffset);
+      std::copy(chunk.TexCoords.begin(), chunk.TexCoords.end(), obj.TexCoords.begin() + 2 * chunk.TexCoordsOffset);
+      std::vector<float>().swap(chunk.Positions);
+      std::vector<float>().swap(chunk.Normals);
+      std::vector<float>().swap(chunk.TexCoords);
+   });
+   try {
+      ForEachChunk(chunks, jobSystem, [&obj] (Chunk& chunk) { TriangulateChunk(chunk, obj); });
+   } catch (const std::exception& e) {
+      throw std::runtime_error("'" + fileName.string() + "': " + e.what());
+   }
+   return obj;
+}
+
+
+ObjIndexTable::ObjIndexTable(const size_t expectedCount) {
+   size_t size = 1024;
+   while (size < 2 * expectedCount) {
+      size *= 2;
+   }
+   m_Slots.resize(size, {{None, None, None}, ~0u});
+}
+
+
+std::pair<uint32_t, bool> ObjIndexTable::Insert(const ObjIndex& index) {
+   if (2 * (m_Count + 1) > m_Slots.size()) {
+      Grow();
+   }
+   const size_t mask = m_Slots.size() - 1;
+   size_t slot = HashObjIndex(index) & mask;
+   while (m_Slots[slot].Id != ~0u) {
+      const ObjIndex& existing = m_Slots[slot].Index;
+      if ((existing.Position == index.Position) && (existing.Normal == index.Normal) && (existing.TexCoord == index.TexCoord)) {
+         return {m_Slots[slot].Id, false};
+      }
+      slot = (slot + 1) & mask;
+   }
+   m_Slots[slot] = {index, m_Count};
+   return {m_Count++, true};
+}
+
+
+void ObjIndexTable::Grow() {
+   std::vector<Slot> slots(m_Slots.size() * 2, {{None, None, None}, ~0u});
+   const size_t mask = slots.size() - 1;
+   for (const Slot& existing : m_Slots) {
+      if (existing.Id != ~0u) {
+         size_t slot = HashObjIndex(existing.Index) & mask;
+         while (slots[slot].Id != ~0u) {
+            slot = (slot + 1) & mask;
+         }
+         slots[slot] = existing;
+      }
+   }
+   m_Slots.swap(slots);
+}
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "JobSystem.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+namespace Vulkan {
+
+// Indices of the attributes of one corner of a triangle.  -1 => none
+struct ObjIndex {
+   int32_t Position;
+   int32_t Normal;
+   int32_t TexCoord;
+};
+
+
+// Triangles of an .obj file, as they come from the file: one attribute array per kind, and three corners per triangle
+struct ObjData {
+   std::vector<float> Positions;       // x, y, z
+   std::vector<float> Normals;         // x, y, z
+   std::vector<float> TexCoords;       // u, v
+   std::vector<ObjIndex> Corners;      // three per triangle, in file order
+
+   // True if the file has faces with more than four vertices.  These are not supported (everything else is still
+   // imported), as tinyobjloader triangulates them by ear clipping, and reproducing that exactly is not worth it.
+   bool HasPolygons = false;
+};
+
+
+// Import the triangles (and quads) of an .obj file.
+// The file is memory mapped and split into chunks at line boundaries, which are parsed in parallel on jobSystem (or
+// serially, if jobSystem is null).
+// The result is exactly what tinyobjloader (2.0) gives: numbers are parsed with the same algorithm, faces with fewer
+// than three vertices are skipped, and quads are split along their shorter diagonal.  Only v, vn, vt and f lines are
+// read.  Throws on malformed faces (zero, or out of range, indices).
+ObjData ImportObj(const std::filesystem::path& fileName, JobSystem* jobSystem);
+
+
+// Open addressing hash table from ObjIndex to a dense id (0, 1, 2, ... in order of insertion)
+class ObjIndexTable {
+public:
+   ObjIndexTable(const size_t expectedCount);
+
+   // Returns the id of index, and whether it was newly inserted
+   std::pair<uint32_t, bool> Insert(const ObjIndex& index);
+
+   uint32_t GetCount() const { return m_Count; }
+
+private:
+   struct Slot {
+      ObjIndex Index;
+      uint32_t Id;       // ~0 => empty
+   };
+
+   void Grow();
+
+   std::vector<Slot> m_Slots;
+   uint32_t m_Count = 0;
+};
+
+
+// Convert obj's corners to indexed vertices, with each distinct vertex appearing once.
+// makeVertex(const ObjData&, const ObjIndex&) returns the vertex for a corner.
+// Vertices are deduplicated by value (by VertexT's operator== and std::hash), and are ordered by first use, so the result
+// is exactly that of the usual loop of "if (uniqueVertices.count(vertex) == 0) {...}" over the corners with an
+// std::unordered_map<VertexT, uint32_t>.  However, makeVertex is only called, and the vertex only hashed, once per
+// distinct ObjIndex rather than for every corner.
+template<typename VertexT, typename MakeVertexFn>
+void BuildIndexedMesh(const ObjData& obj, MakeVertexFn&& makeVertex, std::vector<VertexT>& vertices, std::vector<uint32_t>& indices) {
+   constexpr uint32_t Invalid = ~0u;
+   constexpr uint32_t NotEqualToItself = Invalid - 1;
+
+   vertices.clear();
+   indices.clear();
+   indices.reserve(obj.Corners.size());
+
+   ObjIndexTable indexTable(obj.Corners.size() / 4);
+   std::vector<uint32_t> vertexOfIndex;
+
+   // open addressing, on the vertex hash, to the index of the vertex in vertices
+   std::vector<uint32_t> vertexSlots(1024, Invalid);
+   std::vector<size_t> vertexHashes;
+   const std::hash<VertexT> hasher;
+   const auto insertVertex = [&] (const VertexT& vertex) {
+      if ((vertices.size() + 1) * 2 > vertexSlots.size()) {
+         std::vector<uint32_t> slots(vertexSlots.size() * 2, Invalid);
+         const size_t mask = slots.size() - 1;
+         for (uint32_t i = 0; i < vertices.size(); ++i) {
+            size_t slot = vertexHashes[i] & mask;
+            while (slots[slot] != Invalid) {
+               slot = (slot + 1) & mask;
+            }
+            slots[slot] = i;
+         }
+         vertexSlots.swap(slots);
+      }
+      const size_t hash = hasher(vertex);
+      const size_t mask = vertexSlots.size() - 1;
+      size_t slot = hash & mask;
+      while (vertexSlots[slot] != Invalid) {
+         const uint32_t i = vertexSlots[slot];
+         if ((vertexHashes[i] == hash) && (vertices[i] == vertex)) {
+            return i;
+         }
+         slot = (slot + 1) & mask;
+      }
+      const uint32_t i = static_cast<uint32_t>(vertices.size());
+      vertexSlots[slot] = i;
+      vertexHashes.push_back(hash);
+      vertices.push_back(vertex);
+      return i;
+   };
+
+   for (const ObjIndex& corner : obj.Corners) {
+      const auto [id, isNew] = indexTable.Insert(corner);
+      if (isNew) {
+         const VertexT vertex = makeVertex(obj, corner);
+         vertexOfIndex.push_back((vertex == vertex) ? insertVertex(vertex) : NotEqualToItself);
+      }
+      const uint32_t vertexIndex = vertexOfIndex[id];
+      if (vertexIndex == NotEqualToItself) {
+         // e.g. has a NaN.  The unordered_map loop never finds such a vertex, so adds it every time it is used, and
+         // (as its operator[] then inserts a second, value initialised, entry) always indexes it as 0
+         vertices.push_back(makeVertex(obj, corner));
+         vertexHashes.push_back(0);
+         indices.push_back(0);
+      } else {
+         indices.push_back(vertexIndex);
+      }
+   }
+}
+
+}
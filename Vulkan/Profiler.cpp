@@ -0,0 +1,266 @@
+#include "Profiler.h"
+
+#include "Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace Vulkan {
+
+namespace {
+
+std::string EscapeJson(const std::string& s) {
+   std::string escaped;
+   escaped.reserve(s.size());
+   for (const char c : s) {
+      switch (c) {
+         case '"':  escaped += "\\\""; break;
+         case '\\': escaped += "\\\\"; break;
+         case '\n': escaped += "\\n"; break;
+         case '\t': escaped += "\\t"; break;
+         default:   escaped += c; break;
+      }
+   }
+   return escaped;
+}
+
+}
+
+
+Profiler::CpuScope::CpuScope(Profiler* profiler, const char* name)
+: m_Profiler(profiler)
+, m_Name(name)
+{
+   if (m_Profiler) {
+      m_Start = Clock::now();
+   }
+}
+
+
+Profiler::CpuScope::~CpuScope() {
+   if (m_Profiler) {
+      m_Profiler->AddCpuSample(m_Name, m_Start, Clock::now());
+   }
+}
+
+
+Profiler::Profiler(vk::Device device, const float timestampPeriod, const uint32_t timestampValidBits)
+: m_Device(device)
+, m_TimestampPeriod(timestampPeriod)
+, m_TimestampMask((timestampValidBits >= 64) ? ~0ull : ((1ull << timestampValidBits) - 1))
+, m_IsGpuEnabled(timestampValidBits > 0)
+, m_StartTime(Clock::now())
+{
+   if (!m_IsGpuEnabled) {
+      CORE_LOG_WARN("Profiler: queue family does not support timestamps.  GPU scopes will not be recorded");
+   }
+}
+
+
+Profiler::~Profiler() {
+   DestroyQueryPools();
+}
+
+
+void Profiler::CreateQueryPools(const uint32_t commandBufferCount) {
+   if (!m_IsGpuEnabled) {
+      return;
+   }
+   // Existing pools are kept, as the command buffers that previously used them may still be in flight.
+   // Whatever those write is discarded: the re-recorded command buffers reset their pool before use.
+   for (auto& queryPool : m_QueryPools) {
+      queryPool.ScopeNames.clear();
+      queryPool.IsPending = false;
+   }
+   while (m_QueryPools.size() < commandBufferCount) {
+      m_QueryPools.emplace_back().Pool = m_Device.createQueryPool({
+         {}                            /*flags*/,
+         vk::QueryType::eTimestamp     /*queryType*/,
+         2 * MaxGpuScopes              /*queryCount*/,
+         {}                            /*pipelineStatistics*/
+      });
+   }
+}
+
+
+void Profiler::DestroyQueryPools() {
+   if (m_Device) {
+      for (auto& queryPool : m_QueryPools) {
+         m_Device.destroy(queryPool.Pool);
+      }
+   }
+   m_QueryPools.clear();
+}
+
+
+void Profiler::CmdReset(vk::CommandBuffer cmd, const uint32_t commandBufferIndex) {
+   if (commandBufferIndex < m_QueryPools.size()) {
+      QueryPool& queryPool = m_QueryPools[commandBufferIndex];
+      queryPool.ScopeNames.clear();
+      queryPool.IsPending = false;
+      cmd.resetQueryPool(queryPool.Pool, 0, 2 * MaxGpuScopes);
+   }
+}
+
+
+uint32_t Profiler::CmdBeginScope(vk::CommandBuffer cmd, const uint32_t commandBufferIndex, const char* name) {
+   if (commandBufferIndex >= m_QueryPools.size()) {
+      return MaxGpuScopes;
+   }
+   QueryPool& queryPool = m_QueryPools[commandBufferIndex];
+   const uint32_t scope = static_cast<uint32_t>(queryPool.ScopeNames.size());
+   if (scope >= MaxGpuScopes) {
+      CORE_LOG_WARN("Profiler: too many GPU scopes in command buffer {0}, '{1}' will not be recorded", commandBufferIndex, name);
+      return MaxGpuScopes;
+   }
+   queryPool.ScopeNames.emplace_back(name);
+   cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, queryPool.Pool, 2 * scope);
+   return scope;
+}
+
+
+void Profiler::CmdEndScope(vk::CommandBuffer cmd, const uint32_t commandBufferIndex, const uint32_t scope) {
+   if ((commandBufferIndex < m_QueryPools.size()) && (scope < MaxGpuScopes)) {
+      cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_QueryPools[commandBufferIndex].Pool, 2 * scope + 1);
+   }
+}
+
+
+void Profiler::OnSubmit(const uint32_t commandBufferIndex) {
+   if (commandBufferIndex < m_QueryPools.size()) {
+      QueryPool& queryPool = m_QueryPools[commandBufferIndex];
+      queryPool.SubmitTime = Clock::now();
+      queryPool.IsPending = !queryPool.ScopeNames.empty();
+   }
+}
+
+
+void Profiler::Collect(const uint32_t commandBufferIndex) {
+   if (commandBufferIndex >= m_QueryPools.size()) {
+      return;
+   }
+   QueryPool& queryPool = m_QueryPools[commandBufferIndex];
+   if (!queryPool.IsPending) {
+      return;
+   }
+   queryPool.IsPending = false;
+
+   const uint32_t queryCount = 2 * static_cast<uint32_t>(queryPool.ScopeNames.size());
+   std::vector<uint64_t> timestamps(queryCount);
+
+   // no eWait: the submission has already completed, so results are available (and if for some reason they are not,
+   // we skip this frame rather than stall)
+   vk::Result result = m_Device.getQueryPoolResults(queryPool.Pool, 0, queryCount, timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+   if (result != vk::Result::eSuccess) {
+      return;
+   }
+
+   uint64_t base = UINT64_MAX;
+   for (uint32_t scope = 0; scope < queryPool.ScopeNames.size(); ++scope) {
+      base = std::min(base, timestamps[2 * scope] & m_TimestampMask);
+   }
+
+   const double submitMicroseconds = std::chrono::duration<double, std::micro>(queryPool.SubmitTime - m_StartTime).count();
+   for (uint32_t scope = 0; scope < queryPool.ScopeNames.size(); ++scope) {
+      const uint64_t begin = timestamps[2 * scope] & m_TimestampMask;
+      const uint64_t end = timestamps[2 * scope + 1] & m_TimestampMask;
+      if (end < begin) {
+         continue;   // counter wrapped
+      }
+      const double startMicroseconds = submitMicroseconds + (static_cast<double>(begin - base) * m_TimestampPeriod / 1000.0);
+      const double durationMicroseconds = static_cast<double>(end - begin) * m_TimestampPeriod / 1000.0;
+      AddSample(queryPool.ScopeNames[scope], true, startMicroseconds, durationMicroseconds);
+   }
+}
+
+
+void Profiler::CollectAll() {
+   for (uint32_t i = 0; i < m_QueryPools.size(); ++i) {
+      Collect(i);
+   }
+}
+
+
+void Profiler::AddCpuSample(const char* name, const Clock::time_point start, const Clock::time_point end) {
+   const double startMicroseconds = std::chrono::duration<double, std::micro>(start - m_StartTime).count();
+   const double durationMicroseconds = std::chrono::duration<double, std::micro>(end - start).count();
+   AddSample(name, false, startMicroseconds, durationMicroseconds);
+}
+
+
+ProfileStats Profiler::GetStats(const std::string& name) const {
+   std::lock_guard lock(m_Mutex);
+   auto samples = m_Samples.find(name);
+   if (samples == m_Samples.end()) {
+      return {};
+   }
+   return CalculateStats(samples->second.Milliseconds);
+}
+
+
+void Profiler::LogStats() const {
+   std::lock_guard lock(m_Mutex);
+   for (const auto& [name, samples] : m_Samples) {
+      ProfileStats stats = CalculateStats(samples.Milliseconds);
+      CORE_LOG_INFO("Profile {0} '{1}': min {2:.3f}ms, avg {3:.3f}ms, p95 {4:.3f}ms (last {5} samples)", samples.IsGpu ? "GPU" : "CPU", name, stats.Min, stats.Avg, stats.P95, stats.Count);
+   }
+}
+
+
+void Profiler::WriteChromeTrace(const std::string& fileName) const {
+   std::ofstream file(fileName);
+   if (!file.is_open()) {
+      CORE_LOG_ERROR("Profiler: failed to open '{0}' for writing", fileName);
+      return;
+   }
+
+   std::lock_guard lock(m_Mutex);
+   file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+   file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+   file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+   for (const auto& event : m_TraceEvents) {
+      file << ",\n{\"name\":\"" << EscapeJson(*event.Name) << "\",\"cat\":\"" << (event.IsGpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (event.IsGpu ? 2 : 1) << ",\"ts\":" << event.Start << ",\"dur\":" << event.Duration << "}";
+   }
+   file << "\n]}\n";
+
+   CORE_LOG_INFO("Profiler: wrote {0} events to '{1}'", m_TraceEvents.size(), fileName);
+}
+
+
+void Profiler::AddSample(const std::string& name, const bool isGpu, const double startMicroseconds, const double durationMicroseconds) {
+   std::lock_guard lock(m_Mutex);
+   auto samples = m_Samples.try_emplace(name).first;
+   samples->second.IsGpu = isGpu;
+   samples->second.Milliseconds.push_back(durationMicroseconds / 1000.0);
+   if (samples->second.Milliseconds.size() > RollingWindow) {
+      samples->second.Milliseconds.pop_front();
+   }
+   if (m_TraceEvents.size() < MaxTraceEvents) {
+      m_TraceEvents.push_back({&samples->first, isGpu, startMicroseconds, durationMicroseconds});
+   }
+}
+
+
+ProfileStats Profiler::CalculateStats(const std::deque<double>& samples) {
+   ProfileStats stats;
+   if (samples.empty()) {
+      return stats;
+   }
+   std::vector<double> sorted(samples.begin(), samples.end());
+   std::sort(sorted.begin(), sorted.end());
+
+   double total = 0.0;
+   for (const double sample : sorted) {
+      total += sample;
+   }
+   const size_t p95Index = static_cast<size_t>(std::ceil(0.95 * sorted.size())) - 1;
+
+   stats.Count = static_cast<uint32_t>(sorted.size());
+   stats.Min = sorted.front();
+   stats.Avg = total / sorted.size();
+   stats.P95 = sorted[std::min(p95Index, sorted.size() - 1)];
+   return stats;
+}
+
+}
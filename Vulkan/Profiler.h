@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Vulkan {
+
+// Rolling statistics for one named scope, in milliseconds
+struct ProfileStats {
+   uint32_t Count = 0;
+   double Min = 0.0;
+   double Avg = 0.0;
+   double P95 = 0.0;
+};
+
+
+// Collects named CPU and GPU timings.
+//
+// GPU scopes are timestamp queries written into a command buffer.  The apps pre-record one command buffer per swap chain
+// image and re-submit it each time that image comes around, so there is one query pool per command buffer.  A pool is read
+// back only after the fence for its previous submission has signaled, so reading results never stalls.
+//
+// CPU and GPU clocks are not calibrated against each other: in the trace, GPU scopes are placed relative to the CPU time
+// at which their command buffer was submitted.
+//
+// Each scope keeps rolling min/avg/p95 over its last RollingWindow samples, and everything can be written out as a
+// Chrome trace (open in chrome://tracing, or https://ui.perfetto.dev)
+class Profiler {
+public:
+   using Clock = std::chrono::steady_clock;
+
+   static constexpr uint32_t MaxGpuScopes = 64;            // per command buffer
+   static constexpr uint32_t RollingWindow = 256;
+   static constexpr size_t MaxTraceEvents = 1024 * 1024;   // events beyond this are counted in stats, but not traced
+
+   // Times the enclosing block of CPU code.  profiler may be nullptr, in which case nothing is recorded.
+   class CpuScope {
+   public:
+      CpuScope(Profiler* profiler, const char* name);
+      CpuScope(const CpuScope&) = delete;
+      CpuScope& operator=(const CpuScope&) = delete;
+      ~CpuScope();
+
+   private:
+      Profiler* m_Profiler;
+      const char* m_Name;
+      Clock::time_point m_Start;
+   };
+
+   // timestampValidBits is from the queue family that command buffers will be submitted to.  If it is zero then
+   // GPU scopes are silently ignored.
+   Profiler(vk::Device device, const float timestampPeriod, const uint32_t timestampValidBits);
+   Profiler(const Profiler&) = delete;
+   Profiler(Profiler&&) = delete;
+
+   Profiler& operator=(const Profiler&) = delete;
+   Profiler& operator=(Profiler&&) = delete;
+
+   ~Profiler();
+
+   // Ensure there is a query pool for each of commandBufferCount command buffers, and forget any scopes recorded so far.
+   // Call whenever the command buffers are recreated.  Existing pools may still be in use by the device.
+   void CreateQueryPools(const uint32_t commandBufferCount);
+   void DestroyQueryPools();
+
+   // Record at the start of command buffer commandBufferIndex, outside of any render pass.
+   // Forgets the scopes that were previously recorded into that command buffer.
+   void CmdReset(vk::CommandBuffer cmd, const uint32_t commandBufferIndex);
+
+   // Record timestamps around a region of a command buffer.  Scopes may be nested.
+   uint32_t CmdBeginScope(vk::CommandBuffer cmd, const uint32_t commandBufferIndex, const char* name);
+   void CmdEndScope(vk::CommandBuffer cmd, const uint32_t commandBufferIndex, const uint32_t scope);
+
+   // Call when command buffer commandBufferIndex has been submitted
+   void OnSubmit(const uint32_t commandBufferIndex);
+
+   // Call once the most recent submission of command buffer commandBufferIndex has completed.
+   // Reads back its timestamps.  Does nothing if there is nothing to read.
+   void Collect(const uint32_t commandBufferIndex);
+
+   // Collect from all command buffers.  Device must be idle.
+   void CollectAll();
+
+   void AddCpuSample(const char* name, const Clock::time_point start, const Clock::time_point end);
+
+   ProfileStats GetStats(const std::string& name) const;
+   void LogStats() const;
+   void WriteChromeTrace(const std::string& fileName) const;
+
+private:
+   struct QueryPool {
+      vk::QueryPool Pool;
+      std::vector<std::string> ScopeNames;
+      Clock::time_point SubmitTime;
+      bool IsPending = false;
+   };
+
+   struct Samples {
+      std::deque<double> Milliseconds;
+      bool IsGpu = false;
+   };
+
+   struct TraceEvent {
+      const std::string* Name;
+      bool IsGpu;
+      double Start;      // microseconds since profiler was created
+      double Duration;   // microseconds
+   };
+
+   void AddSample(const std::string& name, const bool isGpu, const double startMicroseconds, const double durationMicroseconds);
+   static ProfileStats CalculateStats(const std::deque<double>& samples);
+
+private:
+   vk::Device m_Device;
+   double m_TimestampPeriod;    // nanoseconds per tick
+   uint64_t m_TimestampMask;
+   bool m_IsGpuEnabled;
+   Clock::time_point m_StartTime;
+
+   std::vector<QueryPool> m_QueryPools;   // indexed by command buffer
+
+   std::map<std::string, Samples> m_Samples;
+   std::vector<TraceEvent> m_TraceEvents;
+   mutable std::mutex m_Mutex;
+};
+
+}
@@ -7,6 +7,7 @@ namespace Vulkan {
 struct QueueFamilyIndices {
    std::optional<uint32_t> GraphicsFamily;
    std::optional<uint32_t> PresentFamily;
+   std::optional<uint32_t> TransferFamily;   // a transfer queue family without graphics, if the device has one
 
    bool IsComplete() {
       return GraphicsFamily.has_value() && PresentFamily.has_value();
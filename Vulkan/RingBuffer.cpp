@@ -0,0 +1,47 @@
+#include "RingBuffer.h"
+
+#include "Core.h"
+#include "Utility.h"
+
+namespace Vulkan {
+
+RingBuffer::RingBuffer(MemoryAllocator& allocator, const vk::DeviceSize frameSize, const uint32_t frameCount, const vk::BufferUsageFlags usage, const vk::DeviceSize minOffsetAlignment)
+: Buffer(allocator, AlignUp(frameSize, minOffsetAlignment) * frameCount, usage, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent)
+, m_FrameSize(AlignUp(frameSize, minOffsetAlignment))
+, m_FrameCount(frameCount)
+, m_Alignment(std::max<vk::DeviceSize>(minOffsetAlignment, 1))
+{}
+
+
+void RingBuffer::BeginFrame(const uint32_t frameIndex) {
+   CORE_ASSERT(frameIndex < m_FrameCount, "RingBuffer::BeginFrame() frame index out of range!");
+   m_FrameIndex = frameIndex;
+   m_Head = 0;
+}
+
+
+uint32_t RingBuffer::Push(const void* pData, const vk::DeviceSize size) {
+   const vk::DeviceSize offset = AlignUp(m_Head, m_Alignment);
+   if (offset + size > m_FrameSize) {
+      throw std::runtime_error("RingBuffer: frame region overflow!");
+   }
+   m_Head = offset + size;
+   CopyFromHost(GetFrameOffset(m_FrameIndex) + offset, size, pData);
+   return GetFrameOffset(m_FrameIndex) + static_cast<uint32_t>(offset);
+}
+
+
+uint32_t RingBuffer::GetFrameOffset(const uint32_t frameIndex) const {
+   return static_cast<uint32_t>(frameIndex * m_FrameSize);
+}
+
+
+vk::DescriptorBufferInfo RingBuffer::GetDescriptor(const vk::DeviceSize range) const {
+   return {
+      m_Buffer   /*buffer*/,
+      0          /*offset*/,
+      range      /*range*/
+   };
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Buffer.h"
+
+namespace Vulkan {
+
+// A host visible, persistently mapped buffer that is divided into one region per frame.
+// Within the current frame's region, slices are handed out in order and are intended to be bound
+// with dynamic offsets (vk::DescriptorType::eUniformBufferDynamic or eStorageBufferDynamic).
+// Per-frame data is then a memcpy into already mapped memory, and one allocation serves every frame in flight.
+//
+// The caller is responsible for making sure the GPU has finished with a frame's region before calling
+// BeginFrame() for that frame again.  (e.g. index frames by swap chain image, which Application::BeginFrame() fences)
+class RingBuffer : public Buffer {
+public:
+
+   RingBuffer(MemoryAllocator& allocator, const vk::DeviceSize frameSize, const uint32_t frameCount, const vk::BufferUsageFlags usage, const vk::DeviceSize minOffsetAlignment);
+
+   // Start handing out slices from the beginning of the given frame's region
+   void BeginFrame(const uint32_t frameIndex);
+
+   // Copy size bytes into the next slice of the current frame's region.
+   // Returns the (dynamic) offset of the slice from the start of the buffer
+   uint32_t Push(const void* pData, const vk::DeviceSize size);
+
+   template<typename T>
+   uint32_t Push(const T& data) {
+      return Push(&data, sizeof(T));
+   }
+
+   // Offset of the first slice in given frame's region
+   uint32_t GetFrameOffset(const uint32_t frameIndex) const;
+
+   // Descriptor for a dynamic uniform (or storage) buffer binding, where each slice is range bytes
+   vk::DescriptorBufferInfo GetDescriptor(const vk::DeviceSize range) const;
+
+   vk::DeviceSize m_FrameSize;
+   uint32_t m_FrameCount;
+   vk::DeviceSize m_Alignment;
+
+private:
+   uint32_t m_FrameIndex = 0;
+   vk::DeviceSize m_Head = 0;   // offset of next free byte, relative to start of current frame's region
+};
+
+}
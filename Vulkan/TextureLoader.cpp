@@ -0,0 +1,128 @@
+#include "TextureLoader.h"
+
+#include "Buffer.h"
+#include "Log.h"
+#include "Utility.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+namespace Vulkan {
+
+TextureLoader::TextureLoader(vk::PhysicalDevice physicalDevice, MemoryAllocator& allocator, UploadManager& uploadManager, JobSystem& jobSystem)
+: m_PhysicalDevice(physicalDevice)
+, m_Allocator(allocator)
+, m_UploadManager(uploadManager)
+, m_JobSystem(jobSystem)
+{}
+
+
+TextureLoader::Result TextureLoader::Load(const std::vector<std::string>& fileNames, const bool generateMips) {
+   struct Slice {
+      int Width = 0;
+      int Height = 0;
+      vk::DeviceSize Offset = 0;      // in the arena
+      vk::DeviceSize Size = 0;
+      double DecodeMilliseconds = 0.0;
+      double CopyMilliseconds = 0.0;
+      double UploadMilliseconds = 0.0;
+   };
+
+   Result result;
+   if (fileNames.empty()) {
+      return result;
+   }
+
+   const auto start = std::chrono::steady_clock::now();
+   const uint32_t count = static_cast<uint32_t>(fileNames.size());
+   std::vector<Slice> slices(count);
+
+   // Read just the image headers first, to size the arena.  This is cheap compared to decoding.
+   m_JobSystem.ParallelFor(0, count, 1, [&fileNames, &slices] (const uint32_t begin, const uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+         int channels;
+         if (!stbi_info(fileNames[i].c_str(), &slices[i].Width, &slices[i].Height, &channels)) {
+            throw std::runtime_error("failed to load texture '" + fileNames[i] + "': " + stbi_failure_reason());
+         }
+      }
+   });
+
+   vk::DeviceSize arenaSize = 0;
+   for (auto& slice : slices) {
+      // RGBA8 slices are always a multiple of the 4 byte texel size, which is all that buffer to image copies need
+      slice.Offset = arenaSize;
+      slice.Size = static_cast<vk::DeviceSize>(slice.Width) * static_cast<vk::DeviceSize>(slice.Height) * 4;
+      arenaSize += slice.Size;
+   }
+   Buffer arena(m_Allocator, arenaSize, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   char* arenaData = static_cast<char*>(arena.GetMappedData());
+
+   m_JobSystem.ParallelFor(0, count, 1, [&fileNames, &slices, arenaData] (const uint32_t begin, const uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+         Slice& slice = slices[i];
+         auto timer = std::chrono::steady_clock::now();
+         int width;
+         int height;
+         int channels;
+         stbi_uc* pixels = stbi_load(fileNames[i].c_str(), &width, &height, &channels, STBI_rgb_alpha);
+         if (!pixels) {
+            throw std::runtime_error("failed to load texture '" + fileNames[i] + "': " + stbi_failure_reason());
+         }
+         if ((width != slice.Width) || (height != slice.Height)) {
+            stbi_image_free(pixels);
+            throw std::runtime_error("texture '" + fileNames[i] + "' changed while it was being loaded");
+         }
+         slice.DecodeMilliseconds = MillisecondsSince(timer);
+
+         timer = std::chrono::steady_clock::now();
+         std::memcpy(arenaData + slice.Offset, pixels, static_cast<size_t>(slice.Size));
+         stbi_image_free(pixels);
+         slice.CopyMilliseconds = MillisecondsSince(timer);
+      }
+   });
+   const double decodeMilliseconds = MillisecondsSince(start);
+
+   const vk::FormatFeatureFlags blitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+   const bool canGenerateMips = generateMips && ((m_PhysicalDevice.getFormatProperties(sm_Format).optimalTilingFeatures & blitFeatures) == blitFeatures);
+
+   result.Textures.reserve(count);
+   for (uint32_t i = 0; i < count; ++i) {
+      Slice& slice = slices[i];
+      const auto timer = std::chrono::steady_clock::now();
+      Texture& texture = result.Textures.emplace_back();
+      texture.Width = static_cast<uint32_t>(slice.Width);
+      texture.Height = static_cast<uint32_t>(slice.Height);
+      texture.MipLevels = canGenerateMips ? static_cast<uint32_t>(std::floor(std::log2(std::max(slice.Width, slice.Height)))) + 1 : 1;
+      texture.Image = std::make_unique<Image>(
+         m_Allocator,
+         texture.Width,
+         texture.Height,
+         texture.MipLevels,
+         vk::SampleCountFlagBits::e1,
+         sm_Format,
+         vk::ImageTiling::eOptimal,
+         vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+         vk::MemoryPropertyFlagBits::eDeviceLocal
+      );
+      m_UploadManager.UploadImageFromStaging(arena.m_Buffer, slice.Offset, texture.Image->m_Image, texture.Width, texture.Height, texture.MipLevels);
+      texture.Image->CreateImageView(sm_Format, vk::ImageAspectFlagBits::eColor, texture.MipLevels);
+      slice.UploadMilliseconds = MillisecondsSince(timer);
+   }
+   result.Ticket = m_UploadManager.AdoptStagingBuffer(std::move(arena));
+
+   // "upload" is creating the image and recording its commands.  The GPU executes them later, with the rest of the batch.
+   for (uint32_t i = 0; i < count; ++i) {
+      const Slice& slice = slices[i];
+      CORE_LOG_INFO("Texture {0}: {1}x{2}, {3} mip levels.  Decode {4:.2f}ms, copy {5:.2f}ms, upload {6:.2f}ms", fileNames[i], slice.Width, slice.Height, result.Textures[i].MipLevels, slice.DecodeMilliseconds, slice.CopyMilliseconds, slice.UploadMilliseconds);
+   }
+   CORE_LOG_INFO("Loaded {0} textures ({1:.2f} MiB staging) on {2} threads in {3:.2f}ms ({4:.2f}ms decoding)", count, arenaSize / (1024.0 * 1024.0), m_JobSystem.GetThreadCount(), MillisecondsSince(start), decodeMilliseconds);
+   return result;
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Image.h"
+#include "JobSystem.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Vulkan {
+
+// Loads image files (anything stb_image can decode) into sampled RGBA8 textures.
+//
+// All of the images of a Load() are decoded in parallel on the job system's threads.  Each worker copies its decoded
+// pixels straight into that image's slice of one shared staging buffer (the "arena"), and then the copies, mip map
+// generation and layout transitions for all of the images are recorded into the UploadManager's current batch.
+// Load() does not submit the batch, so the caller can put other uploads in with it.  The textures are ready to use once
+// the returned ticket is complete.
+class TextureLoader {
+public:
+   struct Texture {
+      std::unique_ptr<Vulkan::Image> Image;   // in eShaderReadOnlyOptimal layout (once the upload is complete), with an image view of all levels
+      uint32_t Width = 0;
+      uint32_t Height = 0;
+      uint32_t MipLevels = 0;
+   };
+
+   struct Result {
+      std::vector<Texture> Textures;  // in the order of the file names
+      UploadTicket Ticket = 0;
+   };
+
+   TextureLoader(vk::PhysicalDevice physicalDevice, MemoryAllocator& allocator, UploadManager& uploadManager, JobSystem& jobSystem);
+
+   // Throws if any of the files cannot be decoded.
+   // If generateMips, and the device can blit RGBA8 with linear filtering, the textures have full mip chains.
+   // Otherwise they have one level.
+   // Logs a per-texture breakdown of where the time went.
+   Result Load(const std::vector<std::string>& fileNames, const bool generateMips);
+
+   static constexpr vk::Format sm_Format = vk::Format::eR8G8B8A8Unorm;
+
+private:
+   vk::PhysicalDevice m_PhysicalDevice;
+   MemoryAllocator& m_Allocator;
+   UploadManager& m_UploadManager;
+   JobSystem& m_JobSystem;
+};
+
+}
@@ -0,0 +1,375 @@
+#include "UploadManager.h"
+
+#include "Utility.h"
+
+#include <algorithm>
+
+namespace Vulkan {
+
+UploadManager::UploadManager(MemoryAllocator& allocator, const uint32_t graphicsFamily, vk::Queue graphicsQueue, const uint32_t transferFamily, vk::Queue transferQueue)
+: m_Device(allocator.GetDevice())
+, m_Allocator(allocator)
+, m_GraphicsFamily(graphicsFamily)
+, m_GraphicsQueue(graphicsQueue)
+, m_TransferFamily(transferFamily)
+, m_TransferQueue(transferQueue)
+{
+   m_TransferCommandPool = m_Device.createCommandPool({
+      {vk::CommandPoolCreateFlagBits::eTransient}   /*flags*/,
+      m_TransferFamily                             /*queueFamilyIndex*/
+   });
+   if (HasDedicatedTransferQueue()) {
+      m_GraphicsCommandPool = m_Device.createCommandPool({
+         {vk::CommandPoolCreateFlagBits::eTransient}   /*flags*/,
+         m_GraphicsFamily                             /*queueFamilyIndex*/
+      });
+   }
+}
+
+
+UploadManager::~UploadManager() {
+   WaitIdle();
+   if (m_GraphicsCommandPool) {
+      m_Device.destroy(m_GraphicsCommandPool);
+      m_GraphicsCommandPool = nullptr;
+   }
+   if (m_TransferCommandPool) {
+      m_Device.destroy(m_TransferCommandPool);
+      m_TransferCommandPool = nullptr;
+   }
+}
+
+
+UploadTicket UploadManager::UploadBuffer(vk::Buffer dst, const vk::DeviceSize dstOffset, const vk::DeviceSize size, const void* pData) {
+   std::lock_guard lock(m_Mutex);
+   Batch& batch = GetOpenBatch();
+
+   Buffer& stagingBuffer = batch.StagingBuffers.emplace_back(m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   stagingBuffer.CopyFromHost(0, size, pData);
+
+   vk::BufferCopy copyRegion = {
+      0           /*srcOffset*/,
+      dstOffset   /*dstOffset*/,
+      size        /*size*/
+   };
+   batch.TransferCommandBuffer.copyBuffer(stagingBuffer.m_Buffer, dst, copyRegion);
+
+   if (HasDedicatedTransferQueue()) {
+      // release from transfer queue family...
+      vk::BufferMemoryBarrier barrier = {
+         vk::AccessFlagBits::eTransferWrite  /*srcAccessMask*/,
+         {}                                  /*dstAccessMask*/,
+         m_TransferFamily                    /*srcQueueFamilyIndex*/,
+         m_GraphicsFamily                    /*dstQueueFamilyIndex*/,
+         dst                                 /*buffer*/,
+         dstOffset                           /*offset*/,
+         size                                /*size*/
+      };
+      batch.TransferCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, barrier, nullptr);
+
+      // ...and acquire on graphics queue family
+      barrier.srcAccessMask = {};
+      barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+      batch.GraphicsCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, barrier, nullptr);
+   }
+   return batch.Ticket;
+}
+
+
+UploadTicket UploadManager::UploadImage(vk::Image image, const uint32_t width, const uint32_t height, const uint32_t mipLevels, const vk::DeviceSize size, const void* pData) {
+   std::lock_guard lock(m_Mutex);
+   Batch& batch = GetOpenBatch();
+
+   Buffer& stagingBuffer = batch.StagingBuffers.emplace_back(m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   stagingBuffer.CopyFromHost(0, size, pData);
+
+   return UploadImageFromStaging(stagingBuffer.m_Buffer, 0, image, width, height, mipLevels);
+}
+
+
+UploadTicket UploadManager::UploadImageFromStaging(vk::Buffer stagingBuffer, const vk::DeviceSize stagingOffset, vk::Image image, const uint32_t width, const uint32_t height, const uint32_t mipLevels) {
+   std::lock_guard lock(m_Mutex);
+   Batch& batch = GetOpenBatch();
+
+   vk::ImageMemoryBarrier barrier = {
+      {}                                  /*srcAccessMask*/,
+      vk::AccessFlagBits::eTransferWrite  /*dstAccessMask*/,
+      vk::ImageLayout::eUndefined         /*oldLayout*/,
+      vk::ImageLayout::eTransferDstOptimal/*newLayout*/,
+      VK_QUEUE_FAMILY_IGNORED             /*srcQueueFamilyIndex*/,
+      VK_QUEUE_FAMILY_IGNORED             /*dstQueueFamilyIndex*/,
+      image                               /*image*/,
+      {
+         vk::ImageAspectFlagBits::eColor     /*aspectMask*/,
+         0                                   /*baseMipLevel*/,
+         mipLevels                           /*levelCount*/,
+         0                                   /*baseArrayLayer*/,
+         1                                   /*layerCount*/
+      }                                   /*subresourceRange*/
+   };
+   batch.TransferCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+
+   vk::BufferImageCopy region = {
+      stagingOffset                        /*bufferOffset*/,
+      0                                    /*bufferRowLength*/,
+      0                                    /*bufferImageHeight*/,
+      vk::ImageSubresourceLayers {
+         vk::ImageAspectFlagBits::eColor      /*aspectMask*/,
+         0                                    /*mipLevel*/,
+         0                                    /*baseArrayLayer*/,
+         1                                    /*layerCount*/
+      }                                    /*imageSubresource*/,
+      {0, 0, 0}                            /*imageOffset*/,
+      {width, height, 1}                   /*imageExtent*/
+   };
+   batch.TransferCommandBuffer.copyBufferToImage(stagingBuffer, image, vk::ImageLayout::eTransferDstOptimal, region);
+
+   if (HasDedicatedTransferQueue()) {
+      // release from transfer queue family...
+      barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+      barrier.dstAccessMask = {};
+      barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+      barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+      barrier.srcQueueFamilyIndex = m_TransferFamily;
+      barrier.dstQueueFamilyIndex = m_GraphicsFamily;
+      batch.TransferCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, barrier);
+
+      // ...and acquire on graphics queue family
+      barrier.srcAccessMask = {};
+      barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite;
+      batch.GraphicsCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+   }
+
+   if (mipLevels > 1) {
+      CmdGenerateMIPMaps(batch.GraphicsCommandBuffer, image, width, height, mipLevels);
+   } else {
+      barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+      barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+      barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+      barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+      barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      batch.GraphicsCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
+   }
+   return batch.Ticket;
+}
+
+
+UploadTicket UploadManager::UploadImageLevels(vk::Image image, const uint32_t width, const uint32_t height, const std::vector<vk::DeviceSize>& levelOffsets, const vk::DeviceSize size, const void* pData) {
+   std::lock_guard lock(m_Mutex);
+   Batch& batch = GetOpenBatch();
+
+   Buffer& stagingBuffer = batch.StagingBuffers.emplace_back(m_Allocator, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+   stagingBuffer.CopyFromHost(0, size, pData);
+
+   const uint32_t mipLevels = static_cast<uint32_t>(levelOffsets.size());
+   vk::ImageMemoryBarrier barrier = {
+      {}                                  /*srcAccessMask*/,
+      vk::AccessFlagBits::eTransferWrite  /*dstAccessMask*/,
+      vk::ImageLayout::eUndefined         /*oldLayout*/,
+      vk::ImageLayout::eTransferDstOptimal/*newLayout*/,
+      VK_QUEUE_FAMILY_IGNORED             /*srcQueueFamilyIndex*/,
+      VK_QUEUE_FAMILY_IGNORED             /*dstQueueFamilyIndex*/,
+      image                               /*image*/,
+      {
+         vk::ImageAspectFlagBits::eColor     /*aspectMask*/,
+         0                                   /*baseMipLevel*/,
+         mipLevels                           /*levelCount*/,
+         0                                   /*baseArrayLayer*/,
+         1                                   /*layerCount*/
+      }                                   /*subresourceRange*/
+   };
+   batch.TransferCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+
+   std::vector<vk::BufferImageCopy> regions;
+   regions.reserve(mipLevels);
+   for (uint32_t level = 0; level < mipLevels; ++level) {
+      regions.emplace_back(
+         levelOffsets[level]                  /*bufferOffset*/,
+         0                                    /*bufferRowLength*/,
+         0                                    /*bufferImageHeight*/,
+         vk::ImageSubresourceLayers {
+            vk::ImageAspectFlagBits::eColor      /*aspectMask*/,
+            level                                /*mipLevel*/,
+            0                                    /*baseArrayLayer*/,
+            1                                    /*layerCount*/
+         }                                    /*imageSubresource*/,
+         vk::Offset3D {0, 0, 0}               /*imageOffset*/,
+         vk::Extent3D {std::max(width >> level, 1u), std::max(height >> level, 1u), 1}   /*imageExtent*/
+      );
+   }
+   batch.TransferCommandBuffer.copyBufferToImage(stagingBuffer.m_Buffer, image, vk::ImageLayout::eTransferDstOptimal, regions);
+
+   // all levels are already there, so (unlike UploadImage()) nothing needs doing on the graphics queue other than the
+   // layout transition.  With a dedicated transfer queue, the transition is done as part of the ownership transfer.
+   barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+   barrier.dstAccessMask = {};
+   barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+   barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+   if (HasDedicatedTransferQueue()) {
+      // release from transfer queue family...
+      barrier.srcQueueFamilyIndex = m_TransferFamily;
+      barrier.dstQueueFamilyIndex = m_GraphicsFamily;
+      batch.TransferCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, barrier);
+
+      // ...and acquire on graphics queue family
+      barrier.srcAccessMask = {};
+      barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+      batch.GraphicsCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
+   } else {
+      barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+      batch.GraphicsCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr, nullptr, barrier);
+   }
+   return batch.Ticket;
+}
+
+
+UploadTicket UploadManager::AdoptStagingBuffer(Buffer&& stagingBuffer) {
+   std::lock_guard lock(m_Mutex);
+   Batch& batch = GetOpenBatch();
+   batch.StagingBuffers.emplace_back(std::move(stagingBuffer));
+   return batch.Ticket;
+}
+
+
+UploadTicket UploadManager::Submit() {
+   std::lock_guard lock(m_Mutex);
+   if (!m_OpenBatch) {
+      return m_NextTicket - 1;
+   }
+
+   Batch& batch = *m_OpenBatch;
+
+   // make the uploaded data visible to whatever runs after this batch
+   vk::MemoryBarrier memoryBarrier = {
+      vk::AccessFlagBits::eTransferWrite   /*srcAccessMask*/,
+      vk::AccessFlagBits::eMemoryRead      /*dstAccessMask*/
+   };
+   batch.GraphicsCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, memoryBarrier, nullptr, nullptr);
+
+   if (HasDedicatedTransferQueue()) {
+      batch.TransferCommandBuffer.end();
+      batch.GraphicsCommandBuffer.end();
+
+      vk::SubmitInfo transferSI;
+      transferSI.commandBufferCount = 1;
+      transferSI.pCommandBuffers = &batch.TransferCommandBuffer;
+      transferSI.signalSemaphoreCount = 1;
+      transferSI.pSignalSemaphores = &batch.TransferComplete;
+      m_TransferQueue.submit(transferSI, nullptr);
+
+      vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+      vk::SubmitInfo graphicsSI;
+      graphicsSI.waitSemaphoreCount = 1;
+      graphicsSI.pWaitSemaphores = &batch.TransferComplete;
+      graphicsSI.pWaitDstStageMask = &waitStage;
+      graphicsSI.commandBufferCount = 1;
+      graphicsSI.pCommandBuffers = &batch.GraphicsCommandBuffer;
+      m_GraphicsQueue.submit(graphicsSI, batch.Fence);
+   } else {
+      batch.TransferCommandBuffer.end();
+
+      vk::SubmitInfo si;
+      si.commandBufferCount = 1;
+      si.pCommandBuffers = &batch.TransferCommandBuffer;
+      m_TransferQueue.submit(si, batch.Fence);
+   }
+
+   const UploadTicket ticket = batch.Ticket;
+   m_SubmittedBatches.emplace_back(std::move(batch));
+   m_OpenBatch.reset(nullptr);
+   return ticket;
+}
+
+
+bool UploadManager::IsComplete(const UploadTicket ticket) {
+   std::lock_guard lock(m_Mutex);
+   RetireCompletedBatches();
+   return ticket <= m_CompletedTicket;
+}
+
+
+void UploadManager::Wait(const UploadTicket ticket) {
+   std::lock_guard lock(m_Mutex);
+   if (m_OpenBatch && (ticket >= m_OpenBatch->Ticket)) {
+      Submit();
+   }
+
+   // batches complete in submission order, so it is enough to wait for the last batch up to and including the ticket
+   vk::Fence fence;
+   for (const auto& batch : m_SubmittedBatches) {
+      if (batch.Ticket > ticket) {
+         break;
+      }
+      fence = batch.Fence;
+   }
+   if (fence) {
+      if (m_Device.waitForFences(fence, true, UINT64_MAX) != vk::Result::eSuccess) {
+         throw std::runtime_error("UploadManager: failed to wait for upload fence!");
+      }
+   }
+   RetireCompletedBatches();
+}
+
+
+void UploadManager::WaitIdle() {
+   std::lock_guard lock(m_Mutex);
+   Wait(Submit());
+}
+
+
+UploadManager::Batch& UploadManager::GetOpenBatch() {
+   if (!m_OpenBatch) {
+      RetireCompletedBatches();
+
+      m_OpenBatch = std::make_unique<Batch>();
+      m_OpenBatch->Ticket = m_NextTicket++;
+      m_OpenBatch->Fence = m_Device.createFence({});
+
+      m_OpenBatch->TransferCommandBuffer = m_Device.allocateCommandBuffers({
+         m_TransferCommandPool               /*commandPool*/,
+         vk::CommandBufferLevel::ePrimary    /*level*/,
+         1                                   /*commandBufferCount*/
+      }).front();
+      m_OpenBatch->TransferCommandBuffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+      if (HasDedicatedTransferQueue()) {
+         m_OpenBatch->TransferComplete = m_Device.createSemaphore({});
+         m_OpenBatch->GraphicsCommandBuffer = m_Device.allocateCommandBuffers({
+            m_GraphicsCommandPool               /*commandPool*/,
+            vk::CommandBufferLevel::ePrimary    /*level*/,
+            1                                   /*commandBufferCount*/
+         }).front();
+         m_OpenBatch->GraphicsCommandBuffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+      } else {
+         m_OpenBatch->GraphicsCommandBuffer = m_OpenBatch->TransferCommandBuffer;
+      }
+   }
+   return *m_OpenBatch;
+}
+
+
+void UploadManager::RetireCompletedBatches() {
+   while (!m_SubmittedBatches.empty()) {
+      Batch& batch = m_SubmittedBatches.front();
+      if (m_Device.getFenceStatus(batch.Fence) != vk::Result::eSuccess) {
+         break;
+      }
+      m_CompletedTicket = batch.Ticket;
+      DestroyBatch(batch);
+      m_SubmittedBatches.pop_front();
+   }
+}
+
+
+void UploadManager::DestroyBatch(Batch& batch) {
+   m_Device.freeCommandBuffers(m_TransferCommandPool, batch.TransferCommandBuffer);
+   if (HasDedicatedTransferQueue()) {
+      m_Device.freeCommandBuffers(m_GraphicsCommandPool, batch.GraphicsCommandBuffer);
+      m_Device.destroy(batch.TransferComplete);
+   }
+   m_Device.destroy(batch.Fence);
+   batch.StagingBuffers.clear();
+}
+
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Buffer.h"
+#include "MemoryAllocator.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Vulkan {
+
+// Identifies a batch of uploads.  Tickets increase monotonically, so a ticket is complete once all uploads
+// up to and including its batch have been executed by the GPU.
+using UploadTicket = uint64_t;
+
+
+// Batches host -> device uploads into one command buffer per batch, instead of one submit + queue idle per copy.
+//
+// Uploads are recorded as they are queued (the source data is copied into staging memory straight away, so the caller
+// may discard it immediately).  Submit() closes the current batch and submits it without waiting, returning a ticket
+// that can later be waited on.
+//
+// If the device has a dedicated transfer queue family, the copies are executed there, and ownership of the destination
+// resources is then released to the graphics queue family (which also does anything that needs a graphics queue,
+// such as generating mip maps).
+//
+// Batch completion is tracked with one fence per batch (the tickets behave like timeline semaphore values, but we
+// target Vulkan 1.0 so timeline semaphores themselves are not available).
+class UploadManager {
+public:
+   UploadManager(MemoryAllocator& allocator, const uint32_t graphicsFamily, vk::Queue graphicsQueue, const uint32_t transferFamily, vk::Queue transferQueue);
+   UploadManager(const UploadManager&) = delete;
+   UploadManager(UploadManager&&) = delete;
+
+   UploadManager& operator=(const UploadManager&) = delete;
+   UploadManager& operator=(UploadManager&&) = delete;
+
+   ~UploadManager();
+
+   // Queue copy of size bytes from pData to dst (at dstOffset).
+   // Returns the ticket of the batch the copy is in.
+   UploadTicket UploadBuffer(vk::Buffer dst, const vk::DeviceSize dstOffset, const vk::DeviceSize size, const void* pData);
+
+   // Queue copy of tightly packed pixel data (pData) to mip level 0 of image.
+   // image must have been created with eTransferDst (and eTransferSrc if mipLevels > 1) usage, and be in undefined layout.
+   // If mipLevels > 1 then the remaining levels are generated by blitting.
+   // All mip levels are left in eShaderReadOnlyOptimal layout.
+   UploadTicket UploadImage(vk::Image image, const uint32_t width, const uint32_t height, const uint32_t mipLevels, const vk::DeviceSize size, const void* pData);
+
+   // As UploadImage(), but from data that the caller has already put in stagingBuffer (at stagingOffset).
+   // stagingBuffer must stay alive until the copy has been executed: e.g. hand it over with AdoptStagingBuffer() once
+   // all copies from it have been queued.
+   UploadTicket UploadImageFromStaging(vk::Buffer stagingBuffer, const vk::DeviceSize stagingOffset, vk::Image image, const uint32_t width, const uint32_t height, const uint32_t mipLevels);
+
+   // Queue copy of ready made mip levels (e.g. block compressed levels from a texture container) to image.
+   // Level i is tightly packed at pData + levelOffsets[i], and is max(1, width >> i) by max(1, height >> i) texels.
+   // size is the size of the data from pData up to the end of the last level.
+   // image must have been created with eTransferDst usage, and be in undefined layout.
+   // All levelOffsets.size() mip levels are left in eShaderReadOnlyOptimal layout.
+   UploadTicket UploadImageLevels(vk::Image image, const uint32_t width, const uint32_t height, const std::vector<vk::DeviceSize>& levelOffsets, const vk::DeviceSize size, const void* pData);
+
+   // Take ownership of a caller's staging buffer: it is destroyed once the current batch has completed.
+   // Batches complete in order, so this is also late enough for any copies from it that went in earlier batches.
+   UploadTicket AdoptStagingBuffer(Buffer&& stagingBuffer);
+
+   // Submit the current batch (if there is one).  Does not wait.
+   // Returns ticket for the submitted batch (or the most recent ticket if there was nothing to submit)
+   UploadTicket Submit();
+
+   bool IsComplete(const UploadTicket ticket);
+
+   // Wait for given ticket (submitting it first, if necessary)
+   void Wait(const UploadTicket ticket);
+
+   // Submit anything outstanding and wait for all of it
+   void WaitIdle();
+
+   bool HasDedicatedTransferQueue() const { return m_TransferFamily != m_GraphicsFamily; }
+
+private:
+   struct Batch {
+      UploadTicket Ticket = 0;
+      vk::CommandBuffer TransferCommandBuffer;
+      vk::CommandBuffer GraphicsCommandBuffer;   // same as TransferCommandBuffer if there is no dedicated transfer queue
+      vk::Semaphore TransferComplete;            // only if there is a dedicated transfer queue
+      vk::Fence Fence;
+      std::vector<Buffer> StagingBuffers;
+   };
+
+   Batch& GetOpenBatch();
+   void RetireCompletedBatches();
+   void DestroyBatch(Batch& batch);
+
+private:
+   vk::Device m_Device;
+   MemoryAllocator& m_Allocator;
+   uint32_t m_GraphicsFamily;
+   vk::Queue m_GraphicsQueue;
+   uint32_t m_TransferFamily;
+   vk::Queue m_TransferQueue;
+   vk::CommandPool m_TransferCommandPool;
+   vk::CommandPool m_GraphicsCommandPool;
+
+   std::unique_ptr<Batch> m_OpenBatch;
+   std::deque<Batch> m_SubmittedBatches;
+   UploadTicket m_NextTicket = 1;
+   UploadTicket m_CompletedTicket = 0;
+
+   std::recursive_mutex m_Mutex;
+};
+
+}
@@ -2,7 +2,11 @@
 
 #include "Log.h"
 
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <thread>
 
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
@@ -130,6 +134,77 @@ bool HasStencilComponent(vk::Format format) {
 }
 
 
+vk::DeviceSize AlignUp(const vk::DeviceSize value, const vk::DeviceSize alignment) {
+   return alignment > 1 ? (value + alignment - 1) & ~(alignment - 1) : value;
+}
+
+
+void CmdGenerateMIPMaps(vk::CommandBuffer cmd, vk::Image image, const uint32_t width, const uint32_t height, const uint32_t mipLevels) {
+   vk::ImageMemoryBarrier barrier = {
+      {}                                   /*srcAccessMask*/,
+      {}                                   /*dstAccessMask*/,
+      vk::ImageLayout::eUndefined          /*oldLayout*/,
+      vk::ImageLayout::eUndefined          /*newLayout*/,
+      VK_QUEUE_FAMILY_IGNORED              /*srcQueueFamilyIndex*/,
+      VK_QUEUE_FAMILY_IGNORED              /*dstQueueFamilyIndex*/,
+      image                                /*image*/,
+      vk::ImageSubresourceRange {
+         {vk::ImageAspectFlagBits::eColor}    /*aspectMask*/,
+         0                                    /*baseMipLevel*/,
+         1                                    /*levelCount*/,
+         0                                    /*baseArrayLayer*/,
+         1                                    /*layerCount*/
+      }                                    /*subresourceRange*/
+   };
+
+   int32_t mipWidth = static_cast<int32_t>(width);
+   int32_t mipHeight = static_cast<int32_t>(height);
+
+   for (uint32_t i = 1; i < mipLevels; i++) {
+      barrier.subresourceRange.baseMipLevel = i - 1;
+      barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+      barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+      barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+      barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+      cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+
+      vk::ImageBlit blit;
+      blit.srcOffsets[0] = {0, 0, 0};
+      blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+      blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+      blit.srcSubresource.mipLevel = i - 1;
+      blit.srcSubresource.baseArrayLayer = 0;
+      blit.srcSubresource.layerCount = 1;
+      blit.dstOffsets[0] = {0, 0, 0};
+      blit.dstOffsets[1] = {mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1};
+      blit.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+      blit.dstSubresource.mipLevel = i;
+      blit.dstSubresource.baseArrayLayer = 0;
+      blit.dstSubresource.layerCount = 1;
+      cmd.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, blit, vk::Filter::eLinear);
+
+      barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+      barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+      barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+      barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+      cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, barrier);
+
+      if (mipWidth > 1) {
+         mipWidth /= 2;
+      }
+      if (mipHeight > 1) {
+         mipHeight /= 2;
+      }
+   }
+   barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+   barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+   barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+   barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+   barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+   cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, barrier);
+}
+
+
 std::vector<char> ReadFile(const std::string& filename) {
    std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
@@ -148,4 +223,54 @@ std::vector<char> ReadFile(const std::string& filename) {
    return buffer;
 }
 
+
+void WriteFileAtomic(const std::string& filename, const void* pData, const size_t size) {
+   // temporary is per thread, so that several threads may write the same file at once (the last rename wins)
+   const std::string tempFilename = filename + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+   {
+      std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+      if (!file.is_open()) {
+         throw std::runtime_error("failed to open file '" + tempFilename + "'");
+      }
+      file.write(static_cast<const char*>(pData), size);
+      file.flush();
+      if (!file) {
+         throw std::runtime_error("failed to write file '" + tempFilename + "'");
+      }
+   }
+   std::filesystem::rename(tempFilename, filename);
+}
+
+
+bool IsPipelineCacheCompatible(const std::vector<char>& data, const vk::PhysicalDeviceProperties& properties) {
+   // Layout of the header is defined by the Vulkan spec (VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+   struct PipelineCacheHeader {
+      uint32_t HeaderLength;
+      uint32_t HeaderVersion;
+      uint32_t VendorID;
+      uint32_t DeviceID;
+      uint8_t PipelineCacheUUID[VK_UUID_SIZE];
+   };
+
+   PipelineCacheHeader header;
+   if (data.size() < sizeof(header)) {
+      return false;
+   }
+   std::memcpy(&header, data.data(), sizeof(header));
+
+   return
+      (header.HeaderLength >= sizeof(header)) &&
+      (header.HeaderVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+      (header.VendorID == properties.vendorID) &&
+      (header.DeviceID == properties.deviceID) &&
+      (std::memcmp(header.PipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0)
+   ;
+}
+
+
+
+double MillisecondsSince(const std::chrono::steady_clock::time_point start) {
+   return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
 }
\ No newline at end of file
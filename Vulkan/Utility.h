@@ -3,6 +3,7 @@
 #include "SwapChainSupportDetails.h"
 
 #include <vulkan/vulkan.hpp>
+#include <chrono>
 #include <vector>
 
 #define NON_COPYABLE(ClassName)                       \
@@ -33,6 +34,26 @@ SwapChainSupportDetails QuerySwapChainSupport(vk::PhysicalDevice device, vk::Sur
 
 bool HasStencilComponent(vk::Format format);
 
+// Round value up to a multiple of alignment (which must be a power of two)
+vk::DeviceSize AlignUp(const vk::DeviceSize value, const vk::DeviceSize alignment);
+
+// Record commands to fill mip levels 1..mipLevels-1 of image by successively blitting from the level above.
+// All levels must be in eTransferDstOptimal layout (with level 0 containing the image), and are left in eShaderReadOnlyOptimal.
+// The caller is responsible for checking that the image format supports linear blitting.
+void CmdGenerateMIPMaps(vk::CommandBuffer cmd, vk::Image image, const uint32_t width, const uint32_t height, const uint32_t mipLevels);
+
 std::vector<char> ReadFile(const std::string& filename);
 
+// Write size bytes from pData to filename.
+// Data is written to a temporary file which is then renamed over filename, so that if we crash part way through,
+// filename is left with either its old contents or the new, never something half written.
+// Safe to call from several threads at once, even for the same filename.
+void WriteFileAtomic(const std::string& filename, const void* pData, const size_t size);
+
+// Check that pipeline cache data (as previously returned by vkGetPipelineCacheData) has a header that matches the given device
+bool IsPipelineCacheCompatible(const std::vector<char>& data, const vk::PhysicalDeviceProperties& properties);
+
+// Wall clock time since start, for timing loads and benchmarks
+double MillisecondsSince(const std::chrono::steady_clock::time_point start);
+
 }
\ No newline at end of file